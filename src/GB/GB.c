@@ -36,89 +36,146 @@
 #include "cartridge.h"
 #include "serial.h"
 #include "joypad.h"
+#include "scheduler.h"
+#include "context.h"
 
-static int _exit_code = EXIT_SUCCESS;
+struct gb *GB_create(void)
+{
+    struct gb *gb = calloc(1, sizeof(struct gb));
+    if(gb == NULL) {
+        log_error("Could not allocate GameBoy instance.\n");
+        return NULL;
+    }
 
-static enum GB_state {
-    INIT = 0x00,
-    BIOS_LOADED = 0x01,
-    CARTRIDGE_LOADED = 0x02,
-    RUNNING = 0x03,
-    STOPPED = 0x04
-} _state = INIT;
+    gb->state = INIT;
+    gb->jit.enabled = JIT_AVAILABLE;
+    GB_set_display_palette(gb, NULL);
+    GB_reset(gb);
 
-static FILE *_rom_ptr = NULL;
-static FILE *_save_ptr = NULL;
+    return gb;
+}
 
-void GB_load_bios(const char *bios_file)
+void GB_destroy(struct gb *gb)
+{
+    if(gb == NULL) {
+        return;
+    }
+
+    unload_cartridge(gb);
+    jit_destroy(gb);
+    free(gb);
+}
+
+void GB_load_bios(struct gb *gb, const char *bios_file)
 {
     FILE *_bios_ptr = fopen(bios_file, "rb");
     if(_bios_ptr == NULL) {
         log_error("Invalid BIOS file: %s\n", bios_file);
-        GB_exit();
+        GB_exit(gb);
         return;
     }
 
-    int status = mmu_load_bios(_bios_ptr);
+    int status = mmu_load_bios(gb, _bios_ptr);
     fclose(_bios_ptr);
     if(!status) {
         log_error("Invalid BIOS file: %s\n", bios_file);
-        GB_exit();
+        GB_exit(gb);
         return;
     }
 
-    _state |= BIOS_LOADED;
+    gb->state |= BIOS_LOADED;
 }
 
-void GB_load_cartridge(const char *rom_file, char *save_file)
+void GB_load_cartridge(struct gb *gb, const char *rom_file, char *save_file)
 {
-    if(!(_state & BIOS_LOADED)) {
-        GB_exit();
+    if(!(gb->state & BIOS_LOADED)) {
+        GB_exit(gb);
         return;
     }
 
-    int status = load_cartridge(rom_file, save_file);
+    int status = load_cartridge(gb, rom_file, save_file);
     if(!status) {
-        GB_exit();
+        GB_exit(gb);
         return;
     }
 
-    _state |= CARTRIDGE_LOADED;
+    gb->state |= CARTRIDGE_LOADED;
 }
 
-void GB_start(void)
+/**
+ *
+ * @param gb
+ * @return
+ */
+static int runnable(struct gb *gb)
 {
-    if(_state == STOPPED) {
-        GB_exit();
-        return;
+    if(gb->state == STOPPED) {
+        return 0;
     }
 
-    if(!(_state & BIOS_LOADED)) {
+    if(!(gb->state & BIOS_LOADED)) {
         log_error("BIOS not yet loaded.\n");
-        GB_exit();
-        return;
+        GB_exit(gb);
+        return 0;
     }
+    return 1;
+}
 
-    // Setup display and sound
-    display_setup();
-    audio_setup();
+uint64_t GB_run_cycles(struct gb *gb, uint64_t cycles)
+{
+    if(!runnable(gb)) {
+        return 0;
+    }
 
-    // Main dispatch loop
-    while(_state <= RUNNING) {
-        uint64_t _local_clk = _r.clk;
+    uint64_t _start_clk = gb->cpu.r.clk;
+    uint64_t _end_clk = _start_clk + cycles;
 
-        dispatch();
+    while(gb->state <= RUNNING && gb->cpu.r.clk < _end_clk) {
+        cpu_run(gb, _end_clk);
+        run_events(gb);
+    }
 
-        uint8_t _clock_tics;
-        if(_r.clk < _local_clk) {
-            _clock_tics = (uint8_t) (1 + _r.clk + ~_local_clk);
-        } else {
-            _clock_tics = (uint8_t) (_r.clk - _local_clk);
-        }
+    return gb->cpu.r.clk - _start_clk;
+}
+
+uint64_t GB_run_frame(struct gb *gb)
+{
+    if(!runnable(gb)) {
+        return 0;
+    }
+
+    uint64_t _start_clk = gb->cpu.r.clk;
+
+    gb->ppu.frame_done = false;
+    while(gb->state <= RUNNING && !gb->ppu.frame_done) {
+        cpu_run(gb, EVENT_NEVER);
+        run_events(gb);
+    }
+
+    return gb->cpu.r.clk - _start_clk;
+}
+
+void GB_start(struct gb *gb)
+{
+    if(gb->state == STOPPED) {
+        GB_exit(gb);
+        return;
+    }
+
+    if(!runnable(gb)) {
+        return;
+    }
 
-        video_update(_clock_tics);
-        audio_update(_clock_tics);
-        timer_update(_clock_tics);
+    // Setup display and sound
+    display_setup(gb);
+    audio_setup(gb);
+
+    // Main loop, the host gets control back once every frame
+    while(gb->state <= RUNNING) {
+        GB_run_frame(gb);
+        if(gb->state <= RUNNING) {
+            sync_frame(gb);
+        }
     }
 
     // Destroy display and sound
@@ -126,48 +183,50 @@ void GB_start(void)
     audio_teardown();
 }
 
-void GB_stop(void)
+int GB_idle(struct gb *gb)
 {
-    unload_cartridge();
+    return gb->cpu.STOP || (gb->cpu.HALT && !(gb->cpu.IE & (VBLANK | LCDC | TIMER_OVERFLOW | SERIAL_TRANSFER)));
+}
 
-    if(_save_ptr != NULL) {
-        fclose(_save_ptr);
-        _save_ptr = NULL;
-    }
-    if(_rom_ptr != NULL) {
-        fclose(_rom_ptr);
-        _rom_ptr = NULL;
-    }
+void GB_stop(struct gb *gb)
+{
+    unload_cartridge(gb);
 
-    _state = STOPPED;
+    gb->state = STOPPED;
+}
+
+void GB_flush_save(struct gb *gb)
+{
+    flush_save(gb, true);
 }
 
-void GB_save_state(char *save_state_file)
+void GB_save_state(struct gb *gb, char *save_state_file)
 {
     // TODO
 }
 
-void GB_exit(void)
+void GB_exit(struct gb *gb)
 {
-    _exit_code = EXIT_FAILURE;
-    GB_stop();
+    gb->exit_code = EXIT_FAILURE;
+    GB_stop(gb);
 }
 
-int GB_exit_code(void)
+int GB_exit_code(struct gb *gb)
 {
-    return _exit_code;
+    return gb->exit_code;
 }
 
-void GB_reset(void)
+void GB_reset(struct gb *gb)
 {
-    _exit_code = EXIT_SUCCESS;
-
-    cpu_reset();
-    mmu_reset();
-    mbc_reset();
-    video_reset();
-    audio_reset();
-    timer_reset();
-    serial_reset();
-    joypad_reset();
+    gb->exit_code = EXIT_SUCCESS;
+
+    cpu_reset(gb);
+    scheduler_reset(gb);
+    mmu_reset(gb);
+    mbc_reset(gb);
+    video_reset(gb);
+    audio_reset(gb);
+    timer_reset(gb);
+    serial_reset(gb);
+    joypad_reset(gb);
 }
\ No newline at end of file
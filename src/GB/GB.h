@@ -26,6 +26,11 @@
 
 #include <stdint.h>
 
+/**
+ * Opaque handle to a single GameBoy instance.
+ */
+struct gb;
+
 /**
  *
  */
@@ -41,60 +46,186 @@ enum GB_key {
 };
 
 /**
+ * Pixel formats the 160x144 frame can be rendered in.
+ */
+enum GB_display_format {
+    GB_DISPLAY_SHADE = 0,   // uint8_t per pixel, shade 0 (lightest) to 3 (darkest)
+    GB_DISPLAY_GRAY8,       // uint8_t per pixel
+    GB_DISPLAY_RGB565,      // uint16_t per pixel
+    GB_DISPLAY_RGBA8888     // uint32_t per pixel, 0xRRGGBBAA
+};
+
+/**
+ * Ways of turning VRAM into pixels.
+ */
+enum GB_renderer {
+    GB_RENDERER_FIFO = 0,   // Per dot pixel FIFO, follows mid-line register writes
+    GB_RENDERER_SCANLINE    // Whole line at the end of mode 3, several times faster
+};
+
+/**
+ * Allocate and reset a new GameBoy instance.
+ *
+ * @return The new instance, or NULL if it could not be allocated.
+ */
+struct gb *GB_create(void);
+
+/**
+ * Release a GameBoy instance and any cartridge files it still holds.
  *
+ * @param gb
+ */
+void GB_destroy(struct gb *gb);
+
+/**
+ *
+ * @param gb
  * @param key
  */
-void key_pressed(enum GB_key key);
+void key_pressed(struct gb *gb, enum GB_key key);
 
 /**
  *
+ * @param gb
  * @param key
  */
-void key_released(enum GB_key key);
+void key_released(struct gb *gb, enum GB_key key);
 
 /**
  *
+ * @param gb
  * @param bios_file
  */
-void GB_load_bios(const char *bios_file);
+void GB_load_bios(struct gb *gb, const char *bios_file);
 
 /**
  *
+ * @param gb
  * @param bios_file
  */
-void GB_load_cartridge(const char *rom_file, char *save_file);
+void GB_load_cartridge(struct gb *gb, const char *rom_file, char *save_file);
+
+/**
+ * Run the emulation loop until the instance is stopped, handing control to
+ * the host through sync_frame() once every frame.
+ *
+ * @param gb
+ */
+void GB_start(struct gb *gb);
+
+/**
+ * Run the instance for the given number of clock cycles (4,194,304Hz) and
+ * return. Instructions are never split, so the run ends on the first
+ * instruction boundary at or past the budget.
+ *
+ * @param gb
+ * @param cycles
+ * @return The number of clock cycles actually executed
+ */
+uint64_t GB_run_cycles(struct gb *gb, uint64_t cycles);
+
+/**
+ * Run the instance until the PPU enters V-Blank, or a frame's worth of
+ * cycles passed with the LCD off, and return.
+ *
+ * @param gb
+ * @return The number of clock cycles actually executed
+ */
+uint64_t GB_run_frame(struct gb *gb);
+
+/**
+ * Select the pixel format of the frame. The frame is cleared.
+ *
+ * @param gb
+ * @param format
+ */
+void GB_set_display_format(struct gb *gb, enum GB_display_format format);
+
+/**
+ * Select the colors (0xRRGGBB) of the four shades, from lightest to darkest,
+ * or NULL for the default grayscale. Ignored by GB_DISPLAY_SHADE.
+ *
+ * @param gb
+ * @param colors
+ */
+void GB_set_display_palette(struct gb *gb, const uint32_t colors[4]);
+
+/**
+ * Select the renderer. Games that change scroll, window or palette registers
+ * in the middle of a line need GB_RENDERER_FIFO.
+ *
+ * @param gb
+ * @param renderer
+ */
+void GB_set_renderer(struct gb *gb, enum GB_renderer renderer);
+
+/**
+ * Select whether code the CPU runs often is compiled to native code. Only
+ * x86-64 builds with NEC_JIT have a compiler, elsewhere this is ignored.
+ *
+ * @param gb
+ * @param enabled
+ */
+void GB_set_jit(struct gb *gb, int enabled);
+
+/**
+ * The last rendered frame: DISPLAY_HEIGHT rows of DISPLAY_WIDTH pixels in
+ * the selected format, without padding.
+ *
+ * @param gb
+ * @return
+ */
+const void *GB_get_frame(struct gb *gb);
+
+/**
+ * Whether only a key press can wake the CPU: it executed STOP, or it is
+ * halted with no interrupt but the joypad one enabled. Frontends running in
+ * real time can block on their input events instead of running frames.
+ *
+ * @param gb
+ * @return
+ */
+int GB_idle(struct gb *gb);
 
 /**
  *
+ * @param gb
  */
-void GB_start(void);
+void GB_stop(struct gb *gb);
 
 /**
+ * Write the battery backed cartridge RAM to the SAV file now. This also
+ * happens when the cartridge is unloaded and about once every emulated second.
  *
+ * @param gb
  */
-void GB_stop(void);
+void GB_flush_save(struct gb *gb);
 
 /**
  *
+ * @param gb
  * @param save_state_file
  */
-void GB_save_state(char *save_state_file);
+void GB_save_state(struct gb *gb, char *save_state_file);
 
 /**
  *
+ * @param gb
  */
-void GB_exit(void);
+void GB_exit(struct gb *gb);
 
 /**
  *
+ * @param gb
  * @return
  */
-int GB_exit_code(void);
+int GB_exit_code(struct gb *gb);
 
 /**
  *
+ * @param gb
  */
-void GB_reset(void);
+void GB_reset(struct gb *gb);
 
 /**
  *
@@ -110,25 +241,32 @@ extern void log_warning(char *message, ...);
 
 /**
  *
+ * @param gb
  */
-extern void sync_frame(void);
+extern void sync_frame(struct gb *gb);
 
 /**
  *
+ * @param gb
  * @param data
  */
-extern void serial_transfer_initiate(uint8_t data);
+extern void serial_transfer_initiate(struct gb *gb, uint8_t data);
 
 /**
+ * Complete a pending serial transfer with the byte received from the link
+ * partner. Transfers on the internal clock that are not completed by the host
+ * finish on their own after 4096 cycles, receiving 0xFF.
  *
+ * @param gb
  * @param data
  */
-void serial_transfer_complete(uint8_t data);
+void serial_transfer_complete(struct gb *gb, uint8_t data);
 
 /**
  *
+ * @param gb
  * @param title
  */
-extern void set_title(const char *title);
+extern void set_title(struct gb *gb, const char *title);
 
 #endif /* NEC_GB_H */
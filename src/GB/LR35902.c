@@ -23,25 +23,29 @@
 
 #include "LR35902.h"
 
-#define IS_ZERO         (_r.f & 0x80)
-#define IS_NEGATIVE     (_r.f & 0x40)
-#define IS_HALF_CARRY   (_r.f & 0x20)
-#define IS_CARRY        (_r.f & 0x10)
+#define IS_ZERO         (!(uint8_t) gb->cpu.flags.zc)
+#define IS_NEGATIVE     (gb->cpu.flags.nh & 0x40)
+#define IS_HALF_CARRY   (gb->cpu.flags.nh & 0x20)
+#define IS_CARRY        (gb->cpu.flags.zc & 0x100)
 
-#define SET_ZERO(c)         (c) ? (_r.f |= 0x80) : (_r.f &= 0x7F)
-#define SET_NEGATIVE(c)     (c) ? (_r.f |= 0x40) : (_r.f &= 0xBF)
-#define SET_HALF_CARRY(c)   (c) ? (_r.f |= 0x20) : (_r.f &= 0xDF)
-#define SET_CARRY(c)        (c) ? (_r.f |= 0x10) : (_r.f &= 0xEF)
+// Half carry out of bit 3 (11 for 16 bit), from the operands and result
+#define HALF_CARRY8(a, b, r)    ((uint8_t) ((((a) ^ (b) ^ (r)) << 1) & 0x20))
+#define HALF_CARRY16(a, b, r)   ((uint8_t) ((((a) ^ (b) ^ (r)) >> 7) & 0x20))
+
+// Immediate operand of the current instruction, fetched with its opcode
+#define OPERAND8            ((uint8_t) gb->cpu.operand)
+#define OPERAND16           (gb->cpu.operand)
 
 #include <stdbool.h>
 
 #include "MMU.h"
 #include "timer.h"
 #include "PPU.h"
-#include "audio.h"
 #include "GB.h"
+#include "context.h"
+#include "jit.h"
 
-typedef void (*instruction)(void);
+typedef void (*instruction)(struct gb *gb);
 
 enum condition {
     NZ,
@@ -51,133 +55,528 @@ enum condition {
     T
 };
 
-struct registers _r = {
-        .sp = 0x0000,
-        .pc = 0x0000
-};
-
 #define NUM_OPCODES 0x100
 
-uint8_t _IE = 0x00;
-uint8_t _IF = 0x00;
-
-static bool _IME = false;
-static bool _HALT = false;
-static bool _STOP = false;
+// X(h, l) for every byte 0xhl
+#define OPCODE_ROW(X, h)    X(h, 0) X(h, 1) X(h, 2) X(h, 3) X(h, 4) X(h, 5) X(h, 6) X(h, 7) \
+                            X(h, 8) X(h, 9) X(h, A) X(h, B) X(h, C) X(h, D) X(h, E) X(h, F)
+#define OPCODE_GRID(X)      OPCODE_ROW(X, 0) OPCODE_ROW(X, 1) OPCODE_ROW(X, 2) OPCODE_ROW(X, 3) \
+                            OPCODE_ROW(X, 4) OPCODE_ROW(X, 5) OPCODE_ROW(X, 6) OPCODE_ROW(X, 7) \
+                            OPCODE_ROW(X, 8) OPCODE_ROW(X, 9) OPCODE_ROW(X, A) OPCODE_ROW(X, B) \
+                            OPCODE_ROW(X, C) OPCODE_ROW(X, D) OPCODE_ROW(X, E) OPCODE_ROW(X, F)
 
-static bool _DI_pending = false;
-static bool _EI_pending = false;
+#define IDLE_LOOP_MAX_SIZE  16
 
 /*
  * Debugging functions
  */
 
-static void XX(void)
+static void XX(struct gb *gb)
+{
+    log_error("Invalid instruction with opcode 0x%02X (ROM address 0x%04X)\n", read_byte(gb, (uint16_t) (gb->cpu.r.pc - 1)), gb->cpu.r.pc - 1);
+    GB_exit(gb);
+}
+
+static void YY(struct gb *gb)
 {
-    log_error("Invalid instruction with opcode 0x%02X (ROM address 0x%04X)\n", read_byte((uint16_t) (_r.pc - 1)), _r.pc - 1);
-    GB_exit();
+    log_error("Invalid instruction in CB MAP with opcode 0x%02X (ROM address 0x%04X)\n", read_byte(gb, (uint16_t) (gb->cpu.r.pc - 1)), gb->cpu.r.pc - 1);
+    GB_exit(gb);
+}
+
+/*
+ * Idle loop detection
+ */
+
+/*
+ * Registers and flags read or written by an instruction
+ */
+enum idle_res {
+    RES_A = 0x001,
+    RES_B = 0x002,
+    RES_C = 0x004,
+    RES_D = 0x008,
+    RES_E = 0x010,
+    RES_H = 0x020,
+    RES_L = 0x040,
+    RES_FZ = 0x080, // Z, N and H flags
+    RES_FC = 0x100  // Carry flag
+};
+
+static const uint16_t _idle_reg[8] = {RES_B, RES_C, RES_D, RES_E, RES_H, RES_L, RES_H | RES_L, RES_A};
+
+struct idle_op {
+    uint8_t size;
+    uint8_t clocks;
+    uint16_t reads;
+    uint16_t writes;
+    bool mem;
+    uint16_t address;
+    uint16_t pointer;   // Registers the address is taken from
+};
+
+/**
+ * Whether a read from the address returns the same value until the CPU
+ * writes to memory, or an event or interrupt runs.
+ *
+ * @param address
+ * @return
+ */
+static bool idle_stable(uint16_t address)
+{
+    if(address < _EXT_RAM_OFFSET) {
+        return true;    // ROM, VRAM
+    } else if(address < _RAM_OFFSET) {
+        return false;   // Cartridge RAM, can be a real time clock
+    } else if(address < _IO_OFFSET || address >= _HRAM_OFFSET) {
+        return true;    // Work RAM, OAM, HRAM, IE
+    }
+
+    switch(address) {
+        case 0xFF00:    // P1
+        case 0xFF01:    // SB
+        case 0xFF02:    // SC
+        case 0xFF0F:    // IF
+            return true;
+        default:
+            return (0xFF40 <= address && address <= 0xFF4B);    // LCD registers
+    }
+}
+
+/**
+ * Add a register operand, register 6 being (HL).
+ *
+ * @param gb
+ * @param reg
+ * @param op
+ */
+static void idle_operand(struct gb *gb, uint8_t reg, struct idle_op *op)
+{
+    op->reads |= _idle_reg[reg];
+    if(reg == 6) {
+        op->clocks += 4;
+        op->mem = true;
+        op->address = gb->cpu.r.hl;
+        op->pointer = RES_H | RES_L;
+    }
 }
 
-static void YY(void)
+/**
+ * Decode an instruction that may be part of an idle loop: one that changes
+ * nothing but registers and flags.
+ *
+ * @param gb
+ * @param pc
+ * @param op
+ * @return false if the instruction does anything else
+ */
+static bool idle_decode(struct gb *gb, uint16_t pc, struct idle_op *op)
+{
+    uint8_t opcode = read_byte(gb, pc);
+    uint8_t src = (uint8_t) (opcode & 0x07);
+    uint8_t dst = (uint8_t) ((opcode >> 3) & 0x07);
+
+    *op = (struct idle_op) {.size = 1, .clocks = 4};
+    if(opcode == 0x00) {                                            // NOP
+        return true;
+    } else if((opcode & 0xC7) == 0x06 && dst != 6) {                // LD r,d8
+        op->size = 2;
+        op->clocks = 8;
+        op->writes = _idle_reg[dst];
+    } else if((opcode & 0xC6) == 0x04 && dst != 6) {                // INC r, DEC r
+        op->reads = _idle_reg[dst];
+        op->writes = _idle_reg[dst] | RES_FZ;
+    } else if(opcode == 0x0A || opcode == 0x1A) {                   // LD A,(BC), LD A,(DE)
+        op->clocks = 8;
+        op->reads = (opcode == 0x0A ? RES_B | RES_C : RES_D | RES_E);
+        op->writes = RES_A;
+        op->mem = true;
+        op->address = (opcode == 0x0A ? gb->cpu.r.bc : gb->cpu.r.de);
+        op->pointer = op->reads;
+    } else if(0x40 <= opcode && opcode < 0x80 && dst != 6) {        // LD r,r
+        idle_operand(gb, src, op);
+        op->writes = _idle_reg[dst];
+    } else if(0x80 <= opcode && opcode < 0xC0) {                    // ALU A,r
+        idle_operand(gb, src, op);
+        op->reads |= RES_A | ((dst == 1 || dst == 3) ? RES_FC : 0);
+        op->writes = (dst == 7 ? 0 : RES_A) | RES_FZ | RES_FC;
+    } else if((opcode & 0xC7) == 0xC6) {                            // ALU A,d8
+        op->size = 2;
+        op->clocks = 8;
+        op->reads = RES_A | ((dst == 1 || dst == 3) ? RES_FC : 0);
+        op->writes = (dst == 7 ? 0 : RES_A) | RES_FZ | RES_FC;
+    } else if(opcode == 0xF0) {                                     // LDH A,(a8)
+        op->size = 2;
+        op->clocks = 12;
+        op->writes = RES_A;
+        op->mem = true;
+        op->address = (uint16_t) (0xFF00 + read_byte(gb, (uint16_t) (pc + 1)));
+    } else if(opcode == 0xF2) {                                     // LD A,(C)
+        op->clocks = 8;
+        op->reads = RES_C;
+        op->writes = RES_A;
+        op->mem = true;
+        op->address = (uint16_t) (0xFF00 + gb->cpu.r.c);
+        op->pointer = RES_C;
+    } else if(opcode == 0xFA) {                                     // LD A,(a16)
+        op->size = 3;
+        op->clocks = 16;
+        op->writes = RES_A;
+        op->mem = true;
+        op->address = (uint16_t) (read_byte(gb, (uint16_t) (pc + 1)) + (read_byte(gb, (uint16_t) (pc + 2)) << 8));
+    } else if(opcode == 0xCB) {
+        uint8_t cb = read_byte(gb, (uint16_t) (pc + 1));
+        uint8_t reg = (uint8_t) (cb & 0x07);
+        uint8_t kind = (uint8_t) ((cb >> 3) & 0x07);
+
+        op->size = 2;
+        op->clocks = 8;
+        if((cb & 0xC0) == 0x40) {                                   // BIT b,r
+            idle_operand(gb, reg, op);
+            op->clocks += (reg == 6 ? 4 : 0);
+            op->writes = RES_FZ;
+        } else if(reg == 6) {                                       // Writes to (HL)
+            return false;
+        } else if((cb & 0xC0) == 0x00) {                            // Rotates, shifts, SWAP
+            op->reads = _idle_reg[reg] | ((kind == 2 || kind == 3) ? RES_FC : 0);
+            op->writes = _idle_reg[reg] | RES_FZ | RES_FC;
+        } else {                                                    // RES b,r, SET b,r
+            op->reads = _idle_reg[reg];
+            op->writes = _idle_reg[reg];
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Called after a taken backward JR. When the loop it closes only reads
+ * memory and recomputes the same registers every time round, each iteration
+ * sees the same values until an event or interrupt changes one of them. The
+ * clock then skips the iterations that fit before the next event.
+ *
+ * @param gb
+ * @param tail Address following the JR instruction
+ */
+static void idle_loop(struct gb *gb, uint16_t tail)
 {
-    log_error("Invalid instruction in CB MAP with opcode 0x%02X (ROM address 0x%04X)\n", read_byte((uint16_t) (_r.pc - 1)), _r.pc - 1);
-    GB_exit();
+    uint16_t head = gb->cpu.r.pc;
+    uint16_t jr = (uint16_t) (tail - 2);
+    if(head == gb->cpu.idle_miss || (uint16_t) (tail - head) > IDLE_LOOP_MAX_SIZE) {
+        return;
+    }
+
+    // An interrupt about to be serviced leaves the loop
+    if((gb->cpu.IME && (gb->cpu.IE & gb->cpu.IF)) || gb->cpu.EI_pending || gb->cpu.DI_pending) {
+        return;
+    }
+
+    struct idle_op ops[IDLE_LOOP_MAX_SIZE];
+    size_t count = 0;
+    uint16_t written = 0;
+    uint32_t clocks = 12;
+    uint16_t pc = head;
+    while((uint16_t) (pc - head) < (uint16_t) (jr - head)) {
+        if(!idle_decode(gb, pc, &ops[count]) || (ops[count].mem && !idle_stable(ops[count].address))) {
+            gb->cpu.idle_miss = head;
+            return;
+        }
+        written |= ops[count].writes;
+        clocks += ops[count].clocks;
+        pc += ops[count].size;
+        count++;
+    }
+    bool idle = (pc == jr);
+
+    // Every register the loop changes must be set before it is used. The
+    // addresses checked above are the ones at the JR, so the loop must not
+    // change a register it reads memory through.
+    uint16_t defined = 0;
+    for(size_t i = 0; idle && i < count; i++) {
+        idle = !(ops[i].reads & written & ~defined) && !(ops[i].pointer & written);
+        defined |= ops[i].writes;
+    }
+    if(!idle) {
+        gb->cpu.idle_miss = head;
+        return;
+    }
+
+    // The last iteration has to be a clean one as well
+    uint64_t clk = gb->cpu.r.clk;
+    if(clk - clocks < gb->cpu.idle_since) {
+        return;
+    }
+
+    uint64_t limit = (gb->scheduler.next < gb->cpu.run_end ? gb->scheduler.next : gb->cpu.run_end);
+    if(limit > clk) {
+        gb->cpu.r.clk += (limit - clk) / clocks * clocks;
+    }
 }
 
+/*
+ * 8 bit ALU results in the layout of cpu.flags: the result in the low byte
+ * and the carry in bit 8 of zc, or the N and H bits of nh. NEC_ALU_TABLES
+ * looks them up in tables built from the same expressions.
+ */
+
+#define ADD_NH(i, c)        ((((i) >> 4) + ((i) & 0x0F) + (c)) > 0x0F ? 0x20 : 0x00)
+#define SUB_NH(i, c)        (((i) >> 4) < ((i) & 0x0F) + (c) ? 0x60 : 0x40)
+#define INC_NH(n)           (((n) & 0x0F) == 0x0F ? 0x20 : 0x00)
+#define DEC_NH(n)           (((n) & 0x0F) == 0x00 ? 0x60 : 0x40)
+#define RLC_ZC(n)           ((((n) << 1) | ((n) >> 7)) & 0x1FF)
+#define RRC_ZC(n)           ((((n) & 0x01) << 8) | (((n) & 0x01) << 7) | ((n) >> 1))
+#define RL_ZC(n, c)         (((n) << 1) | (c))
+#define RR_ZC(n, c)         ((((n) & 0x01) << 8) | ((c) << 7) | ((n) >> 1))
+#define SLA_ZC(n)           ((n) << 1)
+#define SRA_ZC(n)           ((((n) & 0x01) << 8) | ((n) & 0x80) | ((n) >> 1))
+#define SRL_ZC(n)           ((((n) & 0x01) << 8) | ((n) >> 1))
+#define SWAP_ZC(n)          ((((n) & 0x0F) << 4) | ((n) >> 4))
+
+// DAA of n, with N, H and C in bits 2, 1 and 0 of f. C is set if 0x60 is added or subtracted
+#define DAA_ADJUST(n, f)    (((((f) & 0x01) || (!((f) & 0x04) && (n) > 0x99)) ? 0x60 : 0x00) | \
+                             ((((f) & 0x02) || (!((f) & 0x04) && ((n) & 0x0F) > 0x09)) ? 0x06 : 0x00))
+#define DAA_ZC(n, f)        (((((f) & 0x04) ? (n) - DAA_ADJUST(n, f) : (n) + DAA_ADJUST(n, f)) & 0xFF) | \
+                             ((DAA_ADJUST(n, f) & 0x60) ? 0x100 : 0x000))
+
+// Index of the half carry tables, from the low nibbles of the operands
+#define NIBBLES(a, n)       ((((a) & 0x0F) << 4) | ((n) & 0x0F))
+
+#if defined(NEC_ALU_TABLES)
+
+#define TABLE_ENTRY(h, l)   TABLE_RESULT(0x##h##l),
+
+#define TABLE_RESULT(i)     ADD_NH(i, 0)
+static const uint8_t _add_nh[2][NUM_OPCODES] = {{OPCODE_GRID(TABLE_ENTRY)},
+#undef TABLE_RESULT
+#define TABLE_RESULT(i)     ADD_NH(i, 1)
+                                                {OPCODE_GRID(TABLE_ENTRY)}};
+#undef TABLE_RESULT
+#define TABLE_RESULT(i)     SUB_NH(i, 0)
+static const uint8_t _sub_nh[2][NUM_OPCODES] = {{OPCODE_GRID(TABLE_ENTRY)},
+#undef TABLE_RESULT
+#define TABLE_RESULT(i)     SUB_NH(i, 1)
+                                                {OPCODE_GRID(TABLE_ENTRY)}};
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     INC_NH(n)
+static const uint8_t _inc_nh[NUM_OPCODES] = {OPCODE_GRID(TABLE_ENTRY)};
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     DEC_NH(n)
+static const uint8_t _dec_nh[NUM_OPCODES] = {OPCODE_GRID(TABLE_ENTRY)};
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     RLC_ZC(n)
+static const uint16_t _rlc_zc[NUM_OPCODES] = {OPCODE_GRID(TABLE_ENTRY)};
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     RRC_ZC(n)
+static const uint16_t _rrc_zc[NUM_OPCODES] = {OPCODE_GRID(TABLE_ENTRY)};
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     RL_ZC(n, 0)
+static const uint16_t _rl_zc[2][NUM_OPCODES] = {{OPCODE_GRID(TABLE_ENTRY)},
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     RL_ZC(n, 1)
+                                                {OPCODE_GRID(TABLE_ENTRY)}};
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     RR_ZC(n, 0)
+static const uint16_t _rr_zc[2][NUM_OPCODES] = {{OPCODE_GRID(TABLE_ENTRY)},
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     RR_ZC(n, 1)
+                                                {OPCODE_GRID(TABLE_ENTRY)}};
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     SLA_ZC(n)
+static const uint16_t _sla_zc[NUM_OPCODES] = {OPCODE_GRID(TABLE_ENTRY)};
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     SRA_ZC(n)
+static const uint16_t _sra_zc[NUM_OPCODES] = {OPCODE_GRID(TABLE_ENTRY)};
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     SRL_ZC(n)
+static const uint16_t _srl_zc[NUM_OPCODES] = {OPCODE_GRID(TABLE_ENTRY)};
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     SWAP_ZC(n)
+static const uint16_t _swap_zc[NUM_OPCODES] = {OPCODE_GRID(TABLE_ENTRY)};
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     DAA_ZC(n, 0)
+static const uint16_t _daa_zc[8][NUM_OPCODES] = {{OPCODE_GRID(TABLE_ENTRY)},
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     DAA_ZC(n, 1)
+                                                 {OPCODE_GRID(TABLE_ENTRY)},
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     DAA_ZC(n, 2)
+                                                 {OPCODE_GRID(TABLE_ENTRY)},
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     DAA_ZC(n, 3)
+                                                 {OPCODE_GRID(TABLE_ENTRY)},
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     DAA_ZC(n, 4)
+                                                 {OPCODE_GRID(TABLE_ENTRY)},
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     DAA_ZC(n, 5)
+                                                 {OPCODE_GRID(TABLE_ENTRY)},
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     DAA_ZC(n, 6)
+                                                 {OPCODE_GRID(TABLE_ENTRY)},
+#undef TABLE_RESULT
+#define TABLE_RESULT(n)     DAA_ZC(n, 7)
+                                                 {OPCODE_GRID(TABLE_ENTRY)}};
+#undef TABLE_RESULT
+
+#define ALU_ADD_NH(a, n, c, r) _add_nh[c][NIBBLES(a, n)]
+#define ALU_SUB_NH(a, n, c, r) _sub_nh[c][NIBBLES(a, n)]
+#define ALU_INC_NH(n)       _inc_nh[n]
+#define ALU_DEC_NH(n)       _dec_nh[n]
+#define ALU_RLC(n)          _rlc_zc[n]
+#define ALU_RRC(n)          _rrc_zc[n]
+#define ALU_RL(n, c)        _rl_zc[c][n]
+#define ALU_RR(n, c)        _rr_zc[c][n]
+#define ALU_SLA(n)          _sla_zc[n]
+#define ALU_SRA(n)          _sra_zc[n]
+#define ALU_SRL(n)          _srl_zc[n]
+#define ALU_SWAP(n)         _swap_zc[n]
+#define ALU_DAA(n, f)       _daa_zc[f][n]
+
+#else
+
+#define ALU_ADD_NH(a, n, c, r) HALF_CARRY8(a, n, r)
+#define ALU_SUB_NH(a, n, c, r) ((uint8_t) (HALF_CARRY8(a, n, r) | 0x40))
+#define ALU_INC_NH(n)       ((uint8_t) INC_NH(n))
+#define ALU_DEC_NH(n)       ((uint8_t) DEC_NH(n))
+#define ALU_RLC(n)          RLC_ZC(n)
+#define ALU_RRC(n)          RRC_ZC(n)
+#define ALU_RL(n, c)        RL_ZC(n, c)
+#define ALU_RR(n, c)        RR_ZC(n, c)
+#define ALU_SLA(n)          SLA_ZC(n)
+#define ALU_SRA(n)          SRA_ZC(n)
+#define ALU_SRL(n)          SRL_ZC(n)
+#define ALU_SWAP(n)         SWAP_ZC(n)
+#define ALU_DAA(n, f)       DAA_ZC(n, f)
+
+#endif
+
 /*
  * Generic helper functions
  */
 
-static inline void ADD8(int n)
+/**
+ * Evaluate the flags into the F register layout.
+ *
+ * @param gb
+ * @return
+ */
+static inline uint8_t get_flags(struct gb *gb)
+{
+    return (uint8_t) ((IS_ZERO ? 0x80 : 0x00) | gb->cpu.flags.nh | ((gb->cpu.flags.zc >> 4) & 0x10));
+}
+
+/**
+ *
+ * @param gb
+ * @param f
+ */
+static inline void set_flags(struct gb *gb, uint8_t f)
+{
+    gb->cpu.flags.zc = (uint16_t) (((f & 0x80) ? 0x00 : 0x01) | ((f & 0x10) << 4));
+    gb->cpu.flags.nh = (uint8_t) (f & 0x60);
+}
+
+/**
+ * A + n + carry, the half carry includes the incoming carry.
+ *
+ * @param gb
+ * @param n
+ * @param carry
+ */
+static inline void ADD8_carry(struct gb *gb, int n, int carry)
+{
+    int result = gb->cpu.r.a + n + carry;
+    gb->cpu.flags.zc = (uint16_t) result;
+    gb->cpu.flags.nh = ALU_ADD_NH(gb->cpu.r.a, n, carry, result);
+    gb->cpu.r.a = (uint8_t) result;
+}
+
+static inline void ADD8(struct gb *gb, int n)
 {
-    _r.f = 0x00;
-    SET_HALF_CARRY(((_r.a & 0x0F) + (n & 0x0F)) > 0x0F);
-    SET_CARRY((_r.a + n) > 0xFF);
-    _r.a += n;
-    SET_ZERO(!_r.a);
+    ADD8_carry(gb, n, 0);
 }
 
-static inline void ADC8(int n)
+static inline void ADC8(struct gb *gb, int n)
 {
-    n += (IS_CARRY ? 0x01 : 0x00);
-    _r.f = 0x00;
-    SET_HALF_CARRY(((_r.a & 0x0F) + (n & 0x0F)) > 0x0F);
-    SET_CARRY((_r.a + n) > 0xFF);
-    _r.a += n;
-    SET_ZERO(!_r.a);
+    ADD8_carry(gb, n, IS_CARRY ? 0x01 : 0x00);
 }
 
-static inline void SUB8(int n)
+/**
+ * A - n - carry, the half carry includes the incoming carry.
+ *
+ * @param gb
+ * @param n
+ * @param carry
+ */
+static inline void SUB8_carry(struct gb *gb, int n, int carry)
 {
-    _r.f = 0x40;
-    SET_HALF_CARRY((_r.a & 0x0F) < (n & 0x0F));
-    SET_CARRY(_r.a < n);
-    _r.a -= n;
-    SET_ZERO(!_r.a);
+    int result = gb->cpu.r.a - n - carry;
+    gb->cpu.flags.zc = (uint16_t) result;
+    gb->cpu.flags.nh = ALU_SUB_NH(gb->cpu.r.a, n, carry, result);
+    gb->cpu.r.a = (uint8_t) result;
 }
 
-static inline void SBC8(int n)
+static inline void SUB8(struct gb *gb, int n)
 {
-    n += (IS_CARRY ? 0x01 : 0x00);
-    _r.f = 0x40;
-    SET_HALF_CARRY((_r.a & 0x0F) < (n & 0x0F));
-    SET_CARRY(_r.a < n);
-    _r.a -= n;
-    SET_ZERO(!_r.a);
+    SUB8_carry(gb, n, 0);
 }
 
-static inline void AND8(uint8_t n)
+static inline void SBC8(struct gb *gb, int n)
 {
-    _r.a &= n;
-    _r.f = 0x20;
-    SET_ZERO(!_r.a);
+    SUB8_carry(gb, n, IS_CARRY ? 0x01 : 0x00);
 }
 
-static inline void OR8(uint8_t n)
+static inline void AND8(struct gb *gb, uint8_t n)
 {
-    _r.a |= n;
-    _r.f = 0x00;
-    SET_ZERO(!_r.a);
+    gb->cpu.r.a &= n;
+    gb->cpu.flags.zc = gb->cpu.r.a;
+    gb->cpu.flags.nh = 0x20;
 }
 
-static inline void XOR8(uint8_t n)
+static inline void OR8(struct gb *gb, uint8_t n)
 {
-    _r.a ^= n;
-    _r.f = 0x00;
-    SET_ZERO(!_r.a);
+    gb->cpu.r.a |= n;
+    gb->cpu.flags.zc = gb->cpu.r.a;
+    gb->cpu.flags.nh = 0x00;
 }
 
-static inline void CP8(uint8_t n)
+static inline void XOR8(struct gb *gb, uint8_t n)
 {
-    _r.f = 0x40;
-    SET_ZERO(_r.a == n);
-    SET_HALF_CARRY((_r.a & 0x0F) < (n & 0x0F));
-    SET_CARRY(_r.a < n);
+    gb->cpu.r.a ^= n;
+    gb->cpu.flags.zc = gb->cpu.r.a;
+    gb->cpu.flags.nh = 0x00;
 }
 
-static inline void INC8(uint8_t *n)
+static inline void CP8(struct gb *gb, uint8_t n)
 {
-    _r.f &= 0x10;
-    SET_HALF_CARRY((*n & 0x0F) == 0x0F);
-    (*n)++;
-    SET_ZERO(!(*n));
+    int result = gb->cpu.r.a - n;
+    gb->cpu.flags.zc = (uint16_t) result;
+    gb->cpu.flags.nh = ALU_SUB_NH(gb->cpu.r.a, n, 0, result);
 }
 
-static inline void DEC8(uint8_t *n)
+static inline void INC8(struct gb *gb, uint8_t *n)
 {
-    _r.f &= 0x10;
-    _r.f |= 0x40;
-    SET_HALF_CARRY((*n & 0x0F) == 0);
-    (*n)--;
-    SET_ZERO(!(*n));
+    uint8_t result = (uint8_t) (*n + 1);
+    gb->cpu.flags.zc = (uint16_t) ((gb->cpu.flags.zc & 0x100) | result);
+    gb->cpu.flags.nh = ALU_INC_NH(*n);
+    *n = result;
 }
 
-static inline void ADD16(uint16_t *dest, uint16_t n)
+static inline void DEC8(struct gb *gb, uint8_t *n)
 {
-    _r.f &= (dest == &_r.sp ? 0x00 : 0x80);
-    SET_HALF_CARRY(((*dest & 0x0FFF) + (n & 0x0FFF)) > 0x0FFF);
-    SET_CARRY((*dest + n) > 0xFFFF);
-    *dest += n;
+    uint8_t result = (uint8_t) (*n - 1);
+    gb->cpu.flags.zc = (uint16_t) ((gb->cpu.flags.zc & 0x100) | result);
+    gb->cpu.flags.nh = ALU_DEC_NH(*n);
+    *n = result;
+}
+
+static inline void ADD16(struct gb *gb, uint16_t *dest, uint16_t n)
+{
+    uint32_t result = (uint32_t) *dest + n;
+    uint16_t zero = (uint16_t) (dest == &gb->cpu.r.sp ? 0x01 : (gb->cpu.flags.zc & 0xFF));
+    gb->cpu.flags.zc = (uint16_t) (zero | ((result >> 8) & 0x100));
+    gb->cpu.flags.nh = HALF_CARRY16(*dest, n, result);
+    *dest = (uint16_t) result;
 }
 
 static inline void INC16(uint16_t *nn)
@@ -190,148 +589,125 @@ static inline void DEC16(uint16_t *nn)
     (*nn)--;
 }
 
-static inline void SWAP(uint8_t *n)
+static inline void SWAP(struct gb *gb, uint8_t *n)
 {
-    *n = (uint8_t) (((*n & 0x0F) << 4) | ((*n >> 4) & 0x0F));
-    _r.f = 0x00;
-    SET_ZERO(!(*n));
+    gb->cpu.flags.zc = ALU_SWAP(*n);
+    gb->cpu.flags.nh = 0x00;
+    *n = (uint8_t) gb->cpu.flags.zc;
 }
 
-static void DAA(void)
+static void DAA(struct gb *gb)
 {
-    _r.f &= 0x40;
-    if(IS_HALF_CARRY || ((_r.a & 0x0F) > 0x09)) {
-        _r.a += 6;
-    }
-
-    if((_r.a & 0xF0) > 0x90) {
-        _r.a += 0x60;
-        _r.f |= 0x10;
-    }
-
-    SET_ZERO(!_r.a);
-    _r.clk += 4;
+    // N, H and C as bits 2, 1 and 0
+    gb->cpu.flags.zc = ALU_DAA(gb->cpu.r.a, (gb->cpu.flags.nh >> 4) | ((gb->cpu.flags.zc >> 8) & 0x01));
+    gb->cpu.flags.nh &= 0x40;
+    gb->cpu.r.a = (uint8_t) gb->cpu.flags.zc;
+    gb->cpu.r.clk += 4;
 }
 
-static void CPL(void)
+static void CPL(struct gb *gb)
 {
-    _r.a = ~_r.a;
-    _r.f = (uint8_t) ((_r.f & 0x90) | 0x60);
-    _r.clk += 4;
+    gb->cpu.r.a = ~gb->cpu.r.a;
+    gb->cpu.flags.nh = 0x60;
+    gb->cpu.r.clk += 4;
 }
 
-static void CCF(void)
+static void CCF(struct gb *gb)
 {
-    _r.f &= 0x90;
-    SET_CARRY(!IS_CARRY);
-    _r.clk += 4;
+    gb->cpu.flags.zc ^= 0x100;
+    gb->cpu.flags.nh = 0x00;
+    gb->cpu.r.clk += 4;
 }
 
-static void SCF(void)
+static void SCF(struct gb *gb)
 {
-    _r.f = (uint8_t) ((_r.f & 0x80) | 0x10);
-    _r.clk += 4;
+    gb->cpu.flags.zc |= 0x100;
+    gb->cpu.flags.nh = 0x00;
+    gb->cpu.r.clk += 4;
 }
 
-static void NOP(void)
+static void NOP(struct gb *gb)
 {
-    _r.clk += 4;
+    gb->cpu.r.clk += 4;
 }
 
-static void HALT(void)
+static void HALT(struct gb *gb)
 {
-    _HALT = true;
-    _r.clk += 4;
+    gb->cpu.HALT = true;
+    gb->cpu.r.clk += 4;
 }
 
-static void STOP(void)
+static void STOP(struct gb *gb)
 {
-    _r.pc++;
-    _STOP = true;
-    _r.clk += 4;
+    gb->cpu.STOP = true;
+    gb->cpu.r.clk += 4;
 }
 
-static void DI(void)
+static void DI(struct gb *gb)
 {
-    _DI_pending = true;
-    _r.clk += 4;
+    gb->cpu.DI_pending = true;
+    gb->cpu.r.clk += 4;
 }
 
-static void EI(void)
+static void EI(struct gb *gb)
 {
-    _EI_pending = true;
-    _r.clk += 4;
+    gb->cpu.EI_pending = true;
+    gb->cpu.r.clk += 4;
 }
 
-static inline void RLC(uint8_t *n)
+static inline void RLC(struct gb *gb, uint8_t *n)
 {
-    uint8_t c = (uint8_t) ((*n & 0x80) ? 0x01 : 0x00);
-    *n = ((*n) << 1) | c;
-    _r.f = 0x00;
-    SET_ZERO(!(*n));
-    SET_CARRY(c);
+    gb->cpu.flags.zc = (uint16_t) ALU_RLC(*n);
+    gb->cpu.flags.nh = 0x00;
+    *n = (uint8_t) gb->cpu.flags.zc;
 }
 
-static inline void RL(uint8_t *n)
+static inline void RL(struct gb *gb, uint8_t *n)
 {
-    uint8_t c_in = (uint8_t) (IS_CARRY ? 0x01 : 0x00);
-    uint8_t c_out = (uint8_t) (*n & 0x80);
-    *n = ((*n) << 1) | c_in;
-    _r.f = 0x00;
-    SET_ZERO(!(*n));
-    SET_CARRY(c_out);
+    gb->cpu.flags.zc = (uint16_t) ALU_RL(*n, IS_CARRY ? 1 : 0);
+    gb->cpu.flags.nh = 0x00;
+    *n = (uint8_t) gb->cpu.flags.zc;
 }
 
-static inline void RRC(uint8_t *n)
+static inline void RRC(struct gb *gb, uint8_t *n)
 {
-    uint8_t c = (uint8_t) ((*n & 0x01) ? 0x80 : 0x00);
-    *n = ((*n) >> 1) | c;
-    _r.f = 0x00;
-    SET_ZERO(!(*n));
-    SET_CARRY(c);
+    gb->cpu.flags.zc = (uint16_t) ALU_RRC(*n);
+    gb->cpu.flags.nh = 0x00;
+    *n = (uint8_t) gb->cpu.flags.zc;
 }
 
-static inline void RR(uint8_t *n)
+static inline void RR(struct gb *gb, uint8_t *n)
 {
-    uint8_t c_in = (uint8_t) (IS_CARRY ? 0x80 : 0x00);
-    uint8_t c_out = (uint8_t) (*n & 0x01);
-    *n = ((*n) >> 1) | c_in;
-    _r.f = 0x00;
-    SET_ZERO(!(*n));
-    SET_CARRY(c_out);
+    gb->cpu.flags.zc = (uint16_t) ALU_RR(*n, IS_CARRY ? 1 : 0);
+    gb->cpu.flags.nh = 0x00;
+    *n = (uint8_t) gb->cpu.flags.zc;
 }
 
-static inline void SLA(uint8_t *n)
+static inline void SLA(struct gb *gb, uint8_t *n)
 {
-    uint8_t c = (uint8_t) ((*n & 0x80) ? 0x01 : 0x00);
-    *n = (*n) << 1;
-    _r.f = 0x00;
-    SET_ZERO(!(*n));
-    SET_CARRY(c);
+    gb->cpu.flags.zc = (uint16_t) ALU_SLA(*n);
+    gb->cpu.flags.nh = 0x00;
+    *n = (uint8_t) gb->cpu.flags.zc;
 }
 
-static inline void SRA(uint8_t *n)
+static inline void SRA(struct gb *gb, uint8_t *n)
 {
-    uint8_t c = (uint8_t) (*n & 0x01);
-    *n = (uint8_t) ((*n & 0x80) | (*n >> 1));
-    _r.f = 0x00;
-    SET_ZERO(!(*n));
-    SET_CARRY(c);
+    gb->cpu.flags.zc = (uint16_t) ALU_SRA(*n);
+    gb->cpu.flags.nh = 0x00;
+    *n = (uint8_t) gb->cpu.flags.zc;
 }
 
-static inline void SRL(uint8_t *n)
+static inline void SRL(struct gb *gb, uint8_t *n)
 {
-    uint8_t c = (uint8_t) (*n & 0x01);
-    *n = (*n) >> 1;
-    _r.f = 0x00;
-    SET_ZERO(!(*n));
-    SET_CARRY(c);
+    gb->cpu.flags.zc = (uint16_t) ALU_SRL(*n);
+    gb->cpu.flags.nh = 0x00;
+    *n = (uint8_t) gb->cpu.flags.zc;
 }
 
-static inline void BIT(uint8_t b, uint8_t n)
+static inline void BIT(struct gb *gb, uint8_t b, uint8_t n)
 {
-    _r.f = (uint8_t) ((_r.f & 0x10) | 0x20);
-    SET_ZERO(!(n & (0x01 << b)));
+    gb->cpu.flags.zc = (uint16_t) ((gb->cpu.flags.zc & 0x100) | (n & (0x01 << b)));
+    gb->cpu.flags.nh = 0x20;
 }
 
 static inline void SET(uint8_t b, uint8_t *n)
@@ -344,7 +720,7 @@ static inline void RES(uint8_t b, uint8_t *n)
     *n &= ~(0x01 << b);
 }
 
-static inline void JP(enum condition c, uint16_t n)
+static inline void JP(struct gb *gb, enum condition c, uint16_t n)
 {
     switch(c) {
         case NZ:
@@ -370,12 +746,13 @@ static inline void JP(enum condition c, uint16_t n)
         case T:
             break;
     }
-    _r.clk += 4;
-    _r.pc = n;
+    gb->cpu.r.clk += 4;
+    gb->cpu.r.pc = n;
 }
 
-static inline void JR(enum condition c, int8_t n)
+static inline void JR(struct gb *gb, enum condition c, int8_t n)
 {
+    gb->cpu.r.clk += 8;
     switch(c) {
         case NZ:
             if(IS_ZERO) {
@@ -400,11 +777,15 @@ static inline void JR(enum condition c, int8_t n)
         case T:
             break;
     }
-    _r.clk += 4;
-    _r.pc += n;
+    gb->cpu.r.clk += 4;
+    gb->cpu.r.pc += n;
+
+    if(n < 0) {
+        idle_loop(gb, (uint16_t) (gb->cpu.r.pc - n));
+    }
 }
 
-static inline void CALL(enum condition c, uint16_t n)
+static inline void CALL(struct gb *gb, enum condition c, uint16_t n)
 {
     switch (c) {
         case NZ:
@@ -430,20 +811,20 @@ static inline void CALL(enum condition c, uint16_t n)
         case T:
             break;
     }
-    _r.clk += 12;
-    _r.sp -= 2;
-    write_word(_r.sp, _r.pc);
-    _r.pc = n;
+    gb->cpu.r.clk += 12;
+    gb->cpu.r.sp -= 2;
+    write_word(gb, gb->cpu.r.sp, gb->cpu.r.pc);
+    gb->cpu.r.pc = n;
 }
 
-static inline void RST(uint16_t n)
+static inline void RST(struct gb *gb, uint16_t n)
 {
-    _r.sp -= 2;
-    write_word(_r.sp, _r.pc);
-    _r.pc = n;
+    gb->cpu.r.sp -= 2;
+    write_word(gb, gb->cpu.r.sp, gb->cpu.r.pc);
+    gb->cpu.r.pc = n;
 }
 
-static inline void RET_internal(enum condition c)
+static inline void RET_internal(struct gb *gb, enum condition c)
 {
     switch (c) {
         case NZ:
@@ -469,3067 +850,3047 @@ static inline void RET_internal(enum condition c)
         case T:
             break;
     }
-    _r.clk += 12;
-    _r.pc = read_word(_r.sp);
-    _r.sp += 2;
+    gb->cpu.r.clk += 12;
+    gb->cpu.r.pc = read_word(gb, gb->cpu.r.sp);
+    gb->cpu.r.sp += 2;
 }
 
-static void RETI(void)
+static void RETI(struct gb *gb)
 {
-    _r.pc = read_word(_r.sp);
-    _r.sp += 2;
-    _r.clk += 12;
-    _IME = true;
+    gb->cpu.r.pc = read_word(gb, gb->cpu.r.sp);
+    gb->cpu.r.sp += 2;
+    gb->cpu.r.clk += 12;
+    gb->cpu.IME = true;
 }
 
-static void PUSH(uint16_t nn)
+static void PUSH(struct gb *gb, uint16_t nn)
 {
-    _r.sp -= 2;
-    write_word(_r.sp, nn);
+    gb->cpu.r.sp -= 2;
+    write_word(gb, gb->cpu.r.sp, nn);
 }
 
-static void POP(uint16_t *nn)
+static void POP(struct gb *gb, uint16_t *nn)
 {
-    *nn = read_word(_r.sp);
-    _r.sp += 2;
+    *nn = read_word(gb, gb->cpu.r.sp);
+    gb->cpu.r.sp += 2;
 }
 
 /**********************************/
 /** Default function map opcodes **/
 /**********************************/
 
-static void LD_SP_d16(void)
+static void LD_SP_d16(struct gb *gb)
 {
-    _r.sp = read_word(_r.pc);
-    _r.pc += 2;
-    _r.clk += 12;
+    gb->cpu.r.sp = OPERAND16;
+    gb->cpu.r.clk += 12;
 }
 
-static void XOR_A(void)
+static void XOR_A(struct gb *gb)
 {
-    XOR8(_r.a);
-    _r.clk += 4;
+    XOR8(gb, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_HL_d16(void)
+static void LD_HL_d16(struct gb *gb)
 {
-    _r.hl = read_word(_r.pc);
-    _r.pc += 2;
-    _r.clk += 12;
+    gb->cpu.r.hl = OPERAND16;
+    gb->cpu.r.clk += 12;
 }
 
-static void LDD_HL_A(void)
+static void LDD_HL_A(struct gb *gb)
 {
-    write_byte(_r.hl--, _r.a);
-    _r.clk += 8;
+    write_byte(gb, gb->cpu.r.hl--, gb->cpu.r.a);
+    gb->cpu.r.clk += 8;
 }
 
-static void JR_NZ_r8(void)
+static void JR_NZ_r8(struct gb *gb)
 {
-    JR(NZ, read_byte(_r.pc++));
-    _r.clk += 8;
+    JR(gb, NZ, OPERAND8);
 }
 
-static void LD_C_d8(void)
+static void LD_C_d8(struct gb *gb)
 {
-    _r.c = read_byte(_r.pc++);
-    _r.clk += 8;
+    gb->cpu.r.c = OPERAND8;
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_A_d8(void)
+static void LD_A_d8(struct gb *gb)
 {
-    _r.a = read_byte(_r.pc++);
-    _r.clk += 8;
+    gb->cpu.r.a = OPERAND8;
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_mC_A(void)
+static void LD_mC_A(struct gb *gb)
 {
-    write_byte((uint16_t) (0xFF00 + _r.c), _r.a);
-    _r.clk += 8;
+    write_byte(gb, (uint16_t) (0xFF00 + gb->cpu.r.c), gb->cpu.r.a);
+    gb->cpu.r.clk += 8;
 }
 
-static void INC_C(void)
+static void INC_C(struct gb *gb)
 {
-    INC8(&_r.c);
-    _r.clk += 4;
+    INC8(gb, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_mHL_A(void)
+static void LD_mHL_A(struct gb *gb)
 {
-    write_byte(_r.hl, _r.a);
-    _r.clk += 8;
+    write_byte(gb, gb->cpu.r.hl, gb->cpu.r.a);
+    gb->cpu.r.clk += 8;
 }
 
-static void LDH_m8_A(void)
+static void LDH_m8_A(struct gb *gb)
 {
-    write_byte((uint16_t) (0xFF00 + read_byte(_r.pc++)), _r.a);
-    _r.clk += 12;
+    write_byte(gb, (uint16_t) (0xFF00 + OPERAND8), gb->cpu.r.a);
+    gb->cpu.r.clk += 12;
 }
 
-static void LD_DE_d16(void)
+static void LD_DE_d16(struct gb *gb)
 {
-    _r.de = read_word(_r.pc);
-    _r.pc += 2;
-    _r.clk += 12;
+    gb->cpu.r.de = OPERAND16;
+    gb->cpu.r.clk += 12;
 }
 
-static void LD_A_mDE(void)
+static void LD_A_mDE(struct gb *gb)
 {
-    _r.a = read_byte(_r.de);
-    _r.clk += 8;
+    gb->cpu.r.a = read_byte(gb, gb->cpu.r.de);
+    gb->cpu.r.clk += 8;
 }
 
-static void CALL_d16(void)
+static void CALL_d16(struct gb *gb)
 {
-    uint16_t a16 = read_word(_r.pc);
-    _r.pc += 2;
-    CALL(T, a16);
-    _r.clk += 12;
+    uint16_t a16 = OPERAND16;
+    CALL(gb, T, a16);
+    gb->cpu.r.clk += 12;
 }
 
-static void LD_C_A(void)
+static void LD_C_A(struct gb *gb)
 {
-    _r.c = _r.a;
-    _r.clk += 4;
+    gb->cpu.r.c = gb->cpu.r.a;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_B_d8(void)
+static void LD_B_d8(struct gb *gb)
 {
-    _r.b = read_byte(_r.pc++);
-    _r.clk += 8;
+    gb->cpu.r.b = OPERAND8;
+    gb->cpu.r.clk += 8;
 }
 
-static void PUSH_BC(void)
+static void PUSH_BC(struct gb *gb)
 {
-    PUSH(_r.bc);
-    _r.clk += 16;
+    PUSH(gb, gb->cpu.r.bc);
+    gb->cpu.r.clk += 16;
 }
 
-static void RLA(void)
+static void RLA(struct gb *gb)
 {
-    RL(&_r.a);
-    _r.clk += 4;
-    _r.f &= 0x70;
+    RL(gb, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
+    gb->cpu.flags.zc |= 0x01;
 }
 
-static void POP_BC(void)
+static void POP_BC(struct gb *gb)
 {
-    POP(&_r.bc);
-    _r.clk += 12;
+    POP(gb, &gb->cpu.r.bc);
+    gb->cpu.r.clk += 12;
 }
 
-static void DEC_B(void)
+static void DEC_B(struct gb *gb)
 {
-    DEC8(&_r.b);
-    _r.clk += 4;
+    DEC8(gb, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void LDI_mHL_A(void)
+static void LDI_mHL_A(struct gb *gb)
 {
-    write_byte(_r.hl++, _r.a);
-    _r.clk += 8;
+    write_byte(gb, gb->cpu.r.hl++, gb->cpu.r.a);
+    gb->cpu.r.clk += 8;
 }
 
-static void INC_HL(void)
+static void INC_HL(struct gb *gb)
 {
-    INC16(&_r.hl);
-    _r.clk += 8;
+    INC16(&gb->cpu.r.hl);
+    gb->cpu.r.clk += 8;
 }
 
-static void RET(void)
+static void RET(struct gb *gb)
 {
-    RET_internal(T);
-    _r.clk += 8;
+    RET_internal(gb, T);
+    gb->cpu.r.clk += 8;
 }
 
-static void LDH_A_m8(void)
+static void LDH_A_m8(struct gb *gb)
 {
-    _r.a = read_byte((uint16_t) (0xFF00 + read_byte(_r.pc++)));
-    _r.clk+= 12;
+    gb->cpu.r.a = read_byte(gb, (uint16_t) (0xFF00 + OPERAND8));
+    gb->cpu.r.clk+= 12;
 }
 
-static void INC_DE(void)
+static void INC_DE(struct gb *gb)
 {
-    INC16(&_r.de);
-    _r.clk += 8;
+    INC16(&gb->cpu.r.de);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_A_E(void)
+static void LD_A_E(struct gb *gb)
 {
-    _r.a = _r.e;
-    _r.clk += 4;
+    gb->cpu.r.a = gb->cpu.r.e;
+    gb->cpu.r.clk += 4;
 }
 
-static void CP_d8(void)
+static void CP_d8(struct gb *gb)
 {
-    CP8(read_byte(_r.pc++));
-    _r.clk += 8;
+    CP8(gb, OPERAND8);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_m16_A(void)
+static void LD_m16_A(struct gb *gb)
 {
-    write_byte(read_word(_r.pc), _r.a);
-    _r.pc += 2;
-    _r.clk += 16;
+    write_byte(gb, OPERAND16, gb->cpu.r.a);
+    gb->cpu.r.clk += 16;
 }
 
-static void DEC_A(void)
+static void DEC_A(struct gb *gb)
 {
-    DEC8(&_r.a);
-    _r.clk += 4;
+    DEC8(gb, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void JR_Z_r8(void)
+static void JR_Z_r8(struct gb *gb)
 {
-    JR(Z, read_byte(_r.pc++));
-    _r.clk += 8;
+    JR(gb, Z, OPERAND8);
 }
 
-static void DEC_C(void)
+static void DEC_C(struct gb *gb)
 {
-    DEC8(&_r.c);
-    _r.clk += 4;
+    DEC8(gb, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_L_d8(void)
+static void LD_L_d8(struct gb *gb)
 {
-    _r.l = read_byte(_r.pc++);
-    _r.clk += 4;
+    gb->cpu.r.l = OPERAND8;
+    gb->cpu.r.clk += 8;
 }
 
-static void JR_r8(void)
+static void JR_r8(struct gb *gb)
 {
-    JR(T, read_byte(_r.pc++));
-    _r.clk += 8;
+    JR(gb, T, OPERAND8);
 }
 
-static void LD_H_A(void)
+static void LD_H_A(struct gb *gb)
 {
-    _r.h = _r.a;
-    _r.clk += 4;
+    gb->cpu.r.h = gb->cpu.r.a;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_D_A(void)
+static void LD_D_A(struct gb *gb)
 {
-    _r.d = _r.a;
-    _r.clk += 4;
+    gb->cpu.r.d = gb->cpu.r.a;
+    gb->cpu.r.clk += 4;
 }
 
-static void INC_B(void)
+static void INC_B(struct gb *gb)
 {
-    INC8(&_r.b);
-    _r.clk += 4;
+    INC8(gb, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_E_d8(void)
+static void LD_E_d8(struct gb *gb)
 {
-    _r.e = read_byte(_r.pc++);
-    _r.clk += 8;
+    gb->cpu.r.e = OPERAND8;
+    gb->cpu.r.clk += 8;
 }
 
-static void DEC_E(void)
+static void DEC_E(struct gb *gb)
 {
-    DEC8(&_r.e);
-    _r.clk += 4;
+    DEC8(gb, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void INC_H(void)
+static void INC_H(struct gb *gb)
 {
-    INC8(&_r.h);
-    _r.clk += 4;
+    INC8(gb, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_A_H(void)
+static void LD_A_H(struct gb *gb)
 {
-    _r.a = _r.h;
-    _r.clk += 4;
+    gb->cpu.r.a = gb->cpu.r.h;
+    gb->cpu.r.clk += 4;
 }
 
-static void SUB_B(void)
+static void SUB_B(struct gb *gb)
 {
-    SUB8(_r.b);
-    _r.clk += 4;
+    SUB8(gb, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void DEC_D(void)
+static void DEC_D(struct gb *gb)
 {
-    DEC8(&_r.d);
-    _r.clk += 4;
+    DEC8(gb, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_D_d8(void)
+static void LD_D_d8(struct gb *gb)
 {
-    _r.d = read_byte(_r.pc++);
-    _r.clk += 8;
+    gb->cpu.r.d = OPERAND8;
+    gb->cpu.r.clk += 8;
 }
 
-static void CP_mHL(void)
+static void CP_mHL(struct gb *gb)
 {
-    CP8(read_byte(_r.hl));
-    _r.clk += 8;
+    CP8(gb, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_A_L(void)
+static void LD_A_L(struct gb *gb)
 {
-    _r.a = _r.l;
-    _r.clk += 4;
+    gb->cpu.r.a = gb->cpu.r.l;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_A_B(void)
+static void LD_A_B(struct gb *gb)
 {
-    _r.a = _r.b;
-    _r.clk += 4;
+    gb->cpu.r.a = gb->cpu.r.b;
+    gb->cpu.r.clk += 4;
 }
 
-static void ADD_mHL(void)
+static void ADD_mHL(struct gb *gb)
 {
-    ADD8(read_byte(_r.hl));
-    _r.clk += 8;
+    ADD8(gb, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 8;
 }
 
-static void JP_a16(void)
+static void JP_a16(struct gb *gb)
 {
-    uint16_t a16 = read_word(_r.pc);
-    _r.pc += 2;
-    JP(T, a16);
-    _r.clk += 12;
+    uint16_t a16 = OPERAND16;
+    JP(gb, T, a16);
+    gb->cpu.r.clk += 12;
 }
 
-static void LD_mHL_d8(void)
+static void LD_mHL_d8(struct gb *gb)
 {
-    write_byte(_r.hl, read_byte(_r.pc++));
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, OPERAND8);
+    gb->cpu.r.clk += 12;
 }
 
-static void LDI_A_mHL(void)
+static void LDI_A_mHL(struct gb *gb)
 {
-    _r.a = read_byte(_r.hl++);
-    _r.clk += 8;
+    gb->cpu.r.a = read_byte(gb, gb->cpu.r.hl++);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_BC_d16(void)
+static void LD_BC_d16(struct gb *gb)
 {
-    _r.bc = read_word(_r.pc);
-    _r.pc += 2;
-    _r.clk += 12;
+    gb->cpu.r.bc = OPERAND16;
+    gb->cpu.r.clk += 12;
 }
 
-static void DEC_BC(void)
+static void DEC_BC(struct gb *gb)
 {
-    DEC16(&_r.bc);
-    _r.clk += 8;
+    DEC16(&gb->cpu.r.bc);
+    gb->cpu.r.clk += 8;
 }
 
-static void OR_C(void)
+static void OR_C(struct gb *gb)
 {
-    OR8(_r.c);
-    _r.clk += 4;
+    OR8(gb, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void PUSH_AF(void)
+static void PUSH_AF(struct gb *gb)
 {
-    PUSH(_r.af);
-    _r.clk += 16;
+    gb->cpu.r.f = get_flags(gb);
+    PUSH(gb, gb->cpu.r.af);
+    gb->cpu.r.clk += 16;
 }
 
-static void PUSH_DE(void)
+static void PUSH_DE(struct gb *gb)
 {
-    PUSH(_r.de);
-    _r.clk += 16;
+    PUSH(gb, gb->cpu.r.de);
+    gb->cpu.r.clk += 16;
 }
 
-static void PUSH_HL(void)
+static void PUSH_HL(struct gb *gb)
 {
-    PUSH(_r.hl);
-    _r.clk += 16;
+    PUSH(gb, gb->cpu.r.hl);
+    gb->cpu.r.clk += 16;
 }
 
-static void AND_A(void)
+static void AND_A(struct gb *gb)
 {
-    AND8(_r.a);
-    _r.clk += 4;
+    AND8(gb, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void AND_d8(void)
+static void AND_d8(struct gb *gb)
 {
-    AND8(read_byte(_r.pc++));
-    _r.clk += 8;
+    AND8(gb, OPERAND8);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_B_A(void)
+static void LD_B_A(struct gb *gb)
 {
-    _r.b = _r.a;
-    _r.clk += 4;
+    gb->cpu.r.b = gb->cpu.r.a;
+    gb->cpu.r.clk += 4;
 }
 
-static void OR_B(void)
+static void OR_B(struct gb *gb)
 {
-    OR8(_r.b);
-    _r.clk += 4;
+    OR8(gb, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void XOR_C(void)
+static void XOR_C(struct gb *gb)
 {
-    XOR8(_r.c);
-    _r.clk += 4;
+    XOR8(gb, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void AND_C(void)
+static void AND_C(struct gb *gb)
 {
-    AND8(_r.c);
-    _r.clk += 4;
+    AND8(gb, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_A_C(void)
+static void LD_A_C(struct gb *gb)
 {
-    _r.a = _r.c;
-    _r.clk += 4;
+    gb->cpu.r.a = gb->cpu.r.c;
+    gb->cpu.r.clk += 4;
 }
 
-static void RST28(void)
+static void RST28(struct gb *gb)
 {
-    RST(0x28);
-    _r.clk += 16;
+    RST(gb, 0x28);
+    gb->cpu.r.clk += 16;
 }
 
-static void ADD_A(void)
+static void ADD_A(struct gb *gb)
 {
-    ADD8(_r.a);
-    _r.clk += 4;
+    ADD8(gb, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void POP_HL(void)
+static void POP_HL(struct gb *gb)
 {
-    POP(&_r.hl);
-    _r.clk += 12;
+    POP(gb, &gb->cpu.r.hl);
+    gb->cpu.r.clk += 12;
 }
 
-static void LD_E_A(void)
+static void LD_E_A(struct gb *gb)
 {
-    _r.e = _r.a;
-    _r.clk += 4;
+    gb->cpu.r.e = gb->cpu.r.a;
+    gb->cpu.r.clk += 4;
 }
 
-static void ADD_HL_DE(void)
+static void ADD_HL_DE(struct gb *gb)
 {
-    ADD16(&_r.hl, _r.de);
-    _r.clk += 8;
+    ADD16(gb, &gb->cpu.r.hl, gb->cpu.r.de);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_E_mHL(void)
+static void LD_E_mHL(struct gb *gb)
 {
-    _r.e = read_byte(_r.hl);
-    _r.clk += 8;
+    gb->cpu.r.e = read_byte(gb, gb->cpu.r.hl);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_D_mHL(void)
+static void LD_D_mHL(struct gb *gb)
 {
-    _r.d = read_byte(_r.hl);
-    _r.clk += 8;
+    gb->cpu.r.d = read_byte(gb, gb->cpu.r.hl);
+    gb->cpu.r.clk += 8;
 }
 
-static void JP_mHL(void)
+static void JP_mHL(struct gb *gb)
 {
-    JP(T, _r.hl);
-    _r.clk += 4;
+    JP(gb, T, gb->cpu.r.hl);
+    gb->cpu.r.clk += 4;
 }
 
-static void RET_NZ(void)
+static void RET_NZ(struct gb *gb)
 {
-    RET_internal(NZ);
-    _r.clk += 8;
+    RET_internal(gb, NZ);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_A_m16(void)
+static void LD_A_m16(struct gb *gb)
 {
-    uint16_t m16 = read_word(_r.pc);
-    _r.pc += 2;
-    _r.a = read_byte(m16);
-    _r.clk += 16;
+    uint16_t m16 = OPERAND16;
+    gb->cpu.r.a = read_byte(gb, m16);
+    gb->cpu.r.clk += 16;
 }
 
-static void RET_Z(void)
+static void RET_Z(struct gb *gb)
 {
-    RET_internal(Z);
-    _r.clk += 8;
+    RET_internal(gb, Z);
+    gb->cpu.r.clk += 8;
 }
 
-static void INC_mHL(void)
+static void INC_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
-    INC8(&mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
+    INC8(gb, &mHL);
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void INC_A(void)
+static void INC_A(struct gb *gb)
 {
-    INC8(&_r.a);
-    _r.clk += 4;
+    INC8(gb, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void POP_DE(void)
+static void POP_DE(struct gb *gb)
 {
-    POP(&_r.de);
-    _r.clk += 12;
+    POP(gb, &gb->cpu.r.de);
+    gb->cpu.r.clk += 12;
 }
 
-static void POP_AF(void)
+static void POP_AF(struct gb *gb)
 {
-    POP(&_r.af);
-    _r.clk += 12;
+    POP(gb, &gb->cpu.r.af);
+    set_flags(gb, gb->cpu.r.f);
+    gb->cpu.r.clk += 12;
 }
 
-static void LD_mDE_A(void)
+static void LD_mDE_A(struct gb *gb)
 {
-    write_byte(_r.de, _r.a);
-    _r.clk += 8;
+    write_byte(gb, gb->cpu.r.de, gb->cpu.r.a);
+    gb->cpu.r.clk += 8;
 }
 
-static void INC_E(void)
+static void INC_E(struct gb *gb)
 {
-    INC8(&_r.e);
-    _r.clk += 4;
+    INC8(gb, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void JP_Z_a16(void)
+static void JP_Z_a16(struct gb *gb)
 {
-    uint16_t d16 = read_word(_r.pc);
-    _r.pc += 2;
-    JP(Z, d16);
-    _r.clk += 12;
+    uint16_t d16 = OPERAND16;
+    JP(gb, Z, d16);
+    gb->cpu.r.clk += 12;
 }
 
-static void LD_A_mHL(void)
+static void LD_A_mHL(struct gb *gb)
 {
-    _r.a = read_byte(_r.hl);
-    _r.clk += 8;
+    gb->cpu.r.a = read_byte(gb, gb->cpu.r.hl);
+    gb->cpu.r.clk += 8;
 }
 
-static void DEC_mHL(void)
+static void DEC_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
-    DEC8(&mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
+    DEC8(gb, &mHL);
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void INC_L(void)
+static void INC_L(struct gb *gb)
 {
-    INC8(&_r.l);
-    _r.clk += 4;
+    INC8(gb, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void ADD_HL_BC(void)
+static void ADD_HL_BC(struct gb *gb)
 {
-    ADD16(&_r.hl, _r.bc);
-    _r.clk += 8;
+    ADD16(gb, &gb->cpu.r.hl, gb->cpu.r.bc);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_C_mHL(void)
+static void LD_C_mHL(struct gb *gb)
 {
-    _r.c = read_byte(_r.hl);
-    _r.clk += 8;
+    gb->cpu.r.c = read_byte(gb, gb->cpu.r.hl);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_B_mHL(void)
+static void LD_B_mHL(struct gb *gb)
 {
-    _r.b = read_byte(_r.hl);
-    _r.clk += 8;
+    gb->cpu.r.b = read_byte(gb, gb->cpu.r.hl);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_L_C(void)
+static void LD_L_C(struct gb *gb)
 {
-    _r.l = _r.c;
-    _r.clk += 4;
+    gb->cpu.r.l = gb->cpu.r.c;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_H_B(void)
+static void LD_H_B(struct gb *gb)
 {
-    _r.h = _r.b;
-    _r.clk += 4;
+    gb->cpu.r.h = gb->cpu.r.b;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_A_mBC(void)
+static void LD_A_mBC(struct gb *gb)
 {
-    _r.a = read_byte(_r.bc);
-    _r.clk += 8;
+    gb->cpu.r.a = read_byte(gb, gb->cpu.r.bc);
+    gb->cpu.r.clk += 8;
 }
 
-static void INC_BC(void)
+static void INC_BC(struct gb *gb)
 {
-    INC16(&_r.bc);
-    _r.clk += 8;
+    INC16(&gb->cpu.r.bc);
+    gb->cpu.r.clk += 8;
 }
 
-static void ADD_L(void)
+static void ADD_L(struct gb *gb)
 {
-    ADD8(_r.l);
-    _r.clk += 4;
+    ADD8(gb, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_L_A(void)
+static void LD_L_A(struct gb *gb)
 {
-    _r.l = _r.a;
-    _r.clk += 4;
+    gb->cpu.r.l = gb->cpu.r.a;
+    gb->cpu.r.clk += 4;
 }
 
-static void JP_NZ_a16(void)
+static void JP_NZ_a16(struct gb *gb)
 {
-    uint16_t d16 = read_word(_r.pc);
-    _r.pc += 2;
-    JP(NZ, d16);
-    _r.clk += 12;
+    uint16_t d16 = OPERAND16;
+    JP(gb, NZ, d16);
+    gb->cpu.r.clk += 12;
 }
 
-static void LDD_A_mHL(void)
+static void LDD_A_mHL(struct gb *gb)
 {
-    _r.a = read_byte(_r.hl--);
-    _r.clk += 8;
+    gb->cpu.r.a = read_byte(gb, gb->cpu.r.hl--);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_A_D(void)
+static void LD_A_D(struct gb *gb)
 {
-    _r.a = _r.d;
-    _r.clk += 4;
+    gb->cpu.r.a = gb->cpu.r.d;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_mHL_E(void)
+static void LD_mHL_E(struct gb *gb)
 {
-    write_byte(_r.hl, _r.e);
-    _r.clk += 8;
+    write_byte(gb, gb->cpu.r.hl, gb->cpu.r.e);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_mHL_D(void)
+static void LD_mHL_D(struct gb *gb)
 {
-    write_byte(_r.hl, _r.d);
-    _r.clk += 8;
+    write_byte(gb, gb->cpu.r.hl, gb->cpu.r.d);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_mHL_C(void)
+static void LD_mHL_C(struct gb *gb)
 {
-    write_byte(_r.hl, _r.c);
-    _r.clk += 8;
+    write_byte(gb, gb->cpu.r.hl, gb->cpu.r.c);
+    gb->cpu.r.clk += 8;
 }
 
-static void DEC_L(void)
+static void DEC_L(struct gb *gb)
 {
-    DEC8(&_r.l);
-    _r.clk += 4;
+    DEC8(gb, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void ADD_d8(void)
+static void ADD_d8(struct gb *gb)
 {
-    ADD8(read_byte(_r.pc++));
-    _r.clk += 8;
+    ADD8(gb, OPERAND8);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_E_L(void)
+static void LD_E_L(struct gb *gb)
 {
-    _r.e = _r.l;
-    _r.clk += 4;
+    gb->cpu.r.e = gb->cpu.r.l;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_D_H(void)
+static void LD_D_H(struct gb *gb)
 {
-    _r.d = _r.h;
-    _r.clk += 4;
+    gb->cpu.r.d = gb->cpu.r.h;
+    gb->cpu.r.clk += 4;
 }
 
-static void OR_d8(void)
+static void OR_d8(struct gb *gb)
 {
-    OR8(read_byte(_r.pc++));
-    _r.clk += 8;
+    OR8(gb, OPERAND8);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_L_E(void)
+static void LD_L_E(struct gb *gb)
 {
-    _r.l = _r.e;
-    _r.clk += 4;
+    gb->cpu.r.l = gb->cpu.r.e;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_H_D(void)
+static void LD_H_D(struct gb *gb)
 {
-    _r.h = _r.d;
-    _r.clk += 4;
+    gb->cpu.r.h = gb->cpu.r.d;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_B_B(void)
+static void LD_B_B(struct gb *gb)
 {
-    _r.b = _r.b;
-    _r.clk += 4;
+    gb->cpu.r.b = gb->cpu.r.b;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_H_d8(void)
+static void LD_H_d8(struct gb *gb)
 {
-    _r.h = read_byte(_r.pc++);
-    _r.clk += 8;
+    gb->cpu.r.h = OPERAND8;
+    gb->cpu.r.clk += 8;
 }
 
-static void RLCA(void)
+static void RLCA(struct gb *gb)
 {
-    RLC(&_r.a);
-    _r.clk += 4;
-    _r.f &= 0x70;
+    RLC(gb, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
+    gb->cpu.flags.zc |= 0x01;
 }
 
-static void ADD_B(void)
+static void ADD_B(struct gb *gb)
 {
-    ADD8(_r.b);
-    _r.clk += 4;
+    ADD8(gb, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void ADC_C(void)
+static void ADC_C(struct gb *gb)
 {
-    ADC8(_r.c);
-    _r.clk += 4;
+    ADC8(gb, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void CP_B(void)
+static void CP_B(struct gb *gb)
 {
-    CP8(_r.b);
-    _r.clk += 4;
+    CP8(gb, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void XOR_B(void)
+static void XOR_B(struct gb *gb)
 {
-    XOR8(_r.b);
-    _r.clk += 4;
+    XOR8(gb, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void AND_B(void)
+static void AND_B(struct gb *gb)
 {
-    AND8(_r.b);
-    _r.clk += 4;
+    AND8(gb, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SUB_d8(void)
+static void SUB_d8(struct gb *gb)
 {
-    SUB8(read_byte(_r.pc++));
-    _r.clk += 8;
+    SUB8(gb, OPERAND8);
+    gb->cpu.r.clk += 8;
 }
 
-static void ADC_mHL(void)
+static void ADC_mHL(struct gb *gb)
 {
-    ADC8(read_byte(_r.hl));
-    _r.clk += 8;
+    ADC8(gb, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 8;
 }
 
-static void RET_NC(void)
+static void RET_NC(struct gb *gb)
 {
-    RET_internal(NC);
-    _r.clk += 8;
+    RET_internal(gb, NC);
+    gb->cpu.r.clk += 8;
 }
 
-static void CP_C(void)
+static void CP_C(struct gb *gb)
 {
-    CP8(_r.c);
-    _r.clk += 4;
+    CP8(gb, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void JR_NC_r8(void)
+static void JR_NC_r8(struct gb *gb)
 {
-    JR(NC, read_byte(_r.pc++));
-    _r.clk += 8;
+    JR(gb, NC, OPERAND8);
 }
 
-static void LD_H_C(void)
+static void LD_H_C(struct gb *gb)
 {
-    _r.h = _r.c;
-    _r.clk += 4;
+    gb->cpu.r.h = gb->cpu.r.c;
+    gb->cpu.r.clk += 4;
 }
 
-static void RET_C(void)
+static void RET_C(struct gb *gb)
 {
-    RET_internal(C);
-    _r.clk += 8;
+    RET_internal(gb, C);
+    gb->cpu.r.clk += 8;
 }
 
-static void DEC_DE(void)
+static void DEC_DE(struct gb *gb)
 {
-    DEC16(&_r.de);
-    _r.clk += 8;
+    DEC16(&gb->cpu.r.de);
+    gb->cpu.r.clk += 8;
 }
 
-static void OR_A(void)
+static void OR_A(struct gb *gb)
 {
-    OR8(_r.a);
-    _r.clk += 4;
+    OR8(gb, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void JR_C_r8(void)
+static void JR_C_r8(struct gb *gb)
 {
-    JR(C, read_byte(_r.pc++));
-    _r.clk += 8;
+    JR(gb, C, OPERAND8);
 }
 
-static void XOR_d8(void)
+static void XOR_d8(struct gb *gb)
 {
-    XOR8(read_byte(_r.pc++));
-    _r.clk += 8;
+    XOR8(gb, OPERAND8);
+    gb->cpu.r.clk += 8;
 }
 
-static void SUB_mHL(void)
+static void SUB_mHL(struct gb *gb)
 {
-    SUB8(read_byte(_r.hl));
-    _r.clk += 8;
+    SUB8(gb, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 8;
 }
 
-static void DEC_HL(void)
+static void DEC_HL(struct gb *gb)
 {
-    DEC16(&_r.hl);
-    _r.clk += 8;
+    DEC16(&gb->cpu.r.hl);
+    gb->cpu.r.clk += 8;
 }
 
-static void ADD_D(void)
+static void ADD_D(struct gb *gb)
 {
-    ADD8(_r.d);
-    _r.clk += 4;
+    ADD8(gb, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void DEC_H(void)
+static void DEC_H(struct gb *gb)
 {
-    DEC8(&_r.h);
-    _r.clk += 4;
+    DEC8(gb, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void OR_D(void)
+static void OR_D(struct gb *gb)
 {
-    OR8(_r.d);
-    _r.clk += 4;
+    OR8(gb, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_mBC_A(void)
+static void LD_mBC_A(struct gb *gb)
 {
-    write_byte(_r.bc, _r.a);
-    _r.clk += 8;
+    write_byte(gb, gb->cpu.r.bc, gb->cpu.r.a);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_m16_SP(void)
+static void LD_m16_SP(struct gb *gb)
 {
-    uint16_t m16 = read_word(_r.pc);
-    _r.pc += 2;
-    write_word(m16, _r.sp);
-    _r.clk += 20;
+    uint16_t m16 = OPERAND16;
+    write_word(gb, m16, gb->cpu.r.sp);
+    gb->cpu.r.clk += 20;
 }
 
-static void RRCA(void)
+static void RRCA(struct gb *gb)
 {
-    RRC(&_r.a);
-    _r.f &= 0x10;
-    _r.clk += 4;
+    RRC(gb, &gb->cpu.r.a);
+    gb->cpu.flags.zc |= 0x01;
+    gb->cpu.r.clk += 4;
 }
 
-static void INC_D(void)
+static void INC_D(struct gb *gb)
 {
-    INC8(&_r.d);
-    _r.clk += 4;
+    INC8(gb, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void RRA(void)
+static void RRA(struct gb *gb)
 {
-    RR(&_r.a);
-    _r.f &= 0x10;
-    _r.clk += 4;
+    RR(gb, &gb->cpu.r.a);
+    gb->cpu.flags.zc |= 0x01;
+    gb->cpu.r.clk += 4;
 }
 
-static void ADD_HL_HL(void)
+static void ADD_HL_HL(struct gb *gb)
 {
-    ADD16(&_r.hl, _r.hl);
-    _r.clk += 8;
+    ADD16(gb, &gb->cpu.r.hl, gb->cpu.r.hl);
+    gb->cpu.r.clk += 8;
 }
 
-static void INC_SP(void)
+static void INC_SP(struct gb *gb)
 {
-    INC16(&_r.sp);
-    _r.clk += 8;
+    INC16(&gb->cpu.r.sp);
+    gb->cpu.r.clk += 8;
 }
 
-static void ADD_HL_SP(void)
+static void ADD_HL_SP(struct gb *gb)
 {
-    ADD16(&_r.hl, _r.sp);
-    _r.clk += 8;
+    ADD16(gb, &gb->cpu.r.hl, gb->cpu.r.sp);
+    gb->cpu.r.clk += 8;
 }
 
-static void DEC_SP(void)
+static void DEC_SP(struct gb *gb)
 {
-    DEC16(&_r.sp);
-    _r.clk += 8;
+    DEC16(&gb->cpu.r.sp);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_B_C(void)
+static void LD_B_C(struct gb *gb)
 {
-    _r.b = _r.c;
-    _r.clk += 4;
+    gb->cpu.r.b = gb->cpu.r.c;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_B_D(void)
+static void LD_B_D(struct gb *gb)
 {
-    _r.b = _r.d;
-    _r.clk += 4;
+    gb->cpu.r.b = gb->cpu.r.d;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_B_E(void)
+static void LD_B_E(struct gb *gb)
 {
-    _r.b = _r.e;
-    _r.clk += 4;
+    gb->cpu.r.b = gb->cpu.r.e;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_B_H(void)
+static void LD_B_H(struct gb *gb)
 {
-    _r.b = _r.h;
-    _r.clk += 4;
+    gb->cpu.r.b = gb->cpu.r.h;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_B_L(void)
+static void LD_B_L(struct gb *gb)
 {
-    _r.b = _r.l;
-    _r.clk += 4;
+    gb->cpu.r.b = gb->cpu.r.l;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_C_B(void)
+static void LD_C_B(struct gb *gb)
 {
-    _r.c = _r.b;
-    _r.clk += 4;
+    gb->cpu.r.c = gb->cpu.r.b;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_C_C(void)
+static void LD_C_C(struct gb *gb)
 {
-    _r.c = _r.c;
-    _r.clk += 4;
+    gb->cpu.r.c = gb->cpu.r.c;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_C_D(void)
+static void LD_C_D(struct gb *gb)
 {
-    _r.c = _r.d;
-    _r.clk += 4;
+    gb->cpu.r.c = gb->cpu.r.d;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_C_E(void)
+static void LD_C_E(struct gb *gb)
 {
-    _r.c = _r.e;
-    _r.clk += 4;
+    gb->cpu.r.c = gb->cpu.r.e;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_C_H(void)
+static void LD_C_H(struct gb *gb)
 {
-    _r.c = _r.h;
-    _r.clk += 4;
+    gb->cpu.r.c = gb->cpu.r.h;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_C_L(void)
+static void LD_C_L(struct gb *gb)
 {
-    _r.c = _r.l;
-    _r.clk += 4;
+    gb->cpu.r.c = gb->cpu.r.l;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_D_B(void)
+static void LD_D_B(struct gb *gb)
 {
-    _r.d = _r.b;
-    _r.clk += 4;
+    gb->cpu.r.d = gb->cpu.r.b;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_D_C(void)
+static void LD_D_C(struct gb *gb)
 {
-    _r.d = _r.c;
-    _r.clk += 4;
+    gb->cpu.r.d = gb->cpu.r.c;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_D_D(void)
+static void LD_D_D(struct gb *gb)
 {
-    _r.d = _r.d;
-    _r.clk += 4;
+    gb->cpu.r.d = gb->cpu.r.d;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_D_E(void)
+static void LD_D_E(struct gb *gb)
 {
-    _r.d = _r.e;
-    _r.clk += 4;
+    gb->cpu.r.d = gb->cpu.r.e;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_D_L(void)
+static void LD_D_L(struct gb *gb)
 {
-    _r.d = _r.l;
-    _r.clk += 4;
+    gb->cpu.r.d = gb->cpu.r.l;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_E_B(void)
+static void LD_E_B(struct gb *gb)
 {
-    _r.e = _r.b;
-    _r.clk += 4;
+    gb->cpu.r.e = gb->cpu.r.b;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_E_C(void)
+static void LD_E_C(struct gb *gb)
 {
-    _r.e = _r.c;
-    _r.clk += 4;
+    gb->cpu.r.e = gb->cpu.r.c;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_E_D(void)
+static void LD_E_D(struct gb *gb)
 {
-    _r.e = _r.d;
-    _r.clk += 4;
+    gb->cpu.r.e = gb->cpu.r.d;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_E_E(void)
+static void LD_E_E(struct gb *gb)
 {
-    _r.e = _r.e;
-    _r.clk += 4;
+    gb->cpu.r.e = gb->cpu.r.e;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_E_H(void)
+static void LD_E_H(struct gb *gb)
 {
-    _r.e = _r.h;
-    _r.clk += 4;
+    gb->cpu.r.e = gb->cpu.r.h;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_H_E(void)
+static void LD_H_E(struct gb *gb)
 {
-    _r.h = _r.e;
-    _r.clk += 4;
+    gb->cpu.r.h = gb->cpu.r.e;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_H_H(void)
+static void LD_H_H(struct gb *gb)
 {
-    _r.h = _r.h;
-    _r.clk += 4;
+    gb->cpu.r.h = gb->cpu.r.h;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_H_L(void)
+static void LD_H_L(struct gb *gb)
 {
-    _r.h = _r.l;
-    _r.clk += 4;
+    gb->cpu.r.h = gb->cpu.r.l;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_H_mHL(void)
+static void LD_H_mHL(struct gb *gb)
 {
-    _r.h = read_byte(_r.hl);
-    _r.clk += 8;
+    gb->cpu.r.h = read_byte(gb, gb->cpu.r.hl);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_L_B(void)
+static void LD_L_B(struct gb *gb)
 {
-    _r.l = _r.b;
-    _r.clk += 4;
+    gb->cpu.r.l = gb->cpu.r.b;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_L_D(void)
+static void LD_L_D(struct gb *gb)
 {
-    _r.l = _r.d;
-    _r.clk += 4;
+    gb->cpu.r.l = gb->cpu.r.d;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_L_H(void)
+static void LD_L_H(struct gb *gb)
 {
-    _r.l = _r.h;
-    _r.clk += 4;
+    gb->cpu.r.l = gb->cpu.r.h;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_L_L(void)
+static void LD_L_L(struct gb *gb)
 {
-    _r.l = _r.l;
-    _r.clk += 4;
+    gb->cpu.r.l = gb->cpu.r.l;
+    gb->cpu.r.clk += 4;
 }
 
-static void LD_L_mHL(void)
+static void LD_L_mHL(struct gb *gb)
 {
-    _r.l = read_byte(_r.hl);
-    _r.clk += 8;
+    gb->cpu.r.l = read_byte(gb, gb->cpu.r.hl);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_mHL_B(void)
+static void LD_mHL_B(struct gb *gb)
 {
-    write_byte(_r.hl, _r.b);
-    _r.clk += 8;
+    write_byte(gb, gb->cpu.r.hl, gb->cpu.r.b);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_mHL_H(void)
+static void LD_mHL_H(struct gb *gb)
 {
-    write_byte(_r.hl, _r.h);
-    _r.clk += 8;
+    write_byte(gb, gb->cpu.r.hl, gb->cpu.r.h);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_mHL_L(void)
+static void LD_mHL_L(struct gb *gb)
 {
-    write_byte(_r.hl, _r.l);
-    _r.clk += 8;
+    write_byte(gb, gb->cpu.r.hl, gb->cpu.r.l);
+    gb->cpu.r.clk += 8;
 }
 
-static void LD_A_A(void)
+static void LD_A_A(struct gb *gb)
 {
-    _r.a = _r.a;
-    _r.clk += 4;
+    gb->cpu.r.a = gb->cpu.r.a;
+    gb->cpu.r.clk += 4;
 }
 
-static void ADD_C(void)
+static void ADD_C(struct gb *gb)
 {
-    ADD8(_r.c);
-    _r.clk += 4;
+    ADD8(gb, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void ADD_E(void)
+static void ADD_E(struct gb *gb)
 {
-    ADD8(_r.e);
-    _r.clk += 4;
+    ADD8(gb, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void ADD_H(void)
+static void ADD_H(struct gb *gb)
 {
-    ADD8(_r.h);
-    _r.clk += 4;
+    ADD8(gb, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void ADC_B(void)
+static void ADC_B(struct gb *gb)
 {
-    ADC8(_r.b);
-    _r.clk += 4;
+    ADC8(gb, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void ADC_D(void)
+static void ADC_D(struct gb *gb)
 {
-    ADC8(_r.d);
-    _r.clk += 4;
+    ADC8(gb, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void ADC_E(void)
+static void ADC_E(struct gb *gb)
 {
-    ADC8(_r.e);
-    _r.clk += 4;
+    ADC8(gb, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void ADC_H(void)
+static void ADC_H(struct gb *gb)
 {
-    ADC8(_r.h);
-    _r.clk += 4;
+    ADC8(gb, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void ADC_L(void)
+static void ADC_L(struct gb *gb)
 {
-    ADC8(_r.l);
-    _r.clk += 4;
+    ADC8(gb, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void ADC_A(void)
+static void ADC_A(struct gb *gb)
 {
-    ADC8(_r.a);
-    _r.clk += 4;
+    ADC8(gb, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SUB_C(void)
+static void SUB_C(struct gb *gb)
 {
-    SUB8(_r.c);
-    _r.clk += 4;
+    SUB8(gb, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SUB_D(void)
+static void SUB_D(struct gb *gb)
 {
-    SUB8(_r.d);
-    _r.clk += 4;
+    SUB8(gb, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SUB_E(void)
+static void SUB_E(struct gb *gb)
 {
-    SUB8(_r.e);
-    _r.clk += 4;
+    SUB8(gb, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SUB_H(void)
+static void SUB_H(struct gb *gb)
 {
-    SUB8(_r.h);
-    _r.clk += 4;
+    SUB8(gb, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SUB_L(void)
+static void SUB_L(struct gb *gb)
 {
-    SUB8(_r.l);
-    _r.clk += 4;
+    SUB8(gb, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SUB_A(void)
+static void SUB_A(struct gb *gb)
 {
-    SUB8(_r.a);
-    _r.clk += 4;
+    SUB8(gb, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SBC_B(void)
+static void SBC_B(struct gb *gb)
 {
-    SBC8(_r.b);
-    _r.clk += 4;
+    SBC8(gb, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SBC_C(void)
+static void SBC_C(struct gb *gb)
 {
-    SBC8(_r.c);
-    _r.clk += 4;
+    SBC8(gb, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SBC_D(void)
+static void SBC_D(struct gb *gb)
 {
-    SBC8(_r.d);
-    _r.clk += 4;
+    SBC8(gb, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SBC_E(void)
+static void SBC_E(struct gb *gb)
 {
-    SBC8(_r.e);
-    _r.clk += 4;
+    SBC8(gb, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SBC_H(void)
+static void SBC_H(struct gb *gb)
 {
-    SBC8(_r.h);
-    _r.clk += 4;
+    SBC8(gb, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SBC_L(void)
+static void SBC_L(struct gb *gb)
 {
-    SBC8(_r.l);
-    _r.clk += 4;
+    SBC8(gb, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SBC_mHL(void)
+static void SBC_mHL(struct gb *gb)
 {
-    SBC8(read_byte(_r.hl));
-    _r.clk += 8;
+    SBC8(gb, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 8;
 }
 
-static void SBC_A(void)
+static void SBC_A(struct gb *gb)
 {
-    SBC8(_r.a);
-    _r.clk += 4;
+    SBC8(gb, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void AND_D(void)
+static void AND_D(struct gb *gb)
 {
-    AND8(_r.d);
-    _r.clk += 4;
+    AND8(gb, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void AND_E(void)
+static void AND_E(struct gb *gb)
 {
-    AND8(_r.e);
-    _r.clk += 4;
+    AND8(gb, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void AND_H(void)
+static void AND_H(struct gb *gb)
 {
-    AND8(_r.h);
-    _r.clk += 4;
+    AND8(gb, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void AND_L(void)
+static void AND_L(struct gb *gb)
 {
-    AND8(_r.l);
-    _r.clk += 4;
+    AND8(gb, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void AND_mHL(void)
+static void AND_mHL(struct gb *gb)
 {
-    AND8(read_byte(_r.hl));
-    _r.clk += 8;
+    AND8(gb, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 8;
 }
 
-static void XOR_D(void)
+static void XOR_D(struct gb *gb)
 {
-    XOR8(_r.d);
-    _r.clk += 4;
+    XOR8(gb, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void XOR_E(void)
+static void XOR_E(struct gb *gb)
 {
-    XOR8(_r.e);
-    _r.clk += 4;
+    XOR8(gb, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void XOR_H(void)
+static void XOR_H(struct gb *gb)
 {
-    XOR8(_r.h);
-    _r.clk += 4;
+    XOR8(gb, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void XOR_L(void)
+static void XOR_L(struct gb *gb)
 {
-    XOR8(_r.l);
-    _r.clk += 4;
+    XOR8(gb, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void XOR_mHL(void)
+static void XOR_mHL(struct gb *gb)
 {
-    XOR8(read_byte(_r.hl));
-    _r.clk += 8;
+    XOR8(gb, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 8;
 }
 
-static void OR_E(void)
+static void OR_E(struct gb *gb)
 {
-    OR8(_r.e);
-    _r.clk += 4;
+    OR8(gb, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void OR_H(void)
+static void OR_H(struct gb *gb)
 {
-    OR8(_r.h);
-    _r.clk += 4;
+    OR8(gb, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void OR_L(void)
+static void OR_L(struct gb *gb)
 {
-    OR8(_r.l);
-    _r.clk += 4;
+    OR8(gb, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void OR_mHL(void)
+static void OR_mHL(struct gb *gb)
 {
-    OR8(read_byte(_r.hl));
-    _r.clk += 8;
+    OR8(gb, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 8;
 }
 
-static void CP_D(void)
+static void CP_D(struct gb *gb)
 {
-    CP8(_r.d);
-    _r.clk += 4;
+    CP8(gb, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void CP_E(void)
+static void CP_E(struct gb *gb)
 {
-    CP8(_r.e);
-    _r.clk += 4;
+    CP8(gb, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void CP_H(void)
+static void CP_H(struct gb *gb)
 {
-    CP8(_r.h);
-    _r.clk += 4;
+    CP8(gb, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void CP_L(void)
+static void CP_L(struct gb *gb)
 {
-    CP8(_r.l);
-    _r.clk += 4;
+    CP8(gb, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void CP_A(void)
+static void CP_A(struct gb *gb)
 {
-    CP8(_r.a);
-    _r.clk += 4;
+    CP8(gb, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void CALL_NZ_a16(void)
+static void CALL_NZ_a16(struct gb *gb)
 {
-    uint16_t a16 = read_word(_r.pc);
-    _r.pc += 2;
-    CALL(NZ, a16);
-    _r.clk += 12;
+    uint16_t a16 = OPERAND16;
+    CALL(gb, NZ, a16);
+    gb->cpu.r.clk += 12;
 }
 
-static void RST00(void)
+static void RST00(struct gb *gb)
 {
-    RST(0x00);
-    _r.clk += 16;
+    RST(gb, 0x00);
+    gb->cpu.r.clk += 16;
 }
 
-static void CALL_Z_a16(void)
+static void CALL_Z_a16(struct gb *gb)
 {
-    uint16_t a16 = read_word(_r.pc);
-    _r.pc += 2;
-    CALL(Z, a16);
-    _r.clk += 12;
+    uint16_t a16 = OPERAND16;
+    CALL(gb, Z, a16);
+    gb->cpu.r.clk += 12;
 }
 
-static void ADC_d8(void)
+static void ADC_d8(struct gb *gb)
 {
-    ADC8(read_byte(_r.pc++));
-    _r.clk += 8;
+    ADC8(gb, OPERAND8);
+    gb->cpu.r.clk += 8;
 }
 
-static void RST08(void)
+static void RST08(struct gb *gb)
 {
-    RST(0x08);
-    _r.clk += 16;
+    RST(gb, 0x08);
+    gb->cpu.r.clk += 16;
 }
 
-static void JP_NC_a16(void)
+static void JP_NC_a16(struct gb *gb)
 {
-    uint16_t a16 = read_word(_r.pc);
-    _r.pc += 2;
-    JP(NC, a16);
-    _r.clk += 12;
+    uint16_t a16 = OPERAND16;
+    JP(gb, NC, a16);
+    gb->cpu.r.clk += 12;
 }
 
-static void CALL_NC_a16(void)
+static void CALL_NC_a16(struct gb *gb)
 {
-    uint16_t a16 = read_word(_r.pc);
-    _r.pc += 2;
-    CALL(NC, a16);
-    _r.clk += 12;
+    uint16_t a16 = OPERAND16;
+    CALL(gb, NC, a16);
+    gb->cpu.r.clk += 12;
 }
 
-static void RST10(void)
+static void RST10(struct gb *gb)
 {
-    RST(0x10);
-    _r.clk += 16;
+    RST(gb, 0x10);
+    gb->cpu.r.clk += 16;
 }
 
-static void JP_C_a16(void)
+static void JP_C_a16(struct gb *gb)
 {
-    uint16_t a16 = read_word(_r.pc);
-    _r.pc += 2;
-    JP(C, a16);
-    _r.clk += 12;
+    uint16_t a16 = OPERAND16;
+    JP(gb, C, a16);
+    gb->cpu.r.clk += 12;
 }
 
-static void CALL_C_a16(void)
+static void CALL_C_a16(struct gb *gb)
 {
-    uint16_t a16 = read_word(_r.pc);
-    _r.pc += 2;
-    CALL(C, a16);
-    _r.clk += 12;
+    uint16_t a16 = OPERAND16;
+    CALL(gb, C, a16);
+    gb->cpu.r.clk += 12;
 }
 
-static void SBC_d8(void)
+static void SBC_d8(struct gb *gb)
 {
-    SBC8(read_byte(_r.pc++));
-    _r.clk += 8;
+    SBC8(gb, OPERAND8);
+    gb->cpu.r.clk += 8;
 }
 
-static void RST18(void)
+static void RST18(struct gb *gb)
 {
-    RST(0x18);
-    _r.clk += 16;
+    RST(gb, 0x18);
+    gb->cpu.r.clk += 16;
 }
 
-static void RST20(void)
+static void RST20(struct gb *gb)
 {
-    RST(0x20);
-    _r.clk += 16;
+    RST(gb, 0x20);
+    gb->cpu.r.clk += 16;
 }
 
-static void ADD_SP_r8(void)
+static void ADD_SP_r8(struct gb *gb)
 {
-    ADD16(&_r.sp, read_byte(_r.pc++));
-    _r.clk += 16;
+    ADD16(gb, &gb->cpu.r.sp, OPERAND8);
+    gb->cpu.r.clk += 16;
 }
 
-static void LD_A_mC(void)
+static void LD_A_mC(struct gb *gb)
 {
-    _r.a = read_byte((uint16_t) (0xFF00 + _r.c));
-    _r.clk += 8;
+    gb->cpu.r.a = read_byte(gb, (uint16_t) (0xFF00 + gb->cpu.r.c));
+    gb->cpu.r.clk += 8;
 }
 
-static void RST30(void)
+static void RST30(struct gb *gb)
 {
-    RST(0x30);
-    _r.clk += 16;
+    RST(gb, 0x30);
+    gb->cpu.r.clk += 16;
 }
 
-static void LDHL_SP_r8(void)
+static void LDHL_SP_r8(struct gb *gb)
 {
-    uint16_t _sp = _r.sp;
-    ADD16(&_sp, read_byte(_r.pc++));
-    _r.hl = _sp;
-    _r.clk += 12;
+    uint16_t _sp = gb->cpu.r.sp;
+    ADD16(gb, &_sp, OPERAND8);
+    gb->cpu.r.hl = _sp;
+    gb->cpu.r.clk += 12;
 }
 
-static void LD_SP_HL(void)
+static void LD_SP_HL(struct gb *gb)
 {
-    _r.sp = _r.hl;
-    _r.clk += 8;
+    gb->cpu.r.sp = gb->cpu.r.hl;
+    gb->cpu.r.clk += 8;
 }
 
-static void RST38(void)
+static void RST38(struct gb *gb)
 {
-    RST(0x38);
-    _r.clk += 16;
+    RST(gb, 0x38);
+    gb->cpu.r.clk += 16;
 }
 
 /*****************************/
 /** CB Function map opcodes **/
 /*****************************/
 
-static void RLC_B(void)
+static void RLC_B(struct gb *gb)
 {
-    RLC(&_r.b);
-    _r.clk += 4;
+    RLC(gb, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void RLC_C(void)
+static void RLC_C(struct gb *gb)
 {
-    RLC(&_r.c);
-    _r.clk += 4;
+    RLC(gb, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void RLC_D(void)
+static void RLC_D(struct gb *gb)
 {
-    RLC(&_r.d);
-    _r.clk += 4;
+    RLC(gb, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void RLC_E(void)
+static void RLC_E(struct gb *gb)
 {
-    RLC(&_r.e);
-    _r.clk += 4;
+    RLC(gb, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void RLC_H(void)
+static void RLC_H(struct gb *gb)
 {
-    RLC(&_r.h);
-    _r.clk += 4;
+    RLC(gb, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void RLC_L(void)
+static void RLC_L(struct gb *gb)
 {
-    RLC(&_r.l);
-    _r.clk += 4;
+    RLC(gb, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void RLC_mHL(void)
+static void RLC_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
-    RLC(&mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
+    RLC(gb, &mHL);
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void RLC_A(void)
+static void RLC_A(struct gb *gb)
 {
-    RLC(&_r.a);
-    _r.clk += 4;
+    RLC(gb, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void RRC_B(void)
+static void RRC_B(struct gb *gb)
 {
-    RRC(&_r.b);
-    _r.clk += 4;
+    RRC(gb, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void RRC_C(void)
+static void RRC_C(struct gb *gb)
 {
-    RRC(&_r.c);
-    _r.clk += 4;
+    RRC(gb, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void RRC_D(void)
+static void RRC_D(struct gb *gb)
 {
-    RRC(&_r.d);
-    _r.clk += 4;
+    RRC(gb, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void RRC_E(void)
+static void RRC_E(struct gb *gb)
 {
-    RRC(&_r.e);
-    _r.clk += 4;
+    RRC(gb, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void RRC_H(void)
+static void RRC_H(struct gb *gb)
 {
-    RRC(&_r.h);
-    _r.clk += 4;
+    RRC(gb, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void RRC_L(void)
+static void RRC_L(struct gb *gb)
 {
-    RRC(&_r.l);
-    _r.clk += 4;
+    RRC(gb, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void RRC_mHL(void)
+static void RRC_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
-    RRC(&mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
+    RRC(gb, &mHL);
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void RRC_A(void)
+static void RRC_A(struct gb *gb)
 {
-    RRC(&_r.a);
-    _r.clk += 4;
+    RRC(gb, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void RL_B(void)
+static void RL_B(struct gb *gb)
 {
-    RL(&_r.b);
-    _r.clk += 4;
+    RL(gb, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void RL_C(void)
+static void RL_C(struct gb *gb)
 {
-    RL(&_r.c);
-    _r.clk += 4;
+    RL(gb, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void RL_D(void)
+static void RL_D(struct gb *gb)
 {
-    RL(&_r.d);
-    _r.clk += 4;
+    RL(gb, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void RL_E(void)
+static void RL_E(struct gb *gb)
 {
-    RL(&_r.e);
-    _r.clk += 4;
+    RL(gb, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void RL_H(void)
+static void RL_H(struct gb *gb)
 {
-    RL(&_r.h);
-    _r.clk += 4;
+    RL(gb, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void RL_L(void)
+static void RL_L(struct gb *gb)
 {
-    RL(&_r.l);
-    _r.clk += 4;
+    RL(gb, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void RL_mHL(void)
+static void RL_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
-    RL(&mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
+    RL(gb, &mHL);
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void RL_A(void)
+static void RL_A(struct gb *gb)
 {
-    RL(&_r.a);
-    _r.clk += 4;
+    RL(gb, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void RR_B(void)
+static void RR_B(struct gb *gb)
 {
-    RR(&_r.b);
-    _r.clk += 4;
+    RR(gb, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void RR_C(void)
+static void RR_C(struct gb *gb)
 {
-    RR(&_r.c);
-    _r.clk += 4;
+    RR(gb, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void RR_D(void)
+static void RR_D(struct gb *gb)
 {
-    RR(&_r.d);
-    _r.clk += 4;
+    RR(gb, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void RR_E(void)
+static void RR_E(struct gb *gb)
 {
-    RR(&_r.e);
-    _r.clk += 4;
+    RR(gb, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void RR_H(void)
+static void RR_H(struct gb *gb)
 {
-    RR(&_r.h);
-    _r.clk += 4;
+    RR(gb, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void RR_L(void)
+static void RR_L(struct gb *gb)
 {
-    RR(&_r.l);
-    _r.clk += 4;
+    RR(gb, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void RR_mHL(void)
+static void RR_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
-    RR(&mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
+    RR(gb, &mHL);
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void RR_A(void)
+static void RR_A(struct gb *gb)
 {
-    RR(&_r.a);
-    _r.clk += 4;
+    RR(gb, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SLA_B(void)
+static void SLA_B(struct gb *gb)
 {
-    SLA(&_r.b);
-    _r.clk += 4;
+    SLA(gb, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SLA_C(void)
+static void SLA_C(struct gb *gb)
 {
-    SLA(&_r.c);
-    _r.clk += 4;
+    SLA(gb, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SLA_D(void)
+static void SLA_D(struct gb *gb)
 {
-    SLA(&_r.d);
-    _r.clk += 4;
+    SLA(gb, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SLA_E(void)
+static void SLA_E(struct gb *gb)
 {
-    SLA(&_r.e);
-    _r.clk += 4;
+    SLA(gb, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SLA_H(void)
+static void SLA_H(struct gb *gb)
 {
-    SLA(&_r.h);
-    _r.clk += 4;
+    SLA(gb, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SLA_L(void)
+static void SLA_L(struct gb *gb)
 {
-    SLA(&_r.l);
-    _r.clk += 4;
+    SLA(gb, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SLA_mHL(void)
+static void SLA_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
-    SLA(&mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
+    SLA(gb, &mHL);
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void SLA_A(void)
+static void SLA_A(struct gb *gb)
 {
-    SLA(&_r.a);
-    _r.clk += 4;
+    SLA(gb, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRA_B(void)
+static void SRA_B(struct gb *gb)
 {
-    SRA(&_r.b);
-    _r.clk += 4;
+    SRA(gb, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRA_C(void)
+static void SRA_C(struct gb *gb)
 {
-    SRA(&_r.c);
-    _r.clk += 4;
+    SRA(gb, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRA_D(void)
+static void SRA_D(struct gb *gb)
 {
-    SRA(&_r.d);
-    _r.clk += 4;
+    SRA(gb, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRA_E(void)
+static void SRA_E(struct gb *gb)
 {
-    SRA(&_r.e);
-    _r.clk += 4;
+    SRA(gb, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRA_H(void)
+static void SRA_H(struct gb *gb)
 {
-    SRA(&_r.h);
-    _r.clk += 4;
+    SRA(gb, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRA_L(void)
+static void SRA_L(struct gb *gb)
 {
-    SRA(&_r.l);
-    _r.clk += 4;
+    SRA(gb, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRA_mHL(void)
+static void SRA_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
-    SRA(&mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
+    SRA(gb, &mHL);
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void SRA_A(void)
+static void SRA_A(struct gb *gb)
 {
-    SRA(&_r.a);
-    _r.clk += 4;
+    SRA(gb, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SWAP_B(void)
+static void SWAP_B(struct gb *gb)
 {
-    SWAP(&_r.b);
-    _r.clk += 4;
+    SWAP(gb, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SWAP_C(void)
+static void SWAP_C(struct gb *gb)
 {
-    SWAP(&_r.c);
-    _r.clk += 4;
+    SWAP(gb, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SWAP_D(void)
+static void SWAP_D(struct gb *gb)
 {
-    SWAP(&_r.d);
-    _r.clk += 4;
+    SWAP(gb, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SWAP_E(void)
+static void SWAP_E(struct gb *gb)
 {
-    SWAP(&_r.e);
-    _r.clk += 4;
+    SWAP(gb, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SWAP_H(void)
+static void SWAP_H(struct gb *gb)
 {
-    SWAP(&_r.h);
-    _r.clk += 4;
+    SWAP(gb, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SWAP_L(void)
+static void SWAP_L(struct gb *gb)
 {
-    SWAP(&_r.l);
-    _r.clk += 4;
+    SWAP(gb, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SWAP_mHL(void)
+static void SWAP_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
-    SWAP(&mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
+    SWAP(gb, &mHL);
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void SWAP_A(void)
+static void SWAP_A(struct gb *gb)
 {
-    SWAP(&_r.a);
-    _r.clk += 4;
+    SWAP(gb, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRL_B(void)
+static void SRL_B(struct gb *gb)
 {
-    SRL(&_r.b);
-    _r.clk += 4;
+    SRL(gb, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRL_C(void)
+static void SRL_C(struct gb *gb)
 {
-    SRL(&_r.c);
-    _r.clk += 4;
+    SRL(gb, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRL_D(void)
+static void SRL_D(struct gb *gb)
 {
-    SRL(&_r.d);
-    _r.clk += 4;
+    SRL(gb, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRL_E(void)
+static void SRL_E(struct gb *gb)
 {
-    SRL(&_r.e);
-    _r.clk += 4;
+    SRL(gb, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRL_H(void)
+static void SRL_H(struct gb *gb)
 {
-    SRL(&_r.h);
-    _r.clk += 4;
+    SRL(gb, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRL_L(void)
+static void SRL_L(struct gb *gb)
 {
-    SRL(&_r.l);
-    _r.clk += 4;
+    SRL(gb, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SRL_mHL(void)
+static void SRL_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
-    SRL(&mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
+    SRL(gb, &mHL);
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void SRL_A(void)
+static void SRL_A(struct gb *gb)
 {
-    SRL(&_r.a);
-    _r.clk += 4;
+    SRL(gb, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_0_B(void)
+static void BIT_0_B(struct gb *gb)
 {
-    BIT(0, _r.b);
-    _r.clk += 4;
+    BIT(gb, 0, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_0_C(void)
+static void BIT_0_C(struct gb *gb)
 {
-    BIT(0, _r.c);
-    _r.clk += 4;
+    BIT(gb, 0, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_0_D(void)
+static void BIT_0_D(struct gb *gb)
 {
-    BIT(0, _r.d);
-    _r.clk += 4;
+    BIT(gb, 0, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_0_E(void)
+static void BIT_0_E(struct gb *gb)
 {
-    BIT(0, _r.e);
-    _r.clk += 4;
+    BIT(gb, 0, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_0_H(void)
+static void BIT_0_H(struct gb *gb)
 {
-    BIT(0, _r.h);
-    _r.clk += 4;
+    BIT(gb, 0, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_0_L(void)
+static void BIT_0_L(struct gb *gb)
 {
-    BIT(0, _r.l);
-    _r.clk += 4;
+    BIT(gb, 0, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_0_mHL(void)
+static void BIT_0_mHL(struct gb *gb)
 {
-    BIT(0, read_byte(_r.hl));
-    _r.clk += 12;
+    BIT(gb, 0, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 12;
 }
 
-static void BIT_0_A(void)
+static void BIT_0_A(struct gb *gb)
 {
-    BIT(0, _r.a);
-    _r.clk += 4;
+    BIT(gb, 0, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_1_B(void)
+static void BIT_1_B(struct gb *gb)
 {
-    BIT(1, _r.b);
-    _r.clk += 4;
+    BIT(gb, 1, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_1_C(void)
+static void BIT_1_C(struct gb *gb)
 {
-    BIT(1, _r.c);
-    _r.clk += 4;
+    BIT(gb, 1, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_1_D(void)
+static void BIT_1_D(struct gb *gb)
 {
-    BIT(1, _r.d);
-    _r.clk += 4;
+    BIT(gb, 1, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_1_E(void)
+static void BIT_1_E(struct gb *gb)
 {
-    BIT(1, _r.e);
-    _r.clk += 4;
+    BIT(gb, 1, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_1_H(void)
+static void BIT_1_H(struct gb *gb)
 {
-    BIT(1, _r.h);
-    _r.clk += 4;
+    BIT(gb, 1, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_1_L(void)
+static void BIT_1_L(struct gb *gb)
 {
-    BIT(1, _r.l);
-    _r.clk += 4;
+    BIT(gb, 1, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_1_mHL(void)
+static void BIT_1_mHL(struct gb *gb)
 {
-    BIT(1, read_byte(_r.hl));
-    _r.clk += 12;
+    BIT(gb, 1, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 12;
 }
 
-static void BIT_1_A(void)
+static void BIT_1_A(struct gb *gb)
 {
-    BIT(1, _r.a);
-    _r.clk += 4;
+    BIT(gb, 1, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_2_B(void)
+static void BIT_2_B(struct gb *gb)
 {
-    BIT(2, _r.b);
-    _r.clk += 4;
+    BIT(gb, 2, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_2_C(void)
+static void BIT_2_C(struct gb *gb)
 {
-    BIT(2, _r.c);
-    _r.clk += 4;
+    BIT(gb, 2, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_2_D(void)
+static void BIT_2_D(struct gb *gb)
 {
-    BIT(2, _r.d);
-    _r.clk += 4;
+    BIT(gb, 2, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_2_E(void)
+static void BIT_2_E(struct gb *gb)
 {
-    BIT(2, _r.e);
-    _r.clk += 4;
+    BIT(gb, 2, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_2_H(void)
+static void BIT_2_H(struct gb *gb)
 {
-    BIT(2, _r.h);
-    _r.clk += 4;
+    BIT(gb, 2, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_2_L(void)
+static void BIT_2_L(struct gb *gb)
 {
-    BIT(2, _r.l);
-    _r.clk += 4;
+    BIT(gb, 2, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_2_mHL(void)
+static void BIT_2_mHL(struct gb *gb)
 {
-    BIT(2, read_byte(_r.hl));
-    _r.clk += 12;
+    BIT(gb, 2, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 12;
 }
 
-static void BIT_2_A(void)
+static void BIT_2_A(struct gb *gb)
 {
-    BIT(2, _r.a);
-    _r.clk += 4;
+    BIT(gb, 2, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_3_B(void)
+static void BIT_3_B(struct gb *gb)
 {
-    BIT(3, _r.b);
-    _r.clk += 4;
+    BIT(gb, 3, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_3_C(void)
+static void BIT_3_C(struct gb *gb)
 {
-    BIT(3, _r.c);
-    _r.clk += 4;
+    BIT(gb, 3, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_3_D(void)
+static void BIT_3_D(struct gb *gb)
 {
-    BIT(3, _r.d);
-    _r.clk += 4;
+    BIT(gb, 3, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_3_E(void)
+static void BIT_3_E(struct gb *gb)
 {
-    BIT(3, _r.e);
-    _r.clk += 4;
+    BIT(gb, 3, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_3_H(void)
+static void BIT_3_H(struct gb *gb)
 {
-    BIT(3, _r.h);
-    _r.clk += 4;
+    BIT(gb, 3, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_3_L(void)
+static void BIT_3_L(struct gb *gb)
 {
-    BIT(3, _r.l);
-    _r.clk += 4;
+    BIT(gb, 3, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_3_mHL(void)
+static void BIT_3_mHL(struct gb *gb)
 {
-    BIT(3, read_byte(_r.hl));
-    _r.clk += 12;
+    BIT(gb, 3, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 12;
 }
 
-static void BIT_3_A(void)
+static void BIT_3_A(struct gb *gb)
 {
-    BIT(3, _r.a);
-    _r.clk += 4;
+    BIT(gb, 3, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_4_B(void)
+static void BIT_4_B(struct gb *gb)
 {
-    BIT(4, _r.b);
-    _r.clk += 4;
+    BIT(gb, 4, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_4_C(void)
+static void BIT_4_C(struct gb *gb)
 {
-    BIT(4, _r.c);
-    _r.clk += 4;
+    BIT(gb, 4, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_4_D(void)
+static void BIT_4_D(struct gb *gb)
 {
-    BIT(4, _r.d);
-    _r.clk += 4;
+    BIT(gb, 4, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_4_E(void)
+static void BIT_4_E(struct gb *gb)
 {
-    BIT(4, _r.e);
-    _r.clk += 4;
+    BIT(gb, 4, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_4_H(void)
+static void BIT_4_H(struct gb *gb)
 {
-    BIT(4, _r.h);
-    _r.clk += 4;
+    BIT(gb, 4, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_4_L(void)
+static void BIT_4_L(struct gb *gb)
 {
-    BIT(4, _r.l);
-    _r.clk += 4;
+    BIT(gb, 4, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_4_mHL(void)
+static void BIT_4_mHL(struct gb *gb)
 {
-    BIT(4, read_byte(_r.hl));
-    _r.clk += 12;
+    BIT(gb, 4, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 12;
 }
 
-static void BIT_4_A(void)
+static void BIT_4_A(struct gb *gb)
 {
-    BIT(4, _r.a);
-    _r.clk += 4;
+    BIT(gb, 4, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_5_B(void)
+static void BIT_5_B(struct gb *gb)
 {
-    BIT(5, _r.b);
-    _r.clk += 4;
+    BIT(gb, 5, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_5_C(void)
+static void BIT_5_C(struct gb *gb)
 {
-    BIT(5, _r.c);
-    _r.clk += 4;
+    BIT(gb, 5, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_5_D(void)
+static void BIT_5_D(struct gb *gb)
 {
-    BIT(5, _r.d);
-    _r.clk += 4;
+    BIT(gb, 5, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_5_E(void)
+static void BIT_5_E(struct gb *gb)
 {
-    BIT(5, _r.e);
-    _r.clk += 4;
+    BIT(gb, 5, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_5_H(void)
+static void BIT_5_H(struct gb *gb)
 {
-    BIT(5, _r.h);
-    _r.clk += 4;
+    BIT(gb, 5, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_5_L(void)
+static void BIT_5_L(struct gb *gb)
 {
-    BIT(5, _r.l);
-    _r.clk += 4;
+    BIT(gb, 5, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_5_mHL(void)
+static void BIT_5_mHL(struct gb *gb)
 {
-    BIT(5, read_byte(_r.hl));
-    _r.clk += 12;
+    BIT(gb, 5, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 12;
 }
 
-static void BIT_5_A(void)
+static void BIT_5_A(struct gb *gb)
 {
-    BIT(5, _r.a);
-    _r.clk += 4;
+    BIT(gb, 5, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_6_B(void)
+static void BIT_6_B(struct gb *gb)
 {
-    BIT(6, _r.b);
-    _r.clk += 4;
+    BIT(gb, 6, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_6_C(void)
+static void BIT_6_C(struct gb *gb)
 {
-    BIT(6, _r.c);
-    _r.clk += 4;
+    BIT(gb, 6, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_6_D(void)
+static void BIT_6_D(struct gb *gb)
 {
-    BIT(6, _r.d);
-    _r.clk += 4;
+    BIT(gb, 6, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_6_E(void)
+static void BIT_6_E(struct gb *gb)
 {
-    BIT(6, _r.e);
-    _r.clk += 4;
+    BIT(gb, 6, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_6_H(void)
+static void BIT_6_H(struct gb *gb)
 {
-    BIT(6, _r.h);
-    _r.clk += 4;
+    BIT(gb, 6, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_6_L(void)
+static void BIT_6_L(struct gb *gb)
 {
-    BIT(6, _r.l);
-    _r.clk += 4;
+    BIT(gb, 6, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_6_mHL(void)
+static void BIT_6_mHL(struct gb *gb)
 {
-    BIT(6, read_byte(_r.hl));
-    _r.clk += 12;
+    BIT(gb, 6, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 12;
 }
 
-static void BIT_6_A(void)
+static void BIT_6_A(struct gb *gb)
 {
-    BIT(6, _r.a);
-    _r.clk += 4;
+    BIT(gb, 6, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_7_B(void)
+static void BIT_7_B(struct gb *gb)
 {
-    BIT(7, _r.b);
-    _r.clk += 4;
+    BIT(gb, 7, gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_7_C(void)
+static void BIT_7_C(struct gb *gb)
 {
-    BIT(7, _r.c);
-    _r.clk += 4;
+    BIT(gb, 7, gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_7_D(void)
+static void BIT_7_D(struct gb *gb)
 {
-    BIT(7, _r.d);
-    _r.clk += 4;
+    BIT(gb, 7, gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_7_E(void)
+static void BIT_7_E(struct gb *gb)
 {
-    BIT(7, _r.e);
-    _r.clk += 4;
+    BIT(gb, 7, gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_7_H(void)
+static void BIT_7_H(struct gb *gb)
 {
-    BIT(7, _r.h);
-    _r.clk += 4;
+    BIT(gb, 7, gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_7_L(void)
+static void BIT_7_L(struct gb *gb)
 {
-    BIT(7, _r.l);
-    _r.clk += 4;
+    BIT(gb, 7, gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void BIT_7_mHL(void)
+static void BIT_7_mHL(struct gb *gb)
 {
-    BIT(7, read_byte(_r.hl));
-    _r.clk += 12;
+    BIT(gb, 7, read_byte(gb, gb->cpu.r.hl));
+    gb->cpu.r.clk += 12;
 }
 
-static void BIT_7_A(void)
+static void BIT_7_A(struct gb *gb)
 {
-    BIT(7, _r.a);
-    _r.clk += 4;
+    BIT(gb, 7, gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_0_B(void)
+static void RES_0_B(struct gb *gb)
 {
-    RES(0, &_r.b);
-    _r.clk += 4;
+    RES(0, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_0_C(void)
+static void RES_0_C(struct gb *gb)
 {
-    RES(0, &_r.c);
-    _r.clk += 4;
+    RES(0, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_0_D(void)
+static void RES_0_D(struct gb *gb)
 {
-    RES(0, &_r.d);
-    _r.clk += 4;
+    RES(0, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_0_E(void)
+static void RES_0_E(struct gb *gb)
 {
-    RES(0, &_r.e);
-    _r.clk += 4;
+    RES(0, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_0_H(void)
+static void RES_0_H(struct gb *gb)
 {
-    RES(0, &_r.h);
-    _r.clk += 4;
+    RES(0, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_0_L(void)
+static void RES_0_L(struct gb *gb)
 {
-    RES(0, &_r.l);
-    _r.clk += 4;
+    RES(0, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_0_mHL(void)
+static void RES_0_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     RES(0, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void RES_0_A(void)
+static void RES_0_A(struct gb *gb)
 {
-    RES(0, &_r.a);
-    _r.clk += 4;
+    RES(0, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_1_B(void)
+static void RES_1_B(struct gb *gb)
 {
-    RES(1, &_r.b);
-    _r.clk += 4;
+    RES(1, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_1_C(void)
+static void RES_1_C(struct gb *gb)
 {
-    RES(1, &_r.c);
-    _r.clk += 4;
+    RES(1, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_1_D(void)
+static void RES_1_D(struct gb *gb)
 {
-    RES(1, &_r.d);
-    _r.clk += 4;
+    RES(1, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_1_E(void)
+static void RES_1_E(struct gb *gb)
 {
-    RES(1, &_r.e);
-    _r.clk += 4;
+    RES(1, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_1_H(void)
+static void RES_1_H(struct gb *gb)
 {
-    RES(1, &_r.h);
-    _r.clk += 4;
+    RES(1, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_1_L(void)
+static void RES_1_L(struct gb *gb)
 {
-    RES(1, &_r.l);
-    _r.clk += 4;
+    RES(1, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_1_mHL(void)
+static void RES_1_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     RES(1, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void RES_1_A(void)
+static void RES_1_A(struct gb *gb)
 {
-    RES(1, &_r.a);
-    _r.clk += 4;
+    RES(1, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_2_B(void)
+static void RES_2_B(struct gb *gb)
 {
-    RES(2, &_r.b);
-    _r.clk += 4;
+    RES(2, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_2_C(void)
+static void RES_2_C(struct gb *gb)
 {
-    RES(2, &_r.c);
-    _r.clk += 4;
+    RES(2, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_2_D(void)
+static void RES_2_D(struct gb *gb)
 {
-    RES(2, &_r.d);
-    _r.clk += 4;
+    RES(2, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_2_E(void)
+static void RES_2_E(struct gb *gb)
 {
-    RES(2, &_r.e);
-    _r.clk += 4;
+    RES(2, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_2_H(void)
+static void RES_2_H(struct gb *gb)
 {
-    RES(2, &_r.h);
-    _r.clk += 4;
+    RES(2, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_2_L(void)
+static void RES_2_L(struct gb *gb)
 {
-    RES(2, &_r.l);
-    _r.clk += 4;
+    RES(2, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_2_mHL(void)
+static void RES_2_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     RES(2, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void RES_2_A(void)
+static void RES_2_A(struct gb *gb)
 {
-    RES(2, &_r.a);
-    _r.clk += 4;
+    RES(2, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_3_B(void)
+static void RES_3_B(struct gb *gb)
 {
-    RES(3, &_r.b);
-    _r.clk += 4;
+    RES(3, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_3_C(void)
+static void RES_3_C(struct gb *gb)
 {
-    RES(3, &_r.c);
-    _r.clk += 4;
+    RES(3, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_3_D(void)
+static void RES_3_D(struct gb *gb)
 {
-    RES(3, &_r.d);
-    _r.clk += 4;
+    RES(3, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_3_E(void)
+static void RES_3_E(struct gb *gb)
 {
-    RES(3, &_r.e);
-    _r.clk += 4;
+    RES(3, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_3_H(void)
+static void RES_3_H(struct gb *gb)
 {
-    RES(3, &_r.h);
-    _r.clk += 4;
+    RES(3, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_3_L(void)
+static void RES_3_L(struct gb *gb)
 {
-    RES(3, &_r.l);
-    _r.clk += 4;
+    RES(3, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_3_mHL(void)
+static void RES_3_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     RES(3, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void RES_3_A(void)
+static void RES_3_A(struct gb *gb)
 {
-    RES(3, &_r.a);
-    _r.clk += 4;
+    RES(3, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_4_B(void)
+static void RES_4_B(struct gb *gb)
 {
-    RES(4, &_r.b);
-    _r.clk += 4;
+    RES(4, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_4_C(void)
+static void RES_4_C(struct gb *gb)
 {
-    RES(4, &_r.c);
-    _r.clk += 4;
+    RES(4, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_4_D(void)
+static void RES_4_D(struct gb *gb)
 {
-    RES(4, &_r.d);
-    _r.clk += 4;
+    RES(4, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_4_E(void)
+static void RES_4_E(struct gb *gb)
 {
-    RES(4, &_r.e);
-    _r.clk += 4;
+    RES(4, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_4_H(void)
+static void RES_4_H(struct gb *gb)
 {
-    RES(4, &_r.h);
-    _r.clk += 4;
+    RES(4, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_4_L(void)
+static void RES_4_L(struct gb *gb)
 {
-    RES(4, &_r.l);
-    _r.clk += 4;
+    RES(4, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_4_mHL(void)
+static void RES_4_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     RES(4, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void RES_4_A(void)
+static void RES_4_A(struct gb *gb)
 {
-    RES(4, &_r.a);
-    _r.clk += 4;
+    RES(4, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_5_B(void)
+static void RES_5_B(struct gb *gb)
 {
-    RES(5, &_r.b);
-    _r.clk += 4;
+    RES(5, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_5_C(void)
+static void RES_5_C(struct gb *gb)
 {
-    RES(5, &_r.c);
-    _r.clk += 4;
+    RES(5, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_5_D(void)
+static void RES_5_D(struct gb *gb)
 {
-    RES(5, &_r.d);
-    _r.clk += 4;
+    RES(5, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_5_E(void)
+static void RES_5_E(struct gb *gb)
 {
-    RES(5, &_r.e);
-    _r.clk += 4;
+    RES(5, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_5_H(void)
+static void RES_5_H(struct gb *gb)
 {
-    RES(5, &_r.h);
-    _r.clk += 4;
+    RES(5, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_5_L(void)
+static void RES_5_L(struct gb *gb)
 {
-    RES(5, &_r.l);
-    _r.clk += 4;
+    RES(5, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_5_mHL(void)
+static void RES_5_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     RES(5, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void RES_5_A(void)
+static void RES_5_A(struct gb *gb)
 {
-    RES(5, &_r.a);
-    _r.clk += 4;
+    RES(5, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_6_B(void)
+static void RES_6_B(struct gb *gb)
 {
-    RES(6, &_r.b);
-    _r.clk += 4;
+    RES(6, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_6_C(void)
+static void RES_6_C(struct gb *gb)
 {
-    RES(6, &_r.c);
-    _r.clk += 4;
+    RES(6, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_6_D(void)
+static void RES_6_D(struct gb *gb)
 {
-    RES(6, &_r.d);
-    _r.clk += 4;
+    RES(6, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_6_E(void)
+static void RES_6_E(struct gb *gb)
 {
-    RES(6, &_r.e);
-    _r.clk += 4;
+    RES(6, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_6_H(void)
+static void RES_6_H(struct gb *gb)
 {
-    RES(6, &_r.h);
-    _r.clk += 4;
+    RES(6, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_6_L(void)
+static void RES_6_L(struct gb *gb)
 {
-    RES(6, &_r.l);
-    _r.clk += 4;
+    RES(6, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_6_mHL(void)
+static void RES_6_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     RES(6, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void RES_6_A(void)
+static void RES_6_A(struct gb *gb)
 {
-    RES(6, &_r.a);
-    _r.clk += 4;
+    RES(6, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_7_B(void)
+static void RES_7_B(struct gb *gb)
 {
-    RES(7, &_r.b);
-    _r.clk += 4;
+    RES(7, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_7_C(void)
+static void RES_7_C(struct gb *gb)
 {
-    RES(7, &_r.c);
-    _r.clk += 4;
+    RES(7, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_7_D(void)
+static void RES_7_D(struct gb *gb)
 {
-    RES(7, &_r.d);
-    _r.clk += 4;
+    RES(7, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_7_E(void)
+static void RES_7_E(struct gb *gb)
 {
-    RES(7, &_r.e);
-    _r.clk += 4;
+    RES(7, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_7_H(void)
+static void RES_7_H(struct gb *gb)
 {
-    RES(7, &_r.h);
-    _r.clk += 4;
+    RES(7, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_7_L(void)
+static void RES_7_L(struct gb *gb)
 {
-    RES(7, &_r.l);
-    _r.clk += 4;
+    RES(7, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void RES_7_mHL(void)
+static void RES_7_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     RES(7, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void RES_7_A(void)
+static void RES_7_A(struct gb *gb)
 {
-    RES(7, &_r.a);
-    _r.clk += 4;
+    RES(7, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_0_B(void)
+static void SET_0_B(struct gb *gb)
 {
-    SET(0, &_r.b);
-    _r.clk += 4;
+    SET(0, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_0_C(void)
+static void SET_0_C(struct gb *gb)
 {
-    SET(0, &_r.c);
-    _r.clk += 4;
+    SET(0, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_0_D(void)
+static void SET_0_D(struct gb *gb)
 {
-    SET(0, &_r.d);
-    _r.clk += 4;
+    SET(0, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_0_E(void)
+static void SET_0_E(struct gb *gb)
 {
-    SET(0, &_r.e);
-    _r.clk += 4;
+    SET(0, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_0_H(void)
+static void SET_0_H(struct gb *gb)
 {
-    SET(0, &_r.h);
-    _r.clk += 4;
+    SET(0, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_0_L(void)
+static void SET_0_L(struct gb *gb)
 {
-    SET(0, &_r.l);
-    _r.clk += 4;
+    SET(0, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_0_mHL(void)
+static void SET_0_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     SET(0, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void SET_0_A(void)
+static void SET_0_A(struct gb *gb)
 {
-    SET(0, &_r.a);
-    _r.clk += 4;
+    SET(0, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_1_B(void)
+static void SET_1_B(struct gb *gb)
 {
-    SET(1, &_r.b);
-    _r.clk += 4;
+    SET(1, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_1_C(void)
+static void SET_1_C(struct gb *gb)
 {
-    SET(1, &_r.c);
-    _r.clk += 4;
+    SET(1, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_1_D(void)
+static void SET_1_D(struct gb *gb)
 {
-    SET(1, &_r.d);
-    _r.clk += 4;
+    SET(1, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_1_E(void)
+static void SET_1_E(struct gb *gb)
 {
-    SET(1, &_r.e);
-    _r.clk += 4;
+    SET(1, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_1_H(void)
+static void SET_1_H(struct gb *gb)
 {
-    SET(1, &_r.h);
-    _r.clk += 4;
+    SET(1, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_1_L(void)
+static void SET_1_L(struct gb *gb)
 {
-    SET(1, &_r.l);
-    _r.clk += 4;
+    SET(1, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_1_mHL(void)
+static void SET_1_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     SET(1, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void SET_1_A(void)
+static void SET_1_A(struct gb *gb)
 {
-    SET(1, &_r.a);
-    _r.clk += 4;
+    SET(1, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_2_B(void)
+static void SET_2_B(struct gb *gb)
 {
-    SET(2, &_r.b);
-    _r.clk += 4;
+    SET(2, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_2_C(void)
+static void SET_2_C(struct gb *gb)
 {
-    SET(2, &_r.c);
-    _r.clk += 4;
+    SET(2, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_2_D(void)
+static void SET_2_D(struct gb *gb)
 {
-    SET(2, &_r.d);
-    _r.clk += 4;
+    SET(2, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_2_E(void)
+static void SET_2_E(struct gb *gb)
 {
-    SET(2, &_r.e);
-    _r.clk += 4;
+    SET(2, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_2_H(void)
+static void SET_2_H(struct gb *gb)
 {
-    SET(2, &_r.h);
-    _r.clk += 4;
+    SET(2, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_2_L(void)
+static void SET_2_L(struct gb *gb)
 {
-    SET(2, &_r.l);
-    _r.clk += 4;
+    SET(2, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_2_mHL(void)
+static void SET_2_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     SET(2, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void SET_2_A(void)
+static void SET_2_A(struct gb *gb)
 {
-    SET(2, &_r.a);
-    _r.clk += 4;
+    SET(2, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_3_B(void)
+static void SET_3_B(struct gb *gb)
 {
-    SET(3, &_r.b);
-    _r.clk += 4;
+    SET(3, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_3_C(void)
+static void SET_3_C(struct gb *gb)
 {
-    SET(3, &_r.c);
-    _r.clk += 4;
+    SET(3, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_3_D(void)
+static void SET_3_D(struct gb *gb)
 {
-    SET(3, &_r.d);
-    _r.clk += 4;
+    SET(3, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_3_E(void)
+static void SET_3_E(struct gb *gb)
 {
-    SET(3, &_r.e);
-    _r.clk += 4;
+    SET(3, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_3_H(void)
+static void SET_3_H(struct gb *gb)
 {
-    SET(3, &_r.h);
-    _r.clk += 4;
+    SET(3, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_3_L(void)
+static void SET_3_L(struct gb *gb)
 {
-    SET(3, &_r.l);
-    _r.clk += 4;
+    SET(3, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_3_mHL(void)
+static void SET_3_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     SET(3, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void SET_3_A(void)
+static void SET_3_A(struct gb *gb)
 {
-    SET(3, &_r.a);
-    _r.clk += 4;
+    SET(3, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_4_B(void)
+static void SET_4_B(struct gb *gb)
 {
-    SET(4, &_r.b);
-    _r.clk += 4;
+    SET(4, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_4_C(void)
+static void SET_4_C(struct gb *gb)
 {
-    SET(4, &_r.c);
-    _r.clk += 4;
+    SET(4, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_4_D(void)
+static void SET_4_D(struct gb *gb)
 {
-    SET(4, &_r.d);
-    _r.clk += 4;
+    SET(4, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_4_E(void)
+static void SET_4_E(struct gb *gb)
 {
-    SET(4, &_r.e);
-    _r.clk += 4;
+    SET(4, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_4_H(void)
+static void SET_4_H(struct gb *gb)
 {
-    SET(4, &_r.h);
-    _r.clk += 4;
+    SET(4, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_4_L(void)
+static void SET_4_L(struct gb *gb)
 {
-    SET(4, &_r.l);
-    _r.clk += 4;
+    SET(4, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_4_mHL(void)
+static void SET_4_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     SET(4, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void SET_4_A(void)
+static void SET_4_A(struct gb *gb)
 {
-    SET(4, &_r.a);
-    _r.clk += 4;
+    SET(4, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_5_B(void)
+static void SET_5_B(struct gb *gb)
 {
-    SET(5, &_r.b);
-    _r.clk += 4;
+    SET(5, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_5_C(void)
+static void SET_5_C(struct gb *gb)
 {
-    SET(5, &_r.c);
-    _r.clk += 4;
+    SET(5, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_5_D(void)
+static void SET_5_D(struct gb *gb)
 {
-    SET(5, &_r.d);
-    _r.clk += 4;
+    SET(5, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_5_E(void)
+static void SET_5_E(struct gb *gb)
 {
-    SET(5, &_r.e);
-    _r.clk += 4;
+    SET(5, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_5_H(void)
+static void SET_5_H(struct gb *gb)
 {
-    SET(5, &_r.h);
-    _r.clk += 4;
+    SET(5, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_5_L(void)
+static void SET_5_L(struct gb *gb)
 {
-    SET(5, &_r.l);
-    _r.clk += 4;
+    SET(5, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_5_mHL(void)
+static void SET_5_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     SET(5, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void SET_5_A(void)
+static void SET_5_A(struct gb *gb)
 {
-    SET(5, &_r.a);
-    _r.clk += 4;
+    SET(5, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_6_B(void)
+static void SET_6_B(struct gb *gb)
 {
-    SET(6, &_r.b);
-    _r.clk += 4;
+    SET(6, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_6_C(void)
+static void SET_6_C(struct gb *gb)
 {
-    SET(6, &_r.c);
-    _r.clk += 4;
+    SET(6, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_6_D(void)
+static void SET_6_D(struct gb *gb)
 {
-    SET(6, &_r.d);
-    _r.clk += 4;
+    SET(6, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_6_E(void)
+static void SET_6_E(struct gb *gb)
 {
-    SET(6, &_r.e);
-    _r.clk += 4;
+    SET(6, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_6_H(void)
+static void SET_6_H(struct gb *gb)
 {
-    SET(6, &_r.h);
-    _r.clk += 4;
+    SET(6, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_6_L(void)
+static void SET_6_L(struct gb *gb)
 {
-    SET(6, &_r.l);
-    _r.clk += 4;
+    SET(6, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_6_mHL(void)
+static void SET_6_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     SET(6, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void SET_6_A(void)
+static void SET_6_A(struct gb *gb)
 {
-    SET(6, &_r.a);
-    _r.clk += 4;
+    SET(6, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_7_B(void)
+static void SET_7_B(struct gb *gb)
 {
-    SET(7, &_r.b);
-    _r.clk += 4;
+    SET(7, &gb->cpu.r.b);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_7_C(void)
+static void SET_7_C(struct gb *gb)
 {
-    SET(7, &_r.c);
-    _r.clk += 4;
+    SET(7, &gb->cpu.r.c);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_7_D(void)
+static void SET_7_D(struct gb *gb)
 {
-    SET(7, &_r.d);
-    _r.clk += 4;
+    SET(7, &gb->cpu.r.d);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_7_E(void)
+static void SET_7_E(struct gb *gb)
 {
-    SET(7, &_r.e);
-    _r.clk += 4;
+    SET(7, &gb->cpu.r.e);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_7_H(void)
+static void SET_7_H(struct gb *gb)
 {
-    SET(7, &_r.h);
-    _r.clk += 4;
+    SET(7, &gb->cpu.r.h);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_7_L(void)
+static void SET_7_L(struct gb *gb)
 {
-    SET(7, &_r.l);
-    _r.clk += 4;
+    SET(7, &gb->cpu.r.l);
+    gb->cpu.r.clk += 4;
 }
 
-static void SET_7_mHL(void)
+static void SET_7_mHL(struct gb *gb)
 {
-    uint8_t mHL = read_byte(_r.hl);
+    uint8_t mHL = read_byte(gb, gb->cpu.r.hl);
     SET(7, &mHL);
-    write_byte(_r.hl, mHL);
-    _r.clk += 12;
+    write_byte(gb, gb->cpu.r.hl, mHL);
+    gb->cpu.r.clk += 12;
 }
 
-static void SET_7_A(void)
+static void SET_7_A(struct gb *gb)
 {
-    SET(7, &_r.a);
-    _r.clk += 4;
+    SET(7, &gb->cpu.r.a);
+    gb->cpu.r.clk += 4;
 }
 
-static instruction _cb_map[NUM_OPCODES] = {
+static const instruction _cb_map[NUM_OPCODES] = {
 /*      x0       x1       x2       x3       x4       x5       x6         x7       x8       x9       xA       xB       xC       xD       xE         xF       */
 /* 0x */RLC_B,   RLC_C,   RLC_D,   RLC_E,   RLC_H,   RLC_L,   RLC_mHL,   RLC_A,   RRC_B,   RRC_C,   RRC_D,   RRC_E,   RRC_H,   RRC_L,   RRC_mHL,   RRC_A,
 /* 1x */RL_B,    RL_C,    RL_D,    RL_E,    RL_H,    RL_L,    RL_mHL,    RL_A,    RR_B,    RR_C,    RR_D,    RR_E,    RR_H,    RR_L,    RR_mHL,    RR_A,
@@ -3549,13 +3910,106 @@ static instruction _cb_map[NUM_OPCODES] = {
 /* Fx */SET_6_B, SET_6_C, SET_6_D, SET_6_E, SET_6_H, SET_6_L, SET_6_mHL, SET_6_A, SET_7_B, SET_7_C, SET_7_D, SET_7_E, SET_7_H, SET_7_L, SET_7_mHL, SET_7_A,
 };
 
-static void PREFIX_CB(void)
+static void PREFIX_CB(struct gb *gb)
 {
-    _cb_map[read_byte(_r.pc++)]();
-    _r.clk += 4;
+    _cb_map[OPERAND8](gb);
+    gb->cpu.r.clk += 4;
 }
 
-static instruction _map[NUM_OPCODES] = {
+/*
+ * Fused instructions: common sequences that the predecoder gives one handler,
+ * so they are dispatched once. Every instruction keeps its own entry in the
+ * block, and the handler stops after any instruction that needs the generic
+ * instruction boundary in step(), which then carries on with the next
+ * entry by itself.
+ */
+
+/**
+ * Step the program counter over the next instruction of the block and latch
+ * its operand, like fetch() does.
+ *
+ * @param gb
+ * @return The instruction
+ */
+static inline const struct decoded *advance(struct gb *gb)
+{
+    const struct decoded *op = gb->cpu.next_op;
+
+    gb->cpu.next_op = op + 1;
+    gb->cpu.r.pc += op->length;
+    gb->cpu.operand = op->operand;
+    return op;
+}
+
+/**
+ * Step over the next instruction of a fused sequence, unless the block was
+ * left, there is an EI, DI or interrupt to finish, or the deadline or the
+ * next event has been reached.
+ *
+ * @param gb
+ * @return false if step() has to take over
+ */
+static inline bool fused_next(struct gb *gb)
+{
+    if(!gb->cpu.next_op->length || gb->cpu.DI_pending || gb->cpu.EI_pending || (gb->cpu.IE & gb->cpu.IF) ||
+            gb->cpu.r.clk >= gb->cpu.run_end || gb->cpu.r.clk >= gb->scheduler.next) {
+        return false;
+    }
+    advance(gb);
+    return true;
+}
+
+// Handler a_b (a_b_c) running the instructions in turn, named after their handlers
+#define FUSE2(a, b)                                                                 \
+    static void a##_##b(struct gb *gb)                                              \
+    {                                                                               \
+        a(gb);                                                                      \
+        if(fused_next(gb)) {                                                        \
+            b(gb);                                                                  \
+        }                                                                           \
+    }
+
+#define FUSE3(a, b, c)                                                              \
+    static void a##_##b##_##c(struct gb *gb)                                        \
+    {                                                                               \
+        a(gb);                                                                      \
+        if(fused_next(gb)) {                                                        \
+            b(gb);                                                                  \
+            if(fused_next(gb)) {                                                    \
+                c(gb);                                                              \
+            }                                                                       \
+        }                                                                           \
+    }
+
+// DEC r; JR NZ,r8
+FUSE2(DEC_B, JR_NZ_r8)
+FUSE2(DEC_C, JR_NZ_r8)
+FUSE2(DEC_D, JR_NZ_r8)
+FUSE2(DEC_E, JR_NZ_r8)
+FUSE2(DEC_H, JR_NZ_r8)
+FUSE2(DEC_L, JR_NZ_r8)
+FUSE2(DEC_mHL, JR_NZ_r8)
+FUSE2(DEC_A, JR_NZ_r8)
+
+// LDH A,(a8); CP d8, polling a register, and the jump on its outcome
+FUSE2(LDH_A_m8, CP_d8)
+FUSE3(LDH_A_m8, CP_d8, JR_NZ_r8)
+FUSE3(LDH_A_m8, CP_d8, JR_Z_r8)
+FUSE3(LDH_A_m8, CP_d8, JR_NC_r8)
+FUSE3(LDH_A_m8, CP_d8, JR_C_r8)
+
+// LDI A,(HL); LD (DE),A; INC DE, the body of a copy loop
+FUSE3(LDI_A_mHL, LD_mDE_A, INC_DE)
+
+// Indices of the fused handlers in _map
+#define FUSED_DEC_JR_NZ     (NUM_OPCODES + 0x00)    // By register, like the DEC opcodes
+#define FUSED_LDH_CP        (NUM_OPCODES + 0x08)
+#define FUSED_LDH_CP_JR     (NUM_OPCODES + 0x09)    // By condition, like the JR opcodes
+#define FUSED_COPY          (NUM_OPCODES + 0x0D)
+#define NUM_FUSED           0x0E
+
+// Handlers by opcode, followed by the fused handlers
+static const instruction _map[NUM_OPCODES + NUM_FUSED] = {
 /*      x0        x1         x2         x3        x4           x5        x6         x7        x8          x9         xA         xB         xC          xD        xE        xF     */
 /* 0x */NOP,      LD_BC_d16, LD_mBC_A,  INC_BC,   INC_B,       DEC_B,    LD_B_d8,   RLCA,     LD_m16_SP,  ADD_HL_BC, LD_A_mBC,  DEC_BC,    INC_C,      DEC_C,    LD_C_d8,  RRCA,
 /* 1x */STOP,     LD_DE_d16, LD_mDE_A,  INC_DE,   INC_D,       DEC_D,    LD_D_d8,   RLA,      JR_r8,      ADD_HL_DE, LD_A_mDE,  DEC_DE,    INC_E,      DEC_E,    LD_E_d8,  RRA,
@@ -3572,85 +4026,516 @@ static instruction _map[NUM_OPCODES] = {
 /* Cx */RET_NZ,   POP_BC,    JP_NZ_a16, JP_a16,   CALL_NZ_a16, PUSH_BC,  ADD_d8,    RST00,    RET_Z,      RET,       JP_Z_a16,  PREFIX_CB, CALL_Z_a16, CALL_d16, ADC_d8,   RST08,
 /* Dx */RET_NC,   POP_DE,    JP_NC_a16, XX,       CALL_NC_a16, PUSH_DE,  SUB_d8,    RST10,    RET_C,      RETI,      JP_C_a16,  XX,        CALL_C_a16, XX,       SBC_d8,   RST18,
 /* Ex */LDH_m8_A, POP_HL,    LD_mC_A,   XX,       XX,          PUSH_HL,  AND_d8,    RST20,    ADD_SP_r8,  JP_mHL,    LD_m16_A,  XX,        XX,         XX,       XOR_d8,   RST28,
-/* Fx */LDH_A_m8, POP_AF,    LD_A_mC,   DI,       XX,          PUSH_AF,  OR_d8,     RST30,    LDHL_SP_r8, LD_SP_HL,  LD_A_m16,  EI,        XX,         XX,       CP_d8,    RST38
+/* Fx */LDH_A_m8, POP_AF,    LD_A_mC,   DI,       XX,          PUSH_AF,  OR_d8,     RST30,    LDHL_SP_r8, LD_SP_HL,  LD_A_m16,  EI,        XX,         XX,       CP_d8,    RST38,
+/* fused */
+        DEC_B_JR_NZ_r8, DEC_C_JR_NZ_r8, DEC_D_JR_NZ_r8, DEC_E_JR_NZ_r8,
+        DEC_H_JR_NZ_r8, DEC_L_JR_NZ_r8, DEC_mHL_JR_NZ_r8, DEC_A_JR_NZ_r8,
+        LDH_A_m8_CP_d8, LDH_A_m8_CP_d8_JR_NZ_r8, LDH_A_m8_CP_d8_JR_Z_r8, LDH_A_m8_CP_d8_JR_NC_r8, LDH_A_m8_CP_d8_JR_C_r8,
+        LDI_A_mHL_LD_mDE_A_INC_DE
+};
+
+/*
+ * Predecoded code
+ */
+
+static const uint8_t _length[NUM_OPCODES] = {
+/*      x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 xA xB xC xD xE xF */
+/* 0x */1, 3, 1, 1, 1, 1, 2, 1, 3, 1, 1, 1, 1, 1, 2, 1,
+/* 1x */2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+/* 2x */2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+/* 3x */2, 3, 1, 1, 1, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 1,
+/* 4x */1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+/* 5x */1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+/* 6x */1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+/* 7x */1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+/* 8x */1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+/* 9x */1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+/* Ax */1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+/* Bx */1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+/* Cx */1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,
+/* Dx */1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 1, 2, 1,
+/* Ex */2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1,
+/* Fx */2, 1, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1, 1, 2, 1
+};
+
+// Length 0 sends the next fetch to lookup()
+static const struct decoded _no_block = {0};
+
+// Jumps, calls, returns, HALT, STOP and invalid opcodes end a block
+static const bool _ends_block[NUM_OPCODES] = {
+/*      x0 x1 x2 x3 x4 x5 x6 x7 x8 x9 xA xB xC xD xE xF */
+/* 0x */0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+/* 1x */1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
+/* 2x */1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
+/* 3x */1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
+/* 4x */0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+/* 5x */0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+/* 6x */0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+/* 7x */0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+/* 8x */0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+/* 9x */0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+/* Ax */0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+/* Bx */0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+/* Cx */1, 0, 1, 1, 1, 0, 0, 1, 1, 1, 1, 0, 1, 1, 0, 1,
+/* Dx */1, 0, 1, 1, 1, 0, 0, 1, 1, 1, 1, 1, 1, 1, 0, 1,
+/* Ex */0, 0, 0, 1, 1, 0, 0, 1, 0, 1, 0, 1, 1, 1, 0, 1,
+/* Fx */0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 1, 1, 0, 1
 };
 
-void interrupt(enum int_src src)
+/**
+ * Read the instruction at pc and its operand.
+ *
+ * @param gb
+ * @param pc
+ * @param op
+ */
+static void decode(struct gb *gb, uint16_t pc, struct decoded *op)
+{
+    op->pc = pc;
+    op->opcode = read_byte(gb, pc);
+    op->length = _length[op->opcode];
+    op->handler = op->opcode;
+    if(op->length == 3) {
+        op->operand = read_word(gb, (uint16_t) (pc + 1));
+    } else if(op->length == 2) {
+        op->operand = read_byte(gb, (uint16_t) (pc + 1));
+    } else {
+        op->operand = 0;
+    }
+}
+
+/**
+ * Whether the instruction at pc lies within the page.
+ *
+ * @param page
+ * @param pc
+ * @return
+ */
+static inline bool in_page(const uint8_t *page, uint16_t pc)
+{
+    return (pc & 0xFF) + _length[page[pc & 0xFF]] <= _PAGE_SIZE;
+}
+
+/**
+ * Give the instructions of a block that start one of the fused sequences its
+ * handler. The whole sequence has to lie within the block.
+ *
+ * @param block
+ */
+static void fuse(struct block *block)
+{
+    for(struct decoded *op = block->ops; op[0].length && op[1].length; op++) {
+        if((op->opcode & 0xC7) == 0x05 && op[1].opcode == 0x20) {
+            op->handler = (uint16_t) (FUSED_DEC_JR_NZ + (op->opcode >> 3));
+        } else if(op->opcode == 0xF0 && op[1].opcode == 0xFE) {
+            if(op[2].length && (op[2].opcode & 0xE7) == 0x20) {
+                op->handler = (uint16_t) (FUSED_LDH_CP_JR + ((op[2].opcode >> 3) & 3));
+            } else {
+                op->handler = FUSED_LDH_CP;
+            }
+        } else if(op->opcode == 0x2A && op[1].opcode == 0x12 && op[2].length && op[2].opcode == 0x13) {
+            op->handler = FUSED_COPY;
+        }
+    }
+}
+
+/**
+ * Find or decode the block starting at the program counter. ROM blocks are
+ * cached by the host page they were read from, so a bank switch simply
+ * misses. Code in RAM, and instructions straddling two pages, are decoded
+ * again every time they run.
+ *
+ * @param gb
+ * @return
+ */
+static struct block *lookup(struct gb *gb)
+{
+    uint16_t pc = gb->cpu.r.pc;
+    const uint8_t *page = gb->mmu.read_page[pc >> 8];
+    struct block *block = &gb->cpu.blocks[((uintptr_t) page / _PAGE_SIZE * 31 + pc) % BLOCK_CACHE_SIZE];
+
+    if(page == NULL || pc >= _VRAM_OFFSET) {
+        block = &gb->cpu.scratch;
+    } else if(block->page != page || block->pc != pc) {
+        if(in_page(page, pc)) {
+            int n = 0;
+            block->page = page;
+            block->pc = pc;
+            block->entries = 0;
+            block->code = NULL;
+            do {
+                decode(gb, pc, &block->ops[n]);
+                pc += block->ops[n].length;
+            } while(!_ends_block[block->ops[n++].opcode] && n < BLOCK_MAX_SIZE &&
+                    (pc >> 8) == (block->pc >> 8) && in_page(page, pc));
+            block->ops[n].length = 0;
+            fuse(block);
+        } else {
+            block = &gb->cpu.scratch;
+        }
+    }
+
+    if(block == &gb->cpu.scratch) {
+        block->page = page;
+        block->pc = pc;
+        decode(gb, pc, &block->ops[0]);
+        block->ops[1].length = 0;
+    }
+
+    return block;
+}
+
+/**
+ * Step the program counter over the next instruction and latch its operand.
+ *
+ * @param gb
+ * @return The instruction
+ */
+static inline const struct decoded *fetch(struct gb *gb)
+{
+    const struct decoded *op = gb->cpu.next_op;
+
+    // Jumps, interrupts and the end of the block leave it
+    if(!op->length || op->pc != gb->cpu.r.pc) {
+        gb->cpu.next_op = lookup(gb)->ops;
+    }
+
+    return advance(gb);
+}
+
+void cpu_leave_block(struct gb *gb)
+{
+    gb->cpu.next_op = &_no_block;
+}
+
+void cpu_flush_code(struct gb *gb)
+{
+    for(int i = 0; i < BLOCK_CACHE_SIZE; i++) {
+        gb->cpu.blocks[i].page = NULL;
+    }
+    jit_reset(gb);
+    cpu_leave_block(gb);
+}
+
+void interrupt(struct gb *gb, enum int_src src)
 {
-    _IF |= src;
+    gb->cpu.IF |= src;
     if(src == BUTTON_PRESSED) {
-        _STOP = false;
+        gb->cpu.STOP = false;
     }
 }
 
-static inline void interrupt_check(void)
+static inline void interrupt_check(struct gb *gb)
 {
-    uint8_t interrupt = _IE & _IF;
-    if(_IME && interrupt) {
-        _IME = false;
-        _HALT = false;
+    uint8_t interrupt = gb->cpu.IE & gb->cpu.IF;
+    if(interrupt) {
+        // A pending interrupt ends HALT, also when it is not serviced
+        gb->cpu.HALT = false;
+    }
+    if(gb->cpu.IME && interrupt) {
+        gb->cpu.IME = false;
+        gb->cpu.HALT = false;
+        gb->cpu.idle_since = gb->cpu.r.clk;
 
         if(interrupt & VBLANK) {
-            _IF &= ~VBLANK;
-            RST(0x40);
+            gb->cpu.IF &= ~VBLANK;
+            RST(gb, 0x40);
         } else if (interrupt & LCDC) {
-            _IF &= ~LCDC;
-            RST(0x48);
+            gb->cpu.IF &= ~LCDC;
+            RST(gb, 0x48);
         } else if(interrupt & TIMER_OVERFLOW) {
-            _IF &= ~TIMER_OVERFLOW;
-            RST(0x50);
+            gb->cpu.IF &= ~TIMER_OVERFLOW;
+            RST(gb, 0x50);
         } else if(interrupt & SERIAL_TRANSFER) {
-            _IF &= ~SERIAL_TRANSFER;
-            RST(0x58);
+            gb->cpu.IF &= ~SERIAL_TRANSFER;
+            RST(gb, 0x58);
         } else if(interrupt & BUTTON_PRESSED) {
-            _IF &= ~BUTTON_PRESSED;
-            RST(0x60);
+            gb->cpu.IF &= ~BUTTON_PRESSED;
+            RST(gb, 0x60);
         }
     }
 }
 
-void dispatch(void)
+/**
+ * Execute a single instruction, or a fused sequence, and finish the
+ * instruction boundary: interrupts and a pending EI or DI. Inlined into the
+ * cpu_run() loop.
+ *
+ * @param gb
+ */
+static inline void step(struct gb *gb)
 {
-    if(!_STOP) {
-        bool _local_di = _DI_pending;
-        bool _local_ei = _EI_pending;
+    if(!gb->cpu.STOP) {
+        bool _local_di = gb->cpu.DI_pending;
+        bool _local_ei = gb->cpu.EI_pending;
 
-        if(_HALT) {
-            NOP();
+        if(gb->cpu.HALT) {
+            NOP(gb);
         } else {
-            _map[read_byte(_r.pc++)]();
+            _map[fetch(gb)->handler](gb);
         }
 
-        interrupt_check();
+        interrupt_check(gb);
 
         if(_local_di) {
-            _IME = false;
-            _DI_pending = false;
+            gb->cpu.IME = false;
+            gb->cpu.DI_pending = false;
         }
         if(_local_ei) {
-            _IME = true;
-            _EI_pending = false;
+            gb->cpu.IME = true;
+            gb->cpu.EI_pending = false;
         }
+    } else {
+        // Keep the clock running so pending deadlines are still reached
+        gb->cpu.r.clk += 4;
     }
 }
 
-void cpu_reset(void)
+/**
+ * Move the clock of a CPU that is halted or stopped, and can not wake up
+ * before the next event, up to that event or the deadline.
+ *
+ * @param gb
+ * @param deadline
+ * @return false if the CPU is running
+ */
+static inline bool idle_skip(struct gb *gb, uint64_t deadline)
 {
-    _r.af = 0x0000;
-    _r.bc = 0x0000;
-    _r.de = 0x0000;
-    _r.hl = 0x0000;
-    _r.pc = 0x0000;
-    _r.sp = 0xFFFE;
-    _r.clk = 0;
+    if(!gb->cpu.STOP && !(gb->cpu.HALT && !(gb->cpu.IE & gb->cpu.IF))) {
+        return false;
+    }
+
+    // Idle in whole machine cycles, like the NOPs step() would run
+    uint64_t end = (gb->scheduler.next < deadline ? gb->scheduler.next : deadline);
+    gb->cpu.r.clk += (end - gb->cpu.r.clk + 3) & ~(uint64_t) 3;
+    return true;
+}
+
+#if defined(NEC_THREADED_CORE)
+
+/*
+ * Threaded core: every handler is inlined into execute(), which jumps from
+ * one instruction straight to the next through a table of label addresses
+ * (GCC, Clang) or a switch. Indices NUM_OPCODES and up are the CB opcodes.
+ */
+
+#if defined(__GNUC__)
+#define CORE_OP_ADDRESS(h, l)   &&op_##h##l,
+#define CORE_CB_ADDRESS(h, l)   &&cb_##h##l,
+#define CORE_OP_TARGET(h, l)    op_##h##l:
+#define CORE_CB_TARGET(h, l)    cb_##h##l:
+#define CORE_DISPATCH(index)    goto *_targets[index]
+#else
+#define CORE_OP_TARGET(h, l)    case 0x##h##l:
+#define CORE_CB_TARGET(h, l)    case NUM_OPCODES + 0x##h##l:
+#define CORE_DISPATCH(index)    do { _index = (index); goto dispatch; } while(0)
+#endif
+
+/*
+ * The block hit test of fetch(), inline at every dispatch so that the next
+ * instruction of a block is reached without a call. A miss goes to lookup().
+ */
+#define CORE_FETCH                                                                                      \
+    if(!gb->cpu.next_op->length || gb->cpu.next_op->pc != gb->cpu.r.pc) {                              \
+        goto miss;                                                                                      \
+    }                                                                                                   \
+    CORE_DISPATCH(advance(gb)->opcode);
+
+// Anything that needs the generic instruction boundary takes the slow path
+#define CORE_NEXT                                                                                       \
+    if(_local_di || _local_ei || gb->cpu.DI_pending || gb->cpu.EI_pending || gb->cpu.HALT || gb->cpu.STOP || \
+            (gb->cpu.IE & gb->cpu.IF) || gb->cpu.r.clk >= deadline || gb->cpu.r.clk >= gb->scheduler.next) { \
+        goto slow;                                                                                      \
+    }                                                                                                   \
+    CORE_FETCH
+
+#define CORE_OP(h, l)                                                                                   \
+    CORE_OP_TARGET(h, l)                                                                                \
+        if(0x##h##l == 0xCB) {                                                                          \
+            CORE_DISPATCH(NUM_OPCODES + OPERAND8);                                                      \
+        }                                                                                               \
+        _map[0x##h##l](gb);                                                                             \
+        CORE_NEXT
+
+#define CORE_CB(h, l)                                                                                   \
+    CORE_CB_TARGET(h, l)                                                                                \
+        _cb_map[0x##h##l](gb);                                                                          \
+        gb->cpu.r.clk += 4;                                                                             \
+        CORE_NEXT
+
+/**
+ * Execute instructions like step() does, until the deadline or the next
+ * event.
+ *
+ * @param gb
+ * @param deadline
+ */
+static void execute(struct gb *gb, uint64_t deadline)
+{
+#if defined(__GNUC__)
+    static const void *const _targets[2 * NUM_OPCODES] = {
+        OPCODE_GRID(CORE_OP_ADDRESS)
+        OPCODE_GRID(CORE_CB_ADDRESS)
+    };
+#else
+    unsigned int _index;
+#endif
+    bool _local_di = false;
+    bool _local_ei = false;
+    goto boundary;
+
+slow:
+    interrupt_check(gb);
+    if(_local_di) {
+        gb->cpu.IME = false;
+        gb->cpu.DI_pending = false;
+    }
+    if(_local_ei) {
+        gb->cpu.IME = true;
+        gb->cpu.EI_pending = false;
+    }
+
+boundary:
+    if(gb->cpu.r.clk >= deadline || gb->cpu.r.clk >= gb->scheduler.next || idle_skip(gb, deadline)) {
+        return;
+    }
+    _local_di = gb->cpu.DI_pending;
+    _local_ei = gb->cpu.EI_pending;
+    if(gb->cpu.HALT) {
+        NOP(gb);
+        goto slow;
+    }
+    CORE_FETCH
+
+miss:
+    gb->cpu.next_op = lookup(gb)->ops;
+    CORE_DISPATCH(advance(gb)->opcode);
+
+#if !defined(__GNUC__)
+dispatch:
+    switch(_index) {
+#endif
+    OPCODE_GRID(CORE_OP)
+    OPCODE_GRID(CORE_CB)
+#if !defined(__GNUC__)
+    }
+#endif
+}
+
+#endif /* NEC_THREADED_CORE */
+
+#if JIT_AVAILABLE
+
+/**
+ * Compile a hot block, starting over with an empty code buffer when it is
+ * full.
+ *
+ * @param gb
+ * @param block
+ */
+static void compile(struct gb *gb, struct block *block)
+{
+    if(!jit_has_room(gb)) {
+        for(int i = 0; i < BLOCK_CACHE_SIZE; i++) {
+            gb->cpu.blocks[i].entries = 0;
+            gb->cpu.blocks[i].code = NULL;
+        }
+        jit_reset(gb);
+    }
+    block->code = jit_compile(gb, block, _map);
+}
+
+/**
+ * Run the native code of the block at the program counter, compiling it
+ * once it has been entered often enough.
+ *
+ * @param gb
+ * @param deadline
+ * @return false if the next instruction has to be interpreted
+ */
+static bool run_native(struct gb *gb, uint64_t deadline)
+{
+    const struct decoded *op = gb->cpu.next_op;
+
+    // Only at the start of a block, with no EI, DI, HALT or interrupt to finish
+    if((op->length && op->pc == gb->cpu.r.pc) || gb->cpu.DI_pending || gb->cpu.EI_pending || gb->cpu.HALT ||
+            (gb->cpu.IME && (gb->cpu.IE & gb->cpu.IF))) {
+        return false;
+    }
+
+    struct block *block = lookup(gb);
+    gb->cpu.next_op = block->ops;
+    if(block == &gb->cpu.scratch) {
+        return false;
+    }
+
+    if(block->code == NULL) {
+        if(block->entries <= JIT_THRESHOLD) {
+            block->entries++;
+        }
+        if(block->entries != JIT_THRESHOLD) {
+            return false;
+        }
+        compile(gb, block);
+        if(block->code == NULL) {
+            return false;
+        }
+    }
+
+    block->code(gb, deadline);
+    gb->cpu.next_op = &_no_block;
+    interrupt_check(gb);
+    return true;
+}
+
+#endif /* JIT_AVAILABLE */
+
+void cpu_run(struct gb *gb, uint64_t deadline)
+{
+    gb->cpu.run_end = deadline;
+    gb->cpu.idle_since = gb->cpu.r.clk;
+
+#if defined(NEC_THREADED_CORE)
+    execute(gb, deadline);
+#else
+    // Instructions can schedule events, so the next one is checked every time
+    while(gb->cpu.r.clk < deadline && gb->cpu.r.clk < gb->scheduler.next && !idle_skip(gb, deadline)) {
+#if JIT_AVAILABLE
+        if(gb->jit.enabled && run_native(gb, deadline)) {
+            continue;
+        }
+#endif
+        step(gb);
+    }
+#endif
+
+    gb->cpu.r.f = get_flags(gb);
+}
+
+void cpu_reset(struct gb *gb)
+{
+    gb->cpu.r.af = 0x0000;
+    set_flags(gb, gb->cpu.r.f);
+    gb->cpu.r.bc = 0x0000;
+    gb->cpu.r.de = 0x0000;
+    gb->cpu.r.hl = 0x0000;
+    gb->cpu.r.pc = 0x0000;
+    gb->cpu.r.sp = 0xFFFE;
+    gb->cpu.r.clk = 0;
+
+    gb->cpu.IE = 0x00;
+    gb->cpu.IF = 0x00;
+
+    gb->cpu.IME = false;
+    gb->cpu.HALT = false;
+    gb->cpu.STOP = false;
 
-    _IE = 0x00;
-    _IF = 0x00;
+    gb->cpu.DI_pending = false;
+    gb->cpu.EI_pending = false;
 
-    _IME = false;
-    _HALT = false;
-    _STOP = false;
+    gb->cpu.run_end = 0;
+    gb->cpu.idle_since = 0;
+    gb->cpu.idle_miss = 0xFFFF;
 
-    _DI_pending = false;
-    _EI_pending = false;
+    cpu_flush_code(gb);
 }
\ No newline at end of file
@@ -26,8 +26,14 @@
 
 #include "config.h"
 #include <stdint.h>
+#include <stdbool.h>
 
-extern struct registers {
+#define BLOCK_MAX_SIZE      16
+#define BLOCK_CACHE_SIZE    1024
+
+struct gb;
+
+struct registers {
     union {
         struct {
 #if IS_BIG_ENDIAN
@@ -83,10 +89,79 @@ extern struct registers {
     uint16_t sp;
     uint16_t pc;
     uint64_t clk;
-} _r;
+};
 
-extern uint8_t _IE;
-extern uint8_t _IF;
+/**
+ * An instruction with its operand already read from memory.
+ */
+struct decoded {
+    uint16_t pc;
+    uint16_t operand;
+    uint16_t handler;   // Index into the handler table, the opcode unless fused
+    uint8_t opcode;
+    uint8_t length;
+};
+
+/**
+ * Native code of a block, runs until the deadline at most.
+ */
+typedef void (*block_code)(struct gb *gb, uint64_t deadline);
+
+/**
+ * Straight line code up to and including the first jump, call or return,
+ * followed by an entry of length 0.
+ */
+struct block {
+    const uint8_t *page;
+    uint16_t pc;
+    uint16_t entries;
+    block_code code;
+    struct decoded ops[BLOCK_MAX_SIZE + 1];
+};
+
+/**
+ * CPU state of a single GameBoy instance.
+ */
+struct cpu {
+    struct registers r;
+
+    /*
+     * Flags, evaluated from the last result when needed: Z is set if the low
+     * byte of zc is 0 and C is bit 8 of zc, nh holds N and H where F does. F
+     * is only up to date in r between cpu_run() calls.
+     */
+    struct {
+        uint16_t zc;
+        uint8_t nh;
+    } flags;
+
+    uint8_t IE;
+    uint8_t IF;
+
+    bool IME;
+    bool HALT;
+    bool STOP;
+
+    bool DI_pending;
+    bool EI_pending;
+
+    /*
+     * Idle loop detection, the current cpu_run() deadline, the clock of the
+     * last event or interrupt and the last loop found not to be idle
+     */
+    uint64_t run_end;
+    uint64_t idle_since;
+    uint16_t idle_miss;
+
+    /*
+     * Predecoded code, the operand of the current instruction, the next
+     * instruction in the current block and the cache of ROM blocks
+     */
+    uint16_t operand;
+    const struct decoded *next_op;
+    struct block scratch;
+    struct block blocks[BLOCK_CACHE_SIZE];
+};
 
 /**
  * Possible interrupt sources identified by a bit mask.
@@ -102,18 +177,39 @@ enum int_src {
 /**
  * Generate an interrupt with specified source.
  *
+ * @param gb The GameBoy instance.
  * @param src The source of the interrupt.
  */
-void interrupt(enum int_src src);
+void interrupt(struct gb *gb, enum int_src src);
+
+/**
+ * Execute instructions until the clock reaches the deadline or the next
+ * scheduled event. A halted or stopped CPU skips straight there, since only
+ * events and key presses can wake it.
+ *
+ * @param gb
+ * @param deadline
+ */
+void cpu_run(struct gb *gb, uint64_t deadline);
+
+/**
+ * Stop running from the current block, after the page table changed under it.
+ *
+ * @param gb
+ */
+void cpu_leave_block(struct gb *gb);
 
 /**
+ * Drop all predecoded code, for when the memory it was read from is reused.
  *
+ * @param gb
  */
-void dispatch(void);
+void cpu_flush_code(struct gb *gb);
 
 /**
  *
+ * @param gb
  */
-void cpu_reset(void);
+void cpu_reset(struct gb *gb);
 
 #endif //NEC_CPU_H
@@ -23,160 +23,206 @@
 
 #include "MMU.h"
 
+#include <string.h>
+
 #include "GB.h"
 #include "LR35902.h"
 #include "cartridge.h"
 #include "PPU.h"
-#include "sound.h"
-#include "joypad.h"
-#include "serial.h"
-#include "timer.h"
+#include "context.h"
 
+#define _IF_ADDRESS   0xFF0F
 #define _BOOT_ADDRESS 0xFF50
 
-static uint8_t _BIOS[_BIOS_SIZE];
+static uint8_t unmapped_read(struct gb *gb, uint16_t address)
+{
+    return 0xFF;
+}
+
+static void unmapped_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+}
+
+static uint8_t if_read(struct gb *gb, uint16_t address)
+{
+    return gb->cpu.IF;
+}
+
+static void if_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    gb->cpu.IF = value;
+}
+
+static uint8_t boot_read(struct gb *gb, uint16_t address)
+{
+    return gb->mmu.boot;
+}
 
-static uint8_t _HRAM[_HRAM_SIZE];
-static uint8_t _RAM[_RAM_SIZE];
+static void boot_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    const uint8_t **read_page = (gb->mmu.bus_locked ? gb->mmu.bus_read_page : gb->mmu.read_page);
 
-static uint8_t _boot = 0x00;
+    gb->mmu.boot = value;
+    read_page[0] = (gb->mmu.boot ? gb->mmu.bios_hidden_page : gb->mmu.BIOS);
+    cpu_leave_block(gb);
+}
 
-uint8_t read_byte(uint16_t address)
+static uint8_t read_byte_handler(struct gb *gb, uint16_t address)
 {
+    if( gb->mmu.bus_locked && address < _IO_OFFSET ) {
+        return 0xFF;
+    }
+
     if( _ZERO_PAGE_OFFSET <= address ) {
-        if( address == _IE_ADDRESS ) {
-            return _IE;
+        if( _IO_OFFSET <= address && address < _IO_OFFSET_END ) {
+            return gb->mmu.io_read[ address - _IO_OFFSET ](gb, address);
+        } else if( address == _IE_ADDRESS ) {
+            return gb->cpu.IE;
         } else if( _HRAM_OFFSET <= address && address <= _HRAM_OFFSET_END) {
-            return _HRAM[ address - _HRAM_OFFSET ];
-        } else if( _IO_OFFSET <= address && address <= _IO_OFFSET_END ) {
-            switch (address & 0x00F0) {
-                case 0x00:
-                    switch (address & 0x000F) {
-                        case 0x00:
-                            return joypad_read_byte(address);
-                        case 0x01:
-                        case 0x02:
-                            return serial_read_byte(address);
-                        case 0x03:
-                        case 0x04:
-                        case 0x05:
-                        case 0x06:
-                            return timer_read_byte(address);
-                        case 0x0F:
-                            return _IF;
-                        default:
-                            break;
-                    }
-                    break;
-                case 0x10:
-                case 0x20:
-                case 0x30:
-                    return sound_read_byte(address);
-                case 0x40:
-                    return video_read_byte(address);
-                case 0x50:
-                    if (address == _BOOT_ADDRESS) {
-                        return _boot;
-                    }
-                    break;
-                default:
-                    break;
-            }
+            return gb->mmu.HRAM[ address - _HRAM_OFFSET ];
         }
+        return 0xFF;
     } else if( _OAM_OFFSET <= address && address < _OAM_OFFSET_END ) {
-        return oam_read_byte(address);
+        return oam_read_byte(gb, address);
     } else if( _RAM_ECHO_OFFSET <= address ) {
-        return _RAM[ address - _RAM_ECHO_OFFSET ];
+        return gb->mmu.RAM[ address - _RAM_ECHO_OFFSET ];
     } else if( _RAM_OFFSET <= address ) {
-        return _RAM[ address - _RAM_OFFSET ];
+        return gb->mmu.RAM[ address - _RAM_OFFSET ];
     } else if( _EXT_RAM_OFFSET <= address ) {
-        return ext_ram_read_byte(address);
+        return ext_ram_read_byte(gb, address);
     } else if( _VRAM_OFFSET <= address ) {
-        return vram_read_byte(address);
-    } else if ( !_boot && address < _BIOS_SIZE) {
-        return _BIOS[address];
+        return vram_read_byte(gb, address);
+    } else if ( !gb->mmu.boot && address < _BIOS_SIZE) {
+        return gb->mmu.BIOS[address];
     } else {
-        return rom_read_byte(address);
+        return rom_read_byte(gb, address);
     }
 }
 
-void write_byte(uint16_t address, uint8_t value)
+static void write_byte_handler(struct gb *gb, uint16_t address, uint8_t value)
 {
+    if( gb->mmu.bus_locked && address < _IO_OFFSET ) {
+        return;
+    }
+
     if( _ZERO_PAGE_OFFSET <= address ) {
-        if( address == _IE_ADDRESS ) {
-            _IE = value;
+        if( _IO_OFFSET <= address && address < _IO_OFFSET_END ) {
+            gb->mmu.io_write[ address - _IO_OFFSET ](gb, address, value);
+        } else if( address == _IE_ADDRESS ) {
+            gb->cpu.IE = value;
         } else if( _HRAM_OFFSET <= address && address <= _HRAM_OFFSET_END) {
-            _HRAM[ address - _HRAM_OFFSET ] = value;
-        } else if( _IO_OFFSET <= address && address <= _IO_OFFSET_END ) {
-            switch (address & 0x00F0) {
-                case 0x00:
-                    switch (address & 0x000F) {
-                        case 0x00:
-                            joypad_write_byte(address, value);
-                            break;
-                        case 0x01:
-                        case 0x02:
-                            serial_write_byte(address, value);
-                            break;
-                        case 0x03:
-                        case 0x04:
-                        case 0x05:
-                        case 0x06:
-                            timer_write_byte(address, value);
-                            break;
-                        case 0x0F:
-                            _IF = value;
-                            break;
-                        default:
-                            break;
-                    }
-                    break;
-                case 0x10:
-                case 0x20:
-                case 0x30:
-                    sound_write_byte(address, value);
-                    break;
-                case 0x40:
-                    video_write_byte(address, value);
-                    break;
-                case 0x50:
-                    if (address == _BOOT_ADDRESS) {
-                        _boot = value;
-                    }
-                    break;
-                default:
-                    break;
-            }
+            gb->mmu.HRAM[ address - _HRAM_OFFSET ] = value;
         }
     } else if( _OAM_OFFSET <= address && address < _OAM_OFFSET_END ) {
-        oam_write_byte(address, value);
+        oam_write_byte(gb, address, value);
     } else if( _RAM_ECHO_OFFSET <= address ) {
-        _RAM[ address - _RAM_ECHO_OFFSET ] = value;
+        gb->mmu.RAM[ address - _RAM_ECHO_OFFSET ] = value;
     } else if( _RAM_OFFSET <= address ) {
-        _RAM[ address - _RAM_OFFSET ] = value;
+        gb->mmu.RAM[ address - _RAM_OFFSET ] = value;
     } else if( _EXT_RAM_OFFSET <= address ) {
-        ext_ram_write_byte(address, value);
+        ext_ram_write_byte(gb, address, value);
     } else if( _VRAM_OFFSET <= address ) {
-        vram_write_byte(address, value);
+        vram_write_byte(gb, address, value);
     } else if( _ROM_OFFSET <= address ) {
-        rom_write_byte(address, value);
+        rom_write_byte(gb, address, value);
+    }
+}
+
+uint8_t read_byte(struct gb *gb, uint16_t address)
+{
+    const uint8_t *page = gb->mmu.read_page[address >> 8];
+    if(page != NULL) {
+        return page[address & 0xFF];
+    }
+    return read_byte_handler(gb, address);
+}
+
+void write_byte(struct gb *gb, uint16_t address, uint8_t value)
+{
+    uint8_t *page = gb->mmu.write_page[address >> 8];
+    if(page != NULL) {
+        page[address & 0xFF] = value;
+        return;
     }
+    write_byte_handler(gb, address, value);
 }
 
-uint16_t read_word(uint16_t address)
+uint16_t read_word(struct gb *gb, uint16_t address)
 {
-    uint8_t lo = read_byte(address);
-    uint8_t hi = read_byte((uint16_t) (address + 1));
+    const uint8_t *page = gb->mmu.read_page[address >> 8];
+    if(page != NULL && (address & 0xFF) != 0xFF) {
+        return (uint16_t) (page[address & 0xFF] + (page[(address & 0xFF) + 1] << 8));
+    }
+
+    uint8_t lo = read_byte(gb, address);
+    uint8_t hi = read_byte(gb, (uint16_t) (address + 1));
     return lo + (hi << 8);
 }
 
-void write_word(uint16_t address, uint16_t value)
+void write_word(struct gb *gb, uint16_t address, uint16_t value)
+{
+    uint8_t *page = gb->mmu.write_page[address >> 8];
+    if(page != NULL && (address & 0xFF) != 0xFF) {
+        page[address & 0xFF] = (uint8_t) (value & 0xFF);
+        page[(address & 0xFF) + 1] = (uint8_t) (value >> 8);
+        return;
+    }
+
+    write_byte(gb, address, (uint8_t) (value & 0xFF));
+    write_byte(gb, (uint16_t) (address + 1), (uint8_t) (value >> 8));
+}
+
+void mmu_register_io(struct gb *gb, uint16_t address, io_read_handler read, io_write_handler write)
+{
+    gb->mmu.io_read[address - _IO_OFFSET] = (read != NULL ? read : unmapped_read);
+    gb->mmu.io_write[address - _IO_OFFSET] = (write != NULL ? write : unmapped_write);
+}
+
+void mmu_map(struct gb *gb, uint16_t address, uint32_t size, const uint8_t *read, uint8_t *write)
+{
+    // Bank switches during OAM DMA take effect once the bus is released
+    const uint8_t **read_page = (gb->mmu.bus_locked ? gb->mmu.bus_read_page : gb->mmu.read_page);
+    uint8_t **write_page = (gb->mmu.bus_locked ? gb->mmu.bus_write_page : gb->mmu.write_page);
+
+    for(uint32_t offset = 0; offset < size; offset += _PAGE_SIZE) {
+        uint8_t page = (uint8_t) ((address + offset) >> 8);
+        read_page[page] = (read != NULL ? read + offset : NULL);
+        write_page[page] = (write != NULL ? write + offset : NULL);
+    }
+
+    // The BIOS hides the first page until it is switched off
+    if(address == 0x0000 && size) {
+        gb->mmu.bios_hidden_page = read_page[0];
+        if(!gb->mmu.boot) {
+            read_page[0] = gb->mmu.BIOS;
+        }
+    }
+
+    // Predecoded code may no longer be what the CPU sees
+    cpu_leave_block(gb);
+}
+
+void mmu_lock_bus(struct gb *gb, bool locked)
 {
-    write_byte(address, (uint8_t) (value & 0xFF));
-    write_byte((uint16_t) (address + 1), (uint8_t) (value >> 8));
+    if(locked == gb->mmu.bus_locked) {
+        return;
+    }
+
+    // Empty pages send every access through the handlers, which check the lock
+    if(locked) {
+        memcpy(gb->mmu.bus_read_page, gb->mmu.read_page, sizeof(gb->mmu.read_page));
+        memcpy(gb->mmu.bus_write_page, gb->mmu.write_page, sizeof(gb->mmu.write_page));
+        memset(gb->mmu.read_page, 0, sizeof(gb->mmu.read_page));
+        memset(gb->mmu.write_page, 0, sizeof(gb->mmu.write_page));
+    } else {
+        memcpy(gb->mmu.read_page, gb->mmu.bus_read_page, sizeof(gb->mmu.read_page));
+        memcpy(gb->mmu.write_page, gb->mmu.bus_write_page, sizeof(gb->mmu.write_page));
+    }
+    gb->mmu.bus_locked = locked;
+    cpu_leave_block(gb);
 }
 
-int mmu_load_bios(FILE *bios)
+int mmu_load_bios(struct gb *gb, FILE *bios)
 {
     rewind(bios);
     fseek(bios, 0, SEEK_END);
@@ -188,7 +234,7 @@ int mmu_load_bios(FILE *bios)
     }
 
     rewind(bios);
-    size_t result = fread(_BIOS, sizeof(uint8_t), _BIOS_SIZE, bios);
+    size_t result = fread(gb->mmu.BIOS, sizeof(uint8_t), _BIOS_SIZE, bios);
     if(result != _BIOS_SIZE) {
         log_error("Invalid amount of bytes read (Read: %d bytes, Expected: %d bytes)\n", result, _BIOS_SIZE);
         if(feof(bios)) {
@@ -198,10 +244,23 @@ int mmu_load_bios(FILE *bios)
         }
         return 0;
     }
+
+    cpu_flush_code(gb);
     return 1;
 }
 
-void mmu_reset(void)
+void mmu_reset(struct gb *gb)
 {
-    _boot = 0x00;
+    gb->mmu.boot = 0x00;
+    gb->mmu.bus_locked = false;
+
+    mmu_map(gb, 0x0000, _NUM_PAGES * _PAGE_SIZE, NULL, NULL);
+    mmu_map(gb, _RAM_OFFSET, _RAM_SIZE, gb->mmu.RAM, gb->mmu.RAM);
+    mmu_map(gb, _RAM_ECHO_OFFSET, _OAM_OFFSET - _RAM_ECHO_OFFSET, gb->mmu.RAM, gb->mmu.RAM);
+
+    for(uint16_t address = _IO_OFFSET; address < _IO_OFFSET_END; address++) {
+        mmu_register_io(gb, address, NULL, NULL);
+    }
+    mmu_register_io(gb, _IF_ADDRESS, if_read, if_write);
+    mmu_register_io(gb, _BOOT_ADDRESS, boot_read, boot_write);
 }
\ No newline at end of file
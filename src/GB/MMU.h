@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #define _BIOS_SIZE          0x0100
 
@@ -38,7 +39,7 @@
 #define _OAM_OFFSET         0xFE00
 #define _OAM_OFFSET_END     0xFEA0
 #define _IO_OFFSET          0xFF00
-#define _IO_OFFSET_END      0xFF50
+#define _IO_OFFSET_END      0xFF80
 #define _HRAM_OFFSET        0xFF80
 #define _HRAM_OFFSET_END    0xFFFE
 #define _IE_ADDRESS         0xFFFF
@@ -52,45 +53,126 @@
 #define _RAM_SIZE           (_RAM_ECHO_OFFSET - _RAM_OFFSET)
 #define _OAM_SIZE           (_OAM_OFFSET_END - _OAM_OFFSET)
 #define _HRAM_SIZE          (_IE_ADDRESS - _HRAM_OFFSET)
+#define _IO_SIZE            (_IO_OFFSET_END - _IO_OFFSET)
+
+#define _PAGE_SIZE          0x0100
+#define _NUM_PAGES          0x0100
+
+struct gb;
+
+typedef uint8_t (*io_read_handler)(struct gb *gb, uint16_t address);
+typedef void (*io_write_handler)(struct gb *gb, uint16_t address, uint8_t value);
+
+/**
+ * Internal memory of a single GameBoy instance.
+ */
+struct mmu {
+    uint8_t BIOS[_BIOS_SIZE];
+
+    uint8_t HRAM[_HRAM_SIZE];
+    uint8_t RAM[_RAM_SIZE];
+
+    uint8_t boot;
+
+    /*
+     * Page table, NULL entries are served by the register handlers
+     */
+    const uint8_t *read_page[_NUM_PAGES];
+    uint8_t *write_page[_NUM_PAGES];
+    const uint8_t *bios_hidden_page;
+
+    /*
+     * While OAM DMA owns the bus the page table is parked here, and the CPU
+     * only reaches 0xFF00-0xFFFF
+     */
+    const uint8_t *bus_read_page[_NUM_PAGES];
+    uint8_t *bus_write_page[_NUM_PAGES];
+    bool bus_locked;
+
+    /*
+     * Register handlers of the 0xFF00-0xFF7F I/O page
+     */
+    io_read_handler io_read[_IO_SIZE];
+    io_write_handler io_write[_IO_SIZE];
+};
 
 /**
  *
+ * @param gb
  * @param address
  * @return
  */
-uint8_t read_byte(uint16_t address);
+uint8_t read_byte(struct gb *gb, uint16_t address);
 
 /**
  *
+ * @param gb
  * @param address
  * @param value
  */
-void write_byte(uint16_t address, uint8_t value);
+void write_byte(struct gb *gb, uint16_t address, uint8_t value);
 
 /**
  *
+ * @param gb
  * @param address
  * @return
  */
-uint16_t read_word(uint16_t address);
+uint16_t read_word(struct gb *gb, uint16_t address);
 
 /**
  *
+ * @param gb
  * @param address
  * @param value
  */
-void write_word(uint16_t address, uint16_t value);
+void write_word(struct gb *gb, uint16_t address, uint16_t value);
+
+/**
+ * Install the handlers of a single I/O register. Passing NULL for either
+ * direction makes it read 0xFF or ignore writes.
+ *
+ * @param gb
+ * @param address Register address in 0xFF00-0xFF7F
+ * @param read
+ * @param write
+ */
+void mmu_register_io(struct gb *gb, uint16_t address, io_read_handler read, io_write_handler write);
+
+/**
+ * Map a page aligned region of the address space directly onto host memory.
+ * Passing NULL for either direction hands that direction back to the
+ * register handlers.
+ *
+ * @param gb
+ * @param address Page aligned start address
+ * @param size Multiple of _PAGE_SIZE
+ * @param read Backing memory for reads, or NULL
+ * @param write Backing memory for writes, or NULL
+ */
+void mmu_map(struct gb *gb, uint16_t address, uint32_t size, const uint8_t *read, uint8_t *write);
+
+/**
+ * Take the bus away from the CPU for an OAM DMA, or hand it back. While the
+ * bus is locked everything below 0xFF00 reads 0xFF and ignores writes.
+ *
+ * @param gb
+ * @param locked
+ */
+void mmu_lock_bus(struct gb *gb, bool locked);
 
 /**
  *
+ * @param gb
  * @param bios
  * @return
  */
-int mmu_load_bios(FILE *bios);
+int mmu_load_bios(struct gb *gb, FILE *bios);
 
 /**
  *
+ * @param gb
  */
-void mmu_reset(void);
+void mmu_reset(struct gb *gb);
 
 #endif /* NEC_MMU_H */
@@ -24,33 +24,32 @@
 #include "PPU.h"
 
 #include <stdbool.h>
-#include <stdlib.h>
+#include <string.h>
+
+#if defined(__BMI2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include "MMU.h"
 #include "LR35902.h"
 #include "display.h"
+#include "cartridge.h"
 #include "GB.h"
+#include "scheduler.h"
+#include "context.h"
 
 #define LAST_SCREEN_LINE    143
 #define LAST_VBLANK_LINE    153
 
-#define HBLANK_MODE_CLOCKS      204
-#define VBLANK_MODE_CLOCKS      456
+#define LINE_CLOCKS             456
+#define FRAME_CLOCKS            (LINE_CLOCKS * (LAST_VBLANK_LINE + 1))
 #define OAM_READ_MODE_CLOCKS    80
-#define VRAM_READ_MODE_CLOCKS   172
-
-#define SPRITES_PER_LINE        10
-#define PIXEL_FIFO_SIZE         16
-#define SPRITE_FIFO_SIZE        8
+#define TRANSFER_MODE_CLOCKS    172
 
 #define SPRITE_X_OFFSET         8
 
+#define DMA_CLOCKS              (4 * _OAM_SIZE)
 
-#define OAM_SPRITE_SIZE         (_OAM_SIZE / 4)
-#define VRAM_TILE_DATA_SIZE     0x0800
-#define VRAM_NUM_TILE_DATA      3
-#define VRAM_TILE_MAP_SIZE      0x0400
-#define VRAM_NUM_TILE_MAPS      2
 
 #define LCDC_ADDRESS    0xFF40
 #define STAT_ADDRESS    0xFF41
@@ -65,119 +64,129 @@
 #define WY_ADDRESS      0xFF4A
 #define WX_ADDRESS      0xFF4B
 
-static uint8_t _lcdc = 0x00;
-static uint8_t _stat = 0x04;
-static uint8_t _scy = 0x00;
-static uint8_t _scx = 0x00;
-static uint8_t _ly = 0x00;
-static uint8_t _lyc = 0x00;
-static uint8_t _dma = 0x00;
-static uint8_t _bgp = 0x00;
-static uint8_t _obp[2] = {0x00, 0x00};
-static uint8_t _wx = 0x00;
-static uint8_t _wy = 0x00;
-
-static uint32_t _mode_clocks = 0;
-
-static uint8_t _dma_cycle_counter = 0;
-
-static struct display _display;
-
-struct sprite {
-    uint8_t y;
-    uint8_t x;
-    uint8_t code;
-    uint8_t flags;
-};
+/**
+ * Decode one row of a tile into 8 color indices, leftmost pixel first, and
+ * into the same row mirrored.
+ *
+ * @param data0
+ * @param data1
+ * @param pixels
+ * @param mirrored
+ */
+static inline void decode_tile_row(uint8_t data0, uint8_t data1, uint8_t *pixels, uint8_t *mirrored)
+{
+#if defined(__BMI2__) && defined(__x86_64__)
+    // Deposit bit i of each plane into byte i, which yields the mirrored row
+    uint64_t row = _pdep_u64(data0, 0x0101010101010101ULL) | (_pdep_u64(data1, 0x0101010101010101ULL) << 1);
+    memcpy(mirrored, &row, TILE_WIDTH);
+    row = __builtin_bswap64(row);
+    memcpy(pixels, &row, TILE_WIDTH);
+#elif defined(__SSE2__)
+    // Test every bit of both planes at once, plain row in the low half
+    const __m128i bits = _mm_set_epi8((char) 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01,
+                                      0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, (char) 0x80);
+    __m128i lo = _mm_cmpeq_epi8(_mm_and_si128(_mm_set1_epi8((char) data0), bits), bits);
+    __m128i hi = _mm_cmpeq_epi8(_mm_and_si128(_mm_set1_epi8((char) data1), bits), bits);
+    __m128i row = _mm_or_si128(_mm_and_si128(lo, _mm_set1_epi8(0x01)), _mm_and_si128(hi, _mm_set1_epi8(0x02)));
+    _mm_storel_epi64((__m128i *) pixels, row);
+    _mm_storel_epi64((__m128i *) mirrored, _mm_srli_si128(row, 8));
+#else
+    for(int i = 0; i < TILE_WIDTH; i++) {
+        pixels[i] = (uint8_t) (((data0 >> (7 - i)) & 0x01) | (((data1 >> (7 - i)) & 0x01) << 1));
+        mirrored[TILE_WIDTH - 1 - i] = pixels[i];
+    }
+#endif
+}
 
-static union {
-    struct {
-        uint8_t tile_data[VRAM_NUM_TILE_DATA][VRAM_TILE_DATA_SIZE];
-        uint8_t tile_map[VRAM_NUM_TILE_MAPS][VRAM_TILE_MAP_SIZE];
-    };
-    uint8_t raw[_VRAM_SIZE];
-} _vram;
-
-static union {
-    struct sprite sprites[OAM_SPRITE_SIZE];
-    uint8_t raw[_OAM_SIZE];
-} _oam;
-
-static struct sprite *_visible_sprites[SPRITES_PER_LINE] = {NULL};
-
-enum fetch_state {
-    FETCH_TILE_NO,
-    FETCH_DATA0,
-    FETCH_DATA1,
-    FETCH_SAVE
-};
+/**
+ * Map a line of color indices to shades through a palette register.
+ *
+ * @param palette BGP, OBP0 or OBP1
+ * @param colors
+ * @param shades
+ */
+static inline void apply_palette(uint8_t palette, const uint8_t *colors, uint8_t *shades)
+{
+    int x = 0;
+#if defined(__AVX2__)
+    const __m256i lut = _mm256_setr_epi8(palette & 0x03, (palette >> 2) & 0x03, (palette >> 4) & 0x03, (palette >> 6) & 0x03,
+                                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                         palette & 0x03, (palette >> 2) & 0x03, (palette >> 4) & 0x03, (palette >> 6) & 0x03,
+                                         0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    for(; x + 32 <= DISPLAY_WIDTH; x += 32) {
+        __m256i idx = _mm256_loadu_si256((const __m256i *) &colors[x]);
+        _mm256_storeu_si256((__m256i *) &shades[x], _mm256_shuffle_epi8(lut, idx));
+    }
+#endif
+#if defined(__SSE2__)
+    // Select the shade of each of the four colors
+    const __m128i s1 = _mm_set1_epi8((char) ((palette >> 2) & 0x03));
+    const __m128i s2 = _mm_set1_epi8((char) ((palette >> 4) & 0x03));
+    const __m128i s3 = _mm_set1_epi8((char) ((palette >> 6) & 0x03));
+    const __m128i s0 = _mm_set1_epi8((char) (palette & 0x03));
+    for(; x + 16 <= DISPLAY_WIDTH; x += 16) {
+        __m128i idx = _mm_loadu_si128((const __m128i *) &colors[x]);
+        __m128i shade = _mm_and_si128(_mm_cmpeq_epi8(idx, _mm_setzero_si128()), s0);
+        shade = _mm_or_si128(shade, _mm_and_si128(_mm_cmpeq_epi8(idx, _mm_set1_epi8(1)), s1));
+        shade = _mm_or_si128(shade, _mm_and_si128(_mm_cmpeq_epi8(idx, _mm_set1_epi8(2)), s2));
+        shade = _mm_or_si128(shade, _mm_and_si128(_mm_cmpeq_epi8(idx, _mm_set1_epi8(3)), s3));
+        _mm_storeu_si128((__m128i *) &shades[x], shade);
+    }
+#endif
+    for(; x < DISPLAY_WIDTH; x++) {
+        shades[x] = (uint8_t) ((palette >> (colors[x] * 2)) & 0x03);
+    }
+}
+
+/**
+ * Decode the tile row holding the given VRAM byte again, plain and mirrored.
+ *
+ * @param gb
+ * @param offset Offset of the byte from the start of VRAM
+ */
+static void tile_cache_update(struct gb *gb, uint16_t offset)
+{
+    uint16_t tile = (uint16_t) (offset / VRAM_TILE_SIZE);
+    uint8_t row = (uint8_t) ((offset % VRAM_TILE_SIZE) / 2);
+    const uint8_t *data = &gb->ppu.vram.raw[offset & ~0x01];
 
-static struct {
-    bool in_window;
-
-    uint8_t scy;
-    uint8_t scx;
-    uint8_t ly;
-    uint8_t lx;
-    uint8_t lyc;
-    uint8_t wy;
-    uint8_t wx;
-
-    struct {
-        uint8_t read_ptr;
-        uint8_t write_ptr;
-        int8_t revs;
-        struct {
-            uint8_t data;
-            uint8_t *palette;
-        } pixel[PIXEL_FIFO_SIZE];
-        bool idle;
-    } pixel_fifo;
-
-    struct {
-        uint8_t read_ptr;
-        struct {
-            uint8_t data;
-            uint8_t *palette;
-        } pixel[SPRITE_FIFO_SIZE];
-    } sprite_fifo;
-
-    struct {
-        struct {
-            uint16_t base;
-            uint16_t x_offset;
-            uint16_t y_offset;
-        } address;
-        uint8_t tile_no;
-        uint8_t data0;
-        uint8_t data1;
-        enum fetch_state state;
-        struct sprite *sprite;
-        bool idle;
-    } fetch;
-} _pipeline;
+    decode_tile_row(data[0], data[1], gb->ppu.tiles[0][tile][row], gb->ppu.tiles[1][tile][row]);
+}
+
+/**
+ * Index into the tile cache of a BG/window tile number, following the
+ * addressing mode selected in LCDC.
+ *
+ * @param gb
+ * @param tile_no
+ * @return
+ */
+static inline int bg_tile(struct gb *gb, uint8_t tile_no)
+{
+    return (((tile_no & 0x80) || (gb->ppu.lcdc & 0x10)) ? tile_no : (2 * 0x80) + tile_no);
+}
 
 /**
  *
  * @param x
  * @return
  */
-static int find_sprite(struct sprite **s, const uint8_t x)
+static int find_sprite(struct gb *gb, struct sprite **s, const uint8_t x)
 {
     int l = 0;
     *s = NULL;
 
     for(int i = 0; i < SPRITES_PER_LINE; i++) {
-        if(_visible_sprites[i] == NULL) {
+        if(gb->ppu.visible_sprites[i] == NULL) {
             break;
         }
         if(*s == NULL) {
-            if(_visible_sprites[i]->x == x + SPRITE_X_OFFSET) {
-                *s = _visible_sprites[i];
+            if(gb->ppu.visible_sprites[i]->x == x + SPRITE_X_OFFSET) {
+                *s = gb->ppu.visible_sprites[i];
                 l = 1;
             }
         } else {
-            if(_visible_sprites[i]->x == x + SPRITE_X_OFFSET) {
+            if(gb->ppu.visible_sprites[i]->x == x + SPRITE_X_OFFSET) {
                 l++;
             } else {
                 break;
@@ -190,32 +199,32 @@ static int find_sprite(struct sprite **s, const uint8_t x)
 /**
  *
  */
-static void pixel_pipeline_reset(void)
+static void pixel_pipeline_reset(struct gb *gb)
 {
-    _pipeline.in_window = false;
+    gb->ppu.pipeline.in_window = false;
 
-    _pipeline.scy = 0x00;
-    _pipeline.scx = 0x00;
-    _pipeline.ly = 0x00;
-    _pipeline.lx = 0x00;
-    _pipeline.lyc = 0x00;
-    _pipeline.wy = 0x00;
-    _pipeline.wx = 0x00;
+    gb->ppu.pipeline.scy = 0x00;
+    gb->ppu.pipeline.scx = 0x00;
+    gb->ppu.pipeline.ly = 0x00;
+    gb->ppu.pipeline.lx = 0x00;
+    gb->ppu.pipeline.lyc = 0x00;
+    gb->ppu.pipeline.wy = 0x00;
+    gb->ppu.pipeline.wx = 0x00;
 
-    _pipeline.sprite_fifo.read_ptr = 0;
+    gb->ppu.pipeline.sprite_fifo.read_ptr = 0;
     for(int i = 0; i < SPRITE_FIFO_SIZE; i++) {
-        _pipeline.sprite_fifo.pixel[i].data = 0;
-        _pipeline.sprite_fifo.pixel[i].palette = NULL;
+        gb->ppu.pipeline.sprite_fifo.pixel[i].data = 0;
+        gb->ppu.pipeline.sprite_fifo.pixel[i].palette = NULL;
     }
 
-    _pipeline.pixel_fifo.read_ptr = 0;
-    _pipeline.pixel_fifo.write_ptr = 0;
-    _pipeline.pixel_fifo.revs = 0;
-    _pipeline.pixel_fifo.idle = true;
+    gb->ppu.pipeline.pixel_fifo.read_ptr = 0;
+    gb->ppu.pipeline.pixel_fifo.write_ptr = 0;
+    gb->ppu.pipeline.pixel_fifo.revs = 0;
+    gb->ppu.pipeline.pixel_fifo.idle = true;
 
-    _pipeline.fetch.state = FETCH_TILE_NO;
-    _pipeline.fetch.sprite = NULL;
-    _pipeline.fetch.idle = false;
+    gb->ppu.pipeline.fetch.state = FETCH_TILE_NO;
+    gb->ppu.pipeline.fetch.sprite = NULL;
+    gb->ppu.pipeline.fetch.idle = false;
 }
 
 /**
@@ -227,502 +236,921 @@ static void pixel_pipeline_reset(void)
  * @param wy
  * @param wx
  */
-static void pixel_pipeline_init(uint8_t scy, uint8_t scx, uint8_t ly, uint8_t lyc, uint8_t wy, uint8_t wx)
+static void pixel_pipeline_init(struct gb *gb, uint8_t scy, uint8_t scx, uint8_t ly, uint8_t lyc, uint8_t wy, uint8_t wx)
 {
-    _pipeline.in_window = false;
+    gb->ppu.pipeline.in_window = false;
 
-    _pipeline.scy = scy;
-    _pipeline.scx = (uint8_t) (scx & 0x07);
-    _pipeline.ly = ly;
-    _pipeline.lx = 0x00;
-    _pipeline.lyc = lyc;
-    _pipeline.wy = wy;
-    _pipeline.wx = wx;
+    gb->ppu.pipeline.scy = scy;
+    gb->ppu.pipeline.scx = (uint8_t) (scx & 0x07);
+    gb->ppu.pipeline.ly = ly;
+    gb->ppu.pipeline.lx = 0x00;
+    gb->ppu.pipeline.lyc = lyc;
+    gb->ppu.pipeline.wy = wy;
+    gb->ppu.pipeline.wx = wx;
 
-    _pipeline.sprite_fifo.read_ptr = 0;
+    gb->ppu.pipeline.sprite_fifo.read_ptr = 0;
     for(int i = 0; i < SPRITE_FIFO_SIZE; i++) {
-        _pipeline.sprite_fifo.pixel[i].data = 0;
-        _pipeline.sprite_fifo.pixel[i].palette = NULL;
+        gb->ppu.pipeline.sprite_fifo.pixel[i].data = 0;
+        gb->ppu.pipeline.sprite_fifo.pixel[i].palette = NULL;
     }
 
-    _pipeline.pixel_fifo.read_ptr = 0;
-    _pipeline.pixel_fifo.write_ptr = 0;
-    _pipeline.pixel_fifo.revs = 0;
-    _pipeline.pixel_fifo.idle = true;
+    gb->ppu.pipeline.pixel_fifo.read_ptr = 0;
+    gb->ppu.pipeline.pixel_fifo.write_ptr = 0;
+    gb->ppu.pipeline.pixel_fifo.revs = 0;
+    gb->ppu.pipeline.pixel_fifo.idle = true;
 
-    _pipeline.fetch.state = FETCH_TILE_NO;
-    _pipeline.fetch.idle = false;
+    gb->ppu.pipeline.fetch.state = FETCH_TILE_NO;
+    gb->ppu.pipeline.fetch.idle = false;
 
-    _pipeline.fetch.address.base = (uint16_t) ((_lcdc & 0x08) ? 1 : 0);
-    _pipeline.fetch.address.x_offset = (scx >> 3);
-    _pipeline.fetch.address.y_offset = (uint16_t) ((((ly + scy) >> 3) & 0x1F) * 0x20);
+    gb->ppu.pipeline.fetch.address.base = (uint16_t) ((gb->ppu.lcdc & 0x08) ? 1 : 0);
+    gb->ppu.pipeline.fetch.address.x_offset = (scx >> 3);
+    gb->ppu.pipeline.fetch.address.y_offset = (uint16_t) ((((ly + scy) >> 3) & 0x1F) * 0x20);
 }
 
-static void window_init(void)
+static void window_init(struct gb *gb)
 {
-    _pipeline.in_window = true;
-    _pipeline.scx = 0;
+    gb->ppu.pipeline.in_window = true;
+    gb->ppu.pipeline.scx = 0;
 
-    _pipeline.pixel_fifo.read_ptr = 0;
-    _pipeline.pixel_fifo.write_ptr = 0;
-    _pipeline.pixel_fifo.revs = 0;
-    _pipeline.pixel_fifo.idle = true;
+    gb->ppu.pipeline.pixel_fifo.read_ptr = 0;
+    gb->ppu.pipeline.pixel_fifo.write_ptr = 0;
+    gb->ppu.pipeline.pixel_fifo.revs = 0;
+    gb->ppu.pipeline.pixel_fifo.idle = true;
 
-    _pipeline.fetch.state = FETCH_TILE_NO;
+    gb->ppu.pipeline.fetch.state = FETCH_TILE_NO;
 
-    _pipeline.fetch.address.base = (uint16_t) ((_lcdc & 0x40) ? 1 : 0);
-    _pipeline.fetch.address.x_offset = 0;
-    _pipeline.fetch.address.y_offset = (uint16_t) ((((_pipeline.ly - _pipeline.wy) >> 3) & 0x1F) * 0x20);
+    gb->ppu.pipeline.fetch.address.base = (uint16_t) ((gb->ppu.lcdc & 0x40) ? 1 : 0);
+    gb->ppu.pipeline.fetch.address.x_offset = 0;
+    gb->ppu.pipeline.fetch.address.y_offset = (uint16_t) ((((gb->ppu.pipeline.ly - gb->ppu.pipeline.wy) >> 3) & 0x1F) * 0x20);
 }
 
-static void fetch_sprite(const struct sprite *sprite)
+static void fetch_sprite(struct gb *gb, const struct sprite *sprite)
 {
-    const int h = ((_lcdc & 0x04) ? 16 : 8);
+    const int h = ((gb->ppu.lcdc & 0x04) ? 16 : 8);
     uint8_t tile_no = (uint8_t) ((h == 16) ? (sprite->code & 0xFE) : sprite->code);
-    uint8_t *tile = &_vram.tile_data[(tile_no & 0x80) ? 1 : 0][(tile_no & 0x7F) * 0x10];
-    uint8_t *palette = &_obp[(sprite->flags & 0x10) ? 1 : 0];
+    uint8_t *palette = &gb->ppu.obp[(sprite->flags & 0x10) ? 1 : 0];
 
     int row = 0;
     if(sprite->flags & 0x40) {
         // Vertical flip
-        row = h - (0x10 + _pipeline.ly - sprite->y);
+        row = h - (0x10 + gb->ppu.pipeline.ly - sprite->y);
     } else {
-        row = (0x10 + _pipeline.ly - sprite->y);
+        row = (0x10 + gb->ppu.pipeline.ly - sprite->y);
     }
 
-    uint8_t data0 = tile[row * 2];
-    uint8_t data1 = tile[row * 2 + 1];
+    // Horizontal flip comes from the mirrored tiles
+    const uint8_t *pixels = gb->ppu.tiles[(sprite->flags & 0x20) ? 1 : 0][tile_no + (row / TILE_HEIGHT)][row % TILE_HEIGHT];
 
     for(int i = 0; i < 8; i++) {
-        int idx = (_pipeline.sprite_fifo.read_ptr + i) % SPRITE_FIFO_SIZE;
+        int idx = (gb->ppu.pipeline.sprite_fifo.read_ptr + i) % SPRITE_FIFO_SIZE;
         if (((sprite->flags & 0x80) &&
-                (_pipeline.pixel_fifo.pixel[(_pipeline.pixel_fifo.read_ptr + i) % PIXEL_FIFO_SIZE].data == 0) &&
-                (_pipeline.sprite_fifo.pixel[idx].data == 0)) ||
+                (gb->ppu.pipeline.pixel_fifo.pixel[(gb->ppu.pipeline.pixel_fifo.read_ptr + i) % PIXEL_FIFO_SIZE].data == 0) &&
+                (gb->ppu.pipeline.sprite_fifo.pixel[idx].data == 0)) ||
                 (!(sprite->flags & 0x80) &&
-                (_pipeline.sprite_fifo.pixel[idx].data == 0))) {
+                (gb->ppu.pipeline.sprite_fifo.pixel[idx].data == 0))) {
 
             // Insert
-            if(sprite->flags & 0x20) {
-                // Horizontal flip
-                _pipeline.sprite_fifo.pixel[idx].data = (uint8_t) (((data0 >> i) & 0x01) | (((data1 >> i) & 0x01) << 1));
-                _pipeline.sprite_fifo.pixel[idx].palette = palette;
-            } else {
-                _pipeline.sprite_fifo.pixel[idx].data = (uint8_t) (((data0 >> (7 - i)) & 0x01) | (((data1 >> (7 - i)) & 0x01) << 1));
-                _pipeline.sprite_fifo.pixel[idx].palette = palette;
-            }
+            gb->ppu.pipeline.sprite_fifo.pixel[idx].data = pixels[i];
+            gb->ppu.pipeline.sprite_fifo.pixel[idx].palette = palette;
         }
     }
 }
 
-static void fifo_step(size_t *fifo_size)
+static const uint32_t _default_colors[4] = {
+    0xFFFFFF, 0xAAAAAA, 0x555555, 0x000000
+};
+
+/**
+ * Rebuild the shade to host pixel lookup table.
+ *
+ * @param gb
+ */
+static void display_update_palette(struct gb *gb)
 {
-    if(!_pipeline.pixel_fifo.idle) {
-        uint8_t color_idx = _pipeline.pixel_fifo.pixel[_pipeline.pixel_fifo.read_ptr].data;
-        uint8_t *palette = _pipeline.pixel_fifo.pixel[_pipeline.pixel_fifo.read_ptr].palette;
-        _pipeline.pixel_fifo.read_ptr++;
-        if(_pipeline.pixel_fifo.read_ptr >= PIXEL_FIFO_SIZE) {
-            _pipeline.pixel_fifo.revs--;
-            _pipeline.pixel_fifo.read_ptr -= PIXEL_FIFO_SIZE;
+    for(uint8_t shade = 0; shade < 4; shade++) {
+        uint32_t color = gb->ppu.display.colors[shade];
+        uint32_t r = (color >> 16) & 0xFF;
+        uint32_t g = (color >> 8) & 0xFF;
+        uint32_t b = color & 0xFF;
+
+        switch (gb->ppu.display.format) {
+            default:
+            case GB_DISPLAY_SHADE:
+                gb->ppu.display.palette[shade] = shade;
+                break;
+            case GB_DISPLAY_GRAY8:
+                gb->ppu.display.palette[shade] = (r * 77 + g * 150 + b * 29) >> 8;
+                break;
+            case GB_DISPLAY_RGB565:
+                gb->ppu.display.palette[shade] = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+                break;
+            case GB_DISPLAY_RGBA8888:
+                gb->ppu.display.palette[shade] = (color << 8) | 0xFF;
+                break;
         }
-        (*fifo_size)--;
+    }
+}
 
-        uint8_t sprite_color_idx = _pipeline.sprite_fifo.pixel[_pipeline.sprite_fifo.read_ptr].data;
-        uint8_t *sprite_palette = _pipeline.sprite_fifo.pixel[_pipeline.sprite_fifo.read_ptr].palette;
-        _pipeline.sprite_fifo.pixel[_pipeline.sprite_fifo.read_ptr].data = 0;
-        _pipeline.sprite_fifo.read_ptr = (uint8_t) ((_pipeline.sprite_fifo.read_ptr + 1) % SPRITE_FIFO_SIZE);
+/**
+ *
+ * @param gb
+ * @param x
+ * @param y
+ * @param shade
+ */
+static inline void display_put(struct gb *gb, uint8_t x, uint8_t y, uint8_t shade)
+{
+    if(x >= DISPLAY_WIDTH || y >= DISPLAY_HEIGHT) {
+        return;
+    }
 
-        float color;
-        if(sprite_color_idx != 0) {
-            color = 1.0f - ((float)((*sprite_palette >> (sprite_color_idx * 2)) & 0x03) / 3.0f);
-        } else {
-            color = 1.0f - ((float)((*palette >> (color_idx * 2)) & 0x03) / 3.0f);
+    uint32_t pixel = gb->ppu.display.palette[shade];
+    switch (gb->ppu.display.format) {
+        default:
+        case GB_DISPLAY_SHADE:
+        case GB_DISPLAY_GRAY8:
+            gb->ppu.display.frame.gray8[y][x] = (uint8_t) pixel;
+            break;
+        case GB_DISPLAY_RGB565:
+            gb->ppu.display.frame.rgb565[y][x] = (uint16_t) pixel;
+            break;
+        case GB_DISPLAY_RGBA8888:
+            gb->ppu.display.frame.rgba8888[y][x] = pixel;
+            break;
+    }
+}
+
+/**
+ *
+ * @param gb
+ * @param y
+ * @param shades
+ */
+static void display_put_line(struct gb *gb, uint8_t y, const uint8_t *shades)
+{
+    if(y >= DISPLAY_HEIGHT) {
+        return;
+    }
+
+    const uint32_t *palette = gb->ppu.display.palette;
+    switch (gb->ppu.display.format) {
+        default:
+        case GB_DISPLAY_SHADE:
+        case GB_DISPLAY_GRAY8:
+            for(int x = 0; x < DISPLAY_WIDTH; x++) {
+                gb->ppu.display.frame.gray8[y][x] = (uint8_t) palette[shades[x]];
+            }
+            break;
+        case GB_DISPLAY_RGB565:
+            for(int x = 0; x < DISPLAY_WIDTH; x++) {
+                gb->ppu.display.frame.rgb565[y][x] = (uint16_t) palette[shades[x]];
+            }
+            break;
+        case GB_DISPLAY_RGBA8888:
+            for(int x = 0; x < DISPLAY_WIDTH; x++) {
+                gb->ppu.display.frame.rgba8888[y][x] = palette[shades[x]];
+            }
+            break;
+    }
+}
+
+static void fifo_step(struct gb *gb, size_t *fifo_size)
+{
+    if(!gb->ppu.pipeline.pixel_fifo.idle) {
+        uint8_t color_idx = gb->ppu.pipeline.pixel_fifo.pixel[gb->ppu.pipeline.pixel_fifo.read_ptr].data;
+        uint8_t *palette = gb->ppu.pipeline.pixel_fifo.pixel[gb->ppu.pipeline.pixel_fifo.read_ptr].palette;
+        gb->ppu.pipeline.pixel_fifo.read_ptr++;
+        if(gb->ppu.pipeline.pixel_fifo.read_ptr >= PIXEL_FIFO_SIZE) {
+            gb->ppu.pipeline.pixel_fifo.revs--;
+            gb->ppu.pipeline.pixel_fifo.read_ptr -= PIXEL_FIFO_SIZE;
         }
+        (*fifo_size)--;
+
+        uint8_t sprite_color_idx = gb->ppu.pipeline.sprite_fifo.pixel[gb->ppu.pipeline.sprite_fifo.read_ptr].data;
+        uint8_t *sprite_palette = gb->ppu.pipeline.sprite_fifo.pixel[gb->ppu.pipeline.sprite_fifo.read_ptr].palette;
+        gb->ppu.pipeline.sprite_fifo.pixel[gb->ppu.pipeline.sprite_fifo.read_ptr].data = 0;
+        gb->ppu.pipeline.sprite_fifo.read_ptr = (uint8_t) ((gb->ppu.pipeline.sprite_fifo.read_ptr + 1) % SPRITE_FIFO_SIZE);
 
-        if(!_pipeline.scx) {
-            if((_lcdc & 0x80) && (_lcdc & 0x01)) {
-                _display.lines[_pipeline.ly].dots[_pipeline.lx].r = color;
-                _display.lines[_pipeline.ly].dots[_pipeline.lx].g = color;
-                _display.lines[_pipeline.ly].dots[_pipeline.lx].b = color;
-                _display.lines[_pipeline.ly].dots[_pipeline.lx].a = color;
+        uint8_t shade = 0;
+        if((gb->ppu.lcdc & 0x80) && (gb->ppu.lcdc & 0x01)) {
+            if(sprite_color_idx != 0) {
+                shade = (uint8_t) ((*sprite_palette >> (sprite_color_idx * 2)) & 0x03);
             } else {
-                _display.lines[_pipeline.ly].dots[_pipeline.lx].r = 1.0f;
-                _display.lines[_pipeline.ly].dots[_pipeline.lx].g = 1.0f;
-                _display.lines[_pipeline.ly].dots[_pipeline.lx].b = 1.0f;
-                _display.lines[_pipeline.ly].dots[_pipeline.lx].a = 1.0f;
+                shade = (uint8_t) ((*palette >> (color_idx * 2)) & 0x03);
             }
-            _pipeline.lx++;
+        }
+
+        if(!gb->ppu.pipeline.scx) {
+            display_put(gb, gb->ppu.pipeline.lx, gb->ppu.pipeline.ly, shade);
+            gb->ppu.pipeline.lx++;
         } else {
-            _pipeline.scx--;
+            gb->ppu.pipeline.scx--;
         }
     }
 }
 
-static void fetch_step(size_t *fifo_size)
+static void fetch_step(struct gb *gb, size_t *fifo_size)
 {
-    if(!_pipeline.fetch.idle) {
-        int tile_idx = ((_pipeline.fetch.tile_no & 0x80) ? 1 : ((_lcdc & 0x10) ? 0 : 2));
-        int tile_data = ((_pipeline.fetch.tile_no & 0x7F) * 0x10) + (((_ly + _scy) & 0x07) * 0x02);
-        switch (_pipeline.fetch.state) {
+    if(!gb->ppu.pipeline.fetch.idle) {
+        switch (gb->ppu.pipeline.fetch.state) {
             case FETCH_TILE_NO:
-                _pipeline.fetch.tile_no = _vram.tile_map[_pipeline.fetch.address.base][_pipeline.fetch.address.x_offset + _pipeline.fetch.address.y_offset];
-                _pipeline.fetch.state = FETCH_DATA0;
+                gb->ppu.pipeline.fetch.tile_no = gb->ppu.vram.tile_map[gb->ppu.pipeline.fetch.address.base][gb->ppu.pipeline.fetch.address.x_offset + gb->ppu.pipeline.fetch.address.y_offset];
+                gb->ppu.pipeline.fetch.state = FETCH_DATA0;
                 break;
             case FETCH_DATA0:
-                _pipeline.fetch.data0 = _vram.tile_data[tile_idx][tile_data];
-                _pipeline.fetch.state = FETCH_DATA1;
+                gb->ppu.pipeline.fetch.row = gb->ppu.tiles[0][bg_tile(gb, gb->ppu.pipeline.fetch.tile_no)][(gb->ppu.ly + gb->ppu.scy) & 0x07];
+                gb->ppu.pipeline.fetch.state = FETCH_DATA1;
                 break;
             case FETCH_DATA1:
-                _pipeline.fetch.data1 = _vram.tile_data[tile_idx][tile_data + 1];
-                _pipeline.fetch.state = FETCH_SAVE;
+                gb->ppu.pipeline.fetch.state = FETCH_SAVE;
                 break;
             case FETCH_SAVE:
                 if(*fifo_size + 8 <= PIXEL_FIFO_SIZE) {
                     for(int i = 0; i < 8; i++) {
-                        _pipeline.pixel_fifo.pixel[_pipeline.pixel_fifo.write_ptr].data = (uint8_t) (((_pipeline.fetch.data0 >> (7 - i)) & 0x01) | (((_pipeline.fetch.data1 >> (7 - i)) & 0x01) << 1));
-                        _pipeline.pixel_fifo.pixel[_pipeline.pixel_fifo.write_ptr].palette = &_bgp;
-                        _pipeline.pixel_fifo.write_ptr++;
-                        if(_pipeline.pixel_fifo.write_ptr >= PIXEL_FIFO_SIZE) {
-                            _pipeline.pixel_fifo.revs++;
-                            _pipeline.pixel_fifo.write_ptr -= PIXEL_FIFO_SIZE;
+                        gb->ppu.pipeline.pixel_fifo.pixel[gb->ppu.pipeline.pixel_fifo.write_ptr].data = gb->ppu.pipeline.fetch.row[i];
+                        gb->ppu.pipeline.pixel_fifo.pixel[gb->ppu.pipeline.pixel_fifo.write_ptr].palette = &gb->ppu.bgp;
+                        gb->ppu.pipeline.pixel_fifo.write_ptr++;
+                        if(gb->ppu.pipeline.pixel_fifo.write_ptr >= PIXEL_FIFO_SIZE) {
+                            gb->ppu.pipeline.pixel_fifo.revs++;
+                            gb->ppu.pipeline.pixel_fifo.write_ptr -= PIXEL_FIFO_SIZE;
                         }
                         (*fifo_size)++;
                     }
-                    _pipeline.pixel_fifo.idle = (*fifo_size <= 8);
-                    _pipeline.fetch.address.x_offset = (uint16_t) ((_pipeline.fetch.address.x_offset + 1) & 0x1F);
-                    _pipeline.fetch.state = FETCH_TILE_NO;
+                    gb->ppu.pipeline.pixel_fifo.idle = (*fifo_size <= 8);
+                    gb->ppu.pipeline.fetch.address.x_offset = (uint16_t) ((gb->ppu.pipeline.fetch.address.x_offset + 1) & 0x1F);
+                    gb->ppu.pipeline.fetch.state = FETCH_TILE_NO;
                 }
                 break;
         }
     }
-    _pipeline.fetch.idle = !_pipeline.fetch.idle;
+    gb->ppu.pipeline.fetch.idle = !gb->ppu.pipeline.fetch.idle;
 }
 
 /**
  *
  * @return
  */
-static bool pixel_pipeline_step(void)
+static bool pixel_pipeline_step(struct gb *gb)
 {
-    size_t fifo_size = (size_t) ((_pipeline.pixel_fifo.revs * PIXEL_FIFO_SIZE) + _pipeline.pixel_fifo.write_ptr - _pipeline.pixel_fifo.read_ptr);
+    size_t fifo_size = (size_t) ((gb->ppu.pipeline.pixel_fifo.revs * PIXEL_FIFO_SIZE) + gb->ppu.pipeline.pixel_fifo.write_ptr - gb->ppu.pipeline.pixel_fifo.read_ptr);
 
     // Window check
-    if((_lcdc & 0x20) && (_pipeline.wx == _pipeline.lx + 0x07) && (_pipeline.wy <= _pipeline.ly) && !_pipeline.in_window) {
-        window_init();
+    if((gb->ppu.lcdc & 0x20) && (gb->ppu.pipeline.wx == gb->ppu.pipeline.lx + 0x07) && (gb->ppu.pipeline.wy <= gb->ppu.pipeline.ly) && !gb->ppu.pipeline.in_window) {
+        window_init(gb);
     }
 
     struct sprite *s;
-    int num_sprites = find_sprite(&s, _pipeline.lx);
-    if(fifo_size >= 8 && (_lcdc & 0x02) && num_sprites) {
+    int num_sprites = find_sprite(gb, &s, gb->ppu.pipeline.lx);
+    if(fifo_size >= 8 && (gb->ppu.lcdc & 0x02) && num_sprites) {
         for(int i = 0; i < num_sprites; i++) {
-            fetch_sprite(s + i);
+            fetch_sprite(gb, s + i);
         }
     }
 
     // FIFO Shift
-    fifo_step(&fifo_size);
+    fifo_step(gb, &fifo_size);
 
     // Fetch
-    fetch_step(&fifo_size);
+    fetch_step(gb, &fifo_size);
 
     // Return true if we're done with a line
-    return (_pipeline.lx == 160);
+    return (gb->ppu.pipeline.lx == 160);
 }
 
-static int compare( const void *a, const void *b )
+/**
+ * Draw the current line in one go, from the registers as they are at the end
+ * of mode 3.
+ *
+ * @param gb
+ */
+static void render_line(struct gb *gb)
 {
-    struct sprite *s1 = *(struct sprite **)a;
-    struct sprite *s2 = *(struct sprite **)b;
+    uint8_t ly = gb->ppu.ly;
+    uint8_t shades[DISPLAY_WIDTH];
 
-    if(s1 == NULL && s2 == NULL) {
-        return 0;
-    }
-    if(s1 == NULL) {
-        return 1;
+    if(!(gb->ppu.lcdc & 0x80) || !(gb->ppu.lcdc & 0x01)) {
+        memset(shades, 0, sizeof(shades));
+        display_put_line(gb, ly, shades);
+        return;
     }
-    if(s2 == NULL) {
-        return -1;
+
+    // Background, decoded a whole tile at a time with room for the fine scroll
+    uint8_t colors[DISPLAY_WIDTH + 8];
+    uint8_t y = (uint8_t) (ly + gb->ppu.scy);
+    const uint8_t *map = gb->ppu.vram.tile_map[(gb->ppu.lcdc & 0x08) ? 1 : 0] + ((y >> 3) * 0x20);
+    for(int tile = 0; tile <= DISPLAY_WIDTH / 8; tile++) {
+        uint8_t tile_no = map[((gb->ppu.scx >> 3) + tile) & 0x1F];
+        memcpy(&colors[tile * 8], gb->ppu.tiles[0][bg_tile(gb, tile_no)][y & 0x07], TILE_WIDTH);
     }
 
-    if(s1->x < s2->x) {
-        return -1;
-    } else if(s1->x < s2->x) {
-        return 1;
+    uint8_t bg[DISPLAY_WIDTH];
+    memcpy(bg, &colors[gb->ppu.scx & 0x07], DISPLAY_WIDTH);
+
+    // Window
+    if((gb->ppu.lcdc & 0x20) && (gb->ppu.wy <= ly) && (gb->ppu.wx >= 0x07) && (gb->ppu.wx - 0x07 < DISPLAY_WIDTH)) {
+        int wx = gb->ppu.wx - 0x07;
+        uint8_t wy = (uint8_t) (ly - gb->ppu.wy);
+        map = gb->ppu.vram.tile_map[(gb->ppu.lcdc & 0x40) ? 1 : 0] + ((wy >> 3) * 0x20);
+        for(int tile = 0; wx + tile * 8 < DISPLAY_WIDTH; tile++) {
+            const uint8_t *pixels = gb->ppu.tiles[0][bg_tile(gb, map[tile & 0x1F])][wy & 0x07];
+            for(int i = 0; i < 8 && wx + tile * 8 + i < DISPLAY_WIDTH; i++) {
+                bg[wx + tile * 8 + i] = pixels[i];
+            }
+        }
     }
 
-    if(s1 < s2) {
-        return -1;
-    } else if(s1 > s2) {
-        return 1;
+    apply_palette(gb->ppu.bgp, bg, shades);
+
+    // Sprites, in priority order: a pixel taken by a sprite stays taken
+    if(gb->ppu.lcdc & 0x02) {
+        const int h = ((gb->ppu.lcdc & 0x04) ? 16 : 8);
+        bool taken[DISPLAY_WIDTH] = {false};
+
+        for(int i = 0; i < SPRITES_PER_LINE && gb->ppu.visible_sprites[i] != NULL; i++) {
+            const struct sprite *sprite = gb->ppu.visible_sprites[i];
+            uint8_t tile_no = (uint8_t) ((h == 16) ? (sprite->code & 0xFE) : sprite->code);
+            int row = (0x10 + ly - sprite->y);
+            if(sprite->flags & 0x40) {
+                // Vertical flip
+                row = h - 1 - row;
+            }
+
+            // Horizontal flip comes from the mirrored tiles
+            const uint8_t *pixels = gb->ppu.tiles[(sprite->flags & 0x20) ? 1 : 0][tile_no + (row / TILE_HEIGHT)][row % TILE_HEIGHT];
+
+            uint8_t palette = gb->ppu.obp[(sprite->flags & 0x10) ? 1 : 0];
+            for(int j = 0; j < 8; j++) {
+                int x = sprite->x - SPRITE_X_OFFSET + j;
+                uint8_t color = pixels[j];
+                if(x < 0 || x >= DISPLAY_WIDTH || taken[x] || !color) {
+                    continue;
+                }
+                taken[x] = true;
+                if(!(sprite->flags & 0x80) || !bg[x]) {
+                    shades[x] = (uint8_t) ((palette >> (color * 2)) & 0x03);
+                }
+            }
+        }
     }
-    return 0;
+
+    display_put_line(gb, ly, shades);
+}
+
+/**
+ * Collect the visibility bits of four sprites from a byte compare mask, where
+ * bit 4 * i belongs to sprite i.
+ *
+ * @param m
+ * @return
+ */
+static inline uint32_t sprite_bits(uint32_t m)
+{
+    return (((m & 0x1111) * 0x1248) >> 12) & 0x0F;
 }
 
 /**
+ * Find the sprites covering the current line.
  *
+ * @param gb
+ * @param h Sprite height
+ * @return A mask with bit i set when OAM entry i is on the line
  */
-static void OAM_search(void)
+static inline uint64_t OAM_scan(struct gb *gb, int h)
 {
+    // A sprite covers the line when (ly + 16 - y) wraps into [0, h)
+    const uint8_t line = (uint8_t) (gb->ppu.ly + 0x10);
+    uint64_t mask = 0;
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i l = _mm256_set1_epi8((char) line);
+    const __m256i last = _mm256_set1_epi8((char) (h - 1));
+    for(; i + 8 <= OAM_SPRITE_SIZE; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) &gb->ppu.oam.sprites[i]);
+        __m256i d = _mm256_sub_epi8(l, v);
+        uint32_t y = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(d, last), d));
+        uint32_t x = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        uint32_t m = y & ~(x >> 1);
+        mask |= (uint64_t) (sprite_bits(m) | (sprite_bits(m >> 16) << 4)) << i;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i l4 = _mm_set1_epi8((char) line);
+    const __m128i last4 = _mm_set1_epi8((char) (h - 1));
+    for(; i + 4 <= OAM_SPRITE_SIZE; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *) &gb->ppu.oam.sprites[i]);
+        __m128i d = _mm_sub_epi8(l4, v);
+        uint32_t y = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(d, last4), d));
+        uint32_t x = (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        mask |= (uint64_t) sprite_bits(y & ~(x >> 1)) << i;
+    }
+#endif
+    for(; i < OAM_SPRITE_SIZE; i++) {
+        const struct sprite *sprite = &gb->ppu.oam.sprites[i];
+        if(sprite->x && (uint8_t) (line - sprite->y) < h) {
+            mask |= (uint64_t) 1 << i;
+        }
+    }
+    return mask;
+}
+
+/**
+ * Select the first 10 sprites on the current line and order them by X, OAM
+ * order breaking ties.
+ */
+static void OAM_search(struct gb *gb)
+{
+    const int h = ((gb->ppu.lcdc & 0x04) ? 16 : 8);
+    uint64_t mask = OAM_scan(gb, h);
+
     int s = 0;
-    const int h = ((_lcdc & 0x04) ? 16 : 8);
-    for(int i = 0; i < OAM_SPRITE_SIZE; i++) {
-        if(_oam.sprites[i].x && ((_ly + 0x10) >= _oam.sprites[i].y) && ((_ly + 0x10) < (_oam.sprites[i].y + h))) {
-            _visible_sprites[s++] = &_oam.sprites[i];
-            if(s == SPRITES_PER_LINE) {
-                break;
-            }
+    for(; mask && s < SPRITES_PER_LINE; mask &= mask - 1) {
+        struct sprite *sprite = &gb->ppu.oam.sprites[__builtin_ctzll(mask)];
+
+        // Insert
+        int j = s++;
+        for(; j > 0 && gb->ppu.visible_sprites[j - 1]->x > sprite->x; j--) {
+            gb->ppu.visible_sprites[j] = gb->ppu.visible_sprites[j - 1];
         }
+        gb->ppu.visible_sprites[j] = sprite;
     }
     while (s < SPRITES_PER_LINE) {
-        _visible_sprites[s++] = NULL;
+        gb->ppu.visible_sprites[s++] = NULL;
     }
+}
 
-    qsort(_visible_sprites, 10, sizeof(struct sprite *), compare);
+/**
+ * Update the coincidence flag and the STAT interrupt line, the OR of all
+ * enabled STAT conditions. The LCDC interrupt is only raised when the line
+ * goes high, as long as one condition holds the others are masked.
+ *
+ * @param gb
+ */
+static void stat_update(struct gb *gb)
+{
+    // Check coincidence
+    if(gb->ppu.ly == gb->ppu.lyc) {
+        gb->ppu.stat |= 0x04;
+    } else {
+        gb->ppu.stat &= 0xFB;
+    }
+
+    bool line = (gb->ppu.lcdc & 0x80) &&
+            (((gb->ppu.stat & 0x40) && (gb->ppu.stat & 0x04)) ||            // Coincidence interrupt
+            (((gb->ppu.stat & 0x03) == 0x00) && (gb->ppu.stat & 0x08)) ||   // H-Blank interrupt
+            (((gb->ppu.stat & 0x03) == 0x01) && (gb->ppu.stat & 0x10)) ||   // V-Blank interrupt
+            (((gb->ppu.stat & 0x03) == 0x02) && (gb->ppu.stat & 0x20)));    // OAM interrupt
+
+    if(line && !gb->ppu.stat_line) {
+        interrupt(gb, LCDC);
+    }
+    gb->ppu.stat_line = line;
 }
 
-uint8_t vram_read_byte(uint16_t address)
+/**
+ * Run the PPU up to the given CPU clock. Mode and LY only change on the
+ * boundaries video_schedule() registers, so between PPU events this is only
+ * needed to let the pixel FIFO catch up before a register it uses changes.
+ *
+ * @param gb
+ * @param clk
+ */
+static void video_sync(struct gb *gb, uint64_t clk)
 {
-    if (((_stat & 0x03) <= 0x02) || !(_lcdc & 0x80)) {
-        return _vram.raw[address - _VRAM_OFFSET];
+    if(clk <= gb->ppu.last_sync) {
+        return;
+    }
+    uint64_t clocks = clk - gb->ppu.last_sync;
+    gb->ppu.last_sync = clk;
+
+    // With the LCD off the PPU only keeps the frame pace for the host
+    if(!(gb->ppu.lcdc & 0x80)) {
+        while(clocks) {
+            uint32_t n = (uint32_t) (clocks < FRAME_CLOCKS - gb->ppu.line_clocks ? clocks : FRAME_CLOCKS - gb->ppu.line_clocks);
+            gb->ppu.line_clocks += n;
+            clocks -= n;
+
+            if(gb->ppu.line_clocks == FRAME_CLOCKS) {
+                gb->ppu.line_clocks = 0;
+                display_frame(&gb->ppu.display);
+                gb->ppu.frame_done = true;
+            }
+        }
+        return;
+    }
+
+    while(clocks) {
+        uint32_t n;
+        switch (gb->ppu.stat & 0x03) {
+            default:
+            case 0x00: // HBLANK
+                n = (uint32_t) (clocks < LINE_CLOCKS - gb->ppu.line_clocks ? clocks : LINE_CLOCKS - gb->ppu.line_clocks);
+                gb->ppu.line_clocks += n;
+                clocks -= n;
+
+                if(gb->ppu.line_clocks == LINE_CLOCKS) {
+                    gb->ppu.line_clocks = 0;
+
+                    // Increment line
+                    gb->ppu.ly++;
+
+                    // Check if V-Blank or new line
+                    if (gb->ppu.ly > LAST_SCREEN_LINE) {
+                        gb->ppu.stat = (uint8_t) ((gb->ppu.stat & 0xFC) | 0x01);
+
+                        // Starting VBLANK period
+                        display_frame(&gb->ppu.display);
+                        gb->ppu.frame_done = true;
+                        interrupt(gb, VBLANK);
+                    } else {
+                        gb->ppu.stat = (uint8_t) ((gb->ppu.stat & 0xFC) | 0x02);
+                    }
+                    stat_update(gb);
+                }
+                break;
+            case 0x01: // VBLANK
+                n = (uint32_t) (clocks < LINE_CLOCKS - gb->ppu.line_clocks ? clocks : LINE_CLOCKS - gb->ppu.line_clocks);
+                gb->ppu.line_clocks += n;
+                clocks -= n;
+
+                if(gb->ppu.line_clocks == LINE_CLOCKS) {
+                    gb->ppu.line_clocks = 0;
+
+                    // Increment line
+                    gb->ppu.ly++;
+
+                    // Check if done with V-Blank
+                    if (gb->ppu.ly > LAST_VBLANK_LINE) {
+                        gb->ppu.ly = 0;
+                        gb->ppu.stat = (uint8_t) ((gb->ppu.stat & 0xFC) | 0x02);
+                    }
+                    stat_update(gb);
+                }
+                break;
+            case 0x02: // OAM search
+                n = (uint32_t) (clocks < OAM_READ_MODE_CLOCKS - gb->ppu.line_clocks ? clocks : OAM_READ_MODE_CLOCKS - gb->ppu.line_clocks);
+                gb->ppu.line_clocks += n;
+                clocks -= n;
+
+                if(gb->ppu.line_clocks == OAM_READ_MODE_CLOCKS) {
+                    gb->ppu.stat = (uint8_t) ((gb->ppu.stat & 0xFC) | 0x03);
+
+                    // Find all visible sprites in the current line
+                    OAM_search(gb);
+
+                    // Initialize pixel pipeline
+                    if(gb->ppu.renderer == GB_RENDERER_FIFO) {
+                        pixel_pipeline_init(gb, gb->ppu.scy, gb->ppu.scx, gb->ppu.ly, gb->ppu.lyc, gb->ppu.wy, gb->ppu.wx);
+                    }
+                    stat_update(gb);
+                }
+                break;
+            case 0x03: // Transferring data to LCD driver
+                if(gb->ppu.renderer == GB_RENDERER_SCANLINE) {
+                    uint32_t end = OAM_READ_MODE_CLOCKS + TRANSFER_MODE_CLOCKS;
+                    uint32_t remaining = (gb->ppu.line_clocks < end ? end - gb->ppu.line_clocks : 0);
+                    n = (uint32_t) (clocks < remaining ? clocks : remaining);
+                    gb->ppu.line_clocks += n;
+                    clocks -= n;
+
+                    if(gb->ppu.line_clocks >= end) {
+                        render_line(gb);
+                        gb->ppu.stat = (uint8_t) (gb->ppu.stat & 0xFC);
+                        stat_update(gb);
+                    }
+                    break;
+                }
+
+                while(clocks) {
+                    clocks--;
+                    gb->ppu.line_clocks++;
+
+                    bool line_done = pixel_pipeline_step(gb);
+                    if(line_done || gb->ppu.line_clocks == LINE_CLOCKS) {
+                        gb->ppu.stat = (uint8_t) (gb->ppu.stat & 0xFC);
+                        stat_update(gb);
+                        break;
+                    }
+                }
+                break;
+        }
+    }
+}
+
+/**
+ * Register the clock of the next mode transition.
+ *
+ * @param gb
+ */
+static void video_schedule(struct gb *gb)
+{
+    uint32_t clocks;
+    if(!(gb->ppu.lcdc & 0x80)) {
+        schedule_event(gb, EVENT_PPU, gb->ppu.last_sync + FRAME_CLOCKS - gb->ppu.line_clocks);
+        return;
+    }
+
+    switch (gb->ppu.stat & 0x03) {
+        default:
+        case 0x00:
+        case 0x01:
+            clocks = LINE_CLOCKS - gb->ppu.line_clocks;
+            break;
+        case 0x02:
+            clocks = OAM_READ_MODE_CLOCKS - gb->ppu.line_clocks;
+            break;
+        case 0x03:
+            if(gb->ppu.renderer == GB_RENDERER_SCANLINE) {
+                uint32_t end = OAM_READ_MODE_CLOCKS + TRANSFER_MODE_CLOCKS;
+                clocks = (gb->ppu.line_clocks < end ? end - gb->ppu.line_clocks : 1);
+                break;
+            }
+
+            // The pipeline outputs at most one pixel per clock
+            clocks = (uint32_t) (DISPLAY_WIDTH - gb->ppu.pipeline.lx);
+            if(clocks > LINE_CLOCKS - gb->ppu.line_clocks) {
+                clocks = LINE_CLOCKS - gb->ppu.line_clocks;
+            }
+            break;
+    }
+    schedule_event(gb, EVENT_PPU, gb->ppu.last_sync + clocks);
+}
+
+uint8_t vram_read_byte(struct gb *gb, uint16_t address)
+{
+    if (((gb->ppu.stat & 0x03) <= 0x02) || !(gb->ppu.lcdc & 0x80)) {
+        return gb->ppu.vram.raw[address - _VRAM_OFFSET];
     }
     return 0xFF;
 }
 
-void vram_write_byte(uint16_t address, uint8_t value)
+void vram_write_byte(struct gb *gb, uint16_t address, uint8_t value)
 {
-    if (((_stat & 0x03) <= 0x02) || !(_lcdc & 0x80)) {
-        _vram.raw[address - _VRAM_OFFSET] = value;
+    // The pixel FIFO only reads VRAM in mode 3, when the CPU is locked out
+    if (((gb->ppu.stat & 0x03) <= 0x02) || !(gb->ppu.lcdc & 0x80)) {
+        gb->ppu.vram.raw[address - _VRAM_OFFSET] = value;
+        if(address - _VRAM_OFFSET < VRAM_NUM_TILES * VRAM_TILE_SIZE) {
+            tile_cache_update(gb, (uint16_t) (address - _VRAM_OFFSET));
+        }
     }
 }
 
-uint8_t oam_read_byte(uint16_t address)
+uint8_t oam_read_byte(struct gb *gb, uint16_t address)
 {
     log_error("Direct read from OAM RAM\n");
-    if (((_stat & 0x03) <= 0x01) || !(_lcdc & 0x80)) {
-        return _oam.raw[address - _OAM_OFFSET];
+    if (((gb->ppu.stat & 0x03) <= 0x01) || !(gb->ppu.lcdc & 0x80)) {
+        return gb->ppu.oam.raw[address - _OAM_OFFSET];
     }
     return 0xFF;
 }
 
-void oam_write_byte(uint16_t address, uint8_t value)
+void oam_write_byte(struct gb *gb, uint16_t address, uint8_t value)
 {
     log_error("Direct write to OAM RAM\n");
-    if (((_stat & 0x03) <= 0x01) || !(_lcdc & 0x80)) {
-        _oam.raw[address - _OAM_OFFSET] = value;
-    }
-}
-
-uint8_t video_read_byte(uint16_t address)
-{
-    switch (address) {
-        case LCDC_ADDRESS:
-            return _lcdc;
-        case STAT_ADDRESS:
-            return _stat;
-        case SCY_ADDRESS:
-            return _scy;
-        case SCX_ADDRESS:
-            return _scx;
-        case LY_ADDRESS:
-            return _ly;
-        case LYC_ADDRESS:
-            return _lyc;
-        case DMA_ADDRESS:
-            return _dma;
-        case BGP_ADDRESS:
-            return _bgp;
-        case OBP0_ADDRESS:
-            return _obp[0];
-        case OBP1_ADDRESS:
-            return _obp[1];
-        case WY_ADDRESS:
-            return _wy;
-        case WX_ADDRESS:
-            return _wx;
-        default:
-            return 0;
+    if (((gb->ppu.stat & 0x03) <= 0x01) || !(gb->ppu.lcdc & 0x80)) {
+        gb->ppu.oam.raw[address - _OAM_OFFSET] = value;
     }
 }
 
-void video_write_byte(uint16_t address, uint8_t value)
+static uint8_t lcdc_read(struct gb *gb, uint16_t address)
 {
-    switch (address) {
-        case LCDC_ADDRESS:
-            if(!(_lcdc & 0x80) && (value & 0x80)) {
-                _ly = 0;
-                _mode_clocks = 0;
-                _stat = (uint8_t) ((_stat & 0xFC) | 0x02);
-            }
-            _lcdc = value;
-            break;
-        case STAT_ADDRESS:
-            _stat = (uint8_t) ((value & 0x78) | (_stat & 0x03));
-            break;
-        case SCY_ADDRESS:
-            _scy = value;
-            break;
-        case SCX_ADDRESS:
-            _scx = value;
-            break;
-        case LY_ADDRESS:
-            _ly = 0;
-            break;
-        case LYC_ADDRESS:
-            _lyc = value;
-            break;
-        case DMA_ADDRESS:
-            _dma = value;
-            _dma_cycle_counter = 160;
-            break;
-        case BGP_ADDRESS:
-            _bgp = value;
-            break;
-        case OBP0_ADDRESS:
-            _obp[0] = value;
-            break;
-        case OBP1_ADDRESS:
-            _obp[1] = value;
-            break;
-        case WY_ADDRESS:
-            _wy = value;
-            break;
-        case WX_ADDRESS:
-            _wx = value;
-            break;
-        default:
-            break;
-    }
+    return gb->ppu.lcdc;
+}
 
-    // Check coincidence
-    if(_ly == _lyc) {
-        _stat |= 0x04;
-    } else {
-        _stat &= 0xFB;
-    }
+static void lcdc_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    video_sync(gb, gb->cpu.r.clk);
 
-    // Coincidence interrupt
-    if(((_stat & 0x40) && (_stat & 0x04))) {
-        interrupt(LCDC);
+    if((gb->ppu.lcdc ^ value) & 0x80) {
+        // Switching the LCD off parks the PPU at the start of line 0, switching it on starts that line
+        gb->ppu.ly = 0;
+        gb->ppu.line_clocks = 0;
+        gb->ppu.stat = (uint8_t) ((gb->ppu.stat & 0xFC) | ((value & 0x80) ? 0x02 : 0x00));
     }
+    gb->ppu.lcdc = value;
+
+    stat_update(gb);
+    video_schedule(gb);
 }
 
-void video_update(uint8_t clk_tics)
+static uint8_t stat_read(struct gb *gb, uint16_t address)
 {
-    _mode_clocks += clk_tics;
+    return gb->ppu.stat;
+}
 
-    for(int i = 0; i < clk_tics; i++) {
-        if(_dma_cycle_counter) {
-            int idx = _OAM_SIZE - _dma_cycle_counter;
-            int src = (_dma * 0x100);
-            switch (src & 0xF000) {
-                case 0x8000:
-                case 0x9000:
-                    _oam.raw[idx] = _vram.raw[src - _VRAM_OFFSET + idx];
-                    break;
-                case 0xA000:
-                case 0xB000:
-                case 0xC000:
-                case 0xD000:
-                    _oam.raw[idx] = read_byte((uint16_t) (src + idx));
-                    break;
-                default:
-                    break;
-            }
-            _dma_cycle_counter--;
-        }
-    }
+static void stat_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    video_sync(gb, gb->cpu.r.clk);
+    gb->ppu.stat = (uint8_t) ((value & 0x78) | (gb->ppu.stat & 0x03));
+    stat_update(gb);
+}
 
-    switch (_stat & 0x03) {
-        default:
-        case 0x00: // HBLANK
-            if (_mode_clocks >= HBLANK_MODE_CLOCKS) {
-                _mode_clocks -= HBLANK_MODE_CLOCKS;
-
-                // Increment line
-                _ly++;
-
-                // Check if V-Blank or new line
-                if (_ly > LAST_SCREEN_LINE) {
-                    _stat = (uint8_t) ((_stat & 0xFC) | 0x01);
-
-                    // Starting VBLANK period
-                    display_frame(&_display);
-                    sync_frame();
-                    interrupt(VBLANK);
-                } else {
-                    _stat = (uint8_t) ((_stat & 0xFC) | 0x02);
-                }
-            }
-            break;
-        case 0x01: // VBLANK
-            if (_mode_clocks >= VBLANK_MODE_CLOCKS) {
-                _mode_clocks -= VBLANK_MODE_CLOCKS;
+static uint8_t scy_read(struct gb *gb, uint16_t address)
+{
+    return gb->ppu.scy;
+}
 
-                // Increment line
-                _ly++;
+static void scy_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    video_sync(gb, gb->cpu.r.clk);
+    gb->ppu.scy = value;
+}
 
-                // Check if done with V-Blank
-                if (_ly > LAST_VBLANK_LINE) {
-                    _ly = 0;
-                    _stat = (uint8_t) ((_stat & 0xFC) | 0x02);
-                }
-            }
-            break;
-        case 0x02: // OAM search
-            if (_mode_clocks >= OAM_READ_MODE_CLOCKS) {
-                _mode_clocks -= OAM_READ_MODE_CLOCKS;
-                _stat = (uint8_t) ((_stat & 0xFC) | 0x03);
+static uint8_t scx_read(struct gb *gb, uint16_t address)
+{
+    return gb->ppu.scx;
+}
 
-                // Find all visible sprites in the current line
-                OAM_search();
+static void scx_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    video_sync(gb, gb->cpu.r.clk);
+    gb->ppu.scx = value;
+}
 
-                // Initialize pixel pipeline
-                pixel_pipeline_init(_scy, _scx, _ly, _lyc, _wy, _wx);
-            }
-            break;
-        case 0x03: // Transferring data to LCD driver
-            for(int i = 0; i < clk_tics; i++) {
-                bool line_done = pixel_pipeline_step();
-                if(line_done) {
-                    _mode_clocks -= VRAM_READ_MODE_CLOCKS;
-                    _stat = (uint8_t) (_stat & 0xFC);
-                    break;
-                }
-            }
-            break;
+static uint8_t ly_read(struct gb *gb, uint16_t address)
+{
+    return gb->ppu.ly;
+}
+
+static void ly_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    video_sync(gb, gb->cpu.r.clk);
+    gb->ppu.ly = 0;
+    stat_update(gb);
+}
+
+static uint8_t lyc_read(struct gb *gb, uint16_t address)
+{
+    return gb->ppu.lyc;
+}
+
+static void lyc_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    video_sync(gb, gb->cpu.r.clk);
+    gb->ppu.lyc = value;
+    stat_update(gb);
+}
+
+static uint8_t dma_read(struct gb *gb, uint16_t address)
+{
+    return gb->ppu.dma;
+}
+
+/**
+ * Copy the 160 bytes of the source page into OAM. The DMA unit sees the
+ * memory behind the bus lock, with 0xE000-0xFFFF echoing work RAM.
+ *
+ * @param gb
+ * @param page
+ */
+static void dma_copy(struct gb *gb, uint8_t page)
+{
+    if(page >= (_RAM_ECHO_OFFSET >> 8)) {
+        page -= (_RAM_ECHO_OFFSET - _RAM_OFFSET) >> 8;
     }
 
-    // Check coincidence
-    if(_ly == _lyc) {
-        _stat |= 0x04;
-    } else {
-        _stat &= 0xFB;
+    uint16_t src = (uint16_t) (page << 8);
+    const uint8_t *data = gb->mmu.bus_read_page[page];
+    if(_VRAM_OFFSET <= src && src < _EXT_RAM_OFFSET) {
+        data = &gb->ppu.vram.raw[src - _VRAM_OFFSET];
     }
 
-    if(((_stat & 0x40) && (_stat & 0x04)) ||                // Coincidence interrupt
-            (((_stat & 0x03) == 0x00) && (_stat & 0x08)) || // H-Blank interrupt
-            (((_stat & 0x03) == 0x01) && (_stat & 0x10)) || // V-Blank interrupt
-            (((_stat & 0x03) == 0x02) && (_stat & 0x20))) { // OAM interrupt
-        interrupt(LCDC);
+    if(data != NULL) {
+        memcpy(gb->ppu.oam.raw, data, _OAM_SIZE);
+    } else if(_EXT_RAM_OFFSET <= src) {
+        for(uint16_t i = 0; i < _OAM_SIZE; i++) {
+            gb->ppu.oam.raw[i] = ext_ram_read_byte(gb, (uint16_t) (src + i));
+        }
+    } else {
+        for(uint16_t i = 0; i < _OAM_SIZE; i++) {
+            gb->ppu.oam.raw[i] = rom_read_byte(gb, (uint16_t) (src + i));
+        }
     }
 }
 
-void video_reset(void)
+static void dma_write(struct gb *gb, uint16_t address, uint8_t value)
 {
-    _lcdc = 0x00;
-    _stat = 0x04;
-    _scy = 0x00;
-    _scx = 0x00;
-    _ly = 0x00;
-    _lyc = 0x00;
-    _dma = 0x00;
-    _bgp = 0x00;
-    _obp[0] = 0x00;
-    _obp[1] = 0x00;
-    _wx = 0x00;
-    _wy = 0x00;
+    video_sync(gb, gb->cpu.r.clk);
+    gb->ppu.dma = value;
 
-    _dma_cycle_counter = 0;
+    // The transfer is done in one go, the CPU is kept off the bus for as long as it would take
+    mmu_lock_bus(gb, true);
+    dma_copy(gb, value);
+    schedule_event(gb, EVENT_OAM_DMA, gb->cpu.r.clk + DMA_CLOCKS);
+}
+
+static uint8_t bgp_read(struct gb *gb, uint16_t address)
+{
+    return gb->ppu.bgp;
+}
+
+static void bgp_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    video_sync(gb, gb->cpu.r.clk);
+    gb->ppu.bgp = value;
+}
 
-    _mode_clocks = 0;
-    pixel_pipeline_reset();
+static uint8_t obp_read(struct gb *gb, uint16_t address)
+{
+    return gb->ppu.obp[address - OBP0_ADDRESS];
+}
+
+static void obp_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    video_sync(gb, gb->cpu.r.clk);
+    gb->ppu.obp[address - OBP0_ADDRESS] = value;
+}
+
+static uint8_t wy_read(struct gb *gb, uint16_t address)
+{
+    return gb->ppu.wy;
+}
+
+static void wy_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    video_sync(gb, gb->cpu.r.clk);
+    gb->ppu.wy = value;
+}
+
+static uint8_t wx_read(struct gb *gb, uint16_t address)
+{
+    return gb->ppu.wx;
+}
+
+static void wx_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    video_sync(gb, gb->cpu.r.clk);
+    gb->ppu.wx = value;
+}
+
+void video_event(struct gb *gb, uint64_t deadline)
+{
+    video_sync(gb, deadline);
+    video_schedule(gb);
+}
+
+void dma_event(struct gb *gb, uint64_t deadline)
+{
+    mmu_lock_bus(gb, false);
+}
+
+void GB_set_display_format(struct gb *gb, enum GB_display_format format)
+{
+    gb->ppu.display.format = format;
+    memset(&gb->ppu.display.frame, 0, sizeof(gb->ppu.display.frame));
+    display_update_palette(gb);
+}
+
+void GB_set_display_palette(struct gb *gb, const uint32_t colors[4])
+{
+    memcpy(gb->ppu.display.colors, (colors != NULL ? colors : _default_colors), sizeof(gb->ppu.display.colors));
+    display_update_palette(gb);
+}
+
+void GB_set_renderer(struct gb *gb, enum GB_renderer renderer)
+{
+    video_sync(gb, gb->cpu.r.clk);
+    gb->ppu.renderer = renderer;
+    video_schedule(gb);
+}
+
+const void *GB_get_frame(struct gb *gb)
+{
+    return &gb->ppu.display.frame;
+}
+
+void video_reset(struct gb *gb)
+{
+    gb->ppu.lcdc = 0x00;
+    gb->ppu.stat = 0x04;
+    gb->ppu.scy = 0x00;
+    gb->ppu.scx = 0x00;
+    gb->ppu.ly = 0x00;
+    gb->ppu.lyc = 0x00;
+    gb->ppu.dma = 0x00;
+    gb->ppu.bgp = 0x00;
+    gb->ppu.obp[0] = 0x00;
+    gb->ppu.obp[1] = 0x00;
+    gb->ppu.wx = 0x00;
+    gb->ppu.wy = 0x00;
+
+    gb->ppu.frame_done = false;
+    gb->ppu.stat_line = false;
+    gb->ppu.line_clocks = 0;
+    gb->ppu.last_sync = gb->cpu.r.clk;
+    pixel_pipeline_reset(gb);
+
+    video_schedule(gb);
+
+    mmu_register_io(gb, LCDC_ADDRESS, lcdc_read, lcdc_write);
+    mmu_register_io(gb, STAT_ADDRESS, stat_read, stat_write);
+    mmu_register_io(gb, SCY_ADDRESS, scy_read, scy_write);
+    mmu_register_io(gb, SCX_ADDRESS, scx_read, scx_write);
+    mmu_register_io(gb, LY_ADDRESS, ly_read, ly_write);
+    mmu_register_io(gb, LYC_ADDRESS, lyc_read, lyc_write);
+    mmu_register_io(gb, DMA_ADDRESS, dma_read, dma_write);
+    mmu_register_io(gb, BGP_ADDRESS, bgp_read, bgp_write);
+    mmu_register_io(gb, OBP0_ADDRESS, obp_read, obp_write);
+    mmu_register_io(gb, OBP1_ADDRESS, obp_read, obp_write);
+    mmu_register_io(gb, WY_ADDRESS, wy_read, wy_write);
+    mmu_register_io(gb, WX_ADDRESS, wx_read, wx_write);
 }
\ No newline at end of file
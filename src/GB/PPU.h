@@ -25,61 +25,183 @@
 #define NEC_GPU_H
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "MMU.h"
+#include "display.h"
 
 #define _GPU_REG_OFFSET     0xFF40
 #define _GPU_REG_OFFSET_END 0xFF4B
 
-/**
- *
- * @param address
- * @return
- */
-uint8_t vram_read_byte(uint16_t address);
+#define SPRITES_PER_LINE        10
+#define PIXEL_FIFO_SIZE         16
+#define SPRITE_FIFO_SIZE        8
+
+#define OAM_SPRITE_SIZE         (_OAM_SIZE / 4)
+#define VRAM_TILE_DATA_SIZE     0x0800
+#define VRAM_NUM_TILE_DATA      3
+#define VRAM_TILE_MAP_SIZE      0x0400
+#define VRAM_NUM_TILE_MAPS      2
+#define VRAM_TILE_SIZE          0x10
+#define VRAM_NUM_TILES          (VRAM_NUM_TILE_DATA * VRAM_TILE_DATA_SIZE / VRAM_TILE_SIZE)
+#define TILE_WIDTH              8
+#define TILE_HEIGHT             8
+
+struct gb;
+
+struct sprite {
+    uint8_t y;
+    uint8_t x;
+    uint8_t code;
+    uint8_t flags;
+};
+
+enum fetch_state {
+    FETCH_TILE_NO,
+    FETCH_DATA0,
+    FETCH_DATA1,
+    FETCH_SAVE
+};
 
 /**
- *
- * @param address
- * @param value
+ * Pixel processing unit state of a single GameBoy instance.
  */
-void vram_write_byte(uint16_t address, uint8_t value);
+struct ppu {
+    uint8_t lcdc;
+    uint8_t stat;
+    uint8_t scy;
+    uint8_t scx;
+    uint8_t ly;
+    uint8_t lyc;
+    uint8_t dma;
+    uint8_t bgp;
+    uint8_t obp[2];
+    uint8_t wx;
+    uint8_t wy;
+
+    uint64_t last_sync;
+    uint32_t line_clocks;
+    bool frame_done;
+    bool stat_line;
+
+    enum GB_renderer renderer;
+    struct display display;
+
+    union {
+        struct {
+            uint8_t tile_data[VRAM_NUM_TILE_DATA][VRAM_TILE_DATA_SIZE];
+            uint8_t tile_map[VRAM_NUM_TILE_MAPS][VRAM_TILE_MAP_SIZE];
+        };
+        uint8_t raw[_VRAM_SIZE];
+    } vram;
+
+    // Tile data decoded to color indices, [1] holds the tiles mirrored
+    uint8_t tiles[2][VRAM_NUM_TILES][TILE_HEIGHT][TILE_WIDTH];
+
+    union {
+        struct sprite sprites[OAM_SPRITE_SIZE];
+        uint8_t raw[_OAM_SIZE];
+    } oam;
+
+    struct sprite *visible_sprites[SPRITES_PER_LINE];
+
+    struct {
+        bool in_window;
+
+        uint8_t scy;
+        uint8_t scx;
+        uint8_t ly;
+        uint8_t lx;
+        uint8_t lyc;
+        uint8_t wy;
+        uint8_t wx;
+
+        struct {
+            uint8_t read_ptr;
+            uint8_t write_ptr;
+            int8_t revs;
+            struct {
+                uint8_t data;
+                uint8_t *palette;
+            } pixel[PIXEL_FIFO_SIZE];
+            bool idle;
+        } pixel_fifo;
+
+        struct {
+            uint8_t read_ptr;
+            struct {
+                uint8_t data;
+                uint8_t *palette;
+            } pixel[SPRITE_FIFO_SIZE];
+        } sprite_fifo;
+
+        struct {
+            struct {
+                uint16_t base;
+                uint16_t x_offset;
+                uint16_t y_offset;
+            } address;
+            uint8_t tile_no;
+            const uint8_t *row;
+            enum fetch_state state;
+            struct sprite *sprite;
+            bool idle;
+        } fetch;
+    } pipeline;
+};
 
 /**
  *
+ * @param gb
  * @param address
  * @return
  */
-uint8_t oam_read_byte(uint16_t address);
+uint8_t vram_read_byte(struct gb *gb, uint16_t address);
 
 /**
  *
+ * @param gb
  * @param address
  * @param value
  */
-void oam_write_byte(uint16_t address, uint8_t value);
+void vram_write_byte(struct gb *gb, uint16_t address, uint8_t value);
 
 /**
  *
+ * @param gb
  * @param address
  * @return
  */
-uint8_t video_read_byte(uint16_t address);
+uint8_t oam_read_byte(struct gb *gb, uint16_t address);
 
 /**
  *
+ * @param gb
  * @param address
  * @param value
  */
-void video_write_byte(uint16_t address, uint8_t value);
+void oam_write_byte(struct gb *gb, uint16_t address, uint8_t value);
+
+/**
+ * PPU mode transition deadline handler.
+ *
+ * @param gb
+ * @param deadline
+ */
+void video_event(struct gb *gb, uint64_t deadline);
 
 /**
+ * OAM DMA completion deadline handler.
  *
- * @param clk_tics
+ * @param gb
+ * @param deadline
  */
-void video_update(uint8_t clk_tics);
+void dma_event(struct gb *gb, uint64_t deadline);
 
 /**
  *
+ * @param gb
  */
-void video_reset(void);
+void video_reset(struct gb *gb);
 
 #endif //NEC_GPU_H
@@ -43,7 +43,7 @@ static void audio_callback(void *unused, Uint8 *stream, int len)
     SDL_AudioStreamGet(_audio_stream, stream, len);
 }
 
-void audio_setup(void)
+void audio_setup(struct gb *gb)
 {
     const SDL_AudioSpec _want = {
             .freq = AUDIO_SRC_FREQ,
@@ -58,14 +58,14 @@ void audio_setup(void)
     _audio_device = SDL_OpenAudioDevice(NULL, 0, &_want, &_have, SDL_AUDIO_ALLOW_ANY_CHANGE);
     if(_audio_device == 0) {
         log_error("Could not retrieve a valid audio device: %s.\n", SDL_GetError());
-        GB_exit();
+        GB_exit(gb);
         return;
     }
 
     _audio_stream = SDL_NewAudioStream(AUDIO_SRC_FORMAT, AUDIO_SRC_CHANNELS, AUDIO_SRC_FREQ, _have.format, _have.channels, _have.freq);
     if(_audio_stream == NULL) {
         log_error("Could not initialize audio stream: %s.\n", SDL_GetError());
-        GB_exit();
+        GB_exit(gb);
         return;
     }
 }
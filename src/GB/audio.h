@@ -26,6 +26,8 @@
 
 #include <stdint.h>
 
+struct gb;
+
 struct sound {
     int8_t mix_left;
     int8_t mix_right;
@@ -37,10 +39,15 @@ struct sound {
     int8_t volume_right;
 };
 
+/*
+ * Audio output of the frontend, implemented by audio.c (SDL) or headless.c.
+ */
+
 /**
  *
+ * @param gb
  */
-void audio_setup(void);
+void audio_setup(struct gb *gb);
 
 /**
  *
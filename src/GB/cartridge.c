@@ -21,14 +21,27 @@
  * SOFTWARE.
  */
 
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "cartridge.h"
 
 #include <stdbool.h>
-#include <mem.h>
+#include <string.h>
+#include <errno.h>
 #include <stdlib.h>
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #include "GB.h"
 #include "LR35902.h"
+#include "context.h"
 
 #define TITLE_OFFSET    0x0134
 #define MBC_OFFSET      0x0147
@@ -40,51 +53,251 @@
 #define _RAM_ROM_BANK_NUMBER_OFFSET 0x4000
 #define _ROM_BANK_NUMBER_OFFSET     0x2000
 
-static uint8_t _ROM[_ROM_SIZE] = {0};
-static uint8_t _EXT_ROM[_EXT_ROM_SIZE] = {0};
+// Battery RAM is written back to the SAV file about once every second
+#define SAVE_FLUSH_CLOCKS   (4 * 1024 * 1024)
 
-static uint8_t _EXT_RAM[_EXT_RAM_SIZE] = {0};
+/**
+ *
+ * @return
+ */
+static bool is_mbc2(struct gb *gb)
+{
+    return ((gb->cartridge.ROM[MBC_OFFSET] == 0x05) || (gb->cartridge.ROM[MBC_OFFSET] == 0x06));
+}
 
-struct {
-    FILE *_rom_ptr;
-    FILE *_save_ptr;
-} _cartridge;
+/**
+ * Size of the battery backed RAM of the cartridge, as stored in the SAV file.
+ *
+ * @param gb
+ * @return
+ */
+static size_t sav_size(struct gb *gb)
+{
+    if(is_mbc2(gb)) {
+        return MBC2_EXT_RAM_SIZE;
+    }
+
+    switch (gb->cartridge.ROM[RAM_SIZE_OFFSET]) {
+        case 0x01:
+            return 0x800;
+        case 0x02:
+            return _EXT_RAM_SIZE;
+        case 0x03:
+            return 4 * _EXT_RAM_SIZE;
+        case 0x04:
+            return 16 * _EXT_RAM_SIZE;
+        default:
+            return 0;
+    }
+}
 
 /**
+ * Grow a (new or truncated) SAV file to the full RAM size of the cartridge.
  *
+ * @param gb
+ * @param sav
+ */
+static void init_save_file(struct gb *gb, FILE *sav)
+{
+    size_t size = sav_size(gb);
+    int fill = (is_mbc2(gb) ? 0x0F : 0xFF);
+
+    fseek(sav, 0, SEEK_END);
+    for(long length = ftell(sav); length >= 0 && (size_t) length < size; length++) {
+        fputc(fill, sav);
+    }
+    fflush(sav);
+    rewind(sav);
+}
+
+/**
+ * Map a ROM file into memory as a whole. Where the host supports it the file
+ * is mapped read-only, so every instance running the same ROM shares its pages.
+ *
+ * @param rom
+ * @param size
  * @return
  */
-static bool is_mbc2(void)
+static const uint8_t *rom_image_open(const char *rom, size_t *size)
 {
-    return ((_ROM[MBC_OFFSET] == 0x05) || (_ROM[MBC_OFFSET] == 0x06));
+#if !defined(_WIN32)
+    int fd = open(rom, O_RDONLY);
+    if(fd < 0) {
+        log_error("ROM file could not be opened: %d.\n", errno);
+        return NULL;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < _ROM_SIZE + _EXT_ROM_SIZE) {
+        log_error("ROM file is smaller than 2 banks.\n");
+        close(fd);
+        return NULL;
+    }
+
+    void *image = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(image == MAP_FAILED) {
+        log_error("ROM file could not be mapped: %d.\n", errno);
+        return NULL;
+    }
+
+    *size = (size_t) st.st_size;
+    return image;
+#else
+    FILE *_rom_ptr = fopen(rom, "rb");
+    if(_rom_ptr == NULL) {
+        log_error("ROM file could not be opened: %d.\n", errno);
+        return NULL;
+    }
+
+    fseek(_rom_ptr, 0, SEEK_END);
+    long rom_size = ftell(_rom_ptr);
+    if(rom_size < _ROM_SIZE + _EXT_ROM_SIZE) {
+        log_error("ROM file is smaller than 2 banks.\n");
+        fclose(_rom_ptr);
+        return NULL;
+    }
+
+    uint8_t *image = malloc((size_t) rom_size);
+    if(image == NULL) {
+        log_error("Could not allocate %d bytes for the ROM.\n", rom_size);
+        fclose(_rom_ptr);
+        return NULL;
+    }
+
+    rewind(_rom_ptr);
+    size_t result = fread(image, sizeof(uint8_t), (size_t) rom_size, _rom_ptr);
+    fclose(_rom_ptr);
+    if(result != (size_t) rom_size) {
+        log_error("Invalid amount of bytes read (Read: %d bytes, Expected: %d bytes)\n", result, rom_size);
+        free(image);
+        return NULL;
+    }
+
+    *size = (size_t) rom_size;
+    return image;
+#endif
 }
 
-static void init_save_file(FILE *sav)
+/**
+ *
+ * @param image
+ * @param size
+ */
+static void rom_image_close(const uint8_t *image, size_t size)
 {
-    if(is_mbc2()) {
-        uint8_t init[MBC2_EXT_RAM_SIZE];
-        memset(&init, 0x0F, MBC2_EXT_RAM_SIZE);
-        fwrite(&init, sizeof(uint8_t), MBC2_EXT_RAM_SIZE, sav);
-        rewind(sav);
-    } else {
-        uint8_t rom_size_id = _ROM[RAM_SIZE_OFFSET];
-        size_t size = (size_t) (_EXT_RAM_SIZE << (2 * (rom_size_id - 0x02)));
-        switch (_ROM[RAM_SIZE_OFFSET]) {
-            case 0x01:
-            case 0x02:
-            case 0x03:
-            case 0x04:
-                break;
-            default:
-                return;
-        }
-        uint8_t init[size];
-        memset(&init, 0xFF, size);
-        fwrite(&init, sizeof(uint8_t), size, sav);
-        rewind(sav);
+#if !defined(_WIN32)
+    munmap((void *) image, size);
+#else
+    free((void *) image);
+#endif
+}
+
+/**
+ * Map a SAV file into memory. Where the host supports it the mapping is shared
+ * with the file, so writes to cartridge RAM reach the file without any copying
+ * and only have to be flushed.
+ *
+ * @param sav
+ * @param size
+ * @return
+ */
+static uint8_t *sav_image_open(FILE *sav, size_t size)
+{
+#if !defined(_WIN32)
+    void *image = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(sav), 0);
+    if(image == MAP_FAILED) {
+        log_error("SAV file could not be mapped: %d.\n", errno);
+        return NULL;
+    }
+    return image;
+#else
+    uint8_t *image = malloc(size);
+    if(image == NULL) {
+        log_error("Could not allocate %d bytes for the SAV file.\n", size);
+        return NULL;
+    }
+
+    rewind(sav);
+    size_t result = fread(image, sizeof(uint8_t), size, sav);
+    if(result != size) {
+        log_error("Invalid amount of bytes read (Read: %d bytes, Expected: %d bytes)\n", result, size);
+        free(image);
+        return NULL;
     }
+    return image;
+#endif
+}
+
+/**
+ *
+ * @param sav
+ * @param image
+ * @param size
+ * @param wait Block until the data has reached the file
+ */
+static void sav_image_flush(FILE *sav, uint8_t *image, size_t size, bool wait)
+{
+#if !defined(_WIN32)
+    msync(image, size, (wait ? MS_SYNC : MS_ASYNC));
+#else
+    rewind(sav);
+    fwrite(image, sizeof(uint8_t), size, sav);
+    fflush(sav);
+#endif
+}
+
+/**
+ *
+ * @param image
+ * @param size
+ */
+static void sav_image_close(uint8_t *image, size_t size)
+{
+#if !defined(_WIN32)
+    munmap(image, size);
+#else
+    free(image);
+#endif
+}
+
+/**
+ * Switch the 0x4000-0x7FFF window to another bank of the ROM image. Banks
+ * beyond the end of the ROM wrap around, as the unused bank lines do on a
+ * real cartridge.
+ *
+ * @param gb
+ * @param rom_bank
+ */
+static void map_rom_bank(struct gb *gb, int rom_bank)
+{
+    size_t banks = gb->cartridge.rom_size / _EXT_ROM_SIZE;
+    gb->cartridge.EXT_ROM = gb->cartridge.ROM + ((size_t) rom_bank % banks) * _EXT_ROM_SIZE;
+    mmu_map(gb, _EXT_ROM_OFFSET, _EXT_ROM_SIZE, gb->cartridge.EXT_ROM, NULL);
 }
 
+/**
+ * Switch the 0xA000-0xBFFF window to another bank of the SAV image.
+ *
+ * @param gb
+ * @param ram_bank
+ */
+static void map_ram_bank(struct gb *gb, int ram_bank)
+{
+    if(gb->cartridge.SAV == NULL) {
+        return;
+    }
+
+    size_t banks = gb->cartridge.sav_size / _EXT_RAM_SIZE;
+    banks = (banks ? banks : 1);
+    gb->cartridge.EXT_RAM = gb->cartridge.SAV + ((size_t) ram_bank % banks) * _EXT_RAM_SIZE;
+
+    // MBC2 RAM is only 4 bits wide and always goes through the handlers
+    if(!is_mbc2(gb)) {
+        size_t size = (gb->cartridge.sav_size < _EXT_RAM_SIZE ? gb->cartridge.sav_size : _EXT_RAM_SIZE);
+        mmu_map(gb, _EXT_RAM_OFFSET, (uint32_t) size, gb->cartridge.EXT_RAM, gb->cartridge.EXT_RAM);
+    }
+}
 
 /*
  *  MBC
@@ -94,45 +307,23 @@ static void init_save_file(FILE *sav)
  *
  * @return
  */
-static bool has_extram(void)
+static bool has_extram(struct gb *gb)
 {
-    return (_ROM[RAM_SIZE_OFFSET] != 0) && (_ROM[RAM_SIZE_OFFSET] <= 4);
+    return sav_size(gb) != 0;
 }
 
 /*
  * MBC 1
  */
-struct {
-    bool ext_ram_enabled;
-    bool ram_bank_mode;
-    uint8_t rom_bank_lo;
-    uint8_t rom_bank_hi;
-    uint8_t ram_bank;
-    int current_rom_bank;
-    int current_ram_bank;
-} _mbc1 = {
-        .ext_ram_enabled = false,
-        .ram_bank_mode = false,
-        .rom_bank_lo = 1,
-        .rom_bank_hi = 0,
-        .ram_bank = 0,
-        .current_rom_bank = 1,
-        .current_ram_bank = 0
-};
-
 /**
  *
  * @param ram_bank
  */
-static void mbc1_load_ram_bank(int ram_bank)
+static void mbc1_load_ram_bank(struct gb *gb, int ram_bank)
 {
-    if(ram_bank != _mbc1.current_ram_bank) {
-        fseek(_cartridge._save_ptr, _mbc1.current_ram_bank * _EXT_RAM_SIZE, SEEK_SET);
-        fwrite(_EXT_RAM, sizeof(uint8_t), _EXT_RAM_SIZE, _cartridge._save_ptr);
-
-        fseek(_cartridge._save_ptr, ram_bank * _EXT_RAM_SIZE, SEEK_SET);
-        fread(_EXT_RAM, sizeof(uint8_t), _EXT_RAM_SIZE, _cartridge._save_ptr);
-        _mbc1.current_ram_bank = ram_bank;
+    if(ram_bank != gb->cartridge.mbc1.current_ram_bank) {
+        map_ram_bank(gb, ram_bank);
+        gb->cartridge.mbc1.current_ram_bank = ram_bank;
     }
 }
 
@@ -140,12 +331,11 @@ static void mbc1_load_ram_bank(int ram_bank)
  *
  * @param rom_bank
  */
-static void mbc1_load_rom_bank(int rom_bank)
+static void mbc1_load_rom_bank(struct gb *gb, int rom_bank)
 {
-    if(rom_bank != _mbc1.current_rom_bank) {
-        fseek(_cartridge._rom_ptr, rom_bank * _EXT_ROM_SIZE, SEEK_SET);
-        fread(_EXT_ROM, sizeof(uint8_t), _EXT_ROM_SIZE, _cartridge._rom_ptr);
-        _mbc1.current_rom_bank = rom_bank;
+    if(rom_bank != gb->cartridge.mbc1.current_rom_bank) {
+        map_rom_bank(gb, rom_bank);
+        gb->cartridge.mbc1.current_rom_bank = rom_bank;
     }
 }
 
@@ -154,59 +344,48 @@ static void mbc1_load_rom_bank(int rom_bank)
  * @param address
  * @param value
  */
-static void mbc1_write_rom(uint16_t address, uint8_t value)
+static void mbc1_write_rom(struct gb *gb, uint16_t address, uint8_t value)
 {
     if( _ROM_RAM_MODE_SELECT_OFFSET <= address ) {
-        _mbc1.ram_bank_mode = ((value & 0x01) == 0x01);
+        gb->cartridge.mbc1.ram_bank_mode = ((value & 0x01) == 0x01);
     } else if( _RAM_ROM_BANK_NUMBER_OFFSET <= address ) {
         value &= 0x03;
-        if(_mbc1.ram_bank_mode) {
-            _mbc1.ram_bank = value;
+        if(gb->cartridge.mbc1.ram_bank_mode) {
+            gb->cartridge.mbc1.ram_bank = value;
         } else {
-            _mbc1.rom_bank_hi = value;
+            gb->cartridge.mbc1.rom_bank_hi = value;
         }
     } else if ( _ROM_BANK_NUMBER_OFFSET <= address ) {
         value &= 0x1F;
         if(!value) {
             value = 0x01;
         }
-        _mbc1.rom_bank_lo = value;
+        gb->cartridge.mbc1.rom_bank_lo = value;
     } else {
-        _mbc1.ext_ram_enabled = ((value & 0x0F) == 0x0A);
+        gb->cartridge.mbc1.ext_ram_enabled = ((value & 0x0F) == 0x0A);
     }
 
-    if(_mbc1.ram_bank_mode) {
-        mbc1_load_ram_bank(_mbc1.ram_bank);
-        mbc1_load_rom_bank(_mbc1.rom_bank_lo);
+    if(gb->cartridge.mbc1.ram_bank_mode) {
+        mbc1_load_ram_bank(gb, gb->cartridge.mbc1.ram_bank);
+        mbc1_load_rom_bank(gb, gb->cartridge.mbc1.rom_bank_lo);
     } else {
-        mbc1_load_ram_bank(0);
-        mbc1_load_rom_bank((_mbc1.rom_bank_hi << 5) | _mbc1.rom_bank_lo);
+        mbc1_load_ram_bank(gb, 0);
+        mbc1_load_rom_bank(gb, (gb->cartridge.mbc1.rom_bank_hi << 5) | gb->cartridge.mbc1.rom_bank_lo);
     }
 }
 
 /*
  * MBC 2
  */
-struct {
-    int rom_bank;
-    int current_rom_bank;
-    bool ext_ram_enabled;
-} _mbc2 = {
-        .rom_bank = 1,
-        .current_rom_bank = 1,
-        .ext_ram_enabled = false
-};
-
 /**
  *
  * @param rom_bank
  */
-static void mbc2_load_rom_bank(int rom_bank)
+static void mbc2_load_rom_bank(struct gb *gb, int rom_bank)
 {
-    if(rom_bank != _mbc2.current_rom_bank) {
-        fseek(_cartridge._rom_ptr, rom_bank * _EXT_ROM_SIZE, SEEK_SET);
-        fread(_EXT_ROM, sizeof(uint8_t), _EXT_ROM_SIZE, _cartridge._rom_ptr);
-        _mbc2.current_rom_bank = rom_bank;
+    if(rom_bank != gb->cartridge.mbc2.current_rom_bank) {
+        map_rom_bank(gb, rom_bank);
+        gb->cartridge.mbc2.current_rom_bank = rom_bank;
     }
 }
 
@@ -215,19 +394,19 @@ static void mbc2_load_rom_bank(int rom_bank)
  * @param address
  * @param value
  */
-static void mbc2_write_rom(uint16_t address, uint8_t value)
+static void mbc2_write_rom(struct gb *gb, uint16_t address, uint8_t value)
 {
     if ( _ROM_BANK_NUMBER_OFFSET <= address && address <= _RAM_ROM_BANK_NUMBER_OFFSET && (address & 0x10) ) {
         value &= 0x0F;
         if(!value) {
             value = 0x01;
         }
-        _mbc2.rom_bank = value;
+        gb->cartridge.mbc2.rom_bank = value;
     } else if(!(address & 0x10)) {
-        _mbc2.ext_ram_enabled = ((value & 0x0F) == 0x0A);
+        gb->cartridge.mbc2.ext_ram_enabled = ((value & 0x0F) == 0x0A);
     }
 
-    mbc2_load_rom_bank(_mbc2.rom_bank);
+    mbc2_load_rom_bank(gb, gb->cartridge.mbc2.rom_bank);
 }
 
 /**
@@ -235,10 +414,10 @@ static void mbc2_write_rom(uint16_t address, uint8_t value)
  * @param address
  * @return
  */
-static uint8_t mbc2_read_extram(uint16_t address)
+static uint8_t mbc2_read_extram(struct gb *gb, uint16_t address)
 {
     if(_EXT_RAM_OFFSET <= address && address < _EXT_RAM_OFFSET + MBC2_EXT_RAM_SIZE) {
-        return (uint8_t) (_EXT_RAM[address - _EXT_RAM_OFFSET] & 0x0F);
+        return (uint8_t) (gb->cartridge.EXT_RAM[address - _EXT_RAM_OFFSET] & 0x0F);
     }
     return 0xFF;
 }
@@ -248,45 +427,25 @@ static uint8_t mbc2_read_extram(uint16_t address)
  * @param address
  * @param value
  */
-static void mbc2_write_extram(uint16_t address, uint8_t value)
+static void mbc2_write_extram(struct gb *gb, uint16_t address, uint8_t value)
 {
     if(_EXT_RAM_OFFSET <= address && address < _EXT_RAM_OFFSET + MBC2_EXT_RAM_SIZE) {
-        _EXT_RAM[address - _EXT_RAM_OFFSET] = (uint8_t) (value & 0x0F);
+        gb->cartridge.EXT_RAM[address - _EXT_RAM_OFFSET] = (uint8_t) (value & 0x0F);
     }
 }
 
 /*
  * MBC 3
  */
-struct {
-    uint8_t latch;
-    int rom_bank;
-    int current_rom_bank;
-    int ram_bank;
-    int current_ram_bank;
-    bool ext_ram_enabled;
-} _mbc3 = {
-        .latch = 0x00,
-        .rom_bank = 1,
-        .current_rom_bank = 1,
-        .ram_bank = 0,
-        .current_ram_bank = 0,
-        .ext_ram_enabled = false
-};
-
 /**
  *
  * @param ram_bank
  */
-static void mbc3_load_ram_bank(int ram_bank)
+static void mbc3_load_ram_bank(struct gb *gb, int ram_bank)
 {
-    if(ram_bank != _mbc3.current_ram_bank) {
-        fseek(_cartridge._save_ptr, _mbc3.current_ram_bank * _EXT_RAM_SIZE, SEEK_SET);
-        fwrite(_EXT_RAM, sizeof(uint8_t), _EXT_RAM_SIZE, _cartridge._save_ptr);
-
-        fseek(_cartridge._save_ptr, ram_bank * _EXT_ROM_SIZE, SEEK_SET);
-        fread(_EXT_RAM, sizeof(uint8_t), _EXT_ROM_SIZE, _cartridge._save_ptr);
-        _mbc3.current_ram_bank = ram_bank;
+    if(ram_bank != gb->cartridge.mbc3.current_ram_bank) {
+        map_ram_bank(gb, ram_bank);
+        gb->cartridge.mbc3.current_ram_bank = ram_bank;
     }
 }
 
@@ -294,12 +453,11 @@ static void mbc3_load_ram_bank(int ram_bank)
  *
  * @param rom_bank
  */
-static void mbc3_load_rom_bank(int rom_bank)
+static void mbc3_load_rom_bank(struct gb *gb, int rom_bank)
 {
-    if(rom_bank != _mbc3.current_rom_bank) {
-        fseek(_cartridge._rom_ptr, rom_bank * _EXT_ROM_SIZE, SEEK_SET);
-        fread(_EXT_ROM, sizeof(uint8_t), _EXT_ROM_SIZE, _cartridge._rom_ptr);
-        _mbc3.current_rom_bank = rom_bank;
+    if(rom_bank != gb->cartridge.mbc3.current_rom_bank) {
+        map_rom_bank(gb, rom_bank);
+        gb->cartridge.mbc3.current_rom_bank = rom_bank;
     }
 }
 
@@ -308,13 +466,13 @@ static void mbc3_load_rom_bank(int rom_bank)
  * @param address
  * @param value
  */
-static void mbc3_write_rom(uint16_t address, uint8_t value)
+static void mbc3_write_rom(struct gb *gb, uint16_t address, uint8_t value)
 {
     if( _ROM_RAM_MODE_SELECT_OFFSET <= address ) {
-        if((value & 0x01) && !(_mbc3.latch & 0x01)) {
+        if((value & 0x01) && !(gb->cartridge.mbc3.latch & 0x01)) {
             // TODO: latch
         }
-        _mbc3.latch = value;
+        gb->cartridge.mbc3.latch = value;
     } else if( _RAM_ROM_BANK_NUMBER_OFFSET <= address ) {
         if(value & 0x0C) {
             switch (value & 0x0F) {
@@ -333,10 +491,10 @@ static void mbc3_write_rom(uint16_t address, uint8_t value)
             }
         } else {
             value &= 0x03;
-            if(_mbc1.ram_bank_mode) {
-                _mbc1.ram_bank = value;
+            if(gb->cartridge.mbc1.ram_bank_mode) {
+                gb->cartridge.mbc1.ram_bank = value;
             } else {
-                _mbc1.rom_bank_hi = value;
+                gb->cartridge.mbc1.rom_bank_hi = value;
             }
         }
     } else if ( _ROM_BANK_NUMBER_OFFSET <= address ) {
@@ -344,16 +502,30 @@ static void mbc3_write_rom(uint16_t address, uint8_t value)
         if(!value) {
             value = 0x01;
         }
-        _mbc3.rom_bank = value;
+        gb->cartridge.mbc3.rom_bank = value;
     } else {
-        _mbc3.ext_ram_enabled = ((value & 0x0F) == 0x0A);
+        gb->cartridge.mbc3.ext_ram_enabled = ((value & 0x0F) == 0x0A);
     }
 
-    mbc3_load_ram_bank(_mbc3.ram_bank);
-    mbc3_load_rom_bank(_mbc3.rom_bank);
+    mbc3_load_ram_bank(gb, gb->cartridge.mbc3.ram_bank);
+    mbc3_load_rom_bank(gb, gb->cartridge.mbc3.rom_bank);
+}
+
+/**
+ * Install the cartridge memories into the MMU page table.
+ *
+ * @param gb
+ */
+static void mbc_map(struct gb *gb)
+{
+    mmu_map(gb, _ROM_OFFSET, _ROM_SIZE, gb->cartridge.ROM, NULL);
+    map_rom_bank(gb, 1);
+
+    mmu_map(gb, _EXT_RAM_OFFSET, _EXT_RAM_SIZE, NULL, NULL);
+    map_ram_bank(gb, 0);
 }
 
-static FILE *create_sav_file(const char *rom)
+static FILE *create_sav_file(struct gb *gb, const char *rom)
 {
     FILE *_sav_ptr;
     const char *filepath = strrchr(rom, '.');
@@ -368,177 +540,112 @@ static FILE *create_sav_file(const char *rom)
     _sav_ptr = fopen(new_save_file, "w+b");
     if(_sav_ptr == NULL) {
         log_error("SAV file could not be opened %d.\n", errno);
-        return 0;
+        return NULL;
     }
 
-    init_save_file(_sav_ptr);
     return _sav_ptr;
 }
 
-int load_cartridge(const char *rom, char *sav)
+int load_cartridge(struct gb *gb, const char *rom, char *sav)
 {
-    FILE *_rom_ptr = fopen(rom, "rb");
-    if(_rom_ptr == NULL) {
-        log_error("ROM file could not be opened: %d.\n", errno);
-        return 0;
-    }
-
-    fseek(_rom_ptr, 0, SEEK_END);
-    long rom_size = ftell(_rom_ptr);
-
-    if(rom_size < _ROM_SIZE + _EXT_ROM_SIZE) {
-        log_error("ROM file is smaller than 2 banks.\n");
-        return 0;
-    }
-
-    rewind(_rom_ptr);
-    size_t result = fread(_ROM, sizeof(uint8_t), _ROM_SIZE, _rom_ptr);
-    if(result != _ROM_SIZE) {
-        log_error("Invalid amount of bytes read (Read: %d bytes, Expected: %d bytes)\n", result, _ROM_SIZE);
-        if(feof(_rom_ptr)) {
-            log_error("The end of the ROM file was reached.\n");
-        } else if(ferror(_rom_ptr)) {
-            log_error("Unknown error during read.\n");
-        }
-        return 0;
-    }
-
-    result = fread(_EXT_ROM, sizeof(uint8_t), _EXT_ROM_SIZE, _rom_ptr);
-    if(result != _EXT_ROM_SIZE) {
-        log_error("Invalid amount of bytes read (Read: %d bytes, Expected: %d bytes)\n", result, _EXT_ROM_SIZE);
-        if(feof(_rom_ptr)) {
-            log_error("The end of the ROM file was reached.\n");
-        } else if(ferror(_rom_ptr)) {
-            log_error("Unknown error during read.\n");
-        }
+    size_t rom_size;
+    const uint8_t *image = rom_image_open(rom, &rom_size);
+    if(image == NULL) {
         return 0;
     }
 
-    _cartridge._rom_ptr = _rom_ptr;
-    set_title((const char *) &_ROM[TITLE_OFFSET]);
+    gb->cartridge.ROM = image;
+    gb->cartridge.rom_size = rom_size;
 
-    if(has_extram()) {
+    if(has_extram(gb)) {
         FILE *_sav_ptr;
         if(sav == NULL) {
-            _sav_ptr = create_sav_file(rom);
+            _sav_ptr = create_sav_file(gb, rom);
         } else {
             _sav_ptr = fopen(sav, "r+b");
             if(_sav_ptr == NULL) {
-                _sav_ptr = create_sav_file(rom);
+                _sav_ptr = create_sav_file(gb, rom);
             }
         }
-
-        uint8_t rom_size_id = _ROM[RAM_SIZE_OFFSET];
-        size_t size = (size_t) (_EXT_RAM_SIZE << (2 * (rom_size_id - 0x02)));
-        size = (size > _EXT_RAM_SIZE ? _EXT_RAM_SIZE : size);
-        if(is_mbc2()) {
-            size = MBC2_EXT_RAM_SIZE;
+        if(_sav_ptr == NULL) {
+            unload_cartridge(gb);
+            return 0;
         }
-        result = fread(_EXT_RAM, sizeof(uint8_t), size, _sav_ptr);
-        if(result != size) {
-            log_error("Invalid amount of bytes read (Read: %d bytes, Expected: %d bytes)\n", result, size);
-            if(feof(_sav_ptr)) {
-                log_error("The end of the SAV file was reached.\n");
-            } else if(ferror(_sav_ptr)) {
-                log_error("Unknown error during read.\n");
-            }
+
+        init_save_file(gb, _sav_ptr);
+        uint8_t *_sav_image = sav_image_open(_sav_ptr, sav_size(gb));
+        if(_sav_image == NULL) {
+            fclose(_sav_ptr);
+            unload_cartridge(gb);
             return 0;
         }
-        _cartridge._save_ptr = _sav_ptr;
-    } else {
-        _cartridge._save_ptr = NULL;
+        gb->cartridge.save_ptr = _sav_ptr;
+        gb->cartridge.SAV = _sav_image;
+        gb->cartridge.sav_size = sav_size(gb);
     }
 
+    mbc_reset(gb);
+    set_title(gb, (const char *) &gb->cartridge.ROM[TITLE_OFFSET]);
+
     return 1;
 }
 
-void unload_cartridge(void)
+void unload_cartridge(struct gb *gb)
 {
-    if(_cartridge._rom_ptr != NULL) {
-        switch (_ROM[MBC_OFFSET]) {
-            default:
-            case 0x00:
-            case 0x08:
-            case 0x09:
-                break;
-            case 0x01:
-            case 0x02:
-            case 0x03:
-                fseek(_cartridge._save_ptr, _mbc1.current_ram_bank * _EXT_RAM_SIZE, SEEK_SET);
-                fwrite(_EXT_RAM, sizeof(uint8_t), _EXT_RAM_SIZE, _cartridge._save_ptr);
-                break;
-            case 0x05:
-            case 0x06:
-                fseek(_cartridge._save_ptr, 0, SEEK_SET);
-                fwrite(_EXT_RAM, sizeof(uint8_t), MBC2_EXT_RAM_SIZE, _cartridge._save_ptr);
-                break;
-            case 0x0B:
-            case 0x0C:
-            case 0x0D:
-                //mmm01_write_rom(address, value);
-                break;
-            case 0x0F:
-            case 0x10:
-            case 0x11:
-            case 0x12:
-            case 0x13:
-                fseek(_cartridge._save_ptr, _mbc3.current_ram_bank * _EXT_RAM_SIZE, SEEK_SET);
-                fwrite(_EXT_RAM, sizeof(uint8_t), _EXT_RAM_SIZE, _cartridge._save_ptr);
-                break;
-            case 0x19:
-            case 0x1A:
-            case 0x1B:
-            case 0x1C:
-            case 0x1D:
-            case 0x1E:
-                //mbc5_write_rom(address, value);
-                break;
-            case 0x1F:
-                // Pocket Camera
-                break;
-            case 0xFD:
-                // Bandai TAMA5
-                break;
-            case 0xFE:
-                // Hudson HuC 3
-                break;
-            case 0xFF:
-                // Hudson HuC 1
-                break;
+    if(gb->cartridge.ROM != NULL) {
+        if(gb->cartridge.save_ptr != NULL) {
+            flush_save(gb, true);
+            sav_image_close(gb->cartridge.SAV, gb->cartridge.sav_size);
+            fclose(gb->cartridge.save_ptr);
+            gb->cartridge.save_ptr = NULL;
+            gb->cartridge.SAV = NULL;
+            gb->cartridge.EXT_RAM = NULL;
+            gb->cartridge.sav_size = 0;
         }
+        cancel_event(gb, EVENT_SAVE_FLUSH);
+        rom_image_close(gb->cartridge.ROM, gb->cartridge.rom_size);
+        gb->cartridge.ROM = NULL;
+        gb->cartridge.EXT_ROM = NULL;
+        gb->cartridge.rom_size = 0;
+
+        mmu_map(gb, _ROM_OFFSET, _ROM_SIZE + _EXT_ROM_SIZE, NULL, NULL);
+        mmu_map(gb, _EXT_RAM_OFFSET, _EXT_RAM_SIZE, NULL, NULL);
+
+        // The next image can be loaded at the same address
+        cpu_flush_code(gb);
     }
 }
 
-uint8_t rom_read_byte(uint16_t address)
+uint8_t rom_read_byte(struct gb *gb, uint16_t address)
 {
-    if(_cartridge._rom_ptr != NULL) {
+    if(gb->cartridge.ROM != NULL) {
         if( _EXT_ROM_OFFSET <= address ) {
-            return _EXT_ROM[ address - _EXT_ROM_OFFSET ];
+            return gb->cartridge.EXT_ROM[ address - _EXT_ROM_OFFSET ];
         } else if ( _ROM_OFFSET <= address ) {
-            return _ROM[ address - _ROM_OFFSET ];
+            return gb->cartridge.ROM[ address - _ROM_OFFSET ];
         }
     }
     return 0xFF;
 }
 
-void rom_write_byte(uint16_t address, uint8_t value)
+void rom_write_byte(struct gb *gb, uint16_t address, uint8_t value)
 {
-    if(_cartridge._rom_ptr != NULL) {
-        switch (_ROM[MBC_OFFSET]) {
+    if(gb->cartridge.ROM != NULL) {
+        switch (gb->cartridge.ROM[MBC_OFFSET]) {
             case 0x00:
             case 0x08:
             case 0x09:
                 log_error("Invalid write to ROM only cartridge (ROM address 0x%04X, Instruction opcode 0x%02X at address 0x%04x).\n",
-                          address, read_byte((uint16_t) (_r.pc - 1)), _r.pc - 1);
+                          address, read_byte(gb, (uint16_t) (gb->cpu.r.pc - 1)), gb->cpu.r.pc - 1);
                 break;
             case 0x01:
             case 0x02:
             case 0x03:
-                mbc1_write_rom(address, value);
+                mbc1_write_rom(gb, address, value);
                 break;
             case 0x05:
             case 0x06:
-                mbc2_write_rom(address, value);
+                mbc2_write_rom(gb, address, value);
                 break;
             case 0x0B:
             case 0x0C:
@@ -550,7 +657,7 @@ void rom_write_byte(uint16_t address, uint8_t value)
             case 0x11:
             case 0x12:
             case 0x13:
-                mbc3_write_rom(address, value);
+                mbc3_write_rom(gb, address, value);
                 break;
             case 0x19:
             case 0x1A:
@@ -578,24 +685,24 @@ void rom_write_byte(uint16_t address, uint8_t value)
     }
 }
 
-uint8_t ext_ram_read_byte(uint16_t address)
+uint8_t ext_ram_read_byte(struct gb *gb, uint16_t address)
 {
-    if(_cartridge._rom_ptr != NULL) {
-        switch (_ROM[RAM_SIZE_OFFSET]) {
+    if(gb->cartridge.EXT_RAM != NULL) {
+        switch (gb->cartridge.ROM[RAM_SIZE_OFFSET]) {
             default:
             case 0x00:
-                if(is_mbc2()) return mbc2_read_extram(address);
+                if(is_mbc2(gb)) return mbc2_read_extram(gb, address);
                 break;
             case 0x01:
                 if (_EXT_RAM_OFFSET <= address && address < _EXT_RAM_OFFSET + 0x800) {
-                    return _EXT_RAM[address - _EXT_RAM_OFFSET];
+                    return gb->cartridge.EXT_RAM[address - _EXT_RAM_OFFSET];
                 }
                 break;
             case 0x02:
             case 0x03:
             case 0x04:
                 if (_EXT_RAM_OFFSET <= address) {
-                    return _EXT_RAM[address - _EXT_RAM_OFFSET];
+                    return gb->cartridge.EXT_RAM[address - _EXT_RAM_OFFSET];
                 }
                 break;
         }
@@ -603,36 +710,74 @@ uint8_t ext_ram_read_byte(uint16_t address)
     return 0xFF;
 }
 
-void ext_ram_write_byte(uint16_t address, uint8_t value)
+void ext_ram_write_byte(struct gb *gb, uint16_t address, uint8_t value)
 {
-    if(_cartridge._rom_ptr != NULL) {
-        switch (_ROM[RAM_SIZE_OFFSET]) {
+    if(gb->cartridge.EXT_RAM != NULL) {
+        switch (gb->cartridge.ROM[RAM_SIZE_OFFSET]) {
             default:
             case 0x00:
-                if(is_mbc2()) mbc2_write_extram(address, value);
+                if(is_mbc2(gb)) mbc2_write_extram(gb, address, value);
                 break;
             case 0x01:
                 if (_EXT_RAM_OFFSET <= address && address < _EXT_RAM_OFFSET + 0x800) {
-                    _EXT_RAM[address - _EXT_RAM_OFFSET] = value;
+                    gb->cartridge.EXT_RAM[address - _EXT_RAM_OFFSET] = value;
                 }
                 break;
             case 0x02:
             case 0x03:
             case 0x04:
                 if (_EXT_RAM_OFFSET <= address) {
-                    _EXT_RAM[address - _EXT_RAM_OFFSET] = value;
+                    gb->cartridge.EXT_RAM[address - _EXT_RAM_OFFSET] = value;
                 }
                 break;
         }
     }
 }
 
+void flush_save(struct gb *gb, bool wait)
+{
+    if(gb->cartridge.SAV != NULL) {
+        sav_image_flush(gb->cartridge.save_ptr, gb->cartridge.SAV, gb->cartridge.sav_size, wait);
+    }
+}
+
+void cartridge_event(struct gb *gb, uint64_t deadline)
+{
+    flush_save(gb, false);
+    schedule_event(gb, EVENT_SAVE_FLUSH, deadline + SAVE_FLUSH_CLOCKS);
+}
+
 int8_t get_vin(void)
 {
     return 0;
 }
 
-void mbc_reset(void)
+void mbc_reset(struct gb *gb)
 {
+    gb->cartridge.mbc1.ext_ram_enabled = false;
+    gb->cartridge.mbc1.ram_bank_mode = false;
+    gb->cartridge.mbc1.rom_bank_lo = 1;
+    gb->cartridge.mbc1.rom_bank_hi = 0;
+    gb->cartridge.mbc1.ram_bank = 0;
+    gb->cartridge.mbc1.current_rom_bank = 1;
+    gb->cartridge.mbc1.current_ram_bank = 0;
+
+    gb->cartridge.mbc2.rom_bank = 1;
+    gb->cartridge.mbc2.current_rom_bank = 1;
+    gb->cartridge.mbc2.ext_ram_enabled = false;
+
+    gb->cartridge.mbc3.latch = 0x00;
+    gb->cartridge.mbc3.rom_bank = 1;
+    gb->cartridge.mbc3.current_rom_bank = 1;
+    gb->cartridge.mbc3.ram_bank = 0;
+    gb->cartridge.mbc3.current_ram_bank = 0;
+    gb->cartridge.mbc3.ext_ram_enabled = false;
+
+    if(gb->cartridge.ROM != NULL) {
+        mbc_map(gb);
+    }
 
+    if(gb->cartridge.SAV != NULL) {
+        schedule_event(gb, EVENT_SAVE_FLUSH, gb->cpu.r.clk + SAVE_FLUSH_CLOCKS);
+    }
 }
\ No newline at end of file
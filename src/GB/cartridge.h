@@ -25,22 +25,84 @@
 #define NEC_CARTRIDGE_H
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 #include "MMU.h"
 
-int load_cartridge(const char *_rom_ptr, char *sav);
+struct gb;
 
-void unload_cartridge(void);
+/**
+ * Cartridge state of a single GameBoy instance.
+ */
+struct cartridge {
+    // The whole ROM image, mapped read-only, and the bank in 0x4000-0x7FFF
+    const uint8_t *ROM;
+    const uint8_t *EXT_ROM;
+    size_t rom_size;
+
+    // The battery backed RAM, mapped from the SAV file, and the bank in 0xA000-0xBFFF
+    uint8_t *SAV;
+    uint8_t *EXT_RAM;
+    size_t sav_size;
+
+    FILE *save_ptr;
+
+    struct {
+        bool ext_ram_enabled;
+        bool ram_bank_mode;
+        uint8_t rom_bank_lo;
+        uint8_t rom_bank_hi;
+        uint8_t ram_bank;
+        int current_rom_bank;
+        int current_ram_bank;
+    } mbc1;
+
+    struct {
+        int rom_bank;
+        int current_rom_bank;
+        bool ext_ram_enabled;
+    } mbc2;
+
+    struct {
+        uint8_t latch;
+        int rom_bank;
+        int current_rom_bank;
+        int ram_bank;
+        int current_ram_bank;
+        bool ext_ram_enabled;
+    } mbc3;
+};
+
+int load_cartridge(struct gb *gb, const char *rom, char *sav);
 
-uint8_t rom_read_byte(uint16_t address);
+void unload_cartridge(struct gb *gb);
 
-void rom_write_byte(uint16_t address, uint8_t value);
+uint8_t rom_read_byte(struct gb *gb, uint16_t address);
 
-uint8_t ext_ram_read_byte(uint16_t address);
+void rom_write_byte(struct gb *gb, uint16_t address, uint8_t value);
 
-void ext_ram_write_byte(uint16_t address, uint8_t value);
+uint8_t ext_ram_read_byte(struct gb *gb, uint16_t address);
 
-void mbc_reset(void);
+void ext_ram_write_byte(struct gb *gb, uint16_t address, uint8_t value);
+
+void mbc_reset(struct gb *gb);
+
+/**
+ * Write the battery backed RAM back to the SAV file.
+ *
+ * @param gb
+ * @param wait Block until the data has reached the file
+ */
+void flush_save(struct gb *gb, bool wait);
+
+/**
+ * Periodic SAV file flush handler.
+ *
+ * @param gb
+ * @param deadline
+ */
+void cartridge_event(struct gb *gb, uint64_t deadline);
 
 int8_t get_vin(void);
 
@@ -0,0 +1,68 @@
+/* MIT License
+ *
+ * Copyright (c) 2017 Koen van der Heijden.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef NEC_CONTEXT_H
+#define NEC_CONTEXT_H
+
+#include "LR35902.h"
+#include "MMU.h"
+#include "PPU.h"
+#include "sound.h"
+#include "timer.h"
+#include "serial.h"
+#include "joypad.h"
+#include "cartridge.h"
+#include "scheduler.h"
+#include "jit.h"
+
+enum GB_state {
+    INIT = 0x00,
+    BIOS_LOADED = 0x01,
+    CARTRIDGE_LOADED = 0x02,
+    RUNNING = 0x03,
+    STOPPED = 0x04
+};
+
+/**
+ * Complete state of a single GameBoy instance.
+ *
+ * Every subsystem keeps its registers and memories in here, so any number of
+ * instances can be hosted side by side in a single process.
+ */
+struct gb {
+    struct scheduler scheduler;
+    struct cpu cpu;
+    struct mmu mmu;
+    struct ppu ppu;
+    struct apu apu;
+    struct timer timer;
+    struct serial serial;
+    struct joypad joypad;
+    struct cartridge cartridge;
+    struct jit jit;
+
+    enum GB_state state;
+    int exit_code;
+};
+
+#endif //NEC_CONTEXT_H
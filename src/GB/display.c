@@ -65,7 +65,7 @@ static const GLubyte _vertex_indices[NUM_INDICES] = {
         2, 3, 0
 };
 
-static GLuint load_shader(GLenum type, const char *shader_source)
+static GLuint load_shader(struct gb *gb, GLenum type, const char *shader_source)
 {
     GLint success, max_length;
     GLuint _shader = glCreateShader(type);
@@ -82,13 +82,15 @@ static GLuint load_shader(GLenum type, const char *shader_source)
         glGetShaderInfoLog(_shader, max_length, &max_length, buffer);
         log_error(buffer);
         free(buffer);
-        GB_exit();
+        GB_exit(gb);
     }
     return _shader;
 }
 
-void display_setup(void)
+void display_setup(struct gb *gb)
 {
+    GB_set_display_format(gb, GB_DISPLAY_RGBA8888);
+
     glewExperimental = true;
     if(glewInit() != GLEW_OK) {
         log_error("Error loading GLEW\n");
@@ -119,7 +121,7 @@ void display_setup(void)
 
     // Bind texture
     glBindTexture(GL_TEXTURE_2D, _texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA, TEXTURE_DIMENSION, TEXTURE_DIMENSION, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, DISPLAY_WIDTH, DISPLAY_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, NULL);
 
     // Set texture options
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -130,7 +132,7 @@ void display_setup(void)
     // Build Shaders
     GLint success, max_length;
     GLchar *log = 0;
-    GLuint _vertex_shader = load_shader(GL_VERTEX_SHADER,
+    GLuint _vertex_shader = load_shader(gb, GL_VERTEX_SHADER,
                                         "#version 330\n"
                                                 "\n"
                                                 "layout(location = 0) in vec2 position;\n"
@@ -146,10 +148,10 @@ void display_setup(void)
                                                 "    gl_Position = vec4(position.xy, 0.0f, 1.0f);\n"
                                                 "\n"
                                                 "    // Pass texture coord to Fragment shader\n"
-                                                "    vTexCoord = uvCoord / 256.0f;\n"
+                                                "    vTexCoord = uvCoord / vec2(160.0f, 144.0f);\n"
                                                 "}"
     );
-    GLuint _fragment_shader = load_shader(GL_FRAGMENT_SHADER,
+    GLuint _fragment_shader = load_shader(gb, GL_FRAGMENT_SHADER,
                                           "#version 330\n"
                                                   "\n"
                                                   "in vec2 vTexCoord;\n"
@@ -194,7 +196,7 @@ void display_frame(struct display *_display)
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, _texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, TEXTURE_DIMENSION, TEXTURE_DIMENSION, 0, GL_RGBA, GL_FLOAT, _display);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, _display->frame.rgba8888);
     glUniform1i(_texture_uniform_location, 0);
 
     glBindBuffer(GL_ARRAY_BUFFER, _vbo[0]);
@@ -26,36 +26,41 @@
 
 #include <stdint.h>
 
-#define BG_TILE_WIDTH       8
-#define BG_TILE_HEIGHT      8
-#define BYTES_PER_TEXEL     4
-#define BYTES_PER_TILE      (BG_TILE_WIDTH * BG_TILE_HEIGHT * BYTES_PER_TEXEL)
-#define BG_NUM_TILES        256
+#include "GB.h"
 
 #define DISPLAY_WIDTH   160
 #define DISPLAY_HEIGHT  144
 
-#define TEXTURE_DIMENSION   256
+struct gb;
 
-struct dot {
-    float r;
-    float g;
-    float b;
-    float a;
-};
+/**
+ * The frame the PPU renders into, in the pixel format picked by the host.
+ * Shades are turned into host pixels through the palette lookup table.
+ */
+struct display {
+    enum GB_display_format format;
+    uint32_t colors[4];
+    uint32_t palette[4];
 
-struct line {
-    struct dot dots[TEXTURE_DIMENSION];
+    union {
+        uint8_t shade[DISPLAY_HEIGHT][DISPLAY_WIDTH];
+        uint8_t gray8[DISPLAY_HEIGHT][DISPLAY_WIDTH];
+        uint16_t rgb565[DISPLAY_HEIGHT][DISPLAY_WIDTH];
+        uint32_t rgba8888[DISPLAY_HEIGHT][DISPLAY_WIDTH];
+    } frame;
 };
 
-struct display {
-    struct line lines[TEXTURE_DIMENSION];
-};
+/*
+ * Video output of the frontend. The core calls these, the frontend library
+ * linked next to gb_core (display.c for SDL/OpenGL, headless.c for none)
+ * implements them.
+ */
 
 /**
  *
+ * @param gb
  */
-void display_setup(void);
+void display_setup(struct gb *gb);
 
 /**
  *
@@ -0,0 +1,62 @@
+/* MIT License
+ *
+ * Copyright (c) 2017 Koen van der Heijden.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Frontend without any video or audio output. Hosts linking this instead of
+ * the SDL/OpenGL frontend read the frame from the PPU state themselves.
+ */
+
+#include "display.h"
+#include "audio.h"
+
+void display_setup(struct gb *gb)
+{
+}
+
+void display_frame(struct display *_display)
+{
+}
+
+void display_teardown(void)
+{
+}
+
+void audio_setup(struct gb *gb)
+{
+}
+
+void audio_enable(void)
+{
+}
+
+void audio_disable(void)
+{
+}
+
+void audio_play(struct sound *_sound)
+{
+}
+
+void audio_teardown(void)
+{
+}
\ No newline at end of file
@@ -0,0 +1,487 @@
+/* MIT License
+ *
+ * Copyright (c) 2017 Koen van der Heijden.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#if !defined(_WIN32)
+#define _DEFAULT_SOURCE
+#endif
+
+#include "jit.h"
+
+#include <string.h>
+#include <stdarg.h>
+
+#include "GB.h"
+#include "context.h"
+
+#if JIT_AVAILABLE
+
+#include <errno.h>
+#include <sys/mman.h>
+
+#if !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS   MAP_ANON
+#endif
+
+// Upper bounds of the code emitted for one instruction, and for one block
+#define JIT_OP_MAX_CODE     128
+#define JIT_BLOCK_MAX_CODE  (64 + BLOCK_MAX_SIZE * JIT_OP_MAX_CODE)
+
+// Displacement of a member of the instance from rbx
+#define GB_OFFSET(member)   ((int32_t) offsetof(struct gb, member))
+
+/*
+ * Host registers: rbx holds the instance, rbp the deadline, r12 the earlier
+ * of the deadline and the next event, r13 the first instruction of the
+ * block, which cpu.next_op holds until the page table changes, and r14b
+ * 0xFF if interrupts are enabled.
+ */
+#define REG_AL  0
+#define REG_CL  1
+#define REG_DL  2
+#define REG_R12 4
+#define REG_R13 5
+#define REG_R14 6
+
+struct emitter {
+    uint8_t *code;
+    uint8_t *exits[BLOCK_MAX_SIZE * 4];
+    int num_exits;
+};
+
+static void emit(struct emitter *e, int size, ...)
+{
+    va_list bytes;
+    va_start(bytes, size);
+    for(int i = 0; i < size; i++) {
+        *e->code++ = (uint8_t) va_arg(bytes, int);
+    }
+    va_end(bytes);
+}
+
+static void emit_u16(struct emitter *e, uint16_t value)
+{
+    memcpy(e->code, &value, sizeof(value));
+    e->code += sizeof(value);
+}
+
+static void emit_u32(struct emitter *e, uint32_t value)
+{
+    memcpy(e->code, &value, sizeof(value));
+    e->code += sizeof(value);
+}
+
+static void emit_u64(struct emitter *e, uint64_t value)
+{
+    memcpy(e->code, &value, sizeof(value));
+    e->code += sizeof(value);
+}
+
+/**
+ * ModRM and displacement of a [rbx + offset] operand.
+ *
+ * @param e
+ * @param reg Register or opcode extension
+ * @param offset
+ */
+static void emit_mem(struct emitter *e, uint8_t reg, int32_t offset)
+{
+    emit(e, 1, 0x80 | ((reg & 7) << 3) | 3);
+    emit_u32(e, (uint32_t) offset);
+}
+
+/**
+ * Conditional jump to the epilogue, patched once its address is known.
+ *
+ * @param e
+ * @param condition Second opcode byte of the jcc rel32
+ */
+static void emit_exit(struct emitter *e, uint8_t condition)
+{
+    emit(e, 2, 0x0F, condition);
+    e->exits[e->num_exits++] = e->code;
+    emit_u32(e, 0);
+}
+
+#define JAE     0x83
+#define JNE     0x85
+
+// r12 = min(rbp, scheduler.next)
+static void emit_limit(struct emitter *e)
+{
+    emit(e, 2, 0x4C, 0x8B);
+    emit_mem(e, REG_R12, GB_OFFSET(scheduler.next));
+    emit(e, 7, 0x49, 0x39, 0xEC, 0x4C, 0x0F, 0x47, 0xE5);
+}
+
+// Leave once the clock reaches r12
+static void emit_clock_check(struct emitter *e)
+{
+    emit(e, 2, 0x4C, 0x39);
+    emit_mem(e, REG_R12, GB_OFFSET(cpu.r.clk));
+    emit_exit(e, JAE);
+}
+
+static void emit_clocks(struct emitter *e, uint8_t clocks)
+{
+    emit(e, 2, 0x48, 0x83);
+    emit_mem(e, 0, GB_OFFSET(cpu.r.clk));
+    emit(e, 1, clocks);
+}
+
+static int32_t reg8(uint8_t index)
+{
+    switch(index & 7) {
+        case 0: return GB_OFFSET(cpu.r.b);
+        case 1: return GB_OFFSET(cpu.r.c);
+        case 2: return GB_OFFSET(cpu.r.d);
+        case 3: return GB_OFFSET(cpu.r.e);
+        case 4: return GB_OFFSET(cpu.r.h);
+        case 5: return GB_OFFSET(cpu.r.l);
+        default: return GB_OFFSET(cpu.r.a);
+    }
+}
+
+static int32_t reg16(uint8_t index)
+{
+    switch(index & 3) {
+        case 0: return GB_OFFSET(cpu.r.bc);
+        case 1: return GB_OFFSET(cpu.r.de);
+        case 2: return GB_OFFSET(cpu.r.hl);
+        default: return GB_OFFSET(cpu.r.sp);
+    }
+}
+
+/**
+ * AND, XOR, OR or CP of A with a register or immediate.
+ *
+ * @param e
+ * @param op
+ */
+static void emit_alu(struct emitter *e, const struct decoded *op)
+{
+    bool immediate = (op->opcode >= 0xC0);
+    uint8_t kind = (uint8_t) ((op->opcode >> 3) & 7);
+
+    if(kind == 7) {
+        // movzx eax, byte [a] ; movzx ecx, n
+        emit(e, 2, 0x0F, 0xB6);
+        emit_mem(e, REG_AL, GB_OFFSET(cpu.r.a));
+        if(immediate) {
+            emit(e, 1, 0xB9);
+            emit_u32(e, (uint8_t) op->operand);
+        } else {
+            emit(e, 2, 0x0F, 0xB6);
+            emit_mem(e, REG_CL, reg8(op->opcode));
+        }
+        // mov edx, eax ; sub edx, ecx ; xor eax, ecx ; xor eax, edx
+        emit(e, 8, 0x89, 0xC2, 0x29, 0xCA, 0x31, 0xC8, 0x31, 0xD0);
+        // shl eax, 1 ; and eax, 0x20 ; or eax, 0x40
+        emit(e, 8, 0xD1, 0xE0, 0x83, 0xE0, 0x20, 0x83, 0xC8, 0x40);
+        // mov [flags.nh], al ; mov [flags.zc], dx
+        emit(e, 1, 0x88);
+        emit_mem(e, REG_AL, GB_OFFSET(cpu.flags.nh));
+        emit(e, 2, 0x66, 0x89);
+        emit_mem(e, REG_DL, GB_OFFSET(cpu.flags.zc));
+        return;
+    }
+
+    // mov al, [a] ; and / xor / or al, n ; mov [a], al
+    emit(e, 1, 0x8A);
+    emit_mem(e, REG_AL, GB_OFFSET(cpu.r.a));
+    if(immediate) {
+        emit(e, 2, (kind == 4 ? 0x24 : kind == 5 ? 0x34 : 0x0C), (uint8_t) op->operand);
+    } else {
+        emit(e, 1, (kind == 4 ? 0x22 : kind == 5 ? 0x32 : 0x0A));
+        emit_mem(e, REG_AL, reg8(op->opcode));
+    }
+    emit(e, 1, 0x88);
+    emit_mem(e, REG_AL, GB_OFFSET(cpu.r.a));
+
+    // movzx eax, al ; mov [flags.zc], ax ; mov byte [flags.nh], 0x20 / 0x00
+    emit(e, 3, 0x0F, 0xB6, 0xC0);
+    emit(e, 2, 0x66, 0x89);
+    emit_mem(e, REG_AL, GB_OFFSET(cpu.flags.zc));
+    emit(e, 1, 0xC6);
+    emit_mem(e, 0, GB_OFFSET(cpu.flags.nh));
+    emit(e, 1, (kind == 4 ? 0x20 : 0x00));
+}
+
+/**
+ * INC or DEC of an 8 bit register.
+ *
+ * @param e
+ * @param op
+ */
+static void emit_inc_dec(struct emitter *e, const struct decoded *op)
+{
+    bool dec = (op->opcode & 1);
+    int32_t reg = reg8((uint8_t) (op->opcode >> 3));
+
+    // movzx eax, byte [r] ; mov edx, eax ; inc / dec edx ; mov [r], dl
+    emit(e, 2, 0x0F, 0xB6);
+    emit_mem(e, REG_AL, reg);
+    emit(e, 4, 0x89, 0xC2, 0xFF, (dec ? 0xCA : 0xC2));
+    emit(e, 1, 0x88);
+    emit_mem(e, REG_DL, reg);
+
+    // xor eax, edx ; shl eax, 1 ; and eax, 0x20 (; or eax, 0x40) ; mov [flags.nh], al
+    emit(e, 7, 0x31, 0xD0, 0xD1, 0xE0, 0x83, 0xE0, 0x20);
+    if(dec) {
+        emit(e, 3, 0x83, 0xC8, 0x40);
+    }
+    emit(e, 1, 0x88);
+    emit_mem(e, REG_AL, GB_OFFSET(cpu.flags.nh));
+
+    // movzx edx, dl ; movzx ecx, word [flags.zc] ; and ecx, 0x100 ; or ecx, edx ; mov [flags.zc], cx
+    emit(e, 3, 0x0F, 0xB6, 0xD2);
+    emit(e, 2, 0x0F, 0xB7);
+    emit_mem(e, REG_CL, GB_OFFSET(cpu.flags.zc));
+    emit(e, 8, 0x81, 0xE1, 0x00, 0x01, 0x00, 0x00, 0x09, 0xD1);
+    emit(e, 2, 0x66, 0x89);
+    emit_mem(e, REG_CL, GB_OFFSET(cpu.flags.zc));
+}
+
+/**
+ * Native code for instructions that only touch registers.
+ *
+ * @param e
+ * @param op
+ * @return The clock cycles taken, or 0 if the handler has to be called
+ */
+static uint8_t emit_native(struct emitter *e, const struct decoded *op)
+{
+    uint8_t opcode = op->opcode;
+    uint8_t hi = (uint8_t) ((opcode >> 3) & 7);
+    uint8_t lo = (uint8_t) (opcode & 7);
+
+    if(opcode == 0x00) {
+        return 4;
+    } else if(0x40 <= opcode && opcode < 0x80) {
+        if(hi == 6 || lo == 6) {
+            return 0;
+        }
+        if(hi != lo) {
+            emit(e, 1, 0x8A);
+            emit_mem(e, REG_AL, reg8(lo));
+            emit(e, 1, 0x88);
+            emit_mem(e, REG_AL, reg8(hi));
+        }
+        return 4;
+    } else if(0xA0 <= opcode && opcode < 0xC0) {
+        if(lo == 6) {
+            return 0;
+        }
+        emit_alu(e, op);
+        return 4;
+    } else if(opcode == 0xE6 || opcode == 0xEE || opcode == 0xF6 || opcode == 0xFE) {
+        emit_alu(e, op);
+        return 8;
+    } else if(opcode < 0x40 && hi != 6 && (lo == 4 || lo == 5)) {
+        emit_inc_dec(e, op);
+        return 4;
+    } else if(opcode < 0x40 && hi != 6 && lo == 6) {
+        // mov byte [r], d8
+        emit(e, 1, 0xC6);
+        emit_mem(e, 0, reg8(hi));
+        emit(e, 1, (uint8_t) op->operand);
+        return 8;
+    } else if(opcode < 0x40 && (opcode & 0x0F) == 0x01) {
+        // mov word [rr], d16
+        emit(e, 2, 0x66, 0xC7);
+        emit_mem(e, 0, reg16((uint8_t) (opcode >> 4)));
+        emit_u16(e, op->operand);
+        return 12;
+    } else if(opcode < 0x40 && ((opcode & 0x0F) == 0x03 || (opcode & 0x0F) == 0x0B)) {
+        // inc / dec word [rr]
+        emit(e, 2, 0x66, 0xFF);
+        emit_mem(e, (uint8_t) ((opcode & 0x08) ? 1 : 0), reg16((uint8_t) (opcode >> 4)));
+        return 8;
+    }
+    return 0;
+}
+
+/**
+ * Instructions whose effect on IME or the clock the interpreter applies.
+ *
+ * @param opcode
+ * @return
+ */
+static bool interpreted(uint8_t opcode)
+{
+    return opcode == 0x10 || opcode == 0x76 || opcode == 0xF3 || opcode == 0xFB;
+}
+
+static bool jit_allocate(struct gb *gb)
+{
+    if(gb->jit.buffer != NULL) {
+        return true;
+    }
+
+    void *buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(buffer == MAP_FAILED) {
+        log_warning("Code buffer could not be mapped (%d), running interpreted.\n", errno);
+        gb->jit.enabled = false;
+        return false;
+    }
+    gb->jit.buffer = buffer;
+    gb->jit.used = 0;
+    return true;
+}
+
+bool jit_has_room(struct gb *gb)
+{
+    return gb->jit.used + JIT_BLOCK_MAX_CODE <= JIT_BUFFER_SIZE;
+}
+
+block_code jit_compile(struct gb *gb, const struct block *block, const jit_handler map[])
+{
+    int size = 0;
+    while(block->ops[size].length && !interpreted(block->ops[size].opcode)) {
+        size++;
+    }
+    if(!size || !jit_allocate(gb) || !jit_has_room(gb)) {
+        return NULL;
+    }
+    if(mprotect(gb->jit.buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE) != 0) {
+        return NULL;
+    }
+
+    uint8_t *start = gb->jit.buffer + gb->jit.used;
+    struct emitter e = {start, {NULL}, 0};
+
+    // push rbx ; push rbp ; push r12 ; push r13 ; push r14 ; mov rbx, rdi ; mov rbp, rsi
+    emit(&e, 14, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x48, 0x89, 0xFB, 0x48, 0x89, 0xF5);
+    // mov r13, block->ops ; movzx r14d, byte [ime] ; neg r14d
+    emit(&e, 2, 0x49, 0xBD);
+    emit_u64(&e, (uint64_t) (uintptr_t) block->ops);
+    emit(&e, 3, 0x44, 0x0F, 0xB6);
+    emit_mem(&e, REG_R14, GB_OFFSET(cpu.IME));
+    emit(&e, 3, 0x41, 0xF7, 0xDE);
+    emit_limit(&e);
+
+    for(int i = 0; i < size; i++) {
+        const struct decoded *op = &block->ops[i];
+        bool last = (i == size - 1);
+
+        // Like fetch(), the program counter already points past the instruction
+        emit(&e, 2, 0x66, 0xC7);
+        emit_mem(&e, 0, GB_OFFSET(cpu.r.pc));
+        emit_u16(&e, (uint16_t) (op->pc + op->length));
+
+        uint8_t clocks = emit_native(&e, op);
+        if(clocks) {
+            emit_clocks(&e, clocks);
+            if(!last) {
+                emit_clock_check(&e);
+            }
+            continue;
+        }
+
+        // mov word [operand], n ; mov rdi, rbx ; mov rax, handler ; call rax
+        if(op->length > 1) {
+            emit(&e, 2, 0x66, 0xC7);
+            emit_mem(&e, 0, GB_OFFSET(cpu.operand));
+            emit_u16(&e, op->operand);
+        }
+        emit(&e, 5, 0x48, 0x89, 0xDF, 0x48, 0xB8);
+        emit_u64(&e, (uint64_t) (uintptr_t) map[op->opcode]);
+        emit(&e, 2, 0xFF, 0xD0);
+        if(last) {
+            continue;
+        }
+
+        // The handler may have scheduled an event, raised an interrupt or switched banks
+        emit_limit(&e);
+        emit_clock_check(&e);
+        emit(&e, 2, 0x0F, 0xB6);
+        emit_mem(&e, REG_AL, GB_OFFSET(cpu.IE));
+        emit(&e, 1, 0x22);
+        emit_mem(&e, REG_AL, GB_OFFSET(cpu.IF));
+        emit(&e, 3, 0x44, 0x20, 0xF0);
+        emit_exit(&e, JNE);
+        emit(&e, 2, 0x4C, 0x39);
+        emit_mem(&e, REG_R13, GB_OFFSET(cpu.next_op));
+        emit_exit(&e, JNE);
+    }
+
+    // pop r14 ; pop r13 ; pop r12 ; pop rbp ; pop rbx ; ret
+    uint8_t *epilogue = e.code;
+    emit(&e, 9, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3);
+    for(int i = 0; i < e.num_exits; i++) {
+        uint32_t rel = (uint32_t) (epilogue - (e.exits[i] + 4));
+        memcpy(e.exits[i], &rel, sizeof(rel));
+    }
+
+    if(mprotect(gb->jit.buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC) != 0) {
+        return NULL;
+    }
+
+    gb->jit.used = ((size_t) (e.code - gb->jit.buffer) + 15) & ~(size_t) 15;
+    gb->jit.blocks++;
+
+    block_code code;
+    memcpy(&code, &start, sizeof(code));
+    return code;
+}
+
+void jit_reset(struct gb *gb)
+{
+    gb->jit.used = 0;
+    gb->jit.blocks = 0;
+}
+
+void jit_destroy(struct gb *gb)
+{
+    if(gb->jit.buffer != NULL) {
+        munmap(gb->jit.buffer, JIT_BUFFER_SIZE);
+        gb->jit.buffer = NULL;
+    }
+    jit_reset(gb);
+}
+
+#else
+
+bool jit_has_room(struct gb *gb)
+{
+    return false;
+}
+
+block_code jit_compile(struct gb *gb, const struct block *block, const jit_handler map[])
+{
+    return NULL;
+}
+
+void jit_reset(struct gb *gb)
+{
+}
+
+void jit_destroy(struct gb *gb)
+{
+}
+
+#endif /* JIT_AVAILABLE */
+
+void GB_set_jit(struct gb *gb, int enabled)
+{
+    gb->jit.enabled = (enabled && JIT_AVAILABLE);
+}
\ No newline at end of file
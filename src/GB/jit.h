@@ -0,0 +1,101 @@
+/* MIT License
+ *
+ * Copyright (c) 2017 Koen van der Heijden.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef NEC_JIT_H
+#define NEC_JIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "LR35902.h"
+
+/*
+ * The recompiler emits x86-64 code for the System V calling convention, and
+ * hooks into the table dispatcher
+ */
+#if defined(NEC_JIT) && defined(__x86_64__) && !defined(_WIN32) && !defined(NEC_THREADED_CORE)
+#define JIT_AVAILABLE       1
+#else
+#define JIT_AVAILABLE       0
+#endif
+
+// Entries into a block before it is compiled
+#define JIT_THRESHOLD       64
+
+#define JIT_BUFFER_SIZE     0x100000
+
+struct gb;
+
+typedef void (*jit_handler)(struct gb *gb);
+
+/**
+ * Native code of a single GameBoy instance.
+ */
+struct jit {
+    bool enabled;
+
+    uint8_t *buffer;
+    size_t used;
+    unsigned int blocks;
+};
+
+/**
+ * Whether the code buffer can take another block. If not, every block's
+ * code has to be dropped and the buffer reset.
+ *
+ * @param gb
+ * @return
+ */
+bool jit_has_room(struct gb *gb);
+
+/**
+ * Compile the block to native code. The code runs the block like the
+ * interpreter would, calling the handlers in map for all but the simplest
+ * register instructions, and returns at the end of the block or on the
+ * first instruction boundary where the interpreter has work to do: a
+ * deadline or event is reached, an enabled interrupt is pending, or the page
+ * table changed. EI, DI, HALT and STOP are left to the interpreter.
+ *
+ * @param gb
+ * @param block
+ * @param map
+ * @return The code, or NULL if nothing could be compiled
+ */
+block_code jit_compile(struct gb *gb, const struct block *block, const jit_handler map[]);
+
+/**
+ * Forget all compiled code.
+ *
+ * @param gb
+ */
+void jit_reset(struct gb *gb);
+
+/**
+ * Release the code buffer.
+ *
+ * @param gb
+ */
+void jit_destroy(struct gb *gb);
+
+#endif //NEC_JIT_H
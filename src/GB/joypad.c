@@ -25,57 +25,47 @@
 #include "GB.h"
 
 #include "LR35902.h"
+#include "MMU.h"
+#include "context.h"
 
 #define _OUTPUTS_MASK   0x30
 #define _INPUTS_MASK    0x0F
 
-static uint8_t _keys = 0xFF;
-static uint8_t _mask = 0x00;
-
-void key_pressed(enum GB_key key)
+void key_pressed(struct gb *gb, enum GB_key key)
 {
-    _keys &= ~key;
-    interrupt(BUTTON_PRESSED);
+    gb->joypad.keys &= ~key;
+    interrupt(gb, BUTTON_PRESSED);
 }
 
-void key_released(enum GB_key key)
+void key_released(struct gb *gb, enum GB_key key)
 {
-    _keys |= key;
+    gb->joypad.keys |= key;
 }
 
-uint8_t joypad_read_byte(uint16_t address)
+static uint8_t p1_read(struct gb *gb, uint16_t address)
 {
-    switch (address) {
-        case P1_OFFSET:
-            switch(_mask) {
-                default:
-                case 0:
-                    return 0;
-                case 1:
-                    return (uint8_t) ((_keys >> 4) & _INPUTS_MASK);
-                case 2:
-                    return (uint8_t) (_keys & _INPUTS_MASK);
-                case 3:
-                    return (uint8_t) (((_keys >> 4) & _INPUTS_MASK) | (_keys & _INPUTS_MASK));
-            }
+    switch(gb->joypad.mask) {
         default:
-            return 0xFF;
+        case 0:
+            return 0;
+        case 1:
+            return (uint8_t) ((gb->joypad.keys >> 4) & _INPUTS_MASK);
+        case 2:
+            return (uint8_t) (gb->joypad.keys & _INPUTS_MASK);
+        case 3:
+            return (uint8_t) (((gb->joypad.keys >> 4) & _INPUTS_MASK) | (gb->joypad.keys & _INPUTS_MASK));
     }
 }
 
-void joypad_write_byte(uint16_t address, uint8_t value)
+static void p1_write(struct gb *gb, uint16_t address, uint8_t value)
 {
-    switch (address) {
-        case P1_OFFSET:
-            _mask = (uint8_t) ((value & _OUTPUTS_MASK) >> 4);
-            break;
-        default:
-            break;
-    }
+    gb->joypad.mask = (uint8_t) ((value & _OUTPUTS_MASK) >> 4);
 }
 
-void joypad_reset(void)
+void joypad_reset(struct gb *gb)
 {
-    _keys = 0xFF;
-    _mask = 0x00;
+    gb->joypad.keys = 0xFF;
+    gb->joypad.mask = 0x00;
+
+    mmu_register_io(gb, P1_OFFSET, p1_read, p1_write);
 }
\ No newline at end of file
@@ -28,23 +28,20 @@
 
 #define P1_OFFSET  0xFF00
 
-/**
- *
- * @param address
- * @return
- */
-uint8_t joypad_read_byte(uint16_t address);
+struct gb;
 
 /**
- *
- * @param address
- * @param value
+ * Joypad state of a single GameBoy instance.
  */
-void joypad_write_byte(uint16_t address, uint8_t value);
+struct joypad {
+    uint8_t keys;
+    uint8_t mask;
+};
 
 /**
  *
+ * @param gb
  */
-void joypad_reset(void);
+void joypad_reset(struct gb *gb);
 
 #endif /* NEC_IO_H */
@@ -0,0 +1,160 @@
+/* MIT License
+ *
+ * Copyright (c) 2017 Koen van der Heijden.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "scheduler.h"
+
+#include <stdbool.h>
+
+#include "PPU.h"
+#include "sound.h"
+#include "timer.h"
+#include "serial.h"
+#include "cartridge.h"
+#include "context.h"
+
+typedef void (*event_handler)(struct gb *gb, uint64_t deadline);
+
+static const event_handler _handlers[NUM_EVENTS] = {
+    [EVENT_PPU] = video_event,
+    [EVENT_TIMER] = timer_event,
+    [EVENT_APU_FRAME_SEQ] = audio_event,
+    [EVENT_OAM_DMA] = dma_event,
+    [EVENT_SERIAL] = serial_event,
+    [EVENT_SAVE_FLUSH] = cartridge_event
+};
+
+static inline bool earlier(struct scheduler *s, uint8_t a, uint8_t b)
+{
+    return s->deadline[s->heap[a]] < s->deadline[s->heap[b]];
+}
+
+static inline void swap(struct scheduler *s, uint8_t a, uint8_t b)
+{
+    uint8_t tmp = s->heap[a];
+    s->heap[a] = s->heap[b];
+    s->heap[b] = tmp;
+
+    s->position[s->heap[a]] = a;
+    s->position[s->heap[b]] = b;
+}
+
+static void sift_up(struct scheduler *s, uint8_t i)
+{
+    while(i > 0) {
+        uint8_t parent = (uint8_t) ((i - 1) / 2);
+        if(!earlier(s, i, parent)) {
+            break;
+        }
+        swap(s, i, parent);
+        i = parent;
+    }
+}
+
+static void sift_down(struct scheduler *s, uint8_t i)
+{
+    for(;;) {
+        uint8_t smallest = i;
+        uint8_t left = (uint8_t) (2 * i + 1);
+        uint8_t right = (uint8_t) (2 * i + 2);
+
+        if(left < s->size && earlier(s, left, smallest)) {
+            smallest = left;
+        }
+        if(right < s->size && earlier(s, right, smallest)) {
+            smallest = right;
+        }
+        if(smallest == i) {
+            break;
+        }
+        swap(s, i, smallest);
+        i = smallest;
+    }
+}
+
+static inline void update_next(struct scheduler *s)
+{
+    s->next = (s->size ? s->deadline[s->heap[0]] : EVENT_NEVER);
+}
+
+void schedule_event(struct gb *gb, enum event event, uint64_t deadline)
+{
+    struct scheduler *s = &gb->scheduler;
+    uint64_t old = s->deadline[event];
+    s->deadline[event] = deadline;
+
+    if(s->position[event] == NUM_EVENTS) {
+        s->position[event] = s->size;
+        s->heap[s->size] = (uint8_t) event;
+        sift_up(s, s->size++);
+    } else if(deadline < old) {
+        sift_up(s, s->position[event]);
+    } else {
+        sift_down(s, s->position[event]);
+    }
+
+    update_next(s);
+}
+
+void cancel_event(struct gb *gb, enum event event)
+{
+    struct scheduler *s = &gb->scheduler;
+    uint8_t i = s->position[event];
+    if(i == NUM_EVENTS) {
+        return;
+    }
+
+    s->size--;
+    if(i != s->size) {
+        swap(s, i, s->size);
+        sift_down(s, i);
+        sift_up(s, i);
+    }
+    s->position[event] = NUM_EVENTS;
+    s->deadline[event] = EVENT_NEVER;
+
+    update_next(s);
+}
+
+void run_events(struct gb *gb)
+{
+    struct scheduler *s = &gb->scheduler;
+    while(s->next <= gb->cpu.r.clk) {
+        enum event event = (enum event) s->heap[0];
+        uint64_t deadline = s->next;
+
+        // Handlers usually reschedule themselves
+        cancel_event(gb, event);
+        _handlers[event](gb, deadline);
+    }
+}
+
+void scheduler_reset(struct gb *gb)
+{
+    struct scheduler *s = &gb->scheduler;
+    for(int i = 0; i < NUM_EVENTS; i++) {
+        s->deadline[i] = EVENT_NEVER;
+        s->position[i] = NUM_EVENTS;
+    }
+    s->size = 0;
+    s->next = EVENT_NEVER;
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+/* MIT License
+ *
+ * Copyright (c) 2017 Koen van der Heijden.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef NEC_SCHEDULER_H
+#define NEC_SCHEDULER_H
+
+#include <stdint.h>
+
+struct gb;
+
+/**
+ * Subsystem deadlines kept by the scheduler. Each source has at most one
+ * pending deadline; scheduling it again moves the existing one.
+ */
+enum event {
+    EVENT_PPU = 0,
+    EVENT_TIMER,
+    EVENT_APU_FRAME_SEQ,
+    EVENT_OAM_DMA,
+    EVENT_SERIAL,
+    EVENT_SAVE_FLUSH,
+    NUM_EVENTS
+};
+
+#define EVENT_NEVER     UINT64_MAX
+
+/**
+ * Binary min-heap of pending deadlines on the CPU clock (4,194,304Hz).
+ */
+struct scheduler {
+    uint64_t next;
+
+    uint64_t deadline[NUM_EVENTS];
+    uint8_t heap[NUM_EVENTS];
+    uint8_t position[NUM_EVENTS];
+    uint8_t size;
+};
+
+/**
+ * Register (or move) the deadline of an event source.
+ *
+ * @param gb
+ * @param event
+ * @param deadline Absolute CPU clock at which the event should fire
+ */
+void schedule_event(struct gb *gb, enum event event, uint64_t deadline);
+
+/**
+ *
+ * @param gb
+ * @param event
+ */
+void cancel_event(struct gb *gb, enum event event);
+
+/**
+ * Fire every event whose deadline is at or before the current CPU clock,
+ * in deadline order.
+ *
+ * @param gb
+ */
+void run_events(struct gb *gb);
+
+/**
+ *
+ * @param gb
+ */
+void scheduler_reset(struct gb *gb);
+
+#endif //NEC_SCHEDULER_H
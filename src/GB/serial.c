@@ -25,57 +25,71 @@
 
 #include "GB.h"
 #include "LR35902.h"
+#include "MMU.h"
+#include "scheduler.h"
+#include "context.h"
 
 #define SB  0xFF01
 #define SC  0xFF02
 
-static uint8_t _sb = 0x00;
-static uint8_t _sc = 0x00;
+#define _8192HZ_DIV     512
 
-uint8_t serial_read_byte(uint16_t address)
+static uint8_t sb_read(struct gb *gb, uint16_t address)
 {
-    switch(address) {
-        case SC:
-            return _sc;
-        case SB:
-            if(!(_sc & 0x80)) {
-                return _sb;
-            }
-        default:
-            return 0xFF;
+    if(!(gb->serial.sc & 0x80)) {
+        return gb->serial.sb;
     }
+    return 0xFF;
 }
 
-void serial_write_byte(uint16_t address, uint8_t value)
+static void sb_write(struct gb *gb, uint16_t address, uint8_t value)
 {
-    switch (address) {
-        case SC:
-            _sc = (uint8_t) (value & 0x83);
+    if(!(gb->serial.sc & 0x80)) {
+        gb->serial.sb = value;
+    }
+}
+
+static uint8_t sc_read(struct gb *gb, uint16_t address)
+{
+    return gb->serial.sc;
+}
+
+static void sc_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    gb->serial.sc = (uint8_t) (value & 0x83);
 
-            if(_sc & 0x80) {
-                serial_transfer_initiate(_sb);
-            }
-            break;
-        case SB:
-            if((_sc & 0x80)) {
-                return;
-            }
-            _sb = value;
-            break;
-        default:
-            break;
+    if(gb->serial.sc & 0x80) {
+        serial_transfer_initiate(gb, gb->serial.sb);
+
+        // Internal clock shifts out all 8 bits at 8192Hz
+        if(gb->serial.sc & 0x01) {
+            schedule_event(gb, EVENT_SERIAL, gb->cpu.r.clk + 8 * _8192HZ_DIV);
+        }
     }
 }
 
-void serial_transfer_complete(uint8_t data)
+void serial_transfer_complete(struct gb *gb, uint8_t data)
 {
-    _sb = data;
-    _sc &= 0x7F;
-    interrupt(SERIAL_TRANSFER);
+    cancel_event(gb, EVENT_SERIAL);
+
+    gb->serial.sb = data;
+    gb->serial.sc &= 0x7F;
+    interrupt(gb, SERIAL_TRANSFER);
 }
 
-void serial_reset(void)
+void serial_event(struct gb *gb, uint64_t deadline)
 {
-    _sb = 0x00;
-    _sc = 0x00;
+    // Nobody clocked data back in, the line idles high
+    if(gb->serial.sc & 0x80) {
+        serial_transfer_complete(gb, 0xFF);
+    }
+}
+
+void serial_reset(struct gb *gb)
+{
+    gb->serial.sb = 0x00;
+    gb->serial.sc = 0x00;
+
+    mmu_register_io(gb, SB, sb_read, sb_write);
+    mmu_register_io(gb, SC, sc_read, sc_write);
 }
\ No newline at end of file
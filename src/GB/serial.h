@@ -26,23 +26,28 @@
 
 #include <stdint.h>
 
+struct gb;
+
 /**
- *
- * @param address
- * @return
+ * Serial port state of a single GameBoy instance.
  */
-uint8_t serial_read_byte(uint16_t address);
+struct serial {
+    uint8_t sb;
+    uint8_t sc;
+};
 
 /**
+ * Internal clock transfer completion handler.
  *
- * @param address
- * @param value
+ * @param gb
+ * @param deadline
  */
-void serial_write_byte(uint16_t address, uint8_t value);
+void serial_event(struct gb *gb, uint64_t deadline);
 
 /**
  *
+ * @param gb
  */
-void serial_reset(void);
+void serial_reset(struct gb *gb);
 
 #endif //NEC_SERIAL_H
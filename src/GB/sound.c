@@ -27,6 +27,9 @@
 
 #include "audio.h"
 #include "cartridge.h"
+#include "MMU.h"
+#include "scheduler.h"
+#include "context.h"
 
 #define NR10_ADDRESS    0xFF10
 #define NR11_ADDRESS    0xFF11
@@ -49,206 +52,113 @@
 #define NR50_ADDRESS    0xFF24
 #define NR51_ADDRESS    0xFF25
 #define NR52_ADDRESS    0xFF26
-#define _WAVE_PATTERN_RAM_OFFSET        0xFF30
-#define _WAVE_PATTERN_RAM_OFFSET_END    0xFF40
-#define _WAVE_PATTERN_RAM_SIZE          (_WAVE_PATTERN_RAM_OFFSET_END - _WAVE_PATTERN_RAM_OFFSET)
 
-#define CPU_CLK_SPEED   4194304
 #define _512HZ_DIV      8192
 
 #define WAVEFORM_PERIOD 8
 
-static uint32_t _timer_clk = 0;
-static uint8_t _frame_seq = 0;
-
-/*
- * Audio control
- */
-static uint8_t _nr10 = 0x00;
-static uint8_t _nr11 = 0x00;
-static uint8_t _nr12 = 0x00;
-static uint8_t _nr13 = 0x00;
-static uint8_t _nr14 = 0x00;
-static uint8_t _nr21 = 0x00;
-static uint8_t _nr22 = 0x00;
-static uint8_t _nr23 = 0x00;
-static uint8_t _nr24 = 0x00;
-static uint8_t _nr30 = 0x00;
-static uint8_t _nr31 = 0x00;
-static uint8_t _nr32 = 0x00;
-static uint8_t _nr33 = 0x00;
-static uint8_t _nr34 = 0x00;
-static uint8_t _nr41 = 0x00;
-static uint8_t _nr42 = 0x00;
-static uint8_t _nr43 = 0x00;
-static uint8_t _nr44 = 0x00;
-static uint8_t _nr50 = 0x00;
-static uint8_t _nr51 = 0x00;
-static uint8_t _nr52 = 0x00;
-static uint8_t _wave_pattern_ram[_WAVE_PATTERN_RAM_SIZE];
-
-static inline void reset_regs(void)
-{
-    _nr10 = 0x00;
-    _nr11 = 0x00;
-    _nr12 = 0x00;
-    _nr13 = 0x00;
-    _nr14 = 0x00;
-    _nr21 = 0x00;
-    _nr22 = 0x00;
-    _nr23 = 0x00;
-    _nr24 = 0x00;
-    _nr30 = 0x00;
-    _nr31 = 0x00;
-    _nr32 = 0x00;
-    _nr33 = 0x00;
-    _nr34 = 0x00;
-    _nr41 = 0x00;
-    _nr42 = 0x00;
-    _nr43 = 0x00;
-    _nr44 = 0x00;
-    _nr50 = 0x00;
-    _nr51 = 0x00;
-    _nr52 = 0x00;
+static inline void reset_regs(struct gb *gb)
+{
+    gb->apu.nr10 = 0x00;
+    gb->apu.nr11 = 0x00;
+    gb->apu.nr12 = 0x00;
+    gb->apu.nr13 = 0x00;
+    gb->apu.nr14 = 0x00;
+    gb->apu.nr21 = 0x00;
+    gb->apu.nr22 = 0x00;
+    gb->apu.nr23 = 0x00;
+    gb->apu.nr24 = 0x00;
+    gb->apu.nr30 = 0x00;
+    gb->apu.nr31 = 0x00;
+    gb->apu.nr32 = 0x00;
+    gb->apu.nr33 = 0x00;
+    gb->apu.nr34 = 0x00;
+    gb->apu.nr41 = 0x00;
+    gb->apu.nr42 = 0x00;
+    gb->apu.nr43 = 0x00;
+    gb->apu.nr44 = 0x00;
+    gb->apu.nr50 = 0x00;
+    gb->apu.nr51 = 0x00;
+    gb->apu.nr52 = 0x00;
 }
 
-struct frequency_sweep {
-    uint16_t shadow_frequency;
-    uint8_t timer;
-    bool enabled;
-};
-
-struct length_counter {
-    uint16_t timer;
-    bool enabled;
-};
-
-struct volume_envelope {
-    uint8_t timer;
-    uint8_t period;
-    uint8_t volume;
-    bool direction;
-    bool enabled;
-};
-
-struct lfsr {
-    uint16_t shift_reg;
-};
-
-static struct {
-    struct frequency_sweep sweep;
-    uint16_t timer;
-    uint8_t duty;
-    struct length_counter length;
-    struct volume_envelope envelope;
-
-    uint8_t output;
-} _square_1;
-
-static struct {
-    uint16_t timer;
-    uint8_t duty;
-    struct length_counter length;
-    struct volume_envelope envelope;
-
-    uint8_t output;
-} _square_2;
-
-static struct {
-    uint16_t timer;
-    struct length_counter length;
-    uint8_t volume;
-    uint8_t sample;
-
-    uint8_t output;
-} _wave;
-
-static struct {
-    uint32_t timer;
-    struct lfsr lfsr;
-    struct length_counter length;
-    struct volume_envelope envelope;
-
-    uint8_t output;
-} _noise;
-
-static inline void square_1_untrigger(void)
+static inline void square_1_untrigger(struct gb *gb)
 {
-    _nr52 &= 0xFE;
+    gb->apu.nr52 &= 0xFE;
 }
 
-static inline void square_2_untrigger(void)
+static inline void square_2_untrigger(struct gb *gb)
 {
-    _nr52 &= 0xFD;
+    gb->apu.nr52 &= 0xFD;
 }
 
-static inline void wave_untrigger(void)
+static inline void wave_untrigger(struct gb *gb)
 {
-    _nr52 &= 0xFB;
+    gb->apu.nr52 &= 0xFB;
 }
 
-static inline void noise_untrigger(void)
+static inline void noise_untrigger(struct gb *gb)
 {
-    _nr52 &= 0xF7;
+    gb->apu.nr52 &= 0xF7;
 }
 
-static inline bool square_1_is_triggered(void)
+static inline bool square_1_is_triggered(struct gb *gb)
 {
-    return (_nr52 & 0x01) == 0x01;
+    return (gb->apu.nr52 & 0x01) == 0x01;
 }
 
-static inline bool square_2_is_triggered(void)
+static inline bool square_2_is_triggered(struct gb *gb)
 {
-    return (_nr52 & 0x02) == 0x02;
+    return (gb->apu.nr52 & 0x02) == 0x02;
 }
 
-static inline bool wave_is_triggered(void)
+static inline bool wave_is_triggered(struct gb *gb)
 {
-    return (_nr52 & 0x04) == 0x04;
+    return (gb->apu.nr52 & 0x04) == 0x04;
 }
 
-static inline bool noise_is_triggered(void)
+static inline bool noise_is_triggered(struct gb *gb)
 {
-    return (_nr52 & 0x08) == 0x08;
+    return (gb->apu.nr52 & 0x08) == 0x08;
 }
 
-static void length_counter_step(void)
+static void length_counter_step(struct gb *gb)
 {
-    if(square_1_is_triggered() && _square_1.length.enabled) {
-        if (--_square_1.length.timer == 0) {
-            square_1_untrigger();
+    if(square_1_is_triggered(gb) && gb->apu.square_1.length.enabled) {
+        if (--gb->apu.square_1.length.timer == 0) {
+            square_1_untrigger(gb);
         }
     }
-    if(square_2_is_triggered() && _square_2.length.enabled) {
-        if (--_square_2.length.timer == 0) {
-            square_2_untrigger();
+    if(square_2_is_triggered(gb) && gb->apu.square_2.length.enabled) {
+        if (--gb->apu.square_2.length.timer == 0) {
+            square_2_untrigger(gb);
         }
     }
-    if(wave_is_triggered() && _wave.length.enabled) {
-        if (--_wave.length.timer == 0) {
-            wave_untrigger();
+    if(wave_is_triggered(gb) && gb->apu.wave.length.enabled) {
+        if (--gb->apu.wave.length.timer == 0) {
+            wave_untrigger(gb);
         }
     }
-    if(noise_is_triggered() && _noise.length.enabled) {
-        if (--_noise.length.timer == 0) {
-            noise_untrigger();
+    if(noise_is_triggered(gb) && gb->apu.noise.length.enabled) {
+        if (--gb->apu.noise.length.timer == 0) {
+            noise_untrigger(gb);
         }
     }
 }
 
-static void volume_envelope_step(void)
+static void volume_envelope_step(struct gb *gb)
 {
     for(int i = 0; i < 4; i++) {
         struct volume_envelope *env;
         switch (i) {
             case 0:
-                env = &_square_1.envelope;
+                env = &gb->apu.square_1.envelope;
                 break;
             case 1:
-                env = &_square_2.envelope;
+                env = &gb->apu.square_2.envelope;
                 break;
             case 3:
-                env = &_noise.envelope;
+                env = &gb->apu.noise.envelope;
                 break;
             case 2:
             default:
@@ -270,45 +180,45 @@ static void volume_envelope_step(void)
     }
 }
 
-static inline uint16_t frequency_sweep_calc(struct frequency_sweep *sweep)
+static inline uint16_t frequency_sweep_calc(struct gb *gb, struct frequency_sweep *sweep)
 {
     // Frequency calculation
-    if(_nr10 & 0x08) {
-        return sweep->shadow_frequency - (sweep->shadow_frequency >> (_nr10 & 0x07));
+    if(gb->apu.nr10 & 0x08) {
+        return sweep->shadow_frequency - (sweep->shadow_frequency >> (gb->apu.nr10 & 0x07));
     }
-    return sweep->shadow_frequency + (sweep->shadow_frequency >> (_nr10 & 0x07));
+    return sweep->shadow_frequency + (sweep->shadow_frequency >> (gb->apu.nr10 & 0x07));
 }
 
-static void frequency_sweep_step(void)
+static void frequency_sweep_step(struct gb *gb)
 {
-    struct frequency_sweep *sweep = &_square_1.sweep;
+    struct frequency_sweep *sweep = &gb->apu.square_1.sweep;
 
-    if(sweep->enabled && ((_nr10 & 0x70) != 0) && --sweep->timer == 0) {
-        sweep->timer = (uint8_t) ((_nr10 & 0x70) >> 4);
-        uint16_t new_freq = frequency_sweep_calc(sweep);
+    if(sweep->enabled && ((gb->apu.nr10 & 0x70) != 0) && --sweep->timer == 0) {
+        sweep->timer = (uint8_t) ((gb->apu.nr10 & 0x70) >> 4);
+        uint16_t new_freq = frequency_sweep_calc(gb, sweep);
         if(new_freq > 0x7FF) {
-            square_1_untrigger();
+            square_1_untrigger(gb);
         } else {
-            _square_1.sweep.shadow_frequency = new_freq;
-            _nr13 = (uint8_t) (new_freq & 0xFF);
-            _nr14 = (uint8_t) ((_nr14 & 0xFC) | ((new_freq >> 8) & 0x07));
+            gb->apu.square_1.sweep.shadow_frequency = new_freq;
+            gb->apu.nr13 = (uint8_t) (new_freq & 0xFF);
+            gb->apu.nr14 = (uint8_t) ((gb->apu.nr14 & 0xFC) | ((new_freq >> 8) & 0x07));
 
-            if(frequency_sweep_calc(sweep) > 0x7FF) {
-                square_1_untrigger();
+            if(frequency_sweep_calc(gb, sweep) > 0x7FF) {
+                square_1_untrigger(gb);
             }
         }
     }
 }
 
-static void frequency_sweep_trigger(uint16_t freq)
+static void frequency_sweep_trigger(struct gb *gb, uint16_t freq)
 {
-    _square_1.sweep.shadow_frequency = freq;
-    _square_1.sweep.timer = (uint8_t) ((_nr10 >> 4) & 0x07);
-    _square_1.sweep.enabled = ((_nr10 & 0x77) != 0);
+    gb->apu.square_1.sweep.shadow_frequency = freq;
+    gb->apu.square_1.sweep.timer = (uint8_t) ((gb->apu.nr10 >> 4) & 0x07);
+    gb->apu.square_1.sweep.enabled = ((gb->apu.nr10 & 0x77) != 0);
 
-    if(_nr10 & 0x07) {
-        if(frequency_sweep_calc(&_square_1.sweep) > 0x7FF) {
-            square_1_untrigger();
+    if(gb->apu.nr10 & 0x07) {
+        if(frequency_sweep_calc(gb, &gb->apu.square_1.sweep) > 0x7FF) {
+            square_1_untrigger(gb);
         }
     }
 }
@@ -316,478 +226,351 @@ static void frequency_sweep_trigger(uint16_t freq)
 /*
  * Audio source 1: Square 1
  */
-static void square_1_trigger(bool lc_enabled)
+static void square_1_trigger(struct gb *gb, bool lc_enabled)
 {
-    uint16_t freq = (uint16_t) (((_nr14 & 0x07) << 8) | _nr13);
+    uint16_t freq = (uint16_t) (((gb->apu.nr14 & 0x07) << 8) | gb->apu.nr13);
 
-    _nr52 |= 0x01;
+    gb->apu.nr52 |= 0x01;
 
-    _square_1.length.enabled = lc_enabled;
-    if(_square_1.length.timer == 0) {
-        _square_1.length.timer = 64;
+    gb->apu.square_1.length.enabled = lc_enabled;
+    if(gb->apu.square_1.length.timer == 0) {
+        gb->apu.square_1.length.timer = 64;
     }
 
-    _square_1.timer = (uint16_t) (4 * (2048 - freq));
+    gb->apu.square_1.timer = (uint16_t) (4 * (2048 - freq));
 
-    _square_1.envelope.period = (uint8_t) (_nr12 & 0x07);
-    _square_1.envelope.timer = _square_1.envelope.period;
-    _square_1.envelope.direction = (_nr12 & 0x08) == 0x08;
-    _square_1.envelope.volume = (uint8_t) ((_nr12 & 0xF0) >> 4);
-    _square_1.envelope.enabled = (_square_1.envelope.period != 0);
+    gb->apu.square_1.envelope.period = (uint8_t) (gb->apu.nr12 & 0x07);
+    gb->apu.square_1.envelope.timer = gb->apu.square_1.envelope.period;
+    gb->apu.square_1.envelope.direction = (gb->apu.nr12 & 0x08) == 0x08;
+    gb->apu.square_1.envelope.volume = (uint8_t) ((gb->apu.nr12 & 0xF0) >> 4);
+    gb->apu.square_1.envelope.enabled = (gb->apu.square_1.envelope.period != 0);
 
-    frequency_sweep_trigger(freq);
+    frequency_sweep_trigger(gb, freq);
 
     // Check if DAC is on
-    if((_nr12 & 0xF8) == 0) {
-        square_1_untrigger();
+    if((gb->apu.nr12 & 0xF8) == 0) {
+        square_1_untrigger(gb);
     }
 }
 
-static void square_1_step(void)
+static void square_1_step(struct gb *gb)
 {
-    if(square_1_is_triggered()) {
-        if(--_square_1.timer == 0) {
-            _square_1.timer = (uint16_t) (4 * (2048 - (((_nr14 & 0x07) << 8) | _nr13)));
+    if(square_1_is_triggered(gb)) {
+        if(--gb->apu.square_1.timer == 0) {
+            gb->apu.square_1.timer = (uint16_t) (4 * (2048 - (((gb->apu.nr14 & 0x07) << 8) | gb->apu.nr13)));
 
-            switch ((_nr11 >> 6) & 0x03) {
+            switch ((gb->apu.nr11 >> 6) & 0x03) {
                 case 0x00:
-                    if (_square_1.duty == 7) {
-                        _square_1.output = _square_1.envelope.volume;
+                    if (gb->apu.square_1.duty == 7) {
+                        gb->apu.square_1.output = gb->apu.square_1.envelope.volume;
                     } else {
-                        _square_1.output = 0;
+                        gb->apu.square_1.output = 0;
                     }
                     break;
                 case 0x01:
-                    if (_square_1.duty == 0 || _square_1.duty == 7) {
-                        _square_1.output = _square_1.envelope.volume;
+                    if (gb->apu.square_1.duty == 0 || gb->apu.square_1.duty == 7) {
+                        gb->apu.square_1.output = gb->apu.square_1.envelope.volume;
                     } else {
-                        _square_1.output = 0;
+                        gb->apu.square_1.output = 0;
                     }
                     break;
                 case 0x02:
-                    if (_square_1.duty == 0 || _square_1.duty >= 5) {
-                        _square_1.output = _square_1.envelope.volume;
+                    if (gb->apu.square_1.duty == 0 || gb->apu.square_1.duty >= 5) {
+                        gb->apu.square_1.output = gb->apu.square_1.envelope.volume;
                     } else {
-                        _square_1.output = 0;
+                        gb->apu.square_1.output = 0;
                     }
                     break;
                 case 0x03:
-                    if(_square_1.duty == 0 || _square_1.duty == 7){
-                        _square_1.output = 0;
+                    if(gb->apu.square_1.duty == 0 || gb->apu.square_1.duty == 7){
+                        gb->apu.square_1.output = 0;
                     } else {
-                        _square_1.output = _square_1.envelope.volume;
+                        gb->apu.square_1.output = gb->apu.square_1.envelope.volume;
                     }
                     break;
                 default:
                     break;
 
             }
-            _square_1.duty = (uint8_t) ((_square_1.duty + 1) % WAVEFORM_PERIOD);
+            gb->apu.square_1.duty = (uint8_t) ((gb->apu.square_1.duty + 1) % WAVEFORM_PERIOD);
         }
     } else {
-        _square_1.duty = 0;
-        _square_1.output = 0;
+        gb->apu.square_1.duty = 0;
+        gb->apu.square_1.output = 0;
     }
 }
 
 /*
  * Audio source 2: Square 2
  */
-static void square_2_trigger(bool lc_enabled)
+static void square_2_trigger(struct gb *gb, bool lc_enabled)
 {
-    uint16_t freq = (uint16_t) (((_nr24 & 0x07) << 8) | _nr23);
+    uint16_t freq = (uint16_t) (((gb->apu.nr24 & 0x07) << 8) | gb->apu.nr23);
 
-    _nr52 |= 0x02;
+    gb->apu.nr52 |= 0x02;
 
-    _square_2.length.enabled = lc_enabled;
-    if(_square_2.length.timer == 0) {
-        _square_2.length.timer = 64;
+    gb->apu.square_2.length.enabled = lc_enabled;
+    if(gb->apu.square_2.length.timer == 0) {
+        gb->apu.square_2.length.timer = 64;
     }
 
-    _square_2.timer = (uint16_t) (4 * (2048 - freq));
+    gb->apu.square_2.timer = (uint16_t) (4 * (2048 - freq));
 
-    _square_2.envelope.period = (uint8_t) (_nr22 & 0x07);
-    _square_2.envelope.timer = _square_2.envelope.period;
-    _square_2.envelope.direction = (_nr22 & 0x08) == 0x08;
-    _square_2.envelope.volume = (uint8_t) ((_nr22 & 0xF0) >> 4);
-    _square_2.envelope.enabled = (_square_2.envelope.period != 0);
+    gb->apu.square_2.envelope.period = (uint8_t) (gb->apu.nr22 & 0x07);
+    gb->apu.square_2.envelope.timer = gb->apu.square_2.envelope.period;
+    gb->apu.square_2.envelope.direction = (gb->apu.nr22 & 0x08) == 0x08;
+    gb->apu.square_2.envelope.volume = (uint8_t) ((gb->apu.nr22 & 0xF0) >> 4);
+    gb->apu.square_2.envelope.enabled = (gb->apu.square_2.envelope.period != 0);
 
     // Check if DAC is on
-    if((_nr22 & 0xF8) == 0) {
-        square_2_untrigger();
+    if((gb->apu.nr22 & 0xF8) == 0) {
+        square_2_untrigger(gb);
     }
 }
 
-static void square_2_step(void)
+static void square_2_step(struct gb *gb)
 {
-    if(square_2_is_triggered()) {
-        if(--_square_2.timer == 0) {
-            _square_2.timer = (uint16_t) (4 * (2048 - (((_nr24 & 0x07) << 8) | _nr23)));
+    if(square_2_is_triggered(gb)) {
+        if(--gb->apu.square_2.timer == 0) {
+            gb->apu.square_2.timer = (uint16_t) (4 * (2048 - (((gb->apu.nr24 & 0x07) << 8) | gb->apu.nr23)));
 
-            switch ((_nr21 >> 6) & 0x03) {
+            switch ((gb->apu.nr21 >> 6) & 0x03) {
                 case 0x00:
-                    if (_square_2.duty == 7) {
-                        _square_2.output = _square_2.envelope.volume;
+                    if (gb->apu.square_2.duty == 7) {
+                        gb->apu.square_2.output = gb->apu.square_2.envelope.volume;
                     } else {
-                        _square_2.output = 0;
+                        gb->apu.square_2.output = 0;
                     }
                     break;
                 case 0x01:
-                    if (_square_2.duty == 0 || _square_2.duty == 7) {
-                        _square_2.output = _square_2.envelope.volume;
+                    if (gb->apu.square_2.duty == 0 || gb->apu.square_2.duty == 7) {
+                        gb->apu.square_2.output = gb->apu.square_2.envelope.volume;
                     } else {
-                        _square_2.output = 0;
+                        gb->apu.square_2.output = 0;
                     }
                     break;
                 case 0x02:
-                    if (_square_2.duty == 0 || _square_2.duty >= 5) {
-                        _square_2.output = _square_2.envelope.volume;
+                    if (gb->apu.square_2.duty == 0 || gb->apu.square_2.duty >= 5) {
+                        gb->apu.square_2.output = gb->apu.square_2.envelope.volume;
                     } else {
-                        _square_2.output = 0;
+                        gb->apu.square_2.output = 0;
                     }
                     break;
                 case 0x03:
-                    if(_square_2.duty == 0 || _square_2.duty == 7){
-                        _square_2.output = 0;
+                    if(gb->apu.square_2.duty == 0 || gb->apu.square_2.duty == 7){
+                        gb->apu.square_2.output = 0;
                     } else {
-                        _square_2.output = _square_2.envelope.volume;
+                        gb->apu.square_2.output = gb->apu.square_2.envelope.volume;
                     }
                     break;
                 default:
                     break;
 
             }
-            _square_2.duty = (uint8_t) ((_square_2.duty + 1) % WAVEFORM_PERIOD);
+            gb->apu.square_2.duty = (uint8_t) ((gb->apu.square_2.duty + 1) % WAVEFORM_PERIOD);
         }
     } else {
-        _square_2.duty = 0;
-        _square_2.output = 0;
+        gb->apu.square_2.duty = 0;
+        gb->apu.square_2.output = 0;
     }
 }
 
 /*
  * Audio source 3: Wave
  */
-static void wave_trigger(bool lc_enabled)
+static void wave_trigger(struct gb *gb, bool lc_enabled)
 {
-    _nr52 |= 0x04;
+    gb->apu.nr52 |= 0x04;
 
-    _wave.length.enabled = lc_enabled;
-    if(_wave.length.timer == 0) {
-        _wave.length.timer = 256;
+    gb->apu.wave.length.enabled = lc_enabled;
+    if(gb->apu.wave.length.timer == 0) {
+        gb->apu.wave.length.timer = 256;
     }
 
-    _wave.timer = (uint16_t) (2 * (2048 - (((_nr34 & 0x07) << 8) | _nr33)));
+    gb->apu.wave.timer = (uint16_t) (2 * (2048 - (((gb->apu.nr34 & 0x07) << 8) | gb->apu.nr33)));
 
-    _wave.volume = (uint8_t) ((_nr32 >> 5) & 0x03);
+    gb->apu.wave.volume = (uint8_t) ((gb->apu.nr32 >> 5) & 0x03);
 
-    _wave.sample = 0;
+    gb->apu.wave.sample = 0;
 
     // Check if DAC is on
-    if((_nr30 & 0x80) == 0) {
-        wave_untrigger();
+    if((gb->apu.nr30 & 0x80) == 0) {
+        wave_untrigger(gb);
     }
 }
 
-static void wave_step(void)
+static void wave_step(struct gb *gb)
 {
-    if(wave_is_triggered()) {
-        if(--_wave.timer == 0) {
-            _wave.timer = (uint16_t) (2 * (2048 - (((_nr34 & 0x07) << 8) | _nr33)));
+    if(wave_is_triggered(gb)) {
+        if(--gb->apu.wave.timer == 0) {
+            gb->apu.wave.timer = (uint16_t) (2 * (2048 - (((gb->apu.nr34 & 0x07) << 8) | gb->apu.nr33)));
 
-            uint8_t current_sample = _wave_pattern_ram[_wave.sample / 2];
-            uint8_t sample_data = (uint8_t) (_wave.sample % 2);
+            uint8_t current_sample = gb->apu.wave_pattern_ram[gb->apu.wave.sample / 2];
+            uint8_t sample_data = (uint8_t) (gb->apu.wave.sample % 2);
 
-            if(_wave.volume == 0) {
-                _wave.output = 0;
+            if(gb->apu.wave.volume == 0) {
+                gb->apu.wave.output = 0;
             } else {
-                _wave.output = (uint8_t) (((current_sample >> (4 * (1 - sample_data))) & 0x0F) >> (_wave.volume - 1));
+                gb->apu.wave.output = (uint8_t) (((current_sample >> (4 * (1 - sample_data))) & 0x0F) >> (gb->apu.wave.volume - 1));
             }
 
-            _wave.sample = (uint8_t) ((_wave.sample + 1) % (_WAVE_PATTERN_RAM_SIZE * 2));
+            gb->apu.wave.sample = (uint8_t) ((gb->apu.wave.sample + 1) % (_WAVE_PATTERN_RAM_SIZE * 2));
         }
     } else {
-        _wave.sample = 0;
-        _wave.output = 0;
+        gb->apu.wave.sample = 0;
+        gb->apu.wave.output = 0;
     }
 }
 
 /*
  * Audio source 4: Noise
  */
-static void noise_trigger(bool lc_enabled)
+static void noise_trigger(struct gb *gb, bool lc_enabled)
 {
-    uint8_t r = (uint8_t) ((_nr43 & 0x07) * 2);
+    uint8_t r = (uint8_t) ((gb->apu.nr43 & 0x07) * 2);
     if(r == 0) r = 1;
-    uint8_t s = (uint8_t) ((_nr43 & 0xF0) >> 4);
+    uint8_t s = (uint8_t) ((gb->apu.nr43 & 0xF0) >> 4);
 
-    _nr52 |= 0x08;
+    gb->apu.nr52 |= 0x08;
 
-    _noise.length.enabled = lc_enabled;
-    if(_noise.length.timer == 0) {
-        _noise.length.timer = 256;
+    gb->apu.noise.length.enabled = lc_enabled;
+    if(gb->apu.noise.length.timer == 0) {
+        gb->apu.noise.length.timer = 256;
     }
 
-    _noise.timer = (uint16_t) (8 * (r << (s + 1)));
+    gb->apu.noise.timer = (uint16_t) (8 * (r << (s + 1)));
 
-    _noise.envelope.period = (uint8_t) (_nr42 & 0x07);
-    _noise.envelope.timer = _noise.envelope.period;
-    _noise.envelope.direction = (_nr42 & 0x08) == 0x08;
-    _noise.envelope.volume = (uint8_t) ((_nr42 & 0xF0) >> 4);
-    _noise.envelope.enabled = (_noise.envelope.period != 0);
+    gb->apu.noise.envelope.period = (uint8_t) (gb->apu.nr42 & 0x07);
+    gb->apu.noise.envelope.timer = gb->apu.noise.envelope.period;
+    gb->apu.noise.envelope.direction = (gb->apu.nr42 & 0x08) == 0x08;
+    gb->apu.noise.envelope.volume = (uint8_t) ((gb->apu.nr42 & 0xF0) >> 4);
+    gb->apu.noise.envelope.enabled = (gb->apu.noise.envelope.period != 0);
 
-    _noise.lfsr.shift_reg = 0x7FFF;
+    gb->apu.noise.lfsr.shift_reg = 0x7FFF;
 
     // Check if DAC is on
-    if((_nr42 & 0xF8) == 0) {
-        noise_untrigger();
+    if((gb->apu.nr42 & 0xF8) == 0) {
+        noise_untrigger(gb);
     }
 }
 
-static void noise_step(void)
+static void noise_step(struct gb *gb)
 {
-    if(noise_is_triggered()) {
-        if(--_noise.timer == 0) {
-            uint8_t r = (uint8_t) ((_nr43 & 0x07) * 2);
+    if(noise_is_triggered(gb)) {
+        if(--gb->apu.noise.timer == 0) {
+            uint8_t r = (uint8_t) ((gb->apu.nr43 & 0x07) * 2);
             if(r == 0) r = 1;
-            uint8_t s = (uint8_t) ((_nr43 & 0xF0) >> 4);
+            uint8_t s = (uint8_t) ((gb->apu.nr43 & 0xF0) >> 4);
 
-            _noise.timer = (uint16_t) (8 * (r << (s + 1)));
+            gb->apu.noise.timer = (uint16_t) (8 * (r << (s + 1)));
 
             if(s <= 13) {
-                int bit0 = _noise.lfsr.shift_reg & 0x01;
-                int bit1 = (_noise.lfsr.shift_reg >> 1) & 0x01;
+                int bit0 = gb->apu.noise.lfsr.shift_reg & 0x01;
+                int bit1 = (gb->apu.noise.lfsr.shift_reg >> 1) & 0x01;
                 int xor = (bit0 ^ bit1);
 
-                _noise.lfsr.shift_reg = (uint16_t) ((xor << 14) | ((_noise.lfsr.shift_reg >> 1) & 0x3FFF));
-                if(_nr43 & 0x08) {
-                    _noise.lfsr.shift_reg = (uint16_t) ((xor << 6) | ((_noise.lfsr.shift_reg >> 1) & 0x7FBF));
+                gb->apu.noise.lfsr.shift_reg = (uint16_t) ((xor << 14) | ((gb->apu.noise.lfsr.shift_reg >> 1) & 0x3FFF));
+                if(gb->apu.nr43 & 0x08) {
+                    gb->apu.noise.lfsr.shift_reg = (uint16_t) ((xor << 6) | ((gb->apu.noise.lfsr.shift_reg >> 1) & 0x7FBF));
                 }
             }
 
-            if(_noise.lfsr.shift_reg & 0x01) {
-                _noise.output = 0;
+            if(gb->apu.noise.lfsr.shift_reg & 0x01) {
+                gb->apu.noise.output = 0;
             } else {
-                _noise.output = _noise.envelope.volume;
+                gb->apu.noise.output = gb->apu.noise.envelope.volume;
             }
         }
     } else {
-        _noise.output = 0;
-    }
-}
-
-uint8_t sound_read_byte(uint16_t address)
-{
-    if(_WAVE_PATTERN_RAM_OFFSET <= address && address < _WAVE_PATTERN_RAM_OFFSET_END) {
-        return _wave_pattern_ram[address - _WAVE_PATTERN_RAM_OFFSET];
-    }
-
-    if (address == NR52_ADDRESS) {
-        return (uint8_t) (_nr52 | 0x70);
-    }
-
-    if (_nr52 & 0x80) {
-        if (address == NR10_ADDRESS) {
-            return (uint8_t) (_nr10 | 0x80);
-        } else if (address == NR11_ADDRESS) {
-            return (uint8_t) (_nr11 | 0x3F);
-        } else if (address == NR12_ADDRESS) {
-            return _nr12;
-        } else if (address == NR13_ADDRESS) {
-            return 0xFF;
-        } else if (address == NR14_ADDRESS) {
-            return (uint8_t) (_nr14 | 0xBF);
-        } else if (address == NR21_ADDRESS) {
-            return (uint8_t) (_nr21 | 0x3F);
-        } else if (address == NR22_ADDRESS) {
-            return _nr22;
-        } else if (address == NR23_ADDRESS) {
-            return 0xFF;
-        } else if (address == NR24_ADDRESS) {
-            return (uint8_t) (_nr24 | 0xBF);
-        } else if (address == NR30_ADDRESS) {
-            return (uint8_t) (_nr30 | 0x7F);
-        } else if (address == NR31_ADDRESS) {
-            return 0xFF;
-        } else if (address == NR32_ADDRESS) {
-            return (uint8_t) (_nr32 | 0x9F);
-        } else if (address == NR33_ADDRESS) {
-            return 0xFF;
-        } else if (address == NR34_ADDRESS) {
-            return (uint8_t) (_nr34 | 0xBF);
-        } else if (address == NR41_ADDRESS) {
-            return 0xFF;
-        } else if (address == NR42_ADDRESS) {
-            return _nr42;
-        } else if (address == NR43_ADDRESS) {
-            return _nr43;
-        } else if (address == NR44_ADDRESS) {
-            return (uint8_t) (_nr44 | 0xBF);
-        } else if (address == NR50_ADDRESS) {
-            return _nr50;
-        } else if (address == NR51_ADDRESS) {
-            return _nr51;
-        }
+        gb->apu.noise.output = 0;
     }
-
-    return 0xFF;
 }
 
-void sound_write_byte(uint16_t address, uint8_t value)
+/**
+ *
+ * @param gb
+ */
+static void frame_sequencer_step(struct gb *gb)
 {
-    if (_WAVE_PATTERN_RAM_OFFSET <= address && address < _WAVE_PATTERN_RAM_OFFSET_END) {
-        _wave_pattern_ram[address - _WAVE_PATTERN_RAM_OFFSET] = value;
+    if( (gb->apu.frame_seq % 2) == 0 ) {
+        length_counter_step(gb);
     }
-
-    if (address == NR52_ADDRESS) {
-        _nr52 = (uint8_t) ((value & 0x80) | (_nr52 & 0x0F));
-        if(value & 0x80) {
-            audio_enable();
-            _frame_seq = 0;
-            _square_1.duty = 0;
-            _square_2.duty = 0;
-            _wave.sample = 0;
-        } else {
-            audio_disable();
-            reset_regs();
-        }
+    if( (gb->apu.frame_seq % 8) == 7 ) {
+        volume_envelope_step(gb);
     }
-
-    if (_nr52 & 0x80) {
-        if (address == NR10_ADDRESS) {
-            _nr10 = value;
-        } else if (address == NR11_ADDRESS) {
-            _nr11 = value;
-            _square_1.length.timer = (uint16_t) (64 - (value & 0x3F));
-        } else if (address == NR12_ADDRESS) {
-            _nr12 = value;
-        } else if (address == NR13_ADDRESS) {
-            _nr13 = value;
-        } else if (address == NR14_ADDRESS) {
-            _nr14 = value;
-            if (value & 0x80) {
-                square_1_trigger((value & 0x40) == 0x40);
-            }
-        } else if (address == NR21_ADDRESS) {
-            _nr21 = value;
-            _square_2.length.timer = (uint16_t) (64 - (value & 0x3F));
-        } else if (address == NR22_ADDRESS) {
-            _nr22 = value;
-        } else if (address == NR23_ADDRESS) {
-            _nr23 = value;
-        } else if (address == NR24_ADDRESS) {
-            _nr24 = value;
-            if (value & 0x80) {
-                square_2_trigger((value & 0x40) == 0x40);
-            }
-        } else if (address == NR30_ADDRESS) {
-            _nr30 = value;
-        } else if (address == NR31_ADDRESS) {
-            _nr31 = value;
-            _wave.length.timer = (uint16_t) (256 - (value & 0x3F));
-        } else if (address == NR32_ADDRESS) {
-            _nr32 = value;
-        } else if (address == NR33_ADDRESS) {
-            _nr33 = value;
-        } else if (address == NR34_ADDRESS) {
-            _nr34 = value;
-            if (value & 0x80) {
-                wave_trigger((value & 0x40) == 0x40);
-            }
-        } else if (address == NR41_ADDRESS) {
-            _nr41 = value;
-            _noise.length.timer = (uint16_t) (64 - (value & 0x3F));
-        } else if (address == NR42_ADDRESS) {
-            _nr42 = value;
-        } else if (address == NR43_ADDRESS) {
-            _nr43 = value;
-        } else if (address == NR44_ADDRESS) {
-            _nr44 = value;
-            if (value & 0x80) {
-                noise_trigger((value & 0x40) == 0x40);
-            }
-        } else if (address == NR50_ADDRESS) {
-            _nr50 = value;
-        } else if (address == NR51_ADDRESS) {
-            _nr51 = value;
-        }
+    if( (gb->apu.frame_seq % 4) == 2 ) {
+        frequency_sweep_step(gb);
     }
+    gb->apu.frame_seq = (uint8_t) ((gb->apu.frame_seq + 1) % 8);
 }
 
-void audio_update(uint8_t clk_tics)
+/**
+ * Run the channels and the mixer up to the given CPU clock.
+ *
+ * @param gb
+ * @param clk
+ */
+static void audio_sync(struct gb *gb, uint64_t clk)
 {
     struct sound _sound;
 
-    // Save old clock
-    uint32_t old_timer_clk = _timer_clk;
-
-    // Update clock
-    _timer_clk += clk_tics;
-
-    if(_nr52 & 0x80) {
-        for(int i = 0; i < (_timer_clk - old_timer_clk); i++) {
-            if((_timer_clk + i) % _512HZ_DIV == 0) {
-                if( (_frame_seq % 2) == 0 ) {
-                    length_counter_step();
-                }
-                if( (_frame_seq % 8) == 7 ) {
-                    volume_envelope_step();
-                }
-                if( (_frame_seq % 4) == 2 ) {
-                    frequency_sweep_step();
-                }
-                _frame_seq = (uint8_t) ((_frame_seq + 1) % 8);
-            }
+    uint64_t _old_clk = gb->apu.last_sync;
+    if(clk <= _old_clk) {
+        return;
+    }
+    gb->apu.last_sync = clk;
 
-            square_1_step();
-            square_2_step();
-            wave_step();
-            noise_step();
+    if(gb->apu.nr52 & 0x80) {
+        for(uint64_t t = _old_clk + 1; t <= clk; t++) {
+            square_1_step(gb);
+            square_2_step(gb);
+            wave_step(gb);
+            noise_step(gb);
 
-            if((_timer_clk + i) % 8 != 0) {
+            if(t % 8 != 0) {
                 continue;
             }
 
-            float dac1 = (_nr52 & 0x01 ? ((float)_square_1.output / 7.5f) - 1.0f : 0.0f);
-            float dac2 = (_nr52 & 0x02 ? ((float)_square_2.output / 7.5f) - 1.0f : 0.0f);
-            float dac3 = (_nr52 & 0x04 ? ((float)_wave.output / 7.5f) - 1.0f : 0.0f);
-            float dac4 = (_nr52 & 0x08 ? ((float)_noise.output / 7.5f) - 1.0f : 0.0f);
+            float dac1 = (gb->apu.nr52 & 0x01 ? ((float)gb->apu.square_1.output / 7.5f) - 1.0f : 0.0f);
+            float dac2 = (gb->apu.nr52 & 0x02 ? ((float)gb->apu.square_2.output / 7.5f) - 1.0f : 0.0f);
+            float dac3 = (gb->apu.nr52 & 0x04 ? ((float)gb->apu.wave.output / 7.5f) - 1.0f : 0.0f);
+            float dac4 = (gb->apu.nr52 & 0x08 ? ((float)gb->apu.noise.output / 7.5f) - 1.0f : 0.0f);
 
             float mixer1 = 0.0f;
             float mixer2 = 0.0f;
 
             // S01 Mixing
-            if (_nr51 & 0x01) {
+            if (gb->apu.nr51 & 0x01) {
                 // Output sound 1 to SO1
                 mixer1 += dac1;
             }
-            if (_nr51 & 0x02) {
+            if (gb->apu.nr51 & 0x02) {
                 // Output sound 2 to SO1
                 mixer1 += dac2;
             }
-            if (_nr51 & 0x04) {
+            if (gb->apu.nr51 & 0x04) {
                 // Output sound 3 to SO1
                 mixer1 += dac3;
             }
-            if (_nr51 & 0x08) {
+            if (gb->apu.nr51 & 0x08) {
                 // Output sound 4 to SO1
                 mixer1 += dac4;
             }
 
             // S02 Mixing
-            if (_nr51 & 0x10) {
+            if (gb->apu.nr51 & 0x10) {
                 // Output sound 1 to SO2
                 mixer2 += dac1;
             }
-            if (_nr51 & 0x20) {
+            if (gb->apu.nr51 & 0x20) {
                 // Output sound 2 to SO2
                 mixer2 += dac2;
             }
-            if (_nr51 & 0x40) {
+            if (gb->apu.nr51 & 0x40) {
                 // Output sound 3 to SO2
                 mixer2 += dac3;
             }
-            if (_nr51 & 0x80) {
+            if (gb->apu.nr51 & 0x80) {
                 // Output sound 4 to SO2
                 mixer2 += dac4;
             }
@@ -798,29 +581,356 @@ void audio_update(uint8_t clk_tics)
             _sound.vin_left = 0;
             _sound.vin_right = 0;
 
-            if (_nr50 & 0x08) {
+            if (gb->apu.nr50 & 0x08) {
                 // Output Vin to SO1
                 _sound.vin_left = get_vin();
             }
-            if (_nr50 & 0x80) {
+            if (gb->apu.nr50 & 0x80) {
                 // Output Vin to SO2
                 _sound.vin_right = get_vin();
             }
 
-            _sound.volume_left = (int8_t) ((_nr50 & 0x07) + 1);
-            _sound.volume_right = (int8_t) (((_nr50 >> 4) & 0x07) + 1);
+            _sound.volume_left = (int8_t) ((gb->apu.nr50 & 0x07) + 1);
+            _sound.volume_right = (int8_t) (((gb->apu.nr50 >> 4) & 0x07) + 1);
 
             audio_play(&_sound);
         }
     }
+}
+
+/**
+ * Value of a control register, with its unused and write only bits set.
+ * Everything reads as 0xFF while the APU is off.
+ *
+ * @param gb
+ * @param value
+ * @param unused
+ * @return
+ */
+static inline uint8_t control_read(struct gb *gb, uint8_t value, uint8_t unused)
+{
+    return (uint8_t) ((gb->apu.nr52 & 0x80) ? (value | unused) : 0xFF);
+}
 
-    _timer_clk %= CPU_CLK_SPEED;
+/**
+ * Catch up with the clock before a control register changes.
+ *
+ * @param gb
+ * @return false if the APU is off, and ignores the write
+ */
+static inline bool control_write(struct gb *gb)
+{
+    audio_sync(gb, gb->cpu.r.clk);
+    return (gb->apu.nr52 & 0x80) == 0x80;
+}
+
+static uint8_t nr10_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr10, 0x80);
 }
 
-void audio_reset(void)
+static void nr10_write(struct gb *gb, uint16_t address, uint8_t value)
 {
-    reset_regs();
+    if(control_write(gb)) {
+        gb->apu.nr10 = value;
+    }
+}
+
+static uint8_t nr11_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr11, 0x3F);
+}
+
+static void nr11_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr11 = value;
+        gb->apu.square_1.length.timer = (uint16_t) (64 - (value & 0x3F));
+    }
+}
+
+static uint8_t nr12_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr12, 0x00);
+}
+
+static void nr12_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr12 = value;
+    }
+}
+
+static void nr13_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr13 = value;
+    }
+}
+
+static uint8_t nr14_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr14, 0xBF);
+}
+
+static void nr14_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr14 = value;
+        if(value & 0x80) {
+            square_1_trigger(gb, (value & 0x40) == 0x40);
+        }
+    }
+}
+
+static uint8_t nr21_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr21, 0x3F);
+}
+
+static void nr21_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr21 = value;
+        gb->apu.square_2.length.timer = (uint16_t) (64 - (value & 0x3F));
+    }
+}
+
+static uint8_t nr22_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr22, 0x00);
+}
+
+static void nr22_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr22 = value;
+    }
+}
+
+static void nr23_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr23 = value;
+    }
+}
+
+static uint8_t nr24_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr24, 0xBF);
+}
 
-    _timer_clk = 0;
-    _frame_seq = 0;
+static void nr24_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr24 = value;
+        if(value & 0x80) {
+            square_2_trigger(gb, (value & 0x40) == 0x40);
+        }
+    }
+}
+
+static uint8_t nr30_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr30, 0x7F);
+}
+
+static void nr30_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr30 = value;
+    }
+}
+
+static void nr31_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr31 = value;
+        gb->apu.wave.length.timer = (uint16_t) (256 - (value & 0x3F));
+    }
+}
+
+static uint8_t nr32_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr32, 0x9F);
+}
+
+static void nr32_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr32 = value;
+    }
+}
+
+static void nr33_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr33 = value;
+    }
+}
+
+static uint8_t nr34_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr34, 0xBF);
+}
+
+static void nr34_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr34 = value;
+        if(value & 0x80) {
+            wave_trigger(gb, (value & 0x40) == 0x40);
+        }
+    }
+}
+
+static void nr41_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr41 = value;
+        gb->apu.noise.length.timer = (uint16_t) (64 - (value & 0x3F));
+    }
+}
+
+static uint8_t nr42_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr42, 0x00);
+}
+
+static void nr42_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr42 = value;
+    }
+}
+
+static uint8_t nr43_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr43, 0x00);
+}
+
+static void nr43_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr43 = value;
+    }
+}
+
+static uint8_t nr44_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr44, 0xBF);
+}
+
+static void nr44_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr44 = value;
+        if(value & 0x80) {
+            noise_trigger(gb, (value & 0x40) == 0x40);
+        }
+    }
+}
+
+static uint8_t nr50_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr50, 0x00);
+}
+
+static void nr50_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr50 = value;
+    }
+}
+
+static uint8_t nr51_read(struct gb *gb, uint16_t address)
+{
+    return control_read(gb, gb->apu.nr51, 0x00);
+}
+
+static void nr51_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    if(control_write(gb)) {
+        gb->apu.nr51 = value;
+    }
+}
+
+static uint8_t nr52_read(struct gb *gb, uint16_t address)
+{
+    audio_sync(gb, gb->cpu.r.clk);
+    return (uint8_t) (gb->apu.nr52 | 0x70);
+}
+
+static void nr52_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    audio_sync(gb, gb->cpu.r.clk);
+    gb->apu.nr52 = (uint8_t) ((value & 0x80) | (gb->apu.nr52 & 0x0F));
+    if(value & 0x80) {
+        audio_enable();
+        gb->apu.frame_seq = 0;
+        gb->apu.square_1.duty = 0;
+        gb->apu.square_2.duty = 0;
+        gb->apu.wave.sample = 0;
+    } else {
+        audio_disable();
+        reset_regs(gb);
+    }
+}
+
+static uint8_t wave_pattern_read(struct gb *gb, uint16_t address)
+{
+    audio_sync(gb, gb->cpu.r.clk);
+    return gb->apu.wave_pattern_ram[address - _WAVE_PATTERN_RAM_OFFSET];
+}
+
+static void wave_pattern_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    audio_sync(gb, gb->cpu.r.clk);
+    gb->apu.wave_pattern_ram[address - _WAVE_PATTERN_RAM_OFFSET] = value;
+}
+
+void audio_event(struct gb *gb, uint64_t deadline)
+{
+    audio_sync(gb, deadline);
+
+    if(gb->apu.nr52 & 0x80) {
+        frame_sequencer_step(gb);
+    }
+
+    schedule_event(gb, EVENT_APU_FRAME_SEQ, deadline + _512HZ_DIV);
+}
+
+void audio_reset(struct gb *gb)
+{
+    reset_regs(gb);
+
+    gb->apu.last_sync = gb->cpu.r.clk;
+    gb->apu.frame_seq = 0;
+
+    schedule_event(gb, EVENT_APU_FRAME_SEQ, ((gb->apu.last_sync / _512HZ_DIV) + 1) * _512HZ_DIV);
+
+    mmu_register_io(gb, NR10_ADDRESS, nr10_read, nr10_write);
+    mmu_register_io(gb, NR11_ADDRESS, nr11_read, nr11_write);
+    mmu_register_io(gb, NR12_ADDRESS, nr12_read, nr12_write);
+    mmu_register_io(gb, NR13_ADDRESS, NULL, nr13_write);
+    mmu_register_io(gb, NR14_ADDRESS, nr14_read, nr14_write);
+    mmu_register_io(gb, NR21_ADDRESS, nr21_read, nr21_write);
+    mmu_register_io(gb, NR22_ADDRESS, nr22_read, nr22_write);
+    mmu_register_io(gb, NR23_ADDRESS, NULL, nr23_write);
+    mmu_register_io(gb, NR24_ADDRESS, nr24_read, nr24_write);
+    mmu_register_io(gb, NR30_ADDRESS, nr30_read, nr30_write);
+    mmu_register_io(gb, NR31_ADDRESS, NULL, nr31_write);
+    mmu_register_io(gb, NR32_ADDRESS, nr32_read, nr32_write);
+    mmu_register_io(gb, NR33_ADDRESS, NULL, nr33_write);
+    mmu_register_io(gb, NR34_ADDRESS, nr34_read, nr34_write);
+    mmu_register_io(gb, NR41_ADDRESS, NULL, nr41_write);
+    mmu_register_io(gb, NR42_ADDRESS, nr42_read, nr42_write);
+    mmu_register_io(gb, NR43_ADDRESS, nr43_read, nr43_write);
+    mmu_register_io(gb, NR44_ADDRESS, nr44_read, nr44_write);
+    mmu_register_io(gb, NR50_ADDRESS, nr50_read, nr50_write);
+    mmu_register_io(gb, NR51_ADDRESS, nr51_read, nr51_write);
+    mmu_register_io(gb, NR52_ADDRESS, nr52_read, nr52_write);
+    for(uint16_t address = _WAVE_PATTERN_RAM_OFFSET; address < _WAVE_PATTERN_RAM_OFFSET_END; address++) {
+        mmu_register_io(gb, address, wave_pattern_read, wave_pattern_write);
+    }
 }
\ No newline at end of file
@@ -25,29 +25,120 @@
 #define NEC_AUDIO_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
-/**
- *
- * @param address
- * @return
- */
-uint8_t sound_read_byte(uint16_t address);
+#define _WAVE_PATTERN_RAM_OFFSET        0xFF30
+#define _WAVE_PATTERN_RAM_OFFSET_END    0xFF40
+#define _WAVE_PATTERN_RAM_SIZE          (_WAVE_PATTERN_RAM_OFFSET_END - _WAVE_PATTERN_RAM_OFFSET)
+
+struct gb;
+
+struct frequency_sweep {
+    uint16_t shadow_frequency;
+    uint8_t timer;
+    bool enabled;
+};
+
+struct length_counter {
+    uint16_t timer;
+    bool enabled;
+};
+
+struct volume_envelope {
+    uint8_t timer;
+    uint8_t period;
+    uint8_t volume;
+    bool direction;
+    bool enabled;
+};
+
+struct lfsr {
+    uint16_t shift_reg;
+};
 
 /**
- *
- * @param address
- * @param value
+ * Sound controller state of a single GameBoy instance.
  */
-void sound_write_byte(uint16_t address, uint8_t value);
+struct apu {
+    uint64_t last_sync;
+    uint8_t frame_seq;
+
+    /*
+     * Audio control
+     */
+    uint8_t nr10;
+    uint8_t nr11;
+    uint8_t nr12;
+    uint8_t nr13;
+    uint8_t nr14;
+    uint8_t nr21;
+    uint8_t nr22;
+    uint8_t nr23;
+    uint8_t nr24;
+    uint8_t nr30;
+    uint8_t nr31;
+    uint8_t nr32;
+    uint8_t nr33;
+    uint8_t nr34;
+    uint8_t nr41;
+    uint8_t nr42;
+    uint8_t nr43;
+    uint8_t nr44;
+    uint8_t nr50;
+    uint8_t nr51;
+    uint8_t nr52;
+    uint8_t wave_pattern_ram[_WAVE_PATTERN_RAM_SIZE];
+
+    struct {
+        struct frequency_sweep sweep;
+        uint16_t timer;
+        uint8_t duty;
+        struct length_counter length;
+        struct volume_envelope envelope;
+
+        uint8_t output;
+    } square_1;
+
+    struct {
+        uint16_t timer;
+        uint8_t duty;
+        struct length_counter length;
+        struct volume_envelope envelope;
+
+        uint8_t output;
+    } square_2;
+
+    struct {
+        uint16_t timer;
+        struct length_counter length;
+        uint8_t volume;
+        uint8_t sample;
+
+        uint8_t output;
+    } wave;
+
+    struct {
+        uint32_t timer;
+        struct lfsr lfsr;
+        struct length_counter length;
+        struct volume_envelope envelope;
+
+        uint8_t output;
+    } noise;
+};
 
 /**
+ * Frame sequencer (512Hz) deadline handler.
  *
+ * @param gb
+ * @param deadline
  */
-void audio_update(uint8_t clk_tics);
+void audio_event(struct gb *gb, uint64_t deadline);
 
 /**
  *
+ * @param gb
  */
-void audio_reset(void);
+void audio_reset(struct gb *gb);
 
 #endif //NEC_AUDIO_H
@@ -0,0 +1,309 @@
+/* MIT License
+ *
+ * Copyright (c) 2017 Koen van der Heijden.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Exhaustive test of the 8 bit ALU instructions: every A, operand and
+ * incoming carry (every incoming flag for the single operand instructions)
+ * runs through the CPU, and A and F must match a plain reference. The flag
+ * tables of NEC_ALU_TABLES and the computed flags are both held to the same
+ * results, and with NEC_JIT so is the native code the test blocks compile to.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "../GB.h"
+#include "../context.h"
+#include "harness.h"
+
+#define FLAG_Z          0x80
+#define FLAG_N          0x40
+#define FLAG_H          0x20
+#define FLAG_C          0x10
+
+#define PROGRAMS        0x0200
+#define PROGRAM_SIZE    0x10
+#define BOOT_CYCLES     0x1000
+
+// POP AF reads the inputs from the start of RAM
+#define STACK           0xC000
+#define POP_AF_CYCLES   12
+
+/**
+ * A result as A in the high and F in the low byte.
+ *
+ * @param a
+ * @param z
+ * @param n
+ * @param h
+ * @param c
+ * @return
+ */
+static uint16_t result(unsigned int a, bool z, bool n, bool h, bool c)
+{
+    return (uint16_t) ((a & 0xFF) << 8 | (z ? FLAG_Z : 0) | (n ? FLAG_N : 0) | (h ? FLAG_H : 0) | (c ? FLAG_C : 0));
+}
+
+static uint16_t add(uint8_t a, uint8_t b, bool carry)
+{
+    unsigned int r = a + b + carry;
+    return result(r, (uint8_t) r == 0, false, (a & 0x0F) + (b & 0x0F) + carry > 0x0F, r > 0xFF);
+}
+
+static uint16_t sub(uint8_t a, uint8_t b, bool carry)
+{
+    int r = a - b - carry;
+    return result((unsigned int) r, (uint8_t) r == 0, true, (a & 0x0F) - (b & 0x0F) - carry < 0, r < 0);
+}
+
+static uint16_t ref_add(uint8_t a, uint8_t b, uint8_t f)
+{
+    return add(a, b, false);
+}
+
+static uint16_t ref_adc(uint8_t a, uint8_t b, uint8_t f)
+{
+    return add(a, b, f & FLAG_C);
+}
+
+static uint16_t ref_sub(uint8_t a, uint8_t b, uint8_t f)
+{
+    return sub(a, b, false);
+}
+
+static uint16_t ref_sbc(uint8_t a, uint8_t b, uint8_t f)
+{
+    return sub(a, b, f & FLAG_C);
+}
+
+static uint16_t ref_and(uint8_t a, uint8_t b, uint8_t f)
+{
+    return result(a & b, (a & b) == 0, false, true, false);
+}
+
+static uint16_t ref_xor(uint8_t a, uint8_t b, uint8_t f)
+{
+    return result(a ^ b, (a ^ b) == 0, false, false, false);
+}
+
+static uint16_t ref_or(uint8_t a, uint8_t b, uint8_t f)
+{
+    return result(a | b, (a | b) == 0, false, false, false);
+}
+
+static uint16_t ref_cp(uint8_t a, uint8_t b, uint8_t f)
+{
+    return (uint16_t) (a << 8 | (sub(a, b, false) & 0xFF));
+}
+
+static uint16_t ref_inc(uint8_t a, uint8_t b, uint8_t f)
+{
+    return result(a + 1u, a == 0xFF, false, (a & 0x0F) == 0x0F, f & FLAG_C);
+}
+
+static uint16_t ref_dec(uint8_t a, uint8_t b, uint8_t f)
+{
+    return result(a - 1u, a == 0x01, true, (a & 0x0F) == 0x00, f & FLAG_C);
+}
+
+static uint16_t ref_rlc(uint8_t a, uint8_t b, uint8_t f)
+{
+    return result((unsigned int) (a << 1 | a >> 7), a == 0, false, false, a & 0x80);
+}
+
+static uint16_t ref_rrc(uint8_t a, uint8_t b, uint8_t f)
+{
+    return result((unsigned int) (a >> 1 | a << 7), a == 0, false, false, a & 0x01);
+}
+
+static uint16_t ref_rl(uint8_t a, uint8_t b, uint8_t f)
+{
+    unsigned int r = (unsigned int) (a << 1 | ((f & FLAG_C) ? 1 : 0));
+    return result(r, (uint8_t) r == 0, false, false, a & 0x80);
+}
+
+static uint16_t ref_rr(uint8_t a, uint8_t b, uint8_t f)
+{
+    unsigned int r = (unsigned int) (a >> 1 | ((f & FLAG_C) ? 0x80 : 0));
+    return result(r, r == 0, false, false, a & 0x01);
+}
+
+static uint16_t ref_sla(uint8_t a, uint8_t b, uint8_t f)
+{
+    unsigned int r = (unsigned int) (a << 1);
+    return result(r, (uint8_t) r == 0, false, false, a & 0x80);
+}
+
+static uint16_t ref_sra(uint8_t a, uint8_t b, uint8_t f)
+{
+    unsigned int r = (unsigned int) (a >> 1 | (a & 0x80));
+    return result(r, r == 0, false, false, a & 0x01);
+}
+
+static uint16_t ref_swap(uint8_t a, uint8_t b, uint8_t f)
+{
+    return result((unsigned int) (a << 4 | a >> 4), a == 0, false, false, false);
+}
+
+static uint16_t ref_srl(uint8_t a, uint8_t b, uint8_t f)
+{
+    return result(a >> 1u, (a >> 1) == 0, false, false, a & 0x01);
+}
+
+static uint16_t ref_daa(uint8_t a, uint8_t b, uint8_t f)
+{
+    unsigned int r = a;
+    bool carry = (f & FLAG_C);
+    if(!(f & FLAG_N)) {
+        if(carry || a > 0x99) {
+            r += 0x60;
+            carry = true;
+        }
+        if((f & FLAG_H) || (a & 0x0F) > 0x09) {
+            r += 0x06;
+        }
+    } else {
+        if(carry) {
+            r -= 0x60;
+        }
+        if(f & FLAG_H) {
+            r -= 0x06;
+        }
+    }
+    return result(r, (uint8_t) r == 0, f & FLAG_N, false, carry);
+}
+
+/**
+ * An instruction on A, and B for the ones with two operands.
+ */
+struct alu_op {
+    const char *name;
+    uint8_t code[2];
+    uint8_t length;
+    uint8_t cycles;
+    bool binary;
+    uint16_t (*reference)(uint8_t a, uint8_t b, uint8_t f);
+};
+
+static const struct alu_op _ops[] = {
+        {"ADD A,B", {0x80}, 1, 4, true, ref_add},
+        {"ADC A,B", {0x88}, 1, 4, true, ref_adc},
+        {"SUB B", {0x90}, 1, 4, true, ref_sub},
+        {"SBC A,B", {0x98}, 1, 4, true, ref_sbc},
+        {"AND B", {0xA0}, 1, 4, true, ref_and},
+        {"XOR B", {0xA8}, 1, 4, true, ref_xor},
+        {"OR B", {0xB0}, 1, 4, true, ref_or},
+        {"CP B", {0xB8}, 1, 4, true, ref_cp},
+        {"INC A", {0x3C}, 1, 4, false, ref_inc},
+        {"DEC A", {0x3D}, 1, 4, false, ref_dec},
+        {"RLC A", {0xCB, 0x07}, 2, 8, false, ref_rlc},
+        {"RRC A", {0xCB, 0x0F}, 2, 8, false, ref_rrc},
+        {"RL A", {0xCB, 0x17}, 2, 8, false, ref_rl},
+        {"RR A", {0xCB, 0x1F}, 2, 8, false, ref_rr},
+        {"SLA A", {0xCB, 0x27}, 2, 8, false, ref_sla},
+        {"SRA A", {0xCB, 0x2F}, 2, 8, false, ref_sra},
+        {"SWAP A", {0xCB, 0x37}, 2, 8, false, ref_swap},
+        {"SRL A", {0xCB, 0x3F}, 2, 8, false, ref_srl},
+        {"DAA", {0x27}, 1, 4, false, ref_daa}
+};
+
+#define NUM_OPS         (sizeof(_ops) / sizeof(_ops[0]))
+
+/**
+ * Run every input of an instruction from its program: POP AF, the
+ * instruction, and a JR to itself.
+ *
+ * @param gb
+ * @param op
+ * @param program
+ * @return
+ */
+static bool check(struct gb *gb, const struct alu_op *op, uint16_t program)
+{
+    // Two operand instructions get every carry, the others every flag
+    uint8_t flags_step = (uint8_t) (op->binary ? FLAG_C : 0x10);
+    unsigned int operands = (op->binary ? 0x100 : 1);
+
+    for(unsigned int a = 0; a < 0x100; a++) {
+        for(unsigned int b = 0; b < operands; b++) {
+            for(unsigned int f = 0; f < 0x100; f += flags_step) {
+                gb->mmu.RAM[0] = (uint8_t) f;
+                gb->mmu.RAM[1] = (uint8_t) a;
+                gb->cpu.r.b = (uint8_t) b;
+                gb->cpu.r.sp = STACK;
+                gb->cpu.r.pc = program;
+                GB_run_cycles(gb, POP_AF_CYCLES + op->cycles);
+
+                uint16_t expected = op->reference((uint8_t) a, (uint8_t) b, (uint8_t) f);
+                uint16_t actual = (uint16_t) (gb->cpu.r.a << 8 | gb->cpu.r.f);
+                if(actual != expected) {
+                    fprintf(stderr, "%s with A=%02X B=%02X F=%02X: AF=%04X, expected %04X\n",
+                            op->name, a, b, f, actual, expected);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t rom[HARNESS_ROM_SIZE];
+
+    // The cartridge idles in a JR to itself, every instruction has a program
+    rom[0x100] = 0x18;
+    rom[0x101] = 0xFE;
+    for(size_t i = 0; i < NUM_OPS; i++) {
+        uint8_t *program = &rom[PROGRAMS + i * PROGRAM_SIZE];
+        program[0] = 0xF1;
+        memcpy(&program[1], _ops[i].code, _ops[i].length);
+        program[1 + _ops[i].length] = 0x18;
+        program[2 + _ops[i].length] = 0xFE;
+    }
+
+    struct gb *gb = harness_create("testALU", rom, 1);
+    if(gb == NULL) {
+        fprintf(stderr, "Could not create the instance\n");
+        return EXIT_FAILURE;
+    }
+    GB_run_cycles(gb, BOOT_CYCLES);
+
+    int failed = 0;
+    for(size_t i = 0; i < NUM_OPS; i++) {
+        if(!check(gb, &_ops[i], (uint16_t) (PROGRAMS + i * PROGRAM_SIZE))) {
+            failed++;
+        }
+    }
+
+    if(GB_exit_code(gb)) {
+        fprintf(stderr, "The instance exited\n");
+        failed++;
+    }
+
+    printf("%d of %d instructions failed\n", failed, (int) NUM_OPS);
+    GB_destroy(gb);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,131 @@
+/* MIT License
+ *
+ * Copyright (c) 2017 Koen van der Heijden.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Microbenchmark of the 8 bit ALU instructions: a loop of register only
+ * INC/DEC, ADD/ADC/SUB/SBC/CP, DAA and CB shifts, rotates and SWAP, run with
+ * the LCD and interrupts off. Build it with and without NEC_ALU_TABLES to
+ * compare the flag tables with the computed flags. TestALU checks that both
+ * give the same results.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../GB.h"
+#include "harness.h"
+
+#define LOOP_START      0x0150
+#define LOOP_SIZE       0x1000
+#define RUN_CYCLES      (1000 * 70224)
+#define RUNS            5
+
+static uint8_t rom[HARNESS_ROM_SIZE];
+
+/**
+ * Write a ROM only cartridge running the ALU loop.
+ *
+ * @return The number of instructions in the loop
+ */
+static unsigned int write_program(void)
+{
+    static const uint8_t cb[] = {
+            0x00, 0x08, 0x10, 0x18, 0x20, 0x28, 0x30, 0x38
+    };
+
+    memset(rom, 0, sizeof(rom));
+    rom[0x101] = 0xC3;  // JP 0150
+    rom[0x102] = LOOP_START & 0xFF;
+    rom[0x103] = LOOP_START >> 8;
+
+    uint32_t seed = 1;
+    unsigned int count = 0;
+    size_t size;
+    for(size = LOOP_START; size < LOOP_START + LOOP_SIZE; count++) {
+        seed = seed * 1103515245 + 12345;
+        uint8_t r = (uint8_t) ((seed >> 8) % 8);
+        if(r == 6) {
+            r = 7;
+        }
+
+        switch((seed >> 16) % 4) {
+            case 0:
+                // INC/DEC r
+                rom[size++] = (uint8_t) (0x04 | r << 3 | ((seed >> 24) & 1));
+                break;
+            case 1:
+                // ADD/ADC/SUB/SBC/CP A,r
+                rom[size++] = (uint8_t) (0x80 | ((seed >> 24) % 5 == 4 ? 7 : (seed >> 24) % 4) << 3 | r);
+                break;
+            case 2:
+                // RLC/RRC/RL/RR/SLA/SRA/SWAP/SRL r
+                rom[size++] = 0xCB;
+                rom[size++] = (uint8_t) (cb[(seed >> 24) % 8] | r);
+                break;
+            default:
+                // DAA
+                rom[size++] = 0x27;
+                break;
+        }
+    }
+    rom[size++] = 0xC3;
+    rom[size++] = LOOP_START & 0xFF;
+    rom[size++] = LOOP_START >> 8;
+    return count + 1;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int count = write_program();
+
+    double best = 0.0;
+    for(int run = 0; run < RUNS; run++) {
+        struct gb *gb = harness_create("benchALU", rom, 0);
+        if(gb == NULL) {
+            return EXIT_FAILURE;
+        }
+
+        clock_t start = clock();
+        uint64_t cycles = GB_run_cycles(gb, RUN_CYCLES);
+        double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+        int status = GB_exit_code(gb);
+        GB_destroy(gb);
+
+        if(status) {
+            return EXIT_FAILURE;
+        }
+        if(seconds > 0.0 && (best == 0.0 || cycles / seconds > best)) {
+            best = cycles / seconds;
+        }
+    }
+
+#if defined(NEC_ALU_TABLES)
+    printf("ALU flags: tables\n");
+#else
+    printf("ALU flags: computed\n");
+#endif
+    printf("%u instructions per loop, %.1f MHz (%.1fx real time)\n", count, best / 1e6, best / 4194304.0);
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
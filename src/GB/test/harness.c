@@ -0,0 +1,107 @@
+/* MIT License
+ *
+ * Copyright (c) 2017 Koen van der Heijden.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "harness.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdbool.h>
+
+// LD SP,FFFE, NOPs up to LD A,1 ; LDH (50),A at the end
+static const uint8_t _bios[0x100] = {
+        [0x00] = 0x31, 0xFE, 0xFF,
+        [0xFC] = 0x3E, 0x01, 0xE0, 0x50
+};
+
+void log_error(char *message, ...)
+{
+    va_list args;
+    va_start(args, message);
+    vfprintf(stderr, message, args);
+    va_end(args);
+}
+
+void log_warning(char *message, ...)
+{
+}
+
+void sync_frame(struct gb *gb)
+{
+}
+
+void serial_transfer_initiate(struct gb *gb, uint8_t data)
+{
+}
+
+void set_title(struct gb *gb, const char *title)
+{
+}
+
+/**
+ *
+ * @param file_name
+ * @param data
+ * @param size
+ * @return
+ */
+static bool write_file(const char *file_name, const uint8_t *data, size_t size)
+{
+    FILE *file = fopen(file_name, "wb");
+    if(file == NULL) {
+        log_error("Could not create %s\n", file_name);
+        return false;
+    }
+
+    size_t written = fwrite(data, 1, size, file);
+    return (fclose(file) == 0 && written == size);
+}
+
+struct gb *harness_create(const char *name, const uint8_t *rom, int jit)
+{
+    char bios_file[FILENAME_MAX];
+    char rom_file[FILENAME_MAX];
+    snprintf(bios_file, sizeof(bios_file), "%s_bios.bin", name);
+    snprintf(rom_file, sizeof(rom_file), "%s_rom.gb", name);
+
+    struct gb *gb = GB_create();
+    if(gb == NULL) {
+        return NULL;
+    }
+    GB_set_jit(gb, jit);
+
+    // The cartridge is mapped or read as a whole, so the files can go right away
+    if(write_file(bios_file, _bios, sizeof(_bios)) && write_file(rom_file, rom, HARNESS_ROM_SIZE)) {
+        GB_load_bios(gb, bios_file);
+        GB_load_cartridge(gb, rom_file, NULL);
+    } else {
+        GB_exit(gb);
+    }
+    remove(bios_file);
+    remove(rom_file);
+
+    if(GB_exit_code(gb)) {
+        GB_destroy(gb);
+        return NULL;
+    }
+    return gb;
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+/* MIT License
+ *
+ * Copyright (c) 2017 Koen van der Heijden.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef NEC_HARNESS_H
+#define NEC_HARNESS_H
+
+#include <stdint.h>
+
+#include "../GB.h"
+
+// ROM only cartridge, two banks
+#define HARNESS_ROM_SIZE    0x8000
+
+/**
+ * Create an instance running a ROM only cartridge from memory, behind a boot
+ * ROM that only sets SP and leaves. The images pass through files named after
+ * the test, which are removed again once loaded. The harness also provides
+ * the frontend callbacks of the core.
+ *
+ * @param name
+ * @param rom HARNESS_ROM_SIZE bytes
+ * @param jit Whether to compile hot code, where the build can
+ * @return The instance, or NULL if it could not be created or loaded.
+ */
+struct gb *harness_create(const char *name, const uint8_t *rom, int jit);
+
+#endif /* NEC_HARNESS_H */
@@ -0,0 +1,397 @@
+/* MIT License
+ *
+ * Copyright (c) 2017 Koen van der Heijden.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Differential test of the native code compiler: random programs run on two
+ * instances, one with the JIT and one without, and the CPU and memory state
+ * must match after every slice of cycles.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "../GB.h"
+#include "../context.h"
+#include "harness.h"
+
+#define NUM_PROGRAMS    8
+#define PROGRAM_SIZE    0x1800
+#define PROGRAM_START   0x0300
+#define SUBROUTINES     0x2000
+#define NUM_SUBROUTINES 4
+#define RUN_CYCLES      (60 * 70224)
+
+// Exit status for ctest's SKIP_RETURN_CODE
+#define SKIPPED         77
+
+// C000-C0FF is scratch memory of the program, C100 counts interrupts
+#define SCRATCH         0xC0
+#define COUNTERS        0xC100
+
+static uint32_t seed;
+
+static uint8_t rom[HARNESS_ROM_SIZE];
+static size_t size;
+
+static uint32_t next_random(uint32_t n)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+static void emit(int count, ...)
+{
+    va_list args;
+    va_start(args, count);
+    for(int i = 0; i < count; i++) {
+        rom[size++] = (uint8_t) va_arg(args, int);
+    }
+    va_end(args);
+}
+
+/**
+ * A register or (HL) operand, (HL) pointing into the scratch memory.
+ *
+ * @return The operand's index in the opcode
+ */
+static uint8_t operand(void)
+{
+    uint8_t r = (uint8_t) next_random(8);
+    if(r == 6) {
+        emit(3, 0x21, next_random(0x100), SCRATCH);  // LD HL,d16
+    }
+    return r;
+}
+
+/**
+ * One instruction that does not branch, with its operands.
+ */
+static void emit_simple(void)
+{
+    static const uint8_t misc[] = {
+            0x07, 0x0F, 0x17, 0x1F, 0x27, 0x2F, 0x37, 0x3F, 0x00
+    };
+
+    switch(next_random(16)) {
+        case 0:
+        case 1:
+        case 2: {
+            // LD r,r', but not HALT
+            uint8_t src = operand();
+            uint8_t dst = (uint8_t) next_random(8);
+            if(src == 6 && dst == 6) {
+                dst = 7;
+            }
+            if(dst == 6 && src != 6) {
+                emit(3, 0x21, next_random(0x100), SCRATCH);
+            }
+            emit(1, 0x40 | dst << 3 | src);
+            break;
+        }
+        case 3:
+        case 4:
+        case 5:
+            // ALU r
+            emit(1, 0x80 | next_random(8) << 3 | operand());
+            break;
+        case 6:
+            // ALU d8
+            emit(2, 0xC6 | next_random(8) << 3, next_random(0x100));
+            break;
+        case 7:
+            // INC/DEC r
+            emit(1, 0x04 | operand() << 3 | next_random(2));
+            break;
+        case 8:
+            // LD r,d8
+            emit(2, 0x06 | operand() << 3, next_random(0x100));
+            break;
+        case 9:
+            // LD rr,d16, INC/DEC rr, ADD HL,rr, but not on SP
+            switch(next_random(4)) {
+                case 0:
+                    emit(3, 0x01 | next_random(3) << 4, next_random(0x100), next_random(0x100));
+                    break;
+                case 1:
+                    emit(1, 0x03 | next_random(3) << 4);
+                    break;
+                case 2:
+                    emit(1, 0x0B | next_random(3) << 4);
+                    break;
+                default:
+                    emit(1, 0x09 | next_random(3) << 4);
+                    break;
+            }
+            break;
+        case 10:
+            emit(1, misc[next_random(sizeof(misc))]);
+            break;
+        case 11:
+        case 12:
+            // CB prefixed
+            emit(2, 0xCB, next_random(0x20) << 3 | operand());
+            break;
+        case 13:
+            // LD (a16),A, LD A,(a16)
+            emit(3, next_random(2) ? 0xEA : 0xFA, next_random(0x100), SCRATCH);
+            break;
+        case 14:
+            // LDH (a8),A to HRAM, LDH A,(a8) from HRAM, DIV, TIMA or LY
+            if(next_random(2)) {
+                emit(2, 0xE0, 0x80 + next_random(0x60));
+            } else {
+                static const uint8_t io[] = {0x04, 0x05, 0x44, 0x90};
+                emit(2, 0xF0, io[next_random(sizeof(io))]);
+            }
+            break;
+        default:
+            // PUSH rr, POP rr'
+            emit(1, 0xC5 | next_random(4) << 4);
+            emit_simple();
+            emit(1, 0xC1 | next_random(4) << 4);
+            break;
+    }
+}
+
+/**
+ * One instruction or a small construct with branches.
+ */
+static void emit_any(void)
+{
+    switch(next_random(24)) {
+        case 0: {
+            // JR cc over a few instructions
+            size_t jr = size;
+            emit(2, 0x20 | next_random(4) << 3, 0);
+            for(uint32_t i = next_random(4) + 1; i > 0; i--) {
+                emit_simple();
+            }
+            rom[jr + 1] = (uint8_t) (size - jr - 2);
+            break;
+        }
+        case 1:
+            // CALL
+            emit(3, 0xCD, 0x00, (SUBROUTINES >> 8) + next_random(NUM_SUBROUTINES));
+            break;
+        case 2:
+            switch(next_random(32)) {
+                case 0:
+                    emit(1, 0xF3);          // DI
+                    break;
+                case 1:
+                    emit(2, 0xFB, 0x76);    // EI ; HALT
+                    break;
+                default:
+                    emit(1, 0xFB);          // EI
+                    break;
+            }
+            break;
+        default:
+            emit_simple();
+            break;
+    }
+}
+
+/**
+ *
+ * @param address
+ * @param counter
+ */
+static void emit_handler(uint16_t address, uint8_t counter)
+{
+    size = address;
+    // PUSH AF ; PUSH HL ; LD HL,counter ; INC (HL) ; POP HL ; POP AF ; RETI
+    emit(9, 0xF5, 0xE5, 0x21, counter, COUNTERS >> 8, 0x34, 0xE1, 0xF1, 0xD9);
+}
+
+/**
+ * Assemble a ROM only cartridge with a random program.
+ */
+static void write_program(void)
+{
+    memset(rom, 0, sizeof(rom));
+
+    // Interrupt vectors: V-Blank and timer count, the others are disabled
+    size = 0x40;
+    emit(3, 0xC3, 0x00, 0x02);
+    size = 0x50;
+    emit(3, 0xC3, 0x10, 0x02);
+    emit_handler(0x0200, 0x00);
+    emit_handler(0x0210, 0x01);
+
+    size = 0x100;
+    emit(4, 0x00, 0xC3, PROGRAM_START & 0xFF, PROGRAM_START >> 8);
+    rom[0x147] = 0x00;
+
+    size = PROGRAM_START;
+    emit(3, 0x31, 0xF0, 0xDF);                          // LD SP,DFF0
+    emit(4, 0x3E, next_random(0xC0), 0xE0, 0x06);       // TMA
+    emit(4, 0x3E, 0x05, 0xE0, 0x07);                    // TAC
+    emit(4, 0x3E, 0x05, 0xE0, 0xFF);                    // IE
+    emit(4, 0x3E, 0x91, 0xE0, 0x40);                    // LCDC
+    emit(1, 0xFB);                                      // EI
+
+    size_t loop = size;
+    while(size < PROGRAM_START + PROGRAM_SIZE) {
+        emit_any();
+    }
+    emit(3, 0xC3, loop & 0xFF, loop >> 8);
+
+    for(int i = 0; i < NUM_SUBROUTINES; i++) {
+        size = SUBROUTINES + i * 0x100;
+        for(uint32_t j = next_random(12) + 1; j > 0; j--) {
+            emit_simple();
+        }
+        emit(1, 0xC9);
+    }
+}
+
+/**
+ * Compare the state of both instances, and report the first difference.
+ *
+ * @param interpreted
+ * @param compiled
+ * @return
+ */
+static bool same(struct gb *interpreted, struct gb *compiled)
+{
+    const struct cpu *a = &interpreted->cpu;
+    const struct cpu *b = &compiled->cpu;
+    if(a->r.af != b->r.af || a->r.bc != b->r.bc || a->r.de != b->r.de || a->r.hl != b->r.hl ||
+       a->r.sp != b->r.sp || a->r.pc != b->r.pc || a->r.clk != b->r.clk) {
+        fprintf(stderr, "Registers differ:\n");
+        fprintf(stderr, "  AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X PC=%04X clk=%llu\n",
+                a->r.af, a->r.bc, a->r.de, a->r.hl, a->r.sp, a->r.pc, (unsigned long long) a->r.clk);
+        fprintf(stderr, "  AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X PC=%04X clk=%llu\n",
+                b->r.af, b->r.bc, b->r.de, b->r.hl, b->r.sp, b->r.pc, (unsigned long long) b->r.clk);
+        return false;
+    }
+
+    if(a->IME != b->IME || a->IE != b->IE || a->IF != b->IF || a->HALT != b->HALT) {
+        fprintf(stderr, "Interrupt state differs at PC=%04X\n", a->r.pc);
+        return false;
+    }
+
+    for(size_t i = 0; i < sizeof(interpreted->mmu.RAM); i++) {
+        if(interpreted->mmu.RAM[i] != compiled->mmu.RAM[i]) {
+            fprintf(stderr, "RAM differs at %04X: %02X, %02X\n", (unsigned int) (0xC000 + i),
+                    interpreted->mmu.RAM[i], compiled->mmu.RAM[i]);
+            return false;
+        }
+    }
+
+    if(memcmp(interpreted->mmu.HRAM, compiled->mmu.HRAM, sizeof(interpreted->mmu.HRAM)) != 0) {
+        fprintf(stderr, "HRAM differs\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ *
+ * @param program
+ * @return
+ */
+static bool run(int program)
+{
+    struct gb *interpreted = harness_create("testJIT", rom, 0);
+    struct gb *compiled = harness_create("testJIT", rom, 1);
+    if(interpreted == NULL || compiled == NULL) {
+        fprintf(stderr, "Could not create the instances\n");
+        GB_destroy(interpreted);
+        GB_destroy(compiled);
+        return false;
+    }
+
+    bool passed = true;
+    uint64_t clk = 0;
+    while(passed && clk < RUN_CYCLES) {
+        // Slices of varying length, so runs end in the middle of blocks
+        uint64_t cycles = 1 + next_random(20000);
+        GB_run_cycles(interpreted, cycles);
+        clk += GB_run_cycles(compiled, cycles);
+
+        if(GB_exit_code(interpreted) || GB_exit_code(compiled)) {
+            fprintf(stderr, "Program %d exited\n", program);
+            passed = false;
+        } else if(!same(interpreted, compiled)) {
+            fprintf(stderr, "Program %d differs after %llu cycles\n", program, (unsigned long long) clk);
+            passed = false;
+        }
+    }
+
+    if(passed && !compiled->jit.blocks) {
+        fprintf(stderr, "Program %d was not compiled\n", program);
+        passed = false;
+    }
+
+    if(passed) {
+        printf("Program %d: %u blocks compiled, %d interrupts\n", program, compiled->jit.blocks,
+               compiled->mmu.RAM[0x100] + compiled->mmu.RAM[0x101]);
+    }
+
+    GB_destroy(interpreted);
+    GB_destroy(compiled);
+    return passed;
+}
+
+/**
+ * Whether this build compiles to native code at all. Without a compiler both
+ * instances interpret, and comparing them tests nothing.
+ *
+ * @return
+ */
+static bool available(void)
+{
+    struct gb *gb = GB_create();
+    if(gb == NULL) {
+        return false;
+    }
+
+    GB_set_jit(gb, 1);
+    bool enabled = gb->jit.enabled;
+    GB_destroy(gb);
+    return enabled;
+}
+
+int main(int argc, char **argv)
+{
+    if(!available()) {
+        printf("No native code compiler in this build, skipped\n");
+        return SKIPPED;
+    }
+
+    int failed = 0;
+    for(int program = 0; program < NUM_PROGRAMS; program++) {
+        seed = (uint32_t) program;
+        write_program();
+        if(!run(program)) {
+            failed++;
+        }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
\ No newline at end of file
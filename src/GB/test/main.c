@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdbool.h>
 
 #include <SDL2/SDL.h>
 
@@ -32,10 +33,15 @@
 
 #define PROGRAM_NAME    "NEC-GameBoy"
 #define V_SYNC           1
+#define FRAME_RATE       (4194304.0 / 70224.0)
 
 static SDL_Window* window;
 static SDL_GLContext gl_context;
 
+static bool v_sync;
+static bool turbo;
+static Uint64 frame_deadline;
+
 static void sdl_die(const char *msg)
 {
     fprintf( stderr, "%s: %s\n", msg, SDL_GetError());
@@ -56,44 +62,45 @@ static void sdl_check_error(int line)
 #endif
 }
 
-void serial_transfer_initiate(uint8_t data)
+void serial_transfer_initiate(struct gb *gb, uint8_t data)
 {
 
 }
 
-static void do_key_down(SDL_KeyboardEvent event)
+static void do_key_down(struct gb *gb, SDL_KeyboardEvent event)
 {
     switch (event.keysym.sym) {
         case SDLK_d:
         case SDLK_RIGHT:
-            key_pressed(RIGHT);
+            key_pressed(gb, RIGHT);
             break;
         case SDLK_a:
         case SDLK_LEFT:
-            key_pressed(LEFT);
+            key_pressed(gb, LEFT);
             break;
         case SDLK_w:
         case SDLK_UP:
-            key_pressed(UP);
+            key_pressed(gb, UP);
             break;
         case SDLK_s:
         case SDLK_DOWN:
-            key_pressed(DOWN);
+            key_pressed(gb, DOWN);
             break;
         case SDLK_z:
-            key_pressed(A);
+            key_pressed(gb, A);
             break;
         case SDLK_x:
-            key_pressed(B);
+            key_pressed(gb, B);
             break;
         case SDLK_BACKSPACE:
-            key_pressed(SELECT);
+            key_pressed(gb, SELECT);
             break;
         case SDLK_ESCAPE:
         case SDLK_RETURN:
-            key_pressed(START);
+            key_pressed(gb, START);
             break;
         case SDLK_SPACE:
+            turbo = true;
             SDL_GL_SetSwapInterval(0);
             break;
         default:
@@ -101,64 +108,88 @@ static void do_key_down(SDL_KeyboardEvent event)
     }
 }
 
-static void do_key_up(SDL_KeyboardEvent event)
+static void do_key_up(struct gb *gb, SDL_KeyboardEvent event)
 {
     switch (event.keysym.sym) {
         case SDLK_d:
         case SDLK_RIGHT:
-            key_released(RIGHT);
+            key_released(gb, RIGHT);
             break;
         case SDLK_a:
         case SDLK_LEFT:
-            key_released(LEFT);
+            key_released(gb, LEFT);
             break;
         case SDLK_w:
         case SDLK_UP:
-            key_released(UP);
+            key_released(gb, UP);
             break;
         case SDLK_s:
         case SDLK_DOWN:
-            key_released(DOWN);
+            key_released(gb, DOWN);
             break;
         case SDLK_z:
-            key_released(A);
+            key_released(gb, A);
             break;
         case SDLK_x:
-            key_released(B);
+            key_released(gb, B);
             break;
         case SDLK_BACKSPACE:
-            key_released(SELECT);
+            key_released(gb, SELECT);
             break;
         case SDLK_ESCAPE:
         case SDLK_RETURN:
-            key_released(START);
+            key_released(gb, START);
             break;
         case SDLK_SPACE:
-            SDL_GL_SetSwapInterval(1);
+            turbo = false;
+            SDL_GL_SetSwapInterval(V_SYNC);
             break;
         default:
             break;
     }
 }
 
-void sync_frame(void)
+/**
+ * Sleep until the next frame is due, unless swapping buffers already waits
+ * for the display.
+ */
+static void frame_pace(void)
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 frame = (Uint64) (frequency / FRAME_RATE);
+
+    // Start over in turbo mode, or after falling behind or waiting for input
+    if(v_sync || turbo || now >= frame_deadline + frame) {
+        frame_deadline = now + frame;
+        return;
+    }
+
+    if(now < frame_deadline) {
+        SDL_Delay((Uint32) ((frame_deadline - now) * 1000 / frequency));
+    }
+    frame_deadline += frame;
+}
+
+void sync_frame(struct gb *gb)
 {
     SDL_Event event;
 
     // Swap buffers
     SDL_GL_SwapWindow(window);
+    frame_pace();
 
-    // Check for key events
-    if( SDL_PollEvent(&event) ) {
+    // Check for key events, there is no point in running frames that only a key press can end
+    if( GB_idle(gb) ? SDL_WaitEvent(&event) : SDL_PollEvent(&event) ) {
         switch (event.type) {
             case SDL_KEYDOWN:
-                do_key_down(event.key);
+                do_key_down(gb, event.key);
                 break;
             case SDL_KEYUP:
-                do_key_up(event.key);
+                do_key_up(gb, event.key);
                 break;
             case SDL_QUIT:
-                GB_stop();
+                GB_stop(gb);
                 break;
             default:
                 break;
@@ -166,7 +197,7 @@ void sync_frame(void)
     }
 }
 
-void set_title(const char *title)
+void set_title(struct gb *gb, const char *title)
 {
     char buffer[32] = {0};
     sprintf(buffer, "%s: %s", PROGRAM_NAME, title);
@@ -206,7 +237,7 @@ static void init_window(void)
     sdl_check_error(__LINE__);
 
     // Enable/Disable Vsync
-    SDL_GL_SetSwapInterval(V_SYNC);
+    v_sync = (SDL_GL_SetSwapInterval(V_SYNC) == 0 && V_SYNC);
 }
 
 static void destroy_window(void)
@@ -232,20 +263,29 @@ int main(int argc, char *argv[])
 
     init_window();
 
-    GB_load_bios(argv[1]);
+    struct gb *gameboy = GB_create();
+    if(gameboy == NULL) {
+        destroy_window();
+        return EXIT_FAILURE;
+    }
+
+    GB_load_bios(gameboy, argv[1]);
     if(argc == 2) {
-        GB_load_cartridge(NULL, NULL);
+        GB_load_cartridge(gameboy, NULL, NULL);
     } else if(argc == 3) {
-        GB_load_cartridge(argv[2], NULL);
+        GB_load_cartridge(gameboy, argv[2], NULL);
     } else if(argc == 4) {
-        GB_load_cartridge(argv[2], argv[3]);
+        GB_load_cartridge(gameboy, argv[2], argv[3]);
     }
 
-    GB_start();
+    GB_start(gameboy);
+
+    int exit_code = GB_exit_code(gameboy);
+    GB_destroy(gameboy);
 
     destroy_window();
 
-    return GB_exit_code();
+    return exit_code;
 }
 
 void log_error(char *format, ...)
@@ -24,114 +24,145 @@
 #include "timer.h"
 
 #include "LR35902.h"
+#include "MMU.h"
+#include "scheduler.h"
+#include "context.h"
 
 #define DIV         0xFF04
 #define TIMA        0xFF05
 #define TMA         0xFF06
 #define TAC         0xFF07
 
-#define _TIMER_CLK_MAX      4194304
 #define _4096HZ_DIV         1024
 #define _16384HZ_DIV        256
 #define _65536HZ_DIV        64
 #define _262144HZ_DIV       16
 
-static uint8_t _div = 0x00;
-static uint8_t _tima = 0x00;
-static uint8_t _tma = 0x00;
-static uint8_t _tac = 0x00;
+static const uint16_t _tima_div[] = {
+    _4096HZ_DIV,
+    _262144HZ_DIV,
+    _65536HZ_DIV,
+    _16384HZ_DIV
+};
 
-static uint32_t _timer_clk = 0; // 4,194,304Hz
-
-uint8_t timer_read_byte(uint16_t address)
+/**
+ * Bring DIV and TIMA up to date with the given CPU clock.
+ *
+ * @param gb
+ * @param clk
+ */
+static void timer_sync(struct gb *gb, uint64_t clk)
 {
-    switch (address) {
-        case DIV:
-            return _div;
-        case TIMA:
-            return _tima;
-        case TMA:
-            return _tma;
-        case TAC:
-            return _tac;
-        default:
-            return 0xFF;
+    uint64_t _old_clk = gb->timer.last_sync;
+    if(clk <= _old_clk) {
+        return;
     }
-}
+    gb->timer.last_sync = clk;
+
+    // DIV update
+    gb->timer.div += (uint8_t) ((clk / _16384HZ_DIV) - (_old_clk / _16384HZ_DIV));
 
-void timer_write_byte(uint16_t address, uint8_t value) {
-    switch (address) {
-        case DIV:
-            _div = 0x00;
-        case TIMA:
-            _tima = value;
-        case TMA:
-            _tma = value;
-        case TAC:
-            _tac = (uint8_t) (value & 0x07);
-        default:
-            break;
+    // TIMA update
+    if(gb->timer.tac & 0x04) {
+        uint16_t div = _tima_div[gb->timer.tac & 0x03];
+        uint64_t steps = (clk / div) - (_old_clk / div);
+
+        while(steps) {
+            uint32_t room = (uint32_t) (0x100 - gb->timer.tima);
+            if(steps < room) {
+                gb->timer.tima += (uint8_t) steps;
+                break;
+            }
+
+            steps -= room;
+            gb->timer.tima = gb->timer.tma;
+            interrupt(gb, TIMER_OVERFLOW);
+        }
     }
 }
 
-static inline void timer_step(void)
+/**
+ * Register the clock at which TIMA will overflow next.
+ *
+ * @param gb
+ */
+static void timer_schedule(struct gb *gb)
 {
-    switch (_tima) {
-        case 0xFF:
-            _tima = _tma;
-            interrupt(TIMER_OVERFLOW);
-            break;
-        default:
-            _tima++;
+    if(gb->timer.tac & 0x04) {
+        uint16_t div = _tima_div[gb->timer.tac & 0x03];
+        uint64_t deadline = ((gb->timer.last_sync / div) + (0x100 - gb->timer.tima)) * div;
+        schedule_event(gb, EVENT_TIMER, deadline);
+    } else {
+        cancel_event(gb, EVENT_TIMER);
     }
 }
 
-void timer_update(uint8_t clk_tics)
+static uint8_t div_read(struct gb *gb, uint16_t address)
 {
-    // Save current counter/clock
-    uint32_t _old_timer_clk = _timer_clk;
+    timer_sync(gb, gb->cpu.r.clk);
+    return gb->timer.div;
+}
 
-    // Increment counter/clock
-    _timer_clk += clk_tics;
+static void div_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    timer_sync(gb, gb->cpu.r.clk);
+    gb->timer.div = 0x00;
+}
 
-    // DIV update
-    _div += ((_timer_clk / _16384HZ_DIV) - (_old_timer_clk / _16384HZ_DIV));
+static uint8_t tima_read(struct gb *gb, uint16_t address)
+{
+    timer_sync(gb, gb->cpu.r.clk);
+    return gb->timer.tima;
+}
 
-    // TIMA update
-    int steps = 0;
-    if( _tac & 0x04 ) {
-        switch( _tac & 0x03 ) {
-            case 0x00:
-                steps = ((_timer_clk / _4096HZ_DIV) - (_old_timer_clk / _4096HZ_DIV));
-                break;
-            case 0x01:
-                steps = ((_timer_clk / _262144HZ_DIV) - (_old_timer_clk / _262144HZ_DIV));
-                break;
-            case 0x02:
-                steps = ((_timer_clk / _65536HZ_DIV) - (_old_timer_clk / _65536HZ_DIV));
-                break;
-            case 0x03:
-                steps = ((_timer_clk / _16384HZ_DIV) - (_old_timer_clk / _16384HZ_DIV));
-                break;
-            default:
-                break;
-        }
+static void tima_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    timer_sync(gb, gb->cpu.r.clk);
+    gb->timer.tima = value;
+    timer_schedule(gb);
+}
 
-        for(int i = 0; i < steps; i++) {
-            timer_step();
-        }
-    }
+static uint8_t tma_read(struct gb *gb, uint16_t address)
+{
+    return gb->timer.tma;
+}
+
+static void tma_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    timer_sync(gb, gb->cpu.r.clk);
+    gb->timer.tma = value;
+}
+
+static uint8_t tac_read(struct gb *gb, uint16_t address)
+{
+    return gb->timer.tac;
+}
 
-    // Modulo the counter/clock
-    _timer_clk %= _TIMER_CLK_MAX;
+static void tac_write(struct gb *gb, uint16_t address, uint8_t value)
+{
+    timer_sync(gb, gb->cpu.r.clk);
+    gb->timer.tac = (uint8_t) (value & 0x07);
+    timer_schedule(gb);
 }
 
-void timer_reset(void)
+void timer_event(struct gb *gb, uint64_t deadline)
 {
-    _div = 0x00;
-    _tima = 0x00;
-    _tma = 0x00;
-    _tac = 0x00;
+    timer_sync(gb, deadline);
+    timer_schedule(gb);
+}
 
-    _timer_clk = 0;
+void timer_reset(struct gb *gb)
+{
+    gb->timer.div = 0x00;
+    gb->timer.tima = 0x00;
+    gb->timer.tma = 0x00;
+    gb->timer.tac = 0x00;
+
+    gb->timer.last_sync = gb->cpu.r.clk;
+    timer_schedule(gb);
+
+    mmu_register_io(gb, DIV, div_read, div_write);
+    mmu_register_io(gb, TIMA, tima_read, tima_write);
+    mmu_register_io(gb, TMA, tma_read, tma_write);
+    mmu_register_io(gb, TAC, tac_read, tac_write);
 }
\ No newline at end of file
@@ -26,29 +26,32 @@
 
 #include <stdint.h>
 
-/**
- *
- * @param address
- * @return
- */
-uint8_t timer_read_byte(uint16_t address);
+struct gb;
 
 /**
- *
- * @param address
- * @param value
+ * Timer state of a single GameBoy instance.
  */
-void timer_write_byte(uint16_t address, uint8_t value);
+struct timer {
+    uint8_t div;
+    uint8_t tima;
+    uint8_t tma;
+    uint8_t tac;
+
+    uint64_t last_sync; // 4,194,304Hz
+};
 
 /**
+ * TIMA overflow deadline handler.
  *
- * @param clk_tics
+ * @param gb
+ * @param deadline
  */
-void timer_update(uint8_t clk_tics);
+void timer_event(struct gb *gb, uint64_t deadline);
 
 /**
  *
+ * @param gb
  */
-void timer_reset(void);
+void timer_reset(struct gb *gb);
 
 #endif //NEC_TIMER_H